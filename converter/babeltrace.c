@@ -33,6 +33,7 @@
 #include <babeltrace/context.h>
 #include <babeltrace/context-internal.h>
 #include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
 #include <babeltrace/ctf/events.h>
 /* TODO: fix object model for format-agnostic callbacks */
 #include <babeltrace/ctf/events-internal.h>
@@ -45,11 +46,13 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <ftw.h>
 #include <string.h>
+#include <limits.h>
 
 #include <babeltrace/ctf-ir/metadata.h>	/* for clocks */
 
@@ -72,6 +75,12 @@ static char *opt_input_format, *opt_output_format;
  */
 static GPtrArray *opt_input_paths;
 static char *opt_output_path;
+/* Event name patterns to read (--events), NULL to read all events */
+static GPtrArray *opt_event_names;
+/* Number of parallel conversion jobs (--jobs) */
+static int opt_jobs = 1;
+/* Number of text formatter threads (--format-threads), 0 if unused */
+static int opt_format_threads;
 
 static struct bt_format *fmt_read;
 
@@ -103,6 +112,16 @@ enum {
 	OPT_CLOCK_DATE,
 	OPT_CLOCK_GMT,
 	OPT_CLOCK_FORCE_CORRELATE,
+	OPT_MAP_WHOLE_FILE,
+	OPT_NO_INDEX_CACHE,
+	OPT_ZERO_COPY,
+	OPT_LAZY_PAYLOAD,
+	OPT_EVENTS,
+	OPT_READAHEAD,
+	OPT_READ_PACKETS,
+	OPT_DECODE_THREADS,
+	OPT_JOBS,
+	OPT_FORMAT_THREADS,
 };
 
 /*
@@ -132,6 +151,16 @@ static struct poptOption long_options[] = {
 	{ "clock-date", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_DATE, NULL, NULL },
 	{ "clock-gmt", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_GMT, NULL, NULL },
 	{ "clock-force-correlate", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_FORCE_CORRELATE, NULL, NULL },
+	{ "map-whole-file", 0, POPT_ARG_NONE, NULL, OPT_MAP_WHOLE_FILE, NULL, NULL },
+	{ "no-index-cache", 0, POPT_ARG_NONE, NULL, OPT_NO_INDEX_CACHE, NULL, NULL },
+	{ "zero-copy", 0, POPT_ARG_NONE, NULL, OPT_ZERO_COPY, NULL, NULL },
+	{ "lazy-payload", 0, POPT_ARG_NONE, NULL, OPT_LAZY_PAYLOAD, NULL, NULL },
+	{ "events", 0, POPT_ARG_STRING, NULL, OPT_EVENTS, NULL, NULL },
+	{ "readahead", 0, POPT_ARG_STRING, NULL, OPT_READAHEAD, NULL, NULL },
+	{ "read-packets", 0, POPT_ARG_NONE, NULL, OPT_READ_PACKETS, NULL, NULL },
+	{ "decode-threads", 0, POPT_ARG_NONE, NULL, OPT_DECODE_THREADS, NULL, NULL },
+	{ "jobs", 'j', POPT_ARG_STRING, NULL, OPT_JOBS, NULL, NULL },
+	{ "format-threads", 0, POPT_ARG_STRING, NULL, OPT_FORMAT_THREADS, NULL, NULL },
 	{ NULL, 0, 0, NULL, 0, NULL, NULL },
 };
 
@@ -177,6 +206,25 @@ static void usage(FILE *fp)
 	fprintf(fp, "      --clock-gmt                Print clock in GMT time zone (default: local time zone)\n");
 	fprintf(fp, "      --clock-force-correlate    Assume that clocks are inherently correlated\n");
 	fprintf(fp, "                                 across traces.\n");
+	fprintf(fp, "      --map-whole-file           Map each stream file once instead of\n");
+	fprintf(fp, "                                 mapping each packet\n");
+	fprintf(fp, "      --no-index-cache           Do not read nor write the packet index cache\n");
+	fprintf(fp, "      --zero-copy                Access strings and byte arrays in place\n");
+	fprintf(fp, "                                 instead of copying them\n");
+	fprintf(fp, "      --lazy-payload             Only decode fixed-size event payloads\n");
+	fprintf(fp, "                                 when they are accessed\n");
+	fprintf(fp, "      --events name1<,name2,...> Only read events with these names\n");
+	fprintf(fp, "                                 (wildcards '*' and '?' allowed)\n");
+	fprintf(fp, "      --readahead packets        Packets read ahead of each stream\n");
+	fprintf(fp, "                                 (default: 4, 0 to disable)\n");
+	fprintf(fp, "      --read-packets             Read packets into buffers instead of\n");
+	fprintf(fp, "                                 mapping them, --readahead packets\n");
+	fprintf(fp, "                                 in flight with io_uring\n");
+	fprintf(fp, "      --decode-threads           Decode stream files in worker threads, at\n");
+	fprintf(fp, "                                 most one per processor\n");
+	fprintf(fp, "  -j, --jobs N                   Convert N time slices of the trace in\n");
+	fprintf(fp, "                                 parallel (text and json output only)\n");
+	fprintf(fp, "      --format-threads N         Format the text output in N threads\n");
 	list_formats(fp);
 	fprintf(fp, "\n");
 }
@@ -221,6 +269,36 @@ end:
 	return ret;
 }
 
+static int get_events_args(poptContext *pc)
+{
+	char *str, *strlist, *strctx;
+
+	strlist = (char *) poptGetOptArg(*pc);
+	if (!strlist) {
+		return -EINVAL;
+	}
+	if (!opt_event_names)
+		opt_event_names = g_ptr_array_new();
+	str = strtok_r(strlist, ",", &strctx);
+	do {
+		g_ptr_array_add(opt_event_names, g_strdup(str));
+	} while ((str = strtok_r(NULL, ",", &strctx)));
+	free(strlist);
+	return 0;
+}
+
+static void free_events_args(void)
+{
+	int i;
+
+	if (!opt_event_names)
+		return;
+	for (i = 0; i < opt_event_names->len; i++)
+		g_free(g_ptr_array_index(opt_event_names, i));
+	g_ptr_array_free(opt_event_names, TRUE);
+	opt_event_names = NULL;
+}
+
 static int get_fields_args(poptContext *pc)
 {
 	char *str, *strlist, *strctx;
@@ -396,6 +474,105 @@ static int parse_options(int argc, char **argv)
 		case OPT_CLOCK_FORCE_CORRELATE:
 			opt_clock_force_correlate = 1;
 			break;
+		case OPT_MAP_WHOLE_FILE:
+			opt_map_whole_file = 1;
+			break;
+		case OPT_NO_INDEX_CACHE:
+			opt_no_index_cache = 1;
+			break;
+		case OPT_ZERO_COPY:
+			opt_zero_copy = 1;
+			break;
+		case OPT_LAZY_PAYLOAD:
+			opt_lazy_payload = 1;
+			break;
+		case OPT_EVENTS:
+			if (get_events_args(&pc)) {
+				ret = -EINVAL;
+				goto end;
+			}
+			break;
+		case OPT_READAHEAD:
+		{
+			char *str;
+			char *endptr;
+			long val;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --readahead argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			val = strtol(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0
+					|| val < 0 || val > INT_MAX) {
+				fprintf(stderr, "[error] Incorrect --readahead argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			opt_readahead_packets = (int) val;
+			free(str);
+			break;
+		}
+		case OPT_READ_PACKETS:
+			opt_read_packets = 1;
+			break;
+		case OPT_DECODE_THREADS:
+			opt_decode_threads = 1;
+			break;
+		case OPT_JOBS:
+		{
+			char *str;
+			char *endptr;
+			long val;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --jobs argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			val = strtol(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0
+					|| val < 1 || val > INT_MAX) {
+				fprintf(stderr, "[error] Incorrect --jobs argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			opt_jobs = (int) val;
+			free(str);
+			break;
+		}
+		case OPT_FORMAT_THREADS:
+		{
+			char *str;
+			char *endptr;
+			long val;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --format-threads argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			val = strtol(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0
+					|| val < 1 || val > INT_MAX) {
+				fprintf(stderr, "[error] Incorrect --format-threads argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			opt_format_threads = (int) val;
+			free(str);
+			break;
+		}
 
 		default:
 			ret = -EINVAL;
@@ -617,43 +794,361 @@ end:
 	return ret;
 }
 
+/*
+ * Create an iterator over [begin_pos, end_pos], reading only the
+ * events selected with --events.
+ */
 static
-int convert_trace(struct bt_trace_descriptor *td_write,
-		  struct bt_context *ctx)
+struct bt_ctf_iter *convert_iter_create(struct bt_context *ctx,
+		struct bt_iter_pos *begin_pos, struct bt_iter_pos *end_pos)
 {
 	struct bt_ctf_iter *iter;
-	struct ctf_text_stream_pos *sout;
-	struct bt_iter_pos begin_pos;
+
+	iter = bt_ctf_iter_create(ctx, begin_pos, end_pos);
+	if (!iter)
+		return NULL;
+	if (opt_event_names) {
+		if (bt_ctf_iter_set_event_filter(iter,
+				(const char * const *) opt_event_names->pdata,
+				opt_event_names->len))
+			goto error;
+	}
+	return iter;
+
+error:
+	bt_ctf_iter_destroy(iter);
+	return NULL;
+}
+
+static
+int convert_events(struct ctf_text_stream_pos *sout, struct bt_ctf_iter *iter)
+{
 	struct bt_ctf_event *ctf_event;
 	int ret;
 
-	sout = container_of(td_write, struct ctf_text_stream_pos,
-			trace_descriptor);
-
-	if (!sout->parent.event_cb)
-		return 0;
+	/* Formatter threads are only implemented by the text format. */
+	if (opt_format_threads && !strcmp(opt_output_format, "text"))
+		return ctf_text_write_events_threads(sout, iter,
+				opt_format_threads);
 
-	begin_pos.type = BT_SEEK_BEGIN;
-	iter = bt_ctf_iter_create(ctx, &begin_pos, NULL);
-	if (!iter) {
-		ret = -1;
-		goto error_iter;
-	}
 	while ((ctf_event = bt_ctf_iter_read_event(iter))) {
 		ret = sout->parent.event_cb(&sout->parent, ctf_event->parent->stream);
 		if (ret) {
 			fprintf(stderr, "[error] Writing event failed.\n");
-			goto end;
+			return ret;
 		}
 		ret = bt_iter_next(bt_ctf_get_iter(iter));
 		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+static
+gint packet_begin_compare(gconstpointer a, gconstpointer b)
+{
+	const struct packet_index *pa = a, *pb = b;
+
+	if (pa->ts_real.timestamp_begin < pb->ts_real.timestamp_begin)
+		return -1;
+	return pa->ts_real.timestamp_begin > pb->ts_real.timestamp_begin;
+}
+
+/*
+ * Gather the packet indexes of all stream files, sorted by begin
+ * timestamp. Returns NULL if a stream has no packet index.
+ */
+static
+GArray *get_packets(struct bt_context *ctx)
+{
+	struct trace_collection *tc = ctx->tc;
+	GArray *packets;
+	int i, j, k;
+
+	packets = g_array_new(FALSE, FALSE, sizeof(struct packet_index));
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td;
+		struct ctf_trace *tin;
+
+		td = g_ptr_array_index(tc->array, i);
+		if (!td)
+			continue;
+		tin = container_of(td, struct ctf_trace, parent);
+		for (j = 0; j < tin->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(tin->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct ctf_file_stream *cfs;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				cfs = container_of(stream, struct ctf_file_stream,
+					parent);
+				if (!cfs->pos.packet_index)
+					goto error;
+				g_array_append_vals(packets,
+					cfs->pos.packet_index->data,
+					cfs->pos.packet_index->len);
+			}
+		}
+	}
+	g_array_sort(packets, packet_begin_compare);
+	return packets;
+
+error:
+	g_array_free(packets, TRUE);
+	return NULL;
+}
+
+/*
+ * Split the time range of the packets in up to opt_jobs slices holding
+ * about the same amount of trace data. Slice i starts at bounds[i],
+ * bounds[0] being unused. Returns the number of slices.
+ */
+static
+int get_slice_bounds(GArray *packets, uint64_t *bounds)
+{
+	uint64_t total = 0, sum = 0;
+	int i, nr_slices = 1;
+
+	for (i = 0; i < packets->len; i++)
+		total += g_array_index(packets, struct packet_index, i).content_size;
+	for (i = 0; i < packets->len && nr_slices < opt_jobs; i++) {
+		struct packet_index *index =
+			&g_array_index(packets, struct packet_index, i);
+		uint64_t prev_bound;
+
+		prev_bound = nr_slices > 1 ? bounds[nr_slices - 1] :
+			g_array_index(packets, struct packet_index, 0).ts_real.timestamp_begin;
+		if (sum >= total / opt_jobs * nr_slices
+				&& index->ts_real.timestamp_begin > prev_bound)
+			bounds[nr_slices++] = index->ts_real.timestamp_begin;
+		sum += index->content_size;
+	}
+	return nr_slices;
+}
+
+/*
+ * Find the timestamp of the last event printed before begin, for the
+ * delta field of the first event of a slice. Scan from the packets
+ * starting before begin, going further back while no event is found.
+ * Returns -1ULL if there is no such event.
+ */
+static
+uint64_t slice_prev_timestamp(struct bt_ctf_iter *iter, GArray *packets,
+		uint64_t begin)
+{
+	struct bt_ctf_event *ctf_event;
+	struct bt_iter_pos pos;
+	int i, step = 1;
+
+	for (i = packets->len - 1; i >= 0; i--) {
+		if (g_array_index(packets, struct packet_index,
+				i).ts_real.timestamp_begin < begin)
+			break;
+	}
+	while (i >= 0) {
+		uint64_t prev = -1ULL;
+
+		pos.type = BT_SEEK_TIME;
+		pos.u.seek_time = g_array_index(packets, struct packet_index,
+				i).ts_real.timestamp_begin;
+		if (bt_iter_set_pos(bt_ctf_get_iter(iter), &pos))
+			break;
+		while ((ctf_event = bt_ctf_iter_read_event(iter))) {
+			struct ctf_stream_definition *stream =
+				ctf_event->parent->stream;
+
+			if (stream->has_timestamp) {
+				if (stream->real_timestamp >= begin)
+					break;
+				prev = stream->real_timestamp;
+			}
+			if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+				break;
+		}
+		if (prev != -1ULL)
+			return prev;
+		i -= step;
+		step *= 2;
+	}
+	return -1ULL;
+}
+
+/*
+ * Convert slice i of nr_slices into fp.
+ */
+static
+int convert_slice(struct ctf_text_stream_pos *sout, struct bt_context *ctx,
+		GArray *packets, uint64_t *bounds, int nr_slices, int i,
+		FILE *fp)
+{
+	struct bt_iter_pos begin_pos, end_pos;
+	struct bt_ctf_iter *iter;
+	int console_output = babeltrace_ctf_console_output;
+	int ret = 0;
+
+	if (i == 0) {
+		begin_pos.type = BT_SEEK_BEGIN;
+	} else {
+		begin_pos.type = BT_SEEK_TIME;
+		begin_pos.u.seek_time = bounds[i];
+		/*
+		 * Seeking to the slice begin goes through packets already
+		 * read by the previous slices: do not warn about their
+		 * discarded events again.
+		 */
+		babeltrace_ctf_console_output = 0;
+	}
+	/* End positions are inclusive. */
+	end_pos.type = BT_SEEK_TIME;
+	if (i < nr_slices - 1)
+		end_pos.u.seek_time = bounds[i + 1] - 1;
+	iter = convert_iter_create(ctx, &begin_pos,
+			i < nr_slices - 1 ? &end_pos : NULL);
+	if (!iter) {
+		babeltrace_ctf_console_output = console_output;
+		return -1;
+	}
+	sout->fp = fp;
+	sout->flush_events = 0;
+	if (i > 0 && opt_delta_field) {
+		sout->last_real_timestamp = slice_prev_timestamp(iter,
+				packets, bounds[i]);
+		ret = bt_iter_set_pos(bt_ctf_get_iter(iter), &begin_pos);
+	}
+	babeltrace_ctf_console_output = console_output;
+	if (ret)
+		goto end;
+	ret = convert_events(sout, iter);
+	if (ctf_text_flush(sout) || fflush(fp))
+		ret = -1;
+end:
+	bt_ctf_iter_destroy(iter);
+	return ret;
+}
+
+/*
+ * Convert the trace collection with opt_jobs processes, each
+ * converting one time slice into a temporary file. The traces are
+ * opened and indexed once, before forking. Returns 1 if the trace
+ * collection cannot be split, to convert it sequentially.
+ */
+static
+int convert_trace_jobs(struct ctf_text_stream_pos *sout,
+		struct bt_context *ctx)
+{
+	uint64_t *bounds;
+	GArray *packets;
+	FILE **files;
+	pid_t *pids;
+	char buf[4096];
+	int i, nr_slices, nr_started = 0, ret = 1;
+
+	packets = get_packets(ctx);
+	if (!packets)
+		return 1;
+	bounds = g_new0(uint64_t, opt_jobs);
+	nr_slices = get_slice_bounds(packets, bounds);
+	if (nr_slices < 2)
+		goto end_bounds;
+	printf_verbose("Converting with %d jobs.\n", nr_slices);
+
+	files = g_new0(FILE *, nr_slices);
+	pids = g_new0(pid_t, nr_slices);
+	ret = -1;
+	for (i = 0; i < nr_slices; i++) {
+		files[i] = tmpfile();
+		if (!files[i]) {
+			perror("tmpfile");
 			goto end;
+		}
+	}
+	/* Do not let children write out buffered output twice. */
+	fflush(NULL);
+	for (i = 0; i < nr_slices; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			goto end;
+		}
+		if (pids[i] == 0) {
+			_exit(convert_slice(sout, ctx, packets, bounds,
+				nr_slices, i, files[i]) ? EXIT_FAILURE
+					: EXIT_SUCCESS);
+		}
+		nr_started++;
 	}
 	ret = 0;
-
 end:
+	/* Concatenate the output of the slices in order. */
+	for (i = 0; i < nr_started; i++) {
+		int status;
+		size_t len;
+
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+				|| WEXITSTATUS(status) != EXIT_SUCCESS) {
+			fprintf(stderr, "[error] Conversion job %d failed.\n", i);
+			ret = -1;
+		}
+		if (ret)
+			continue;
+		rewind(files[i]);
+		while ((len = fread(buf, 1, sizeof(buf), files[i])) > 0) {
+			if (fwrite(buf, 1, len, sout->fp) != len) {
+				perror("fwrite");
+				ret = -1;
+				break;
+			}
+		}
+	}
+	for (i = 0; i < nr_slices; i++) {
+		if (files[i])
+			fclose(files[i]);
+	}
+	g_free(pids);
+	g_free(files);
+end_bounds:
+	g_free(bounds);
+	g_array_free(packets, TRUE);
+	return ret;
+}
+
+static
+int convert_trace(struct bt_trace_descriptor *td_write,
+		  struct bt_context *ctx)
+{
+	struct bt_ctf_iter *iter;
+	struct ctf_text_stream_pos *sout;
+	struct bt_iter_pos begin_pos;
+	int ret;
+
+	sout = container_of(td_write, struct ctf_text_stream_pos,
+			trace_descriptor);
+
+	if (!sout->parent.event_cb)
+		return 0;
+
+	/* Slices are concatenated: only for the text based formats. */
+	if (opt_jobs > 1 && (!strcmp(opt_output_format, "text")
+			|| !strcmp(opt_output_format, "json"))) {
+		ret = convert_trace_jobs(sout, ctx);
+		if (ret <= 0)
+			return ret;
+		printf_verbose("Unable to split the trace collection, converting it with a single job.\n");
+	}
+
+	begin_pos.type = BT_SEEK_BEGIN;
+	iter = convert_iter_create(ctx, &begin_pos, NULL);
+	if (!iter)
+		return -1;
+	ret = convert_events(sout, iter);
 	bt_ctf_iter_destroy(iter);
-error_iter:
 	return ret;
 }
 
@@ -672,9 +1167,11 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Error parsing options.\n\n");
 		usage(stderr);
 		g_ptr_array_free(opt_input_paths, TRUE);
+		free_events_args();
 		exit(EXIT_FAILURE);
 	} else if (ret > 0) {
 		g_ptr_array_free(opt_input_paths, TRUE);
+		free_events_args();
 		exit(EXIT_SUCCESS);
 	}
 	printf_verbose("Verbose mode active.\n");
@@ -787,7 +1284,12 @@ int main(int argc, char **argv)
 		goto error_copy_trace;
 	}
 
-	fmt_write->close_trace(td_write);
+	/* Write errors of the output are reported when closing it. */
+	ret = fmt_write->close_trace(td_write);
+	if (ret) {
+		fprintf(stderr, "Error writing output.\n\n");
+		goto error_td_write;
+	}
 
 	bt_context_put(ctx);
 	printf_verbose("finished converting. Output written to:\n%s\n",
@@ -808,6 +1310,7 @@ end:
 	free(opt_output_format);
 	free(opt_output_path);
 	g_ptr_array_free(opt_input_paths, TRUE);
+	free_events_args();
 	if (partial_error)
 		exit(EXIT_FAILURE);
 	else
@@ -0,0 +1,1293 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF Arrow Format registration.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The Arrow output writes one table per event class, as an Arrow IPC
+ * stream named after the event, in the output directory. Each event is
+ * a row: its timestamp, followed by one column per field of the
+ * stream packet context, stream event header, stream event context,
+ * event context and event payload scopes, flattened in declaration
+ * order and named by their path (e.g. "event.fields.prev_comm").
+ *
+ * Integers and floats map to Arrow integers and doubles. Strings,
+ * character arrays and enumeration labels are dictionary-encoded.
+ * Arrays and sequences of numbers are lists. Variant options all have
+ * their own columns, null when another option is selected. Fields of
+ * other types (arrays of compound types) are not written.
+ *
+ * Rows are buffered and written out as record batches of at most
+ * ARROW_BATCH_ROWS rows or ARROW_BATCH_BYTES bytes. Dictionaries only
+ * grow by the entries new to each batch, and are replaced once they
+ * exceed ARROW_DICT_MAX_BYTES, so the memory used is bounded whatever
+ * the trace size.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf-arrow/ipc.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define ARROW_BATCH_ROWS	65536
+#define ARROW_BATCH_BYTES	(16 * 1024 * 1024)
+#define ARROW_DICT_MAX_BYTES	(64 * 1024 * 1024)
+
+#define ARROW_FILE_SUFFIX	".arrows"
+
+/*
+ * The converter handles all outputs as text positions, hence the
+ * ctf_text_stream_pos parent.
+ */
+struct ctf_arrow_stream_pos {
+	struct ctf_text_stream_pos parent;
+	char *path;			/* output directory */
+	GHashTable *tables;		/* event class to struct arrow_table */
+	GHashTable *file_names;		/* set of file names in use */
+};
+
+enum arrow_column_source {
+	ARROW_SOURCE_TIMESTAMP,
+	ARROW_SOURCE_INTEGER,
+	ARROW_SOURCE_FLOAT,
+	ARROW_SOURCE_ENUM,		/* enumeration label */
+	ARROW_SOURCE_STRING,
+	ARROW_SOURCE_TEXT_ARRAY,	/* array of characters */
+	ARROW_SOURCE_TEXT_SEQUENCE,	/* sequence of characters */
+	ARROW_SOURCE_ARRAY,		/* array of numbers */
+	ARROW_SOURCE_SEQUENCE,		/* sequence of numbers */
+};
+
+/* Dictionary of a string column */
+struct arrow_dict {
+	GHashTable *index;		/* string to index + 1 */
+	GStringChunk *strings;		/* hash table keys */
+	uint32_t len;			/* number of entries */
+	size_t size;			/* bytes used by the entries */
+	/* Entries not written yet */
+	uint32_t nr_new;
+	GByteArray *offsets;		/* int32_t, nr_new + 1 */
+	GByteArray *data;
+	int replace;			/* next batch replaces the dictionary */
+};
+
+struct arrow_column {
+	struct arrow_field field;	/* column schema */
+	char *name;
+	enum arrow_column_source source;
+	size_t elem_size;		/* size of values or list elements */
+	int set;			/* set in the current row */
+	uint64_t null_count;
+	GByteArray *validity;		/* validity bitmap */
+	GByteArray *values;		/* values, indexes, or list offsets */
+	GByteArray *elems;		/* list elements */
+	uint64_t nr_elems;
+	struct arrow_dict *dict;	/* string columns */
+};
+
+enum arrow_node_type {
+	ARROW_NODE_STRUCT,
+	ARROW_NODE_VARIANT,
+	ARROW_NODE_COLUMN,
+	ARROW_NODE_SKIP,
+};
+
+/* Mirror of a scope declaration, mapping its fields to columns. */
+struct arrow_node {
+	enum arrow_node_type type;
+	unsigned int column;		/* ARROW_NODE_COLUMN */
+	GPtrArray *children;		/* fields or options, in order */
+};
+
+enum arrow_scope {
+	ARROW_SCOPE_STREAM_PACKET_CONTEXT,
+	ARROW_SCOPE_STREAM_EVENT_HEADER,
+	ARROW_SCOPE_STREAM_EVENT_CONTEXT,
+	ARROW_SCOPE_EVENT_CONTEXT,
+	ARROW_SCOPE_EVENT_FIELDS,
+	NR_ARROW_SCOPES,
+};
+
+static const char *scope_names[NR_ARROW_SCOPES] = {
+	[ARROW_SCOPE_STREAM_PACKET_CONTEXT] = "stream.packet.context",
+	[ARROW_SCOPE_STREAM_EVENT_HEADER] = "stream.event.header",
+	[ARROW_SCOPE_STREAM_EVENT_CONTEXT] = "stream.event.context",
+	[ARROW_SCOPE_EVENT_CONTEXT] = "event.context",
+	[ARROW_SCOPE_EVENT_FIELDS] = "event.fields",
+};
+
+struct arrow_table {
+	struct ctf_event_declaration *event_class;
+	FILE *fp;
+	char *path;
+	struct arrow_node *scopes[NR_ARROW_SCOPES];
+	GArray *columns;		/* Array of struct arrow_column */
+	uint64_t nr_rows;		/* rows in the current batch */
+	size_t batch_bytes;		/* bytes used by the current batch */
+	uint64_t nr_batches;		/* batches written */
+	GString *scratch;		/* character arrays */
+};
+
+static
+struct bt_trace_descriptor *ctf_arrow_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp);
+static
+int ctf_arrow_close_trace(struct bt_trace_descriptor *descriptor);
+
+static
+struct bt_format ctf_arrow_format = {
+	.open_trace = ctf_arrow_open_trace,
+	.close_trace = ctf_arrow_close_trace,
+};
+
+static
+struct arrow_dict *dict_create(void)
+{
+	struct arrow_dict *dict;
+	int32_t zero = 0;
+
+	dict = g_new0(struct arrow_dict, 1);
+	dict->index = g_hash_table_new(g_str_hash, g_str_equal);
+	dict->strings = g_string_chunk_new(4096);
+	dict->offsets = g_byte_array_new();
+	dict->data = g_byte_array_new();
+	g_byte_array_append(dict->offsets, (const guint8 *) &zero,
+		sizeof(zero));
+	return dict;
+}
+
+static
+void dict_destroy(struct arrow_dict *dict)
+{
+	g_hash_table_destroy(dict->index);
+	g_string_chunk_free(dict->strings);
+	g_byte_array_free(dict->offsets, TRUE);
+	g_byte_array_free(dict->data, TRUE);
+	g_free(dict);
+}
+
+/* Forget the entries written, once they have been written out. */
+static
+void dict_written(struct arrow_dict *dict)
+{
+	int32_t zero = 0;
+
+	dict->nr_new = 0;
+	dict->replace = 0;
+	g_byte_array_set_size(dict->offsets, 0);
+	g_byte_array_append(dict->offsets, (const guint8 *) &zero,
+		sizeof(zero));
+	g_byte_array_set_size(dict->data, 0);
+	if (dict->size > ARROW_DICT_MAX_BYTES) {
+		/* Start over with a replacement dictionary. */
+		g_hash_table_remove_all(dict->index);
+		g_string_chunk_clear(dict->strings);
+		dict->len = 0;
+		dict->size = 0;
+		dict->replace = 1;
+	}
+}
+
+static
+uint32_t dict_lookup(struct arrow_dict *dict, const char *str)
+{
+	gpointer value;
+	char *key;
+	int32_t offset;
+	size_t len;
+
+	value = g_hash_table_lookup(dict->index, str);
+	if (value)
+		return GPOINTER_TO_UINT(value) - 1;
+	len = strlen(str);
+	key = g_string_chunk_insert_len(dict->strings, str, len);
+	g_hash_table_insert(dict->index, key, GUINT_TO_POINTER(dict->len + 1));
+	g_byte_array_append(dict->data, (const guint8 *) str, len);
+	offset = dict->data->len;
+	g_byte_array_append(dict->offsets, (const guint8 *) &offset,
+		sizeof(offset));
+	dict->size += len;
+	dict->nr_new++;
+	return dict->len++;
+}
+
+static
+void column_reset(struct arrow_column *column)
+{
+	g_byte_array_set_size(column->validity, 0);
+	g_byte_array_set_size(column->values, 0);
+	column->null_count = 0;
+	if (column->field.type == ARROW_TYPE_LIST) {
+		int32_t zero = 0;
+
+		g_byte_array_append(column->values, (const guint8 *) &zero,
+			sizeof(zero));
+		g_byte_array_set_size(column->elems, 0);
+		column->nr_elems = 0;
+	}
+}
+
+static
+struct arrow_column *table_add_column(struct arrow_table *table,
+		const char *name, enum arrow_column_source source,
+		enum arrow_type type)
+{
+	struct arrow_column column;
+
+	memset(&column, 0, sizeof(column));
+	column.name = g_strdup(name);
+	column.field.name = column.name;
+	column.field.type = type;
+	column.field.dictionary_id = -1;
+	column.source = source;
+	column.validity = g_byte_array_new();
+	column.values = g_byte_array_new();
+	switch (type) {
+	case ARROW_TYPE_UTF8:
+		/* Dictionary ids only need to be unique within the stream. */
+		column.field.dictionary_id = table->columns->len;
+		column.dict = dict_create();
+		column.elem_size = sizeof(int32_t);
+		break;
+	case ARROW_TYPE_LIST:
+		column.elems = g_byte_array_new();
+		break;
+	default:
+		break;
+	}
+	g_array_append_val(table->columns, column);
+	column_reset(&g_array_index(table->columns, struct arrow_column,
+			table->columns->len - 1));
+	return &g_array_index(table->columns, struct arrow_column,
+			table->columns->len - 1);
+}
+
+static
+size_t integer_size(const struct declaration_integer *integer_declaration)
+{
+	if (integer_declaration->len <= 8)
+		return 1;
+	if (integer_declaration->len <= 16)
+		return 2;
+	if (integer_declaration->len <= 32)
+		return 4;
+	return 8;
+}
+
+static
+int integer_is_text(const struct bt_declaration *declaration)
+{
+	const struct declaration_integer *integer_declaration;
+
+	if (declaration->id != CTF_TYPE_INTEGER)
+		return 0;
+	integer_declaration = container_of(declaration,
+			const struct declaration_integer, p);
+	return integer_declaration->encoding == CTF_STRING_UTF8
+		|| integer_declaration->encoding == CTF_STRING_ASCII;
+}
+
+static
+struct arrow_node *node_create(enum arrow_node_type type)
+{
+	struct arrow_node *node;
+
+	node = g_new0(struct arrow_node, 1);
+	node->type = type;
+	return node;
+}
+
+static
+void node_destroy(struct arrow_node *node)
+{
+	unsigned int i;
+
+	if (!node)
+		return;
+	if (node->children) {
+		for (i = 0; i < node->children->len; i++)
+			node_destroy(g_ptr_array_index(node->children, i));
+		g_ptr_array_free(node->children, TRUE);
+	}
+	g_free(node);
+}
+
+static
+struct arrow_node *build_node(struct arrow_table *table,
+		struct bt_declaration *declaration, GString *name);
+
+/* Children of a structure or variant, named name.field */
+static
+struct arrow_node *build_compound_node(struct arrow_table *table,
+		enum arrow_node_type type, GArray *fields, GString *name)
+{
+	struct arrow_node *node;
+	size_t name_len = name->len;
+	unsigned int i;
+
+	node = node_create(type);
+	node->children = g_ptr_array_new();
+	for (i = 0; i < fields->len; i++) {
+		struct declaration_field *field =
+			&g_array_index(fields, struct declaration_field, i);
+
+		g_string_append_printf(name, ".%s",
+			g_quark_to_string(field->name));
+		g_ptr_array_add(node->children,
+			build_node(table, field->declaration, name));
+		g_string_truncate(name, name_len);
+	}
+	return node;
+}
+
+static
+struct arrow_node *build_column_node(struct arrow_table *table,
+		const char *name, enum arrow_column_source source,
+		enum arrow_type type)
+{
+	struct arrow_node *node;
+
+	node = node_create(ARROW_NODE_COLUMN);
+	node->column = table->columns->len;
+	table_add_column(table, name, source, type);
+	return node;
+}
+
+/* Number list, or NULL if elem is not a number. */
+static
+struct arrow_node *build_list_node(struct arrow_table *table,
+		const char *name, enum arrow_column_source source,
+		struct bt_declaration *elem)
+{
+	struct arrow_node *node;
+	struct arrow_column *column;
+
+	if (elem->id != CTF_TYPE_INTEGER && elem->id != CTF_TYPE_FLOAT)
+		return NULL;
+	node = build_column_node(table, name, source, ARROW_TYPE_LIST);
+	column = &g_array_index(table->columns, struct arrow_column,
+			node->column);
+	if (elem->id == CTF_TYPE_INTEGER) {
+		struct declaration_integer *integer_declaration =
+			container_of(elem, struct declaration_integer, p);
+
+		column->field.elem_type = ARROW_TYPE_INT;
+		column->elem_size = integer_size(integer_declaration);
+		column->field.bit_width = column->elem_size * CHAR_BIT;
+		column->field.is_signed = integer_declaration->signedness;
+	} else {
+		column->field.elem_type = ARROW_TYPE_DOUBLE;
+		column->elem_size = sizeof(double);
+	}
+	return node;
+}
+
+static
+struct arrow_node *build_node(struct arrow_table *table,
+		struct bt_declaration *declaration, GString *name)
+{
+	struct arrow_node *node = NULL;
+
+	switch (declaration->id) {
+	case CTF_TYPE_STRUCT:
+	{
+		struct declaration_struct *struct_declaration =
+			container_of(declaration, struct declaration_struct, p);
+
+		return build_compound_node(table, ARROW_NODE_STRUCT,
+				struct_declaration->fields, name);
+	}
+	case CTF_TYPE_VARIANT:
+	{
+		struct declaration_variant *variant_declaration =
+			container_of(declaration, struct declaration_variant, p);
+
+		return build_compound_node(table, ARROW_NODE_VARIANT,
+				variant_declaration->untagged_variant->fields,
+				name);
+	}
+	case CTF_TYPE_INTEGER:
+	{
+		struct declaration_integer *integer_declaration =
+			container_of(declaration, struct declaration_integer, p);
+		struct arrow_column *column;
+
+		node = build_column_node(table, name->str,
+				ARROW_SOURCE_INTEGER, ARROW_TYPE_INT);
+		column = &g_array_index(table->columns, struct arrow_column,
+				node->column);
+		column->elem_size = integer_size(integer_declaration);
+		column->field.bit_width = column->elem_size * CHAR_BIT;
+		column->field.is_signed = integer_declaration->signedness;
+		return node;
+	}
+	case CTF_TYPE_FLOAT:
+	{
+		struct arrow_column *column;
+
+		node = build_column_node(table, name->str,
+				ARROW_SOURCE_FLOAT, ARROW_TYPE_DOUBLE);
+		column = &g_array_index(table->columns, struct arrow_column,
+				node->column);
+		column->elem_size = sizeof(double);
+		return node;
+	}
+	case CTF_TYPE_ENUM:
+		return build_column_node(table, name->str,
+				ARROW_SOURCE_ENUM, ARROW_TYPE_UTF8);
+	case CTF_TYPE_STRING:
+		return build_column_node(table, name->str,
+				ARROW_SOURCE_STRING, ARROW_TYPE_UTF8);
+	case CTF_TYPE_ARRAY:
+	{
+		struct declaration_array *array_declaration =
+			container_of(declaration, struct declaration_array, p);
+
+		if (integer_is_text(array_declaration->elem))
+			return build_column_node(table, name->str,
+					ARROW_SOURCE_TEXT_ARRAY,
+					ARROW_TYPE_UTF8);
+		node = build_list_node(table, name->str, ARROW_SOURCE_ARRAY,
+				array_declaration->elem);
+		break;
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		struct declaration_sequence *sequence_declaration =
+			container_of(declaration, struct declaration_sequence, p);
+
+		if (integer_is_text(sequence_declaration->elem))
+			return build_column_node(table, name->str,
+					ARROW_SOURCE_TEXT_SEQUENCE,
+					ARROW_TYPE_UTF8);
+		node = build_list_node(table, name->str, ARROW_SOURCE_SEQUENCE,
+				sequence_declaration->elem);
+		break;
+	}
+	default:
+		break;
+	}
+	if (!node) {
+		fprintf(stderr, "[warning] Arrow output: field \"%s\" of event \"%s\" has an unsupported type, skipping it.\n",
+			name->str, g_quark_to_string(table->event_class->name));
+		node = node_create(ARROW_NODE_SKIP);
+	}
+	return node;
+}
+
+static
+void column_set_valid(struct arrow_table *table, struct arrow_column *column,
+		int valid)
+{
+	uint64_t row = table->nr_rows;
+
+	if (!(row % CHAR_BIT)) {
+		guint8 zero = 0;
+
+		g_byte_array_append(column->validity, &zero, 1);
+		table->batch_bytes++;
+	}
+	if (valid)
+		column->validity->data[row / CHAR_BIT] |= 1U << (row % CHAR_BIT);
+	else
+		column->null_count++;
+	column->set = 1;
+}
+
+/* Append the elem_size low-order bytes of v, in native byte order. */
+static
+void append_integer(struct arrow_table *table, GByteArray *array,
+		uint64_t v, size_t elem_size)
+{
+	switch (elem_size) {
+	case 1:
+	{
+		uint8_t v8 = v;
+
+		g_byte_array_append(array, &v8, sizeof(v8));
+		break;
+	}
+	case 2:
+	{
+		uint16_t v16 = v;
+
+		g_byte_array_append(array, (const guint8 *) &v16, sizeof(v16));
+		break;
+	}
+	case 4:
+	{
+		uint32_t v32 = v;
+
+		g_byte_array_append(array, (const guint8 *) &v32, sizeof(v32));
+		break;
+	}
+	case 8:
+		g_byte_array_append(array, (const guint8 *) &v, sizeof(v));
+		break;
+	default:
+		assert(0);
+	}
+	table->batch_bytes += elem_size;
+}
+
+static
+void append_double(struct arrow_table *table, GByteArray *array, double v)
+{
+	g_byte_array_append(array, (const guint8 *) &v, sizeof(v));
+	table->batch_bytes += sizeof(v);
+}
+
+static
+void column_append_null(struct arrow_table *table, struct arrow_column *column)
+{
+	column_set_valid(table, column, 0);
+	if (column->field.type == ARROW_TYPE_LIST) {
+		int32_t offset = column->nr_elems;
+
+		g_byte_array_append(column->values, (const guint8 *) &offset,
+			sizeof(offset));
+		table->batch_bytes += sizeof(offset);
+	} else {
+		append_integer(table, column->values, 0, column->elem_size);
+	}
+}
+
+static
+void column_append_string(struct arrow_table *table,
+		struct arrow_column *column, const char *str)
+{
+	size_t size = column->dict->size;
+
+	column_set_valid(table, column, 1);
+	append_integer(table, column->values,
+		dict_lookup(column->dict, str), sizeof(int32_t));
+	table->batch_bytes += column->dict->size - size;
+}
+
+/* Characters of an array or sequence, up to the first null character. */
+static
+void column_append_text(struct arrow_table *table, struct arrow_column *column,
+		const char *bytes, size_t bytes_len, GPtrArray *elems,
+		uint64_t len)
+{
+	GString *str = table->scratch;
+	uint64_t i;
+
+	g_string_truncate(str, 0);
+	if (bytes) {
+		g_string_append_len(str, bytes, strnlen(bytes, bytes_len));
+	} else {
+		for (i = 0; i < len; i++) {
+			struct definition_integer *integer_definition =
+				container_of(g_ptr_array_index(elems, i),
+					struct definition_integer, p);
+			char c = integer_definition->value._unsigned;
+
+			if (!c)
+				break;
+			g_string_append_c(str, c);
+		}
+	}
+	column_append_string(table, column, str->str);
+}
+
+static
+void column_append_list(struct arrow_table *table, struct arrow_column *column,
+		GPtrArray *elems, uint64_t len)
+{
+	int32_t offset;
+	uint64_t i;
+
+	column_set_valid(table, column, 1);
+	for (i = 0; i < len; i++) {
+		struct bt_definition *elem = g_ptr_array_index(elems, i);
+
+		if (column->field.elem_type == ARROW_TYPE_INT) {
+			struct definition_integer *integer_definition =
+				container_of(elem, struct definition_integer, p);
+
+			append_integer(table, column->elems,
+				integer_definition->value._unsigned,
+				column->elem_size);
+		} else {
+			struct definition_float *float_definition =
+				container_of(elem, struct definition_float, p);
+
+			append_double(table, column->elems,
+				float_definition->value);
+		}
+	}
+	column->nr_elems += len;
+	offset = column->nr_elems;
+	g_byte_array_append(column->values, (const guint8 *) &offset,
+		sizeof(offset));
+	table->batch_bytes += sizeof(offset);
+}
+
+static
+void column_append(struct arrow_table *table, struct arrow_column *column,
+		struct bt_definition *definition)
+{
+	switch (column->source) {
+	case ARROW_SOURCE_INTEGER:
+	{
+		struct definition_integer *integer_definition =
+			container_of(definition, struct definition_integer, p);
+
+		column_set_valid(table, column, 1);
+		append_integer(table, column->values,
+			integer_definition->value._unsigned,
+			column->elem_size);
+		break;
+	}
+	case ARROW_SOURCE_FLOAT:
+	{
+		struct definition_float *float_definition =
+			container_of(definition, struct definition_float, p);
+
+		column_set_valid(table, column, 1);
+		append_double(table, column->values, float_definition->value);
+		break;
+	}
+	case ARROW_SOURCE_ENUM:
+	{
+		struct definition_enum *enum_definition =
+			container_of(definition, struct definition_enum, p);
+		GArray *qs = enum_definition->value;
+
+		/* Values without label are null. */
+		if (!qs || !qs->len) {
+			column_append_null(table, column);
+			break;
+		}
+		column_append_string(table, column,
+			g_quark_to_string(g_array_index(qs, GQuark, 0)));
+		break;
+	}
+	case ARROW_SOURCE_STRING:
+	{
+		struct definition_string *string_definition =
+			container_of(definition, struct definition_string, p);
+
+		if (!string_definition->value) {
+			column_append_null(table, column);
+			break;
+		}
+		column_append_string(table, column, string_definition->value);
+		break;
+	}
+	case ARROW_SOURCE_TEXT_ARRAY:
+	{
+		struct definition_array *array_definition =
+			container_of(definition, struct definition_array, p);
+
+		bt_array_bulk_sync(array_definition);
+		column_append_text(table, column, array_definition->bytes,
+			array_definition->bytes_len, array_definition->elems,
+			array_definition->declaration->len);
+		break;
+	}
+	case ARROW_SOURCE_TEXT_SEQUENCE:
+	{
+		struct definition_sequence *sequence_definition =
+			container_of(definition, struct definition_sequence, p);
+
+		bt_sequence_bulk_sync(sequence_definition);
+		column_append_text(table, column, sequence_definition->bytes,
+			sequence_definition->bytes_len,
+			sequence_definition->elems,
+			bt_sequence_len(sequence_definition));
+		break;
+	}
+	case ARROW_SOURCE_ARRAY:
+	{
+		struct definition_array *array_definition =
+			container_of(definition, struct definition_array, p);
+
+		bt_array_bulk_sync(array_definition);
+		column_append_list(table, column, array_definition->elems,
+			array_definition->declaration->len);
+		break;
+	}
+	case ARROW_SOURCE_SEQUENCE:
+	{
+		struct definition_sequence *sequence_definition =
+			container_of(definition, struct definition_sequence, p);
+
+		bt_sequence_bulk_sync(sequence_definition);
+		column_append_list(table, column, sequence_definition->elems,
+			bt_sequence_len(sequence_definition));
+		break;
+	}
+	default:
+		assert(0);
+	}
+}
+
+static
+void node_append(struct arrow_table *table, struct arrow_node *node,
+		struct bt_definition *definition)
+{
+	unsigned int i;
+
+	switch (node->type) {
+	case ARROW_NODE_STRUCT:
+	{
+		struct definition_struct *struct_definition =
+			container_of(definition, struct definition_struct, p);
+
+		for (i = 0; i < node->children->len; i++)
+			node_append(table, g_ptr_array_index(node->children, i),
+				g_ptr_array_index(struct_definition->fields, i));
+		break;
+	}
+	case ARROW_NODE_VARIANT:
+	{
+		struct definition_variant *variant_definition =
+			container_of(definition, struct definition_variant, p);
+
+		/* Columns of the other options stay null. */
+		for (i = 0; i < node->children->len; i++) {
+			if (g_ptr_array_index(variant_definition->fields, i)
+					!= variant_definition->current_field)
+				continue;
+			node_append(table, g_ptr_array_index(node->children, i),
+				variant_definition->current_field);
+			break;
+		}
+		break;
+	}
+	case ARROW_NODE_COLUMN:
+		column_append(table, &g_array_index(table->columns,
+				struct arrow_column, node->column), definition);
+		break;
+	case ARROW_NODE_SKIP:
+		break;
+	default:
+		assert(0);
+	}
+}
+
+static
+int table_write_dictionaries(struct arrow_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->columns->len; i++) {
+		struct arrow_column *column = &g_array_index(table->columns,
+				struct arrow_column, i);
+		struct arrow_dict *dict = column->dict;
+		struct arrow_buffer buffers[3];
+		int is_delta;
+
+		if (!dict)
+			continue;
+		/* All dictionaries precede the first record batch. */
+		is_delta = table->nr_batches && !dict->replace;
+		if (is_delta && !dict->nr_new)
+			continue;
+		buffers[0].data = NULL;
+		buffers[0].len = 0;
+		buffers[1].data = dict->offsets->data;
+		buffers[1].len = dict->offsets->len;
+		buffers[2].data = dict->data->data;
+		buffers[2].len = dict->data->len;
+		if (arrow_write_dictionary_batch(table->fp,
+				column->field.dictionary_id, is_delta,
+				dict->nr_new, buffers))
+			return -1;
+		dict_written(dict);
+	}
+	return 0;
+}
+
+static
+int table_flush(struct arrow_table *table)
+{
+	GArray *nodes, *buffers;
+	unsigned int i;
+	int ret = 0;
+
+	if (!table->nr_rows)
+		return 0;
+	if (table_write_dictionaries(table))
+		goto error;
+
+	nodes = g_array_new(FALSE, FALSE, sizeof(struct arrow_field_node));
+	buffers = g_array_new(FALSE, FALSE, sizeof(struct arrow_buffer));
+	for (i = 0; i < table->columns->len; i++) {
+		struct arrow_column *column = &g_array_index(table->columns,
+				struct arrow_column, i);
+		struct arrow_field_node node;
+		struct arrow_buffer buffer;
+
+		node.length = table->nr_rows;
+		node.null_count = column->null_count;
+		g_array_append_val(nodes, node);
+		buffer.data = column->validity->data;
+		buffer.len = column->validity->len;
+		g_array_append_val(buffers, buffer);
+		buffer.data = column->values->data;
+		buffer.len = column->values->len;
+		g_array_append_val(buffers, buffer);
+		if (column->field.type == ARROW_TYPE_LIST) {
+			/* List elements are never null. */
+			node.length = column->nr_elems;
+			node.null_count = 0;
+			g_array_append_val(nodes, node);
+			buffer.data = NULL;
+			buffer.len = 0;
+			g_array_append_val(buffers, buffer);
+			buffer.data = column->elems->data;
+			buffer.len = column->elems->len;
+			g_array_append_val(buffers, buffer);
+		}
+	}
+	ret = arrow_write_record_batch(table->fp, table->nr_rows,
+			(struct arrow_field_node *) nodes->data, nodes->len,
+			(struct arrow_buffer *) buffers->data, buffers->len);
+	g_array_free(nodes, TRUE);
+	g_array_free(buffers, TRUE);
+	if (ret)
+		goto error;
+
+	for (i = 0; i < table->columns->len; i++)
+		column_reset(&g_array_index(table->columns,
+				struct arrow_column, i));
+	table->nr_rows = 0;
+	table->batch_bytes = 0;
+	table->nr_batches++;
+	return 0;
+
+error:
+	fprintf(stderr, "[error] Unable to write Arrow table \"%s\": %s\n",
+		table->path, strerror(errno));
+	return -1;
+}
+
+static
+void table_destroy(gpointer data)
+{
+	struct arrow_table *table = data;
+	unsigned int i;
+
+	for (i = 0; i < NR_ARROW_SCOPES; i++)
+		node_destroy(table->scopes[i]);
+	for (i = 0; i < table->columns->len; i++) {
+		struct arrow_column *column = &g_array_index(table->columns,
+				struct arrow_column, i);
+
+		g_free(column->name);
+		g_byte_array_free(column->validity, TRUE);
+		g_byte_array_free(column->values, TRUE);
+		if (column->elems)
+			g_byte_array_free(column->elems, TRUE);
+		if (column->dict)
+			dict_destroy(column->dict);
+	}
+	g_array_free(table->columns, TRUE);
+	g_string_free(table->scratch, TRUE);
+	if (table->fp)
+		fclose(table->fp);
+	g_free(table->path);
+	g_free(table);
+}
+
+/* File name of event class: its name, made usable as a file name. */
+static
+void table_file_name(GString *name, struct ctf_event_declaration *event_class)
+{
+	char *p;
+
+	g_string_assign(name, g_quark_to_string(event_class->name));
+	for (p = name->str; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+	if (!name->len || name->str[0] == '.')
+		g_string_prepend_c(name, '_');
+}
+
+/*
+ * Output file path of event class. Event classes of different streams
+ * or traces may have the same name: file names get a numeric suffix to
+ * be unique.
+ */
+static
+char *table_path(struct ctf_arrow_stream_pos *pos,
+		struct ctf_event_declaration *event_class)
+{
+	GString *name;
+	char *file_name;
+	unsigned int i;
+
+	name = g_string_new("");
+	table_file_name(name, event_class);
+	for (i = 1; g_hash_table_lookup(pos->file_names, name->str); i++) {
+		table_file_name(name, event_class);
+		g_string_append_printf(name, ".%u", i);
+	}
+	file_name = g_string_free(name, FALSE);
+	g_hash_table_insert(pos->file_names, file_name, file_name);
+	return g_strdup_printf("%s/%s" ARROW_FILE_SUFFIX, pos->path, file_name);
+}
+
+/* Trace and event class information, saved as schema metadata. */
+static
+GPtrArray *table_metadata(struct ctf_event_declaration *event_class)
+{
+	struct ctf_stream_declaration *stream_class = event_class->stream;
+	struct ctf_trace *trace = stream_class->trace;
+	GPtrArray *metadata;
+
+	metadata = g_ptr_array_new_with_free_func(g_free);
+	g_ptr_array_add(metadata, g_strdup("ctf.event.name"));
+	g_ptr_array_add(metadata,
+		g_strdup(g_quark_to_string(event_class->name)));
+	g_ptr_array_add(metadata, g_strdup("ctf.event.id"));
+	g_ptr_array_add(metadata,
+		g_strdup_printf("%" PRIu64, event_class->id));
+	if (event_class->loglevel != -1) {
+		g_ptr_array_add(metadata, g_strdup("ctf.event.loglevel"));
+		g_ptr_array_add(metadata,
+			g_strdup_printf("%d", event_class->loglevel));
+	}
+	if (event_class->model_emf_uri) {
+		g_ptr_array_add(metadata, g_strdup("ctf.event.model.emf.uri"));
+		g_ptr_array_add(metadata,
+			g_strdup(g_quark_to_string(event_class->model_emf_uri)));
+	}
+	g_ptr_array_add(metadata, g_strdup("ctf.stream.id"));
+	g_ptr_array_add(metadata,
+		g_strdup_printf("%" PRIu64, stream_class->stream_id));
+	if (trace->parent.path[0] != '\0') {
+		g_ptr_array_add(metadata, g_strdup("ctf.trace.path"));
+		g_ptr_array_add(metadata, g_strdup(trace->parent.path));
+	}
+	if (trace->env.hostname[0] != '\0') {
+		g_ptr_array_add(metadata, g_strdup("ctf.trace.hostname"));
+		g_ptr_array_add(metadata, g_strdup(trace->env.hostname));
+	}
+	if (trace->env.domain[0] != '\0') {
+		g_ptr_array_add(metadata, g_strdup("ctf.trace.domain"));
+		g_ptr_array_add(metadata, g_strdup(trace->env.domain));
+	}
+	if (trace->env.procname[0] != '\0') {
+		g_ptr_array_add(metadata, g_strdup("ctf.trace.procname"));
+		g_ptr_array_add(metadata, g_strdup(trace->env.procname));
+	}
+	if (trace->env.vpid != -1) {
+		g_ptr_array_add(metadata, g_strdup("ctf.trace.vpid"));
+		g_ptr_array_add(metadata,
+			g_strdup_printf("%d", trace->env.vpid));
+	}
+	return metadata;
+}
+
+static
+int table_write_schema(struct arrow_table *table)
+{
+	GArray *fields;
+	GPtrArray *metadata;
+	unsigned int i;
+	int ret;
+
+	fields = g_array_new(FALSE, FALSE, sizeof(struct arrow_field));
+	for (i = 0; i < table->columns->len; i++)
+		g_array_append_val(fields, g_array_index(table->columns,
+				struct arrow_column, i).field);
+	metadata = table_metadata(table->event_class);
+	ret = arrow_write_schema(table->fp,
+			(struct arrow_field *) fields->data, fields->len,
+			(const char * const *) metadata->pdata,
+			metadata->len / 2);
+	g_ptr_array_free(metadata, TRUE);
+	g_array_free(fields, TRUE);
+	return ret;
+}
+
+static
+struct arrow_table *table_create(struct ctf_arrow_stream_pos *pos,
+		struct ctf_event_declaration *event_class)
+{
+	struct ctf_stream_declaration *stream_class = event_class->stream;
+	struct bt_declaration *scopes[NR_ARROW_SCOPES];
+	struct arrow_table *table;
+	struct arrow_column *column;
+	GString *name;
+	unsigned int i;
+
+	scopes[ARROW_SCOPE_STREAM_PACKET_CONTEXT] =
+		stream_class->packet_context_decl ?
+			&stream_class->packet_context_decl->p : NULL;
+	scopes[ARROW_SCOPE_STREAM_EVENT_HEADER] =
+		stream_class->event_header_decl ?
+			&stream_class->event_header_decl->p : NULL;
+	scopes[ARROW_SCOPE_STREAM_EVENT_CONTEXT] =
+		stream_class->event_context_decl ?
+			&stream_class->event_context_decl->p : NULL;
+	scopes[ARROW_SCOPE_EVENT_CONTEXT] =
+		event_class->context_decl ?
+			&event_class->context_decl->p : NULL;
+	scopes[ARROW_SCOPE_EVENT_FIELDS] =
+		event_class->fields_decl ?
+			&event_class->fields_decl->p : NULL;
+
+	table = g_new0(struct arrow_table, 1);
+	table->event_class = event_class;
+	table->columns = g_array_new(FALSE, TRUE, sizeof(struct arrow_column));
+	table->scratch = g_string_new("");
+	column = table_add_column(table, "timestamp",
+			ARROW_SOURCE_TIMESTAMP, ARROW_TYPE_TIMESTAMP_NS);
+	column->elem_size = sizeof(uint64_t);
+	name = g_string_new("");
+	for (i = 0; i < NR_ARROW_SCOPES; i++) {
+		if (!scopes[i])
+			continue;
+		g_string_assign(name, scope_names[i]);
+		table->scopes[i] = build_node(table, scopes[i], name);
+	}
+	g_string_free(name, TRUE);
+
+	table->path = table_path(pos, event_class);
+	table->fp = fopen(table->path, "w");
+	if (!table->fp)
+		goto error;
+	if (table_write_schema(table))
+		goto error;
+	return table;
+
+error:
+	fprintf(stderr, "[error] Unable to write Arrow table \"%s\": %s\n",
+		table->path, strerror(errno));
+	table_destroy(table);
+	return NULL;
+}
+
+static
+struct bt_definition *scope_definition(struct ctf_stream_definition *stream,
+		struct ctf_event_definition *event, enum arrow_scope scope)
+{
+	struct definition_struct *definition;
+
+	switch (scope) {
+	case ARROW_SCOPE_STREAM_PACKET_CONTEXT:
+		definition = stream->stream_packet_context;
+		break;
+	case ARROW_SCOPE_STREAM_EVENT_HEADER:
+		definition = stream->stream_event_header;
+		break;
+	case ARROW_SCOPE_STREAM_EVENT_CONTEXT:
+		definition = stream->stream_event_context;
+		break;
+	case ARROW_SCOPE_EVENT_CONTEXT:
+		definition = event->event_context;
+		break;
+	case ARROW_SCOPE_EVENT_FIELDS:
+		definition = event->event_fields;
+		break;
+	default:
+		assert(0);
+		return NULL;
+	}
+	return definition ? &definition->p : NULL;
+}
+
+static
+int ctf_arrow_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_arrow_stream_pos *pos =
+		container_of(ppos, struct ctf_arrow_stream_pos, parent.parent);
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	struct arrow_table *table;
+	struct arrow_column *column;
+	unsigned int i;
+	uint64_t id;
+	int ret;
+
+	id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return -EINVAL;
+	}
+	event = g_ptr_array_index(stream->events_by_id, id);
+	if (!event) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+
+	table = g_hash_table_lookup(pos->tables, event_class);
+	if (!table) {
+		table = table_create(pos, event_class);
+		if (!table)
+			return -EIO;
+		g_hash_table_insert(pos->tables, event_class, table);
+	}
+
+	ret = ctf_decode_event_fields(event);
+	if (ret) {
+		fprintf(stderr, "[error] Unexpected end of stream. Either the trace data stream is corrupted or metadata description does not match data layout.\n");
+		return ret;
+	}
+
+	for (i = 0; i < table->columns->len; i++)
+		g_array_index(table->columns, struct arrow_column, i).set = 0;
+	column = &g_array_index(table->columns, struct arrow_column, 0);
+	if (stream->has_timestamp) {
+		column_set_valid(table, column, 1);
+		append_integer(table, column->values, stream->real_timestamp,
+			column->elem_size);
+	}
+	for (i = 0; i < NR_ARROW_SCOPES; i++) {
+		struct bt_definition *definition;
+
+		if (!table->scopes[i])
+			continue;
+		definition = scope_definition(stream, event, i);
+		if (definition)
+			node_append(table, table->scopes[i], definition);
+	}
+	/* Fields not present in this event are null. */
+	for (i = 0; i < table->columns->len; i++) {
+		column = &g_array_index(table->columns, struct arrow_column, i);
+		if (!column->set)
+			column_append_null(table, column);
+	}
+	table->nr_rows++;
+
+	if (table->nr_rows >= ARROW_BATCH_ROWS
+			|| table->batch_bytes >= ARROW_BATCH_BYTES) {
+		if (table_flush(table))
+			return -EIO;
+	}
+	return 0;
+}
+
+static
+struct bt_trace_descriptor *ctf_arrow_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	struct ctf_arrow_stream_pos *pos;
+
+	switch (flags & O_ACCMODE) {
+	case O_RDWR:
+		if (!path) {
+			fprintf(stderr, "[error] The Arrow output format writes one file per event class: an output directory is required.\n");
+			return NULL;
+		}
+		if (mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO) && errno != EEXIST) {
+			perror("Unable to create output directory");
+			return NULL;
+		}
+		break;
+	case O_RDONLY:
+	default:
+		fprintf(stderr, "[error] Incorrect open flags.\n");
+		return NULL;
+	}
+
+	pos = g_new0(struct ctf_arrow_stream_pos, 1);
+	pos->path = g_strdup(path);
+	pos->tables = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, table_destroy);
+	pos->file_names = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+	pos->parent.parent.rw_table = NULL;
+	pos->parent.parent.event_cb = ctf_arrow_write_event;
+	pos->parent.parent.trace = &pos->parent.trace_descriptor;
+	return &pos->parent.trace_descriptor;
+}
+
+static
+int ctf_arrow_close_trace(struct bt_trace_descriptor *td)
+{
+	struct ctf_arrow_stream_pos *pos =
+		container_of(td, struct ctf_arrow_stream_pos,
+			parent.trace_descriptor);
+	GHashTableIter iter;
+	gpointer value;
+	int ret = 0;
+
+	g_hash_table_iter_init(&iter, pos->tables);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct arrow_table *table = value;
+
+		if (table_flush(table)) {
+			ret = -1;
+			continue;
+		}
+		if (arrow_write_eos(table->fp) || fclose(table->fp)) {
+			fprintf(stderr, "[error] Unable to write Arrow table \"%s\": %s\n",
+				table->path, strerror(errno));
+			ret = -1;
+		}
+		table->fp = NULL;
+	}
+	g_hash_table_destroy(pos->tables);
+	g_hash_table_destroy(pos->file_names);
+	g_free(pos->path);
+	g_free(pos);
+	return ret;
+}
+
+static
+void __attribute__((constructor)) ctf_arrow_init(void)
+{
+	int ret;
+
+	ctf_arrow_format.name = g_quark_from_static_string("arrow");
+	ret = bt_register_format(&ctf_arrow_format);
+	assert(!ret);
+}
+
+static
+void __attribute__((destructor)) ctf_arrow_exit(void)
+{
+	bt_unregister_format(&ctf_arrow_format);
+}
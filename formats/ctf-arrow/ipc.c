@@ -0,0 +1,543 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Arrow IPC stream writer.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf-arrow/ipc.h>
+#include <babeltrace/align.h>
+#include <babeltrace/endian.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+
+/* Message.fbs and Schema.fbs identifiers */
+#define ARROW_METADATA_V5		4
+#define ARROW_HEADER_SCHEMA		1
+#define ARROW_HEADER_DICTIONARY_BATCH	2
+#define ARROW_HEADER_RECORD_BATCH	3
+#define ARROW_FB_TYPE_INT		2
+#define ARROW_FB_TYPE_FLOATING_POINT	3
+#define ARROW_FB_TYPE_UTF8		5
+#define ARROW_FB_TYPE_TIMESTAMP		10
+#define ARROW_FB_TYPE_LIST		12
+#define ARROW_PRECISION_DOUBLE		2
+#define ARROW_TIME_UNIT_NANOSECOND	3
+
+#define ARROW_CONTINUATION		0xFFFFFFFFU
+
+/* Largest number of fields of the tables written */
+#define FB_MAX_FIELDS			8
+
+/*
+ * FlatBuffers builder. Buffers are built back to front, children
+ * first, so every offset points forward. Offsets of objects are counted
+ * from the end of the buffer, as the bytes used when they were created.
+ */
+struct fb_builder {
+	uint8_t *buf;
+	size_t cap;			/* size of buf */
+	size_t len;			/* bytes used, at the end of buf */
+	size_t minalign;		/* largest alignment used */
+	/* Table being built */
+	size_t table_start;
+	uint32_t fields[FB_MAX_FIELDS];	/* field offsets, 0 if unset */
+	unsigned int nr_fields;
+};
+
+static
+void fb_init(struct fb_builder *b)
+{
+	memset(b, 0, sizeof(*b));
+	b->cap = 1024;
+	b->buf = g_malloc(b->cap);
+	b->minalign = 1;
+}
+
+static
+void fb_fini(struct fb_builder *b)
+{
+	g_free(b->buf);
+}
+
+static
+uint8_t *fb_push(struct fb_builder *b, size_t size)
+{
+	if (b->cap - b->len < size) {
+		size_t cap = b->cap;
+		uint8_t *buf;
+
+		while (cap - b->len < size)
+			cap *= 2;
+		buf = g_malloc(cap);
+		memcpy(buf + cap - b->len, b->buf + b->cap - b->len, b->len);
+		g_free(b->buf);
+		b->buf = buf;
+		b->cap = cap;
+	}
+	b->len += size;
+	return b->buf + b->cap - b->len;
+}
+
+/* Pad so that align is met once additional bytes are pushed. */
+static
+void fb_prep(struct fb_builder *b, size_t align, size_t additional)
+{
+	size_t pad = (-(b->len + additional)) & (align - 1);
+
+	if (align > b->minalign)
+		b->minalign = align;
+	memset(fb_push(b, pad), 0, pad);
+}
+
+static
+void fb_put_u8(struct fb_builder *b, uint8_t v)
+{
+	*fb_push(b, 1) = v;
+}
+
+static
+void fb_put_u16(struct fb_builder *b, uint16_t v)
+{
+	v = GUINT16_TO_LE(v);
+	memcpy(fb_push(b, sizeof(v)), &v, sizeof(v));
+}
+
+static
+void fb_put_u32(struct fb_builder *b, uint32_t v)
+{
+	v = GUINT32_TO_LE(v);
+	memcpy(fb_push(b, sizeof(v)), &v, sizeof(v));
+}
+
+static
+void fb_put_u64(struct fb_builder *b, uint64_t v)
+{
+	v = GUINT64_TO_LE(v);
+	memcpy(fb_push(b, sizeof(v)), &v, sizeof(v));
+}
+
+/* Relative offset from the position being written to object off. */
+static
+void fb_put_offset(struct fb_builder *b, uint32_t off)
+{
+	fb_prep(b, sizeof(uint32_t), 0);
+	fb_put_u32(b, b->len + sizeof(uint32_t) - off);
+}
+
+static
+uint32_t fb_string(struct fb_builder *b, const char *str)
+{
+	size_t len = strlen(str);
+
+	fb_prep(b, sizeof(uint32_t), len + 1);
+	fb_put_u8(b, '\0');
+	memcpy(fb_push(b, len), str, len);
+	fb_put_u32(b, len);
+	return b->len;
+}
+
+/* Vector of structures, already laid out in little endian. */
+static
+uint32_t fb_struct_vector(struct fb_builder *b, const void *data,
+		size_t elem_size, size_t count, size_t align)
+{
+	size_t size = elem_size * count;
+
+	fb_prep(b, sizeof(uint32_t), size);
+	fb_prep(b, align, size);
+	memcpy(fb_push(b, size), data, size);
+	fb_put_u32(b, count);
+	return b->len;
+}
+
+static
+uint32_t fb_offset_vector(struct fb_builder *b, const uint32_t *offsets,
+		size_t count)
+{
+	size_t i;
+
+	fb_prep(b, sizeof(uint32_t), sizeof(uint32_t) * count);
+	for (i = count; i > 0; i--)
+		fb_put_offset(b, offsets[i - 1]);
+	fb_put_u32(b, count);
+	return b->len;
+}
+
+static
+void fb_start_table(struct fb_builder *b)
+{
+	memset(b->fields, 0, sizeof(b->fields));
+	b->nr_fields = 0;
+	b->table_start = b->len;
+}
+
+static
+void fb_field_set(struct fb_builder *b, unsigned int field)
+{
+	assert(field < FB_MAX_FIELDS);
+	b->fields[field] = b->len;
+	if (field >= b->nr_fields)
+		b->nr_fields = field + 1;
+}
+
+static
+void fb_add_u8(struct fb_builder *b, unsigned int field, uint8_t v)
+{
+	fb_put_u8(b, v);
+	fb_field_set(b, field);
+}
+
+static
+void fb_add_u16(struct fb_builder *b, unsigned int field, uint16_t v)
+{
+	fb_prep(b, sizeof(v), 0);
+	fb_put_u16(b, v);
+	fb_field_set(b, field);
+}
+
+static
+void fb_add_u32(struct fb_builder *b, unsigned int field, uint32_t v)
+{
+	fb_prep(b, sizeof(v), 0);
+	fb_put_u32(b, v);
+	fb_field_set(b, field);
+}
+
+static
+void fb_add_u64(struct fb_builder *b, unsigned int field, uint64_t v)
+{
+	fb_prep(b, sizeof(v), 0);
+	fb_put_u64(b, v);
+	fb_field_set(b, field);
+}
+
+static
+void fb_add_offset(struct fb_builder *b, unsigned int field, uint32_t off)
+{
+	fb_put_offset(b, off);
+	fb_field_set(b, field);
+}
+
+/* Write the table header and its vtable, right before it. */
+static
+uint32_t fb_end_table(struct fb_builder *b)
+{
+	uint32_t table, vtable;
+	int32_t soffset;
+	unsigned int i;
+
+	fb_prep(b, sizeof(int32_t), 0);
+	fb_put_u32(b, 0);	/* Offset to vtable, set below */
+	table = b->len;
+	for (i = b->nr_fields; i > 0; i--) {
+		uint32_t field = b->fields[i - 1];
+
+		fb_put_u16(b, field ? table - field : 0);
+	}
+	fb_put_u16(b, table - b->table_start);
+	fb_put_u16(b, (2 + b->nr_fields) * sizeof(uint16_t));
+	vtable = b->len;
+	soffset = GINT32_TO_LE((int32_t) (vtable - table));
+	memcpy(b->buf + b->cap - table, &soffset, sizeof(soffset));
+	return table;
+}
+
+static
+void fb_finish(struct fb_builder *b, uint32_t root)
+{
+	fb_prep(b, b->minalign, sizeof(uint32_t));
+	fb_put_offset(b, root);
+}
+
+static
+uint32_t fb_int_type(struct fb_builder *b, int bit_width, int is_signed)
+{
+	fb_start_table(b);
+	fb_add_u32(b, 0, bit_width);
+	fb_add_u8(b, 1, !!is_signed);
+	return fb_end_table(b);
+}
+
+static
+uint32_t fb_type(struct fb_builder *b, const struct arrow_field *field,
+		enum arrow_type type, uint8_t *type_type)
+{
+	uint32_t timezone;
+
+	switch (type) {
+	case ARROW_TYPE_INT:
+		*type_type = ARROW_FB_TYPE_INT;
+		return fb_int_type(b, field->bit_width, field->is_signed);
+	case ARROW_TYPE_DOUBLE:
+		*type_type = ARROW_FB_TYPE_FLOATING_POINT;
+		fb_start_table(b);
+		fb_add_u16(b, 0, ARROW_PRECISION_DOUBLE);
+		return fb_end_table(b);
+	case ARROW_TYPE_UTF8:
+		*type_type = ARROW_FB_TYPE_UTF8;
+		fb_start_table(b);
+		return fb_end_table(b);
+	case ARROW_TYPE_TIMESTAMP_NS:
+		*type_type = ARROW_FB_TYPE_TIMESTAMP;
+		timezone = fb_string(b, "UTC");
+		fb_start_table(b);
+		fb_add_u16(b, 0, ARROW_TIME_UNIT_NANOSECOND);
+		fb_add_offset(b, 1, timezone);
+		return fb_end_table(b);
+	case ARROW_TYPE_LIST:
+		*type_type = ARROW_FB_TYPE_LIST;
+		fb_start_table(b);
+		return fb_end_table(b);
+	default:
+		assert(0);
+		return 0;
+	}
+}
+
+/*
+ * Field of type "type": list elements are described by the list field,
+ * as their child field.
+ */
+static
+uint32_t fb_field(struct fb_builder *b, const struct arrow_field *field,
+		const char *name, enum arrow_type type, int64_t dictionary_id)
+{
+	uint32_t name_off, type_off, dict_off = 0, children, child;
+	uint8_t type_type;
+
+	if (type == ARROW_TYPE_LIST) {
+		child = fb_field(b, field, "item", field->elem_type, -1);
+		children = fb_offset_vector(b, &child, 1);
+	} else {
+		children = fb_offset_vector(b, NULL, 0);
+	}
+	name_off = fb_string(b, name);
+	type_off = fb_type(b, field, type, &type_type);
+	if (dictionary_id >= 0) {
+		uint32_t index_type = fb_int_type(b, 32, 1);
+
+		fb_start_table(b);
+		fb_add_u64(b, 0, dictionary_id);
+		fb_add_offset(b, 1, index_type);
+		fb_add_u8(b, 2, 0);		/* isOrdered */
+		dict_off = fb_end_table(b);
+	}
+	fb_start_table(b);
+	fb_add_offset(b, 0, name_off);
+	fb_add_u8(b, 1, 1);			/* nullable */
+	fb_add_u8(b, 2, type_type);
+	fb_add_offset(b, 3, type_off);
+	if (dict_off)
+		fb_add_offset(b, 4, dict_off);
+	fb_add_offset(b, 5, children);
+	return fb_end_table(b);
+}
+
+static
+int write_all(FILE *fp, const void *data, size_t len)
+{
+	if (!len)
+		return 0;
+	if (fwrite(data, 1, len, fp) != len)
+		return -1;
+	return 0;
+}
+
+static
+int write_padding(FILE *fp, size_t len)
+{
+	static const char zeroes[8];
+
+	assert(len <= sizeof(zeroes));
+	return write_all(fp, zeroes, len);
+}
+
+/*
+ * Encapsulated message: continuation marker, metadata length, Message
+ * flatbuffer padded to 8 bytes, then the body buffers, each padded to
+ * 8 bytes.
+ */
+static
+int write_message(FILE *fp, struct fb_builder *b, uint8_t header_type,
+		uint32_t header, const struct arrow_buffer *buffers,
+		unsigned int nr_buffers, uint64_t body_len)
+{
+	uint32_t prefix[2];
+	size_t meta_len;
+	unsigned int i;
+	uint32_t message;
+
+	fb_start_table(b);
+	fb_add_u16(b, 0, ARROW_METADATA_V5);
+	fb_add_u8(b, 1, header_type);
+	fb_add_offset(b, 2, header);
+	fb_add_u64(b, 3, body_len);
+	message = fb_end_table(b);
+	fb_finish(b, message);
+
+	meta_len = ALIGN(b->len, 8);
+	prefix[0] = GUINT32_TO_LE(ARROW_CONTINUATION);
+	prefix[1] = GUINT32_TO_LE(meta_len);
+	if (write_all(fp, prefix, sizeof(prefix)))
+		return -1;
+	if (write_all(fp, b->buf + b->cap - b->len, b->len))
+		return -1;
+	if (write_padding(fp, meta_len - b->len))
+		return -1;
+	for (i = 0; i < nr_buffers; i++) {
+		if (write_all(fp, buffers[i].data, buffers[i].len))
+			return -1;
+		if (write_padding(fp, ALIGN(buffers[i].len, 8) - buffers[i].len))
+			return -1;
+	}
+	return 0;
+}
+
+/* Returns the RecordBatch table, and the body length in body_len. */
+static
+uint32_t fb_record_batch(struct fb_builder *b, int64_t length,
+		const struct arrow_field_node *nodes, unsigned int nr_nodes,
+		const struct arrow_buffer *buffers, unsigned int nr_buffers,
+		uint64_t *body_len)
+{
+	uint64_t *data, offset = 0;
+	uint32_t nodes_vec, buffers_vec;
+	unsigned int i;
+
+	data = g_new(uint64_t, 2 * MAX(nr_nodes, nr_buffers));
+	for (i = 0; i < nr_nodes; i++) {
+		data[2 * i] = GUINT64_TO_LE(nodes[i].length);
+		data[2 * i + 1] = GUINT64_TO_LE(nodes[i].null_count);
+	}
+	nodes_vec = fb_struct_vector(b, data, 2 * sizeof(uint64_t),
+			nr_nodes, sizeof(uint64_t));
+	for (i = 0; i < nr_buffers; i++) {
+		data[2 * i] = GUINT64_TO_LE(offset);
+		data[2 * i + 1] = GUINT64_TO_LE(buffers[i].len);
+		offset += ALIGN(buffers[i].len, 8);
+	}
+	buffers_vec = fb_struct_vector(b, data, 2 * sizeof(uint64_t),
+			nr_buffers, sizeof(uint64_t));
+	g_free(data);
+
+	fb_start_table(b);
+	fb_add_u64(b, 0, length);
+	fb_add_offset(b, 1, nodes_vec);
+	fb_add_offset(b, 2, buffers_vec);
+	*body_len = offset;
+	return fb_end_table(b);
+}
+
+int arrow_write_schema(FILE *fp, const struct arrow_field *fields,
+		unsigned int nr_fields, const char * const *metadata,
+		unsigned int nr_metadata)
+{
+	struct fb_builder b;
+	uint32_t *offsets, fields_vec, metadata_vec, schema;
+	unsigned int i;
+	int ret;
+
+	fb_init(&b);
+	offsets = g_new(uint32_t, MAX(nr_fields, nr_metadata) + 1);
+	for (i = 0; i < nr_fields; i++)
+		offsets[i] = fb_field(&b, &fields[i], fields[i].name,
+				fields[i].type, fields[i].dictionary_id);
+	fields_vec = fb_offset_vector(&b, offsets, nr_fields);
+	for (i = 0; i < nr_metadata; i++) {
+		uint32_t key, value;
+
+		key = fb_string(&b, metadata[2 * i]);
+		value = fb_string(&b, metadata[2 * i + 1]);
+		fb_start_table(&b);
+		fb_add_offset(&b, 0, key);
+		fb_add_offset(&b, 1, value);
+		offsets[i] = fb_end_table(&b);
+	}
+	metadata_vec = fb_offset_vector(&b, offsets, nr_metadata);
+	g_free(offsets);
+
+	fb_start_table(&b);
+	fb_add_u16(&b, 0, BYTE_ORDER == BIG_ENDIAN);	/* endianness */
+	fb_add_offset(&b, 1, fields_vec);
+	fb_add_offset(&b, 2, metadata_vec);
+	schema = fb_end_table(&b);
+
+	ret = write_message(fp, &b, ARROW_HEADER_SCHEMA, schema, NULL, 0, 0);
+	fb_fini(&b);
+	return ret;
+}
+
+int arrow_write_record_batch(FILE *fp, int64_t length,
+		const struct arrow_field_node *nodes, unsigned int nr_nodes,
+		const struct arrow_buffer *buffers, unsigned int nr_buffers)
+{
+	struct fb_builder b;
+	uint64_t body_len;
+	uint32_t batch;
+	int ret;
+
+	fb_init(&b);
+	batch = fb_record_batch(&b, length, nodes, nr_nodes,
+			buffers, nr_buffers, &body_len);
+	ret = write_message(fp, &b, ARROW_HEADER_RECORD_BATCH, batch,
+			buffers, nr_buffers, body_len);
+	fb_fini(&b);
+	return ret;
+}
+
+int arrow_write_dictionary_batch(FILE *fp, int64_t id, int is_delta,
+		int64_t length, const struct arrow_buffer *buffers)
+{
+	struct arrow_field_node node;
+	struct fb_builder b;
+	uint64_t body_len;
+	uint32_t batch, dictionary;
+	int ret;
+
+	node.length = length;
+	node.null_count = 0;
+	fb_init(&b);
+	batch = fb_record_batch(&b, length, &node, 1, buffers, 3, &body_len);
+	fb_start_table(&b);
+	fb_add_u64(&b, 0, id);
+	fb_add_offset(&b, 1, batch);
+	fb_add_u8(&b, 2, !!is_delta);
+	dictionary = fb_end_table(&b);
+	ret = write_message(fp, &b, ARROW_HEADER_DICTIONARY_BATCH, dictionary,
+			buffers, 3, body_len);
+	fb_fini(&b);
+	return ret;
+}
+
+int arrow_write_eos(FILE *fp)
+{
+	uint32_t eos[2];
+
+	eos[0] = GUINT32_TO_LE(ARROW_CONTINUATION);
+	eos[1] = 0;
+	return write_all(fp, eos, sizeof(eos));
+}
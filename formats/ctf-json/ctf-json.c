@@ -0,0 +1,652 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF JSON Lines Format registration.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The JSON output writes one JSON object per line and per event:
+ *
+ *   {"timestamp":1351532897586558519,"name":"sched_switch","stream_id":0,
+ *    "stream.packet.context":{"cpu_id":0},"event.fields":{...}}
+ *
+ * The timestamp is in ns (in cycles with --clock-cycles), and is absent
+ * if the event has none. Trace information follows, as selected by the
+ * --fields option, then the scopes of the event. Structures are
+ * objects, variants are objects holding the selected option, and
+ * arrays and sequences are arrays, or strings for text. Enumerations
+ * are written as their label, as an array of labels if there are more
+ * than one, or as their value if there is none. Floats are written
+ * with a '.' decimal point whatever the locale, and NaN and infinities
+ * are null.
+ *
+ * Output goes through the text output buffer: values are escaped and
+ * formatted straight into it, without allocation.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <glib.h>
+
+/*
+ * Inherit from struct ctf_text_stream_pos, for its output buffer, and
+ * since the converter handles all outputs as text positions.
+ */
+struct ctf_json_stream_pos {
+	struct ctf_text_stream_pos parent;
+	GHashTable *prefixes;	/* event class to its GString prefix */
+};
+
+static
+struct bt_trace_descriptor *ctf_json_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp);
+static
+int ctf_json_close_trace(struct bt_trace_descriptor *descriptor);
+
+static
+struct bt_format ctf_json_format = {
+	.open_trace = ctf_json_open_trace,
+	.close_trace = ctf_json_close_trace,
+};
+
+static
+int json_write_definition(struct ctf_text_stream_pos *pos,
+		struct bt_definition *definition);
+
+/*
+ * Escape sequence of the character at s, of at most max bytes (-1 if s
+ * is null-terminated), into esc. Returns its length, or 0 if the
+ * character needs no escaping, and the length of the character in
+ * *char_len. Bytes not starting a valid UTF-8 character are escaped as
+ * the replacement character U+FFFD, so that the output stays valid
+ * JSON.
+ */
+static inline
+size_t json_escape(const char *s, gssize max, char *esc, size_t *char_len)
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned char c = *s;
+
+	*char_len = 1;
+	if (likely(c >= 0x20 && c < 0x80 && c != '"' && c != '\\'))
+		return 0;
+	if (c >= 0x80) {
+		gunichar uc = g_utf8_get_char_validated(s, max);
+
+		if (likely(uc != (gunichar) -1 && uc != (gunichar) -2)) {
+			*char_len = g_utf8_skip[c];
+			return 0;
+		}
+		memcpy(esc, "\\ufffd", 6);
+		return 6;
+	}
+	esc[0] = '\\';
+	switch (c) {
+	case '"':
+		esc[1] = '"';
+		return 2;
+	case '\\':
+		esc[1] = '\\';
+		return 2;
+	case '\n':
+		esc[1] = 'n';
+		return 2;
+	case '\r':
+		esc[1] = 'r';
+		return 2;
+	case '\t':
+		esc[1] = 't';
+		return 2;
+	default:
+		esc[1] = 'u';
+		esc[2] = '0';
+		esc[3] = '0';
+		esc[4] = digits[c >> 4];
+		esc[5] = digits[c & 0xF];
+		return 6;
+	}
+}
+
+/* Write len characters of s, or up to a null character, quoted. */
+static
+void json_write_string(struct ctf_text_stream_pos *pos, const char *s,
+		size_t len)
+{
+	const char *run = s, *end = s + len;
+	char esc[6];
+	size_t esc_len, char_len;
+
+	ctf_text_putc(pos, '"');
+	for (; s < end && *s; s += char_len) {
+		esc_len = json_escape(s, end - s, esc, &char_len);
+		if (likely(!esc_len))
+			continue;
+		ctf_text_write(pos, run, s - run);
+		ctf_text_write(pos, esc, esc_len);
+		run = s + char_len;
+	}
+	ctf_text_write(pos, run, s - run);
+	ctf_text_putc(pos, '"');
+}
+
+static
+void json_string_append(GString *str, const char *s)
+{
+	char esc[6];
+	size_t esc_len, char_len;
+
+	g_string_append_c(str, '"');
+	for (; *s; s += char_len) {
+		esc_len = json_escape(s, -1, esc, &char_len);
+		if (esc_len)
+			g_string_append_len(str, esc, esc_len);
+		else
+			g_string_append_len(str, s, char_len);
+	}
+	g_string_append_c(str, '"');
+}
+
+static
+void json_write_key(struct ctf_text_stream_pos *pos, GQuark name)
+{
+	const char *s = rem_(g_quark_to_string(name));
+
+	json_write_string(pos, s, strlen(s));
+	ctf_text_putc(pos, ':');
+}
+
+static
+void json_write_integer(struct ctf_text_stream_pos *pos,
+		struct definition_integer *integer_definition)
+{
+	if (integer_definition->declaration->signedness)
+		ctf_text_print_int(pos, integer_definition->value._signed);
+	else
+		ctf_text_print_uint(pos, integer_definition->value._unsigned);
+}
+
+static
+void json_write_enum(struct ctf_text_stream_pos *pos,
+		struct definition_enum *enum_definition)
+{
+	GArray *qs = enum_definition->value;
+	const char *label;
+	unsigned int i;
+
+	if (!qs || !qs->len) {
+		json_write_integer(pos, enum_definition->integer);
+		return;
+	}
+	if (qs->len == 1) {
+		label = g_quark_to_string(g_array_index(qs, GQuark, 0));
+		json_write_string(pos, label, strlen(label));
+		return;
+	}
+	ctf_text_putc(pos, '[');
+	for (i = 0; i < qs->len; i++) {
+		if (i)
+			ctf_text_putc(pos, ',');
+		label = g_quark_to_string(g_array_index(qs, GQuark, i));
+		json_write_string(pos, label, strlen(label));
+	}
+	ctf_text_putc(pos, ']');
+}
+
+static
+int json_is_text(struct bt_declaration *elem)
+{
+	struct declaration_integer *integer_declaration;
+
+	if (elem->id != CTF_TYPE_INTEGER)
+		return 0;
+	integer_declaration = container_of(elem, struct declaration_integer, p);
+	return integer_declaration->encoding == CTF_STRING_UTF8
+		|| integer_declaration->encoding == CTF_STRING_ASCII;
+}
+
+/*
+ * Elements of an array or sequence of len elements. Text is written
+ * from the bytes read for byte-aligned characters, else from the
+ * elements, up to the first null character.
+ */
+static
+int json_write_elems(struct ctf_text_stream_pos *pos,
+		struct bt_declaration *elem, GPtrArray *elems, uint64_t len,
+		const char *bytes, size_t bytes_len)
+{
+	uint64_t i;
+	char *text;
+	int ret;
+
+	if (json_is_text(elem)) {
+		if (bytes) {
+			json_write_string(pos, bytes, bytes_len);
+			return 0;
+		}
+		text = g_malloc(len);
+
+		for (i = 0; i < len; i++) {
+			struct definition_integer *integer_definition =
+				container_of(g_ptr_array_index(elems, i),
+					struct definition_integer, p);
+
+			text[i] = integer_definition->value._unsigned;
+		}
+		json_write_string(pos, text, len);
+		g_free(text);
+		return 0;
+	}
+	ctf_text_putc(pos, '[');
+	for (i = 0; i < len; i++) {
+		if (i)
+			ctf_text_putc(pos, ',');
+		ret = json_write_definition(pos, g_ptr_array_index(elems, i));
+		if (ret)
+			return ret;
+	}
+	ctf_text_putc(pos, ']');
+	return 0;
+}
+
+static
+int json_write_definition(struct ctf_text_stream_pos *pos,
+		struct bt_definition *definition)
+{
+	unsigned int i;
+	int ret;
+
+	switch (definition->declaration->id) {
+	case CTF_TYPE_INTEGER:
+		json_write_integer(pos, container_of(definition,
+				struct definition_integer, p));
+		break;
+	case CTF_TYPE_FLOAT:
+	{
+		struct definition_float *float_definition =
+			container_of(definition, struct definition_float, p);
+		char str[G_ASCII_DTOSTR_BUF_SIZE];
+
+		if (!isfinite(float_definition->value)) {
+			ctf_text_write(pos, "null", 4);
+			break;
+		}
+		/* JSON numbers use '.' whatever the locale. */
+		ctf_text_puts(pos, g_ascii_formatd(str, sizeof(str), "%.17g",
+			float_definition->value));
+		break;
+	}
+	case CTF_TYPE_ENUM:
+		json_write_enum(pos, container_of(definition,
+				struct definition_enum, p));
+		break;
+	case CTF_TYPE_STRING:
+	{
+		struct definition_string *string_definition =
+			container_of(definition, struct definition_string, p);
+
+		if (!string_definition->value) {
+			ctf_text_write(pos, "null", 4);
+			break;
+		}
+		json_write_string(pos, string_definition->value,
+			strlen(string_definition->value));
+		break;
+	}
+	case CTF_TYPE_STRUCT:
+	{
+		struct definition_struct *struct_definition =
+			container_of(definition, struct definition_struct, p);
+
+		ctf_text_putc(pos, '{');
+		for (i = 0; i < struct_definition->fields->len; i++) {
+			struct bt_definition *field =
+				g_ptr_array_index(struct_definition->fields, i);
+
+			if (i)
+				ctf_text_putc(pos, ',');
+			json_write_key(pos, field->name);
+			ret = json_write_definition(pos, field);
+			if (ret)
+				return ret;
+		}
+		ctf_text_putc(pos, '}');
+		break;
+	}
+	case CTF_TYPE_VARIANT:
+	{
+		struct definition_variant *variant_definition =
+			container_of(definition, struct definition_variant, p);
+		struct bt_definition *field = variant_definition->current_field;
+
+		if (!field) {
+			ctf_text_write(pos, "null", 4);
+			break;
+		}
+		ctf_text_putc(pos, '{');
+		json_write_key(pos, field->name);
+		ret = json_write_definition(pos, field);
+		if (ret)
+			return ret;
+		ctf_text_putc(pos, '}');
+		break;
+	}
+	case CTF_TYPE_ARRAY:
+	{
+		struct definition_array *array_definition =
+			container_of(definition, struct definition_array, p);
+
+		bt_array_bulk_sync(array_definition);
+		return json_write_elems(pos, array_definition->declaration->elem,
+			array_definition->elems,
+			array_definition->declaration->len,
+			array_definition->bytes, array_definition->bytes_len);
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		struct definition_sequence *sequence_definition =
+			container_of(definition, struct definition_sequence, p);
+
+		bt_sequence_bulk_sync(sequence_definition);
+		return json_write_elems(pos,
+			sequence_definition->declaration->elem,
+			sequence_definition->elems,
+			bt_sequence_len(sequence_definition),
+			sequence_definition->bytes,
+			sequence_definition->bytes_len);
+	}
+	default:
+		fprintf(stderr, "[error] Unknown type id: %d\n",
+			definition->declaration->id);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * The members of an event that only depend on its event class are
+ * rendered once per event class, following the --fields options.
+ */
+static
+GString *json_prefix_create(struct ctf_event_declaration *event_class)
+{
+	struct ctf_stream_declaration *stream_class = event_class->stream;
+	struct ctf_trace *trace = stream_class->trace;
+	GString *str;
+
+	str = g_string_new("\"name\":");
+	json_string_append(str, g_quark_to_string(event_class->name));
+	g_string_append_printf(str, ",\"stream_id\":%" PRIu64,
+		stream_class->stream_id);
+	if ((opt_trace_field || opt_all_fields) && trace->parent.path[0] != '\0') {
+		g_string_append(str, ",\"trace\":");
+		json_string_append(str, trace->parent.path);
+	}
+	if ((opt_trace_hostname_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.hostname[0] != '\0') {
+		g_string_append(str, ",\"trace:hostname\":");
+		json_string_append(str, trace->env.hostname);
+	}
+	if ((opt_trace_domain_field || opt_all_fields) && trace->env.domain[0] != '\0') {
+		g_string_append(str, ",\"trace:domain\":");
+		json_string_append(str, trace->env.domain);
+	}
+	if ((opt_trace_procname_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.procname[0] != '\0') {
+		g_string_append(str, ",\"trace:procname\":");
+		json_string_append(str, trace->env.procname);
+	}
+	if ((opt_trace_vpid_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.vpid != -1) {
+		g_string_append_printf(str, ",\"trace:vpid\":%d",
+			trace->env.vpid);
+	}
+	if ((opt_loglevel_field || opt_all_fields) && event_class->loglevel != -1) {
+		g_string_append_printf(str, ",\"loglevel\":%d",
+			event_class->loglevel);
+	}
+	if ((opt_emf_field || opt_all_fields) && event_class->model_emf_uri) {
+		g_string_append(str, ",\"model.emf.uri\":");
+		json_string_append(str,
+			g_quark_to_string(event_class->model_emf_uri));
+	}
+	return str;
+}
+
+static
+void json_prefix_destroy(gpointer data)
+{
+	g_string_free(data, TRUE);
+}
+
+static
+int json_write_scope(struct ctf_text_stream_pos *pos, const char *name,
+		struct definition_struct *definition)
+{
+	if (!definition)
+		return 0;
+	ctf_text_write(pos, ",\"", 2);
+	ctf_text_puts(pos, name);
+	ctf_text_write(pos, "\":", 2);
+	return json_write_definition(pos, &definition->p);
+}
+
+static
+int ctf_json_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_json_stream_pos *json_pos =
+		container_of(ppos, struct ctf_json_stream_pos, parent.parent);
+	struct ctf_text_stream_pos *pos = &json_pos->parent;
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	GString *prefix;
+	uint64_t id, written;
+	size_t start;
+	int ret;
+
+	id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return -EINVAL;
+	}
+	event = g_ptr_array_index(stream->events_by_id, id);
+	if (!event) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+
+	prefix = g_hash_table_lookup(json_pos->prefixes, event_class);
+	if (unlikely(!prefix)) {
+		prefix = json_prefix_create(event_class);
+		g_hash_table_insert(json_pos->prefixes, event_class, prefix);
+	}
+
+	/* Read event payload */
+	ret = ctf_decode_event_fields(event);
+	if (ret)
+		goto error;
+
+	start = pos->buf_len;
+	written = pos->written;
+	ctf_text_putc(pos, '{');
+	if (stream->has_timestamp) {
+		ctf_text_write(pos, "\"timestamp\":", 12);
+		if (opt_clock_cycles)
+			ctf_text_print_uint(pos, stream->cycles_timestamp);
+		else
+			ctf_text_print_uint(pos, stream->real_timestamp);
+		ctf_text_putc(pos, ',');
+	}
+	ctf_text_write(pos, prefix->str, prefix->len);
+	ret = json_write_scope(pos, "stream.packet.context",
+			stream->stream_packet_context);
+	if (ret)
+		goto error_event;
+	/* Only write the event header in verbose mode, as text does. */
+	if (babeltrace_verbose) {
+		ret = json_write_scope(pos, "stream.event.header",
+				stream->stream_event_header);
+		if (ret)
+			goto error_event;
+	}
+	ret = json_write_scope(pos, "stream.event.context",
+			stream->stream_event_context);
+	if (ret)
+		goto error_event;
+	ret = json_write_scope(pos, "event.context", event->event_context);
+	if (ret)
+		goto error_event;
+	ret = json_write_scope(pos, "event.fields", event->event_fields);
+	if (ret)
+		goto error_event;
+	ctf_text_write(pos, "}\n", 2);
+	if (pos->flush_events)
+		(void) ctf_text_flush(pos);
+	if (unlikely(pos->error))
+		return -pos->error;
+	return 0;
+
+error_event:
+	/*
+	 * Drop the partial event, so that every line stays a JSON
+	 * object. If part of it was already written out, end its line.
+	 */
+	if (pos->written == written)
+		pos->buf_len = start;
+	else
+		ctf_text_putc(pos, '\n');
+error:
+	fprintf(stderr, "[error] Unexpected end of stream. Either the trace data stream is corrupted or metadata description does not match data layout.\n");
+	return ret;
+}
+
+static
+struct bt_trace_descriptor *ctf_json_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	struct ctf_json_stream_pos *json_pos;
+	struct ctf_text_stream_pos *pos;
+	FILE *fp;
+
+	json_pos = g_new0(struct ctf_json_stream_pos, 1);
+	pos = &json_pos->parent;
+
+	pos->last_real_timestamp = -1ULL;
+	pos->last_cycles_timestamp = -1ULL;
+	switch (flags & O_ACCMODE) {
+	case O_RDWR:
+		if (!path)
+			fp = stdout;
+		else
+			fp = fopen(path, "w");
+		if (!fp)
+			goto error;
+		pos->fp = fp;
+		pos->buf_size = CTF_TEXT_BUF_SIZE;
+		pos->buf = g_malloc(pos->buf_size);
+		json_pos->prefixes = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, json_prefix_destroy);
+		/* Keep terminal output interleaved with warnings. */
+		pos->flush_events = isatty(fileno(fp));
+		pos->parent.rw_table = NULL;
+		pos->parent.event_cb = ctf_json_write_event;
+		pos->parent.trace = &pos->trace_descriptor;
+		babeltrace_ctf_console_output++;
+		break;
+	case O_RDONLY:
+	default:
+		fprintf(stderr, "[error] Incorrect open flags.\n");
+		goto error;
+	}
+
+	return &pos->trace_descriptor;
+error:
+	g_free(json_pos);
+	return NULL;
+}
+
+static
+int ctf_json_close_trace(struct bt_trace_descriptor *td)
+{
+	int ret, flush_ret;
+	struct ctf_json_stream_pos *json_pos =
+		container_of(td, struct ctf_json_stream_pos,
+			parent.trace_descriptor);
+	struct ctf_text_stream_pos *pos = &json_pos->parent;
+
+	babeltrace_ctf_console_output--;
+	flush_ret = ctf_text_flush(pos);
+	/* Output written to fp directly, as by conversion jobs, too. */
+	if (!pos->error && fflush(pos->fp)) {
+		pos->error = errno;
+		perror("Error on fflush");
+	}
+	if (pos->error)
+		flush_ret = -1;
+	g_free(pos->buf);
+	g_hash_table_destroy(json_pos->prefixes);
+	if (pos->fp != stdout) {
+		ret = fclose(pos->fp);
+		if (ret) {
+			perror("Error on fclose");
+			return -1;
+		}
+	}
+	g_free(json_pos);
+	return flush_ret;
+}
+
+static
+void __attribute__((constructor)) ctf_json_init(void)
+{
+	int ret;
+
+	ctf_json_format.name = g_quark_from_static_string("json");
+	ret = bt_register_format(&ctf_json_format);
+	assert(!ret);
+}
+
+static
+void __attribute__((destructor)) ctf_json_exit(void)
+{
+	bt_unregister_format(&ctf_json_format);
+}
@@ -31,6 +31,8 @@
 #include <babeltrace/ctf/metadata.h>
 #include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/iterator.h>
 #include <inttypes.h>
 #include <sys/mman.h>
 #include <errno.h>
@@ -41,6 +43,8 @@
 #include <glib.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #define NSEC_PER_SEC 1000000000ULL
 
@@ -161,36 +165,144 @@ int print_field(struct bt_definition *definition)
 }
 
 static
-void set_field_names_print(struct ctf_text_stream_pos *pos, enum field_item item)
+int text_write_out(struct ctf_text_stream_pos *pos, const char *s, size_t len)
+{
+	ssize_t ret;
+	int fd;
+
+	if (pos->error)
+		return -1;
+	/* Anything written to fp directly goes out first. */
+	if (fflush(pos->fp)) {
+		pos->error = errno;
+		perror("Error on fflush");
+		return -1;
+	}
+	fd = fileno(pos->fp);
+	while (len) {
+		ret = write(fd, s, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			pos->error = errno;
+			perror("Error on write");
+			return -1;
+		}
+		s += ret;
+		len -= ret;
+		pos->written += ret;
+	}
+	return 0;
+}
+
+int ctf_text_flush(struct ctf_text_stream_pos *pos)
+{
+	int ret;
+
+	/* Workers keep their output. */
+	if (!pos->buf_len || !pos->fp)
+		return 0;
+	ret = text_write_out(pos, pos->buf, pos->buf_len);
+	pos->buf_len = 0;
+	return ret;
+}
+
+void ctf_text_write_slow(struct ctf_text_stream_pos *pos, const char *s,
+		size_t len)
+{
+	if (!pos->fp) {
+		pos->buf_size = MAX(pos->buf_size * 2, pos->buf_len + len);
+		pos->buf = g_realloc(pos->buf, pos->buf_size);
+		memcpy(pos->buf + pos->buf_len, s, len);
+		pos->buf_len += len;
+		return;
+	}
+	(void) ctf_text_flush(pos);
+	if (len > pos->buf_size) {
+		(void) text_write_out(pos, s, len);
+		return;
+	}
+	memcpy(pos->buf, s, len);
+	pos->buf_len = len;
+}
+
+void ctf_text_printf(struct ctf_text_stream_pos *pos, const char *fmt, ...)
+{
+	char str[256];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(str, sizeof(str), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len < sizeof(str)) {
+		ctf_text_write(pos, str, len);
+	} else {
+		char *long_str;
+
+		va_start(ap, fmt);
+		long_str = g_strdup_vprintf(fmt, ap);
+		va_end(ap);
+		ctf_text_write(pos, long_str, len);
+		g_free(long_str);
+	}
+}
+
+/*
+ * Integers are formatted backwards from the end of a buffer large
+ * enough for the longest 64-bit value.
+ */
+void ctf_text_print_uint(struct ctf_text_stream_pos *pos, uint64_t v)
+{
+	char str[20], *p = str + sizeof(str);
+
+	do {
+		*--p = '0' + (v % 10);
+		v /= 10;
+	} while (v);
+	ctf_text_write(pos, p, str + sizeof(str) - p);
+}
+
+void ctf_text_print_int(struct ctf_text_stream_pos *pos, int64_t v)
+{
+	if (v < 0) {
+		ctf_text_putc(pos, '-');
+		/* Negate as unsigned: INT64_MIN has no positive value. */
+		ctf_text_print_uint(pos, -(uint64_t) v);
+	} else {
+		ctf_text_print_uint(pos, v);
+	}
+}
+
+void ctf_text_print_hex(struct ctf_text_stream_pos *pos, uint64_t v)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	char str[16], *p = str + sizeof(str);
+
+	do {
+		*--p = digits[v & 0xF];
+		v >>= 4;
+	} while (v);
+	ctf_text_write(pos, p, str + sizeof(str) - p);
+}
+
+static
+int field_names_print(enum field_item item)
 {
 	switch (item) {
 	case ITEM_SCOPE:
-		if (opt_all_field_names || opt_scope_field_names)
-			pos->print_names = 1;
-		else
-			pos->print_names = 0;
-		break;
+		return opt_all_field_names || opt_scope_field_names;
 	case ITEM_HEADER:
-		if (opt_all_field_names || opt_header_field_names)
-			pos->print_names = 1;
-		else
-			pos->print_names = 0;
-		break;
+		return opt_all_field_names || opt_header_field_names;
 	case ITEM_CONTEXT:
-		if (opt_all_field_names || opt_context_field_names)
-			pos->print_names = 1;
-		else
-			pos->print_names = 0;
-		break;
+		return opt_all_field_names || opt_context_field_names;
 	case ITEM_PAYLOAD:
-		if (opt_all_field_names || opt_payload_field_names)
-			pos->print_names = 1;
-		else
-			pos->print_names = 0;
-
-		break;
+		return opt_all_field_names || opt_payload_field_names;
 	default:
 		assert(0);
+		return 0;
 	}
 }
 
@@ -236,166 +348,195 @@ const char *print_loglevel(int value)
 }
 
 static
-int ctf_text_write_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *stream)
-			 
+void ctf_text_print_timestamp(struct ctf_text_stream_pos *pos,
+		struct ctf_stream_definition *stream, uint64_t timestamp)
 {
-	struct ctf_text_stream_pos *pos =
-		container_of(ppos, struct ctf_text_stream_pos, parent);
-	struct ctf_stream_declaration *stream_class = stream->stream_class;
-	int field_nr_saved;
-	struct ctf_event_declaration *event_class;
-	struct ctf_event_definition *event;
-	uint64_t id;
-	int ret;
-	int dom_print = 0;
+	char str[CTF_TIMESTAMP_STR_LEN];
 
-	id = stream->event_id;
+	ctf_text_write(pos, str, ctf_format_timestamp(str, stream, timestamp));
+}
 
-	if (id >= stream_class->events_by_id->len) {
-		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
-		return -EINVAL;
-	}
-	event = g_ptr_array_index(stream->events_by_id, id);
-	if (!event) {
-		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
-		return -EINVAL;
-	}
-	event_class = g_ptr_array_index(stream_class->events_by_id, id);
-	if (!event_class) {
-		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
-		return -EINVAL;
+/* Print nsec as 9 digits, zero-padded. */
+static
+void ctf_text_print_nsec(struct ctf_text_stream_pos *pos, uint64_t nsec)
+{
+	char str[9];
+	int i;
+
+	for (i = 8; i >= 0; i--) {
+		str[i] = '0' + (nsec % 10);
+		nsec /= 10;
 	}
+	ctf_text_write(pos, str, sizeof(str));
+}
 
-	if (stream->has_timestamp) {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names)
-			fprintf(pos->fp, "timestamp = ");
-		else
-			fprintf(pos->fp, "[");
-		if (opt_clock_cycles) {
-			ctf_print_timestamp(pos->fp, stream, stream->cycles_timestamp);
-		} else {
-			ctf_print_timestamp(pos->fp, stream, stream->real_timestamp);
-		}
-		if (!pos->print_names)
-			fprintf(pos->fp, "]");
+/*
+ * Output template of an event class. Everything that only depends on
+ * the event class, its trace and the output options (field selection,
+ * field names, scope labels) is rendered once into literals, which are
+ * interleaved with ops printing the per-event data.
+ */
+enum text_op_type {
+	TEXT_OP_LITERAL,	/* static event fields */
+	TEXT_OP_TIMESTAMP,	/* event timestamp */
+	TEXT_OP_DELTA,		/* time since the previous event */
+	TEXT_OP_SCOPE,		/* fields of a dynamic scope */
+};
 
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
-		else
-			fprintf(pos->fp, " ");
-	}
-	if (opt_delta_field && stream->has_timestamp) {
-		uint64_t delta, delta_sec, delta_nsec;
+enum text_scope {
+	TEXT_SCOPE_STREAM_PACKET_CONTEXT,
+	TEXT_SCOPE_STREAM_EVENT_HEADER,
+	TEXT_SCOPE_STREAM_EVENT_CONTEXT,
+	TEXT_SCOPE_EVENT_CONTEXT,
+	TEXT_SCOPE_EVENT_FIELDS,
+};
 
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names)
-			fprintf(pos->fp, "delta = ");
-		else
-			fprintf(pos->fp, "(");
-		if (pos->last_real_timestamp != -1ULL) {
-			delta = stream->real_timestamp - pos->last_real_timestamp;
-			delta_sec = delta / NSEC_PER_SEC;
-			delta_nsec = delta % NSEC_PER_SEC;
-			fprintf(pos->fp, "+%" PRIu64 ".%09" PRIu64,
-				delta_sec, delta_nsec);
-		} else {
-			fprintf(pos->fp, "+?.?????????");
-		}
-		if (!pos->print_names)
-			fprintf(pos->fp, ")");
+struct text_op {
+	enum text_op_type type;
+	GString *before;		/* printed before the value */
+	GString *after;			/* printed after the value */
+	int field_nr;			/* LITERAL: fields printed */
+	enum text_scope scope;		/* SCOPE: scope printed */
+	int print_names;		/* SCOPE: print field names */
+};
 
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
-		else
-			fprintf(pos->fp, " ");
-		pos->last_real_timestamp = stream->real_timestamp;
-		pos->last_cycles_timestamp = stream->cycles_timestamp;
+struct text_template {
+	GArray *ops;			/* Array of struct text_op */
+};
+
+static
+void text_template_destroy(gpointer data)
+{
+	struct text_template *tmpl = data;
+	unsigned int i;
+
+	for (i = 0; i < tmpl->ops->len; i++) {
+		struct text_op *op = &g_array_index(tmpl->ops,
+				struct text_op, i);
+
+		g_string_free(op->before, TRUE);
+		g_string_free(op->after, TRUE);
 	}
+	g_array_free(tmpl->ops, TRUE);
+	g_free(tmpl);
+}
+
+static
+struct text_op *text_template_add(struct text_template *tmpl,
+		enum text_op_type type, const char *before, const char *after)
+{
+	struct text_op op;
+
+	memset(&op, 0, sizeof(op));
+	op.type = type;
+	op.before = g_string_new(before);
+	op.after = g_string_new(after);
+	g_array_append_val(tmpl->ops, op);
+	return &g_array_index(tmpl->ops, struct text_op, tmpl->ops->len - 1);
+}
+
+static
+void text_template_add_scope(struct text_template *tmpl,
+		enum text_scope scope, const char *label,
+		enum field_item item)
+{
+	struct text_op *op;
+
+	op = text_template_add(tmpl, TEXT_OP_SCOPE,
+			field_names_print(ITEM_SCOPE) ? label : "", "");
+	op->scope = scope;
+	op->print_names = field_names_print(item);
+}
+
+/*
+ * Render the event fields which do not change from one event of the
+ * class to the next: trace environment, log level, EMF URI, callsites
+ * and event name.
+ */
+static
+void text_template_static_fields(GString *str, int *field_nr,
+		struct ctf_stream_declaration *stream_class,
+		struct ctf_event_declaration *event_class)
+{
+	int print_names = field_names_print(ITEM_HEADER);
+	int dom_print = 0;
 
 	if ((opt_trace_field || opt_all_fields) && stream_class->trace->parent.path[0] != '\0') {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "trace = ");
+		if (print_names) {
+			g_string_append(str, "trace = ");
 		}
-		fprintf(pos->fp, "%s", stream_class->trace->parent.path);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		g_string_append(str, stream_class->trace->parent.path);
+		if (print_names)
+			g_string_append(str, ", ");
 		else
-			fprintf(pos->fp, " ");
+			g_string_append_c(str, ' ');
 	}
 	if ((opt_trace_hostname_field || opt_all_fields || opt_trace_default_fields)
 			&& stream_class->trace->env.hostname[0] != '\0') {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "trace:hostname = ");
+		if (print_names) {
+			g_string_append(str, "trace:hostname = ");
 		}
-		fprintf(pos->fp, "%s", stream_class->trace->env.hostname);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		g_string_append(str, stream_class->trace->env.hostname);
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_trace_domain_field || opt_all_fields) && stream_class->trace->env.domain[0] != '\0') {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "trace:domain = ");
+		if (print_names) {
+			g_string_append(str, "trace:domain = ");
 		}
-		fprintf(pos->fp, "%s", stream_class->trace->env.domain);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		g_string_append(str, stream_class->trace->env.domain);
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_trace_procname_field || opt_all_fields || opt_trace_default_fields)
 			&& stream_class->trace->env.procname[0] != '\0') {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "trace:procname = ");
+		if (print_names) {
+			g_string_append(str, "trace:procname = ");
 		} else if (dom_print) {
-			fprintf(pos->fp, ":");
+			g_string_append_c(str, ':');
 		}
-		fprintf(pos->fp, "%s", stream_class->trace->env.procname);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		g_string_append(str, stream_class->trace->env.procname);
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_trace_vpid_field || opt_all_fields || opt_trace_default_fields)
 			&& stream_class->trace->env.vpid != -1) {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "trace:vpid = ");
+		if (print_names) {
+			g_string_append(str, "trace:vpid = ");
 		} else if (dom_print) {
-			fprintf(pos->fp, ":");
+			g_string_append_c(str, ':');
 		}
-		fprintf(pos->fp, "%d", stream_class->trace->env.vpid);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		g_string_append_printf(str, "%d", stream_class->trace->env.vpid);
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_loglevel_field || opt_all_fields) && event_class->loglevel != -1) {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "loglevel = ");
+		if (print_names) {
+			g_string_append(str, "loglevel = ");
 		} else if (dom_print) {
-			fprintf(pos->fp, ":");
+			g_string_append_c(str, ':');
 		}
-		fprintf(pos->fp, "%s (%d)",
+		g_string_append_printf(str, "%s (%d)",
 			print_loglevel(event_class->loglevel),
 			event_class->loglevel);
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_emf_field || opt_all_fields) && event_class->model_emf_uri) {
-		set_field_names_print(pos, ITEM_HEADER);
-		if (pos->print_names) {
-			fprintf(pos->fp, "model.emf.uri = ");
+		if (print_names) {
+			g_string_append(str, "model.emf.uri = ");
 		} else if (dom_print) {
-			fprintf(pos->fp, ":");
+			g_string_append_c(str, ':');
 		}
-		fprintf(pos->fp, "\"%s\"",
+		g_string_append_printf(str, "\"%s\"",
 			g_quark_to_string(event_class->model_emf_uri));
-		if (pos->print_names)
-			fprintf(pos->fp, ", ");
+		if (print_names)
+			g_string_append(str, ", ");
 		dom_print = 1;
 	}
 	if ((opt_callsite_field || opt_all_fields)) {
@@ -407,127 +548,264 @@ int ctf_text_write_event(struct bt_stream_pos *ppos, struct ctf_stream_definitio
 		if (cs_dups) {
 			int i = 0;
 
-			set_field_names_print(pos, ITEM_HEADER);
-			if (pos->print_names) {
-				fprintf(pos->fp, "callsite = ");
+			if (print_names) {
+				g_string_append(str, "callsite = ");
 			} else if (dom_print) {
-				fprintf(pos->fp, ":");
+				g_string_append_c(str, ':');
 			}
-			fprintf(pos->fp, "[");
+			g_string_append_c(str, '[');
 			bt_list_for_each_entry(callsite, &cs_dups->head, node) {
 				if (i != 0)
-					fprintf(pos->fp, ",");
+					g_string_append_c(str, ',');
 				if (CTF_CALLSITE_FIELD_IS_SET(callsite, ip)) {
-					fprintf(pos->fp, "%s@0x%" PRIx64 ":%s:%" PRIu64 "",
+					g_string_append_printf(str, "%s@0x%" PRIx64 ":%s:%" PRIu64 "",
 						callsite->func, callsite->ip, callsite->file,
 						callsite->line);
 				} else {
-					fprintf(pos->fp, "%s:%s:%" PRIu64 "",
+					g_string_append_printf(str, "%s:%s:%" PRIu64 "",
 						callsite->func, callsite->file,
 						callsite->line);
 				}
 				i++;
 			}
-			fprintf(pos->fp, "]");
-			if (pos->print_names)
-				fprintf(pos->fp, ", ");
+			g_string_append_c(str, ']');
+			if (print_names)
+				g_string_append(str, ", ");
 			dom_print = 1;
 		}
 	}
-	if (dom_print && !pos->print_names)
-		fprintf(pos->fp, " ");
-	set_field_names_print(pos, ITEM_HEADER);
-	if (pos->print_names)
-		fprintf(pos->fp, "name = ");
-	fprintf(pos->fp, "%s", g_quark_to_string(event_class->name));
-	if (pos->print_names)
-		pos->field_nr++;
+	if (dom_print && !print_names)
+		g_string_append_c(str, ' ');
+	if (print_names)
+		g_string_append(str, "name = ");
+	g_string_append(str, g_quark_to_string(event_class->name));
+	if (print_names)
+		(*field_nr)++;
 	else
-		fprintf(pos->fp, ":");
+		g_string_append_c(str, ':');
+}
 
-	/* print cpuid field from packet context */
-	if (stream->stream_packet_context) {
-		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		set_field_names_print(pos, ITEM_SCOPE);
-		if (pos->print_names)
-			fprintf(pos->fp, " stream.packet.context =");
-		field_nr_saved = pos->field_nr;
-		pos->field_nr = 0;
-		set_field_names_print(pos, ITEM_CONTEXT);
-		ret = generic_rw(ppos, &stream->stream_packet_context->p);
-		if (ret)
-			goto error;
-		pos->field_nr = field_nr_saved;
+static
+struct text_template *text_template_create(
+		struct ctf_stream_declaration *stream_class,
+		struct ctf_event_declaration *event_class)
+{
+	struct text_template *tmpl;
+	struct text_op *op;
+	int print_names = field_names_print(ITEM_HEADER);
+
+	tmpl = g_new0(struct text_template, 1);
+	tmpl->ops = g_array_new(FALSE, TRUE, sizeof(struct text_op));
+
+	text_template_add(tmpl, TEXT_OP_TIMESTAMP,
+		print_names ? "timestamp = " : "[",
+		print_names ? ", " : "] ");
+	if (opt_delta_field) {
+		text_template_add(tmpl, TEXT_OP_DELTA,
+			print_names ? "delta = " : "(",
+			print_names ? ", " : ") ");
 	}
+	op = text_template_add(tmpl, TEXT_OP_LITERAL, "", "");
+	text_template_static_fields(op->before, &op->field_nr,
+		stream_class, event_class);
 
+	/* print cpuid field from packet context */
+	text_template_add_scope(tmpl, TEXT_SCOPE_STREAM_PACKET_CONTEXT,
+		" stream.packet.context =", ITEM_CONTEXT);
 	/* Only show the event header in verbose mode */
-	if (babeltrace_verbose && stream->stream_event_header) {
-		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		set_field_names_print(pos, ITEM_SCOPE);
-		if (pos->print_names)
-			fprintf(pos->fp, " stream.event.header =");
-		field_nr_saved = pos->field_nr;
-		pos->field_nr = 0;
-		set_field_names_print(pos, ITEM_CONTEXT);
-		ret = generic_rw(ppos, &stream->stream_event_header->p);
-		if (ret)
-			goto error;
-		pos->field_nr = field_nr_saved;
+	if (babeltrace_verbose) {
+		text_template_add_scope(tmpl, TEXT_SCOPE_STREAM_EVENT_HEADER,
+			" stream.event.header =", ITEM_CONTEXT);
 	}
-
 	/* print stream-declared event context */
-	if (stream->stream_event_context) {
-		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		set_field_names_print(pos, ITEM_SCOPE);
-		if (pos->print_names)
-			fprintf(pos->fp, " stream.event.context =");
-		field_nr_saved = pos->field_nr;
-		pos->field_nr = 0;
-		set_field_names_print(pos, ITEM_CONTEXT);
-		ret = generic_rw(ppos, &stream->stream_event_context->p);
-		if (ret)
-			goto error;
-		pos->field_nr = field_nr_saved;
+	text_template_add_scope(tmpl, TEXT_SCOPE_STREAM_EVENT_CONTEXT,
+		" stream.event.context =", ITEM_CONTEXT);
+	/* print event-declared event context */
+	text_template_add_scope(tmpl, TEXT_SCOPE_EVENT_CONTEXT,
+		" event.context =", ITEM_CONTEXT);
+	/* event payload */
+	text_template_add_scope(tmpl, TEXT_SCOPE_EVENT_FIELDS,
+		" event.fields =", ITEM_PAYLOAD);
+	return tmpl;
+}
+
+/*
+ * Templates are looked up by event class: the traces printed must
+ * outlive the text output, as they do in the converter.
+ */
+static
+struct text_template *text_template_get(struct ctf_text_stream_pos *pos,
+		struct ctf_stream_declaration *stream_class,
+		struct ctf_event_declaration *event_class)
+{
+	struct text_template *tmpl;
+
+	tmpl = g_hash_table_lookup(pos->templates, event_class);
+	if (unlikely(!tmpl)) {
+		tmpl = text_template_create(stream_class, event_class);
+		g_hash_table_insert(pos->templates, event_class, tmpl);
 	}
+	return tmpl;
+}
 
-	/* print event-declared event context */
-	if (event->event_context) {
-		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		set_field_names_print(pos, ITEM_SCOPE);
-		if (pos->print_names)
-			fprintf(pos->fp, " event.context =");
-		field_nr_saved = pos->field_nr;
-		pos->field_nr = 0;
-		set_field_names_print(pos, ITEM_CONTEXT);
-		ret = generic_rw(ppos, &event->event_context->p);
-		if (ret)
-			goto error;
-		pos->field_nr = field_nr_saved;
-	}
-
-	/* Read and print event payload */
-	if (event->event_fields) {
-		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		set_field_names_print(pos, ITEM_SCOPE);
-		if (pos->print_names)
-			fprintf(pos->fp, " event.fields =");
-		field_nr_saved = pos->field_nr;
-		pos->field_nr = 0;
-		set_field_names_print(pos, ITEM_PAYLOAD);
-		ret = generic_rw(ppos, &event->event_fields->p);
-		if (ret)
-			goto error;
-		pos->field_nr = field_nr_saved;
+static
+struct bt_definition *text_scope_definition(
+		struct ctf_stream_definition *stream,
+		struct ctf_event_definition *event, enum text_scope scope)
+{
+	switch (scope) {
+	case TEXT_SCOPE_STREAM_PACKET_CONTEXT:
+		return stream->stream_packet_context ?
+			&stream->stream_packet_context->p : NULL;
+	case TEXT_SCOPE_STREAM_EVENT_HEADER:
+		return stream->stream_event_header ?
+			&stream->stream_event_header->p : NULL;
+	case TEXT_SCOPE_STREAM_EVENT_CONTEXT:
+		return stream->stream_event_context ?
+			&stream->stream_event_context->p : NULL;
+	case TEXT_SCOPE_EVENT_CONTEXT:
+		return event->event_context ?
+			&event->event_context->p : NULL;
+	case TEXT_SCOPE_EVENT_FIELDS:
+		return event->event_fields ?
+			&event->event_fields->p : NULL;
+	default:
+		assert(0);
+		return NULL;
+	}
+}
+
+static
+void text_op_write_delta(struct ctf_text_stream_pos *pos,
+		struct ctf_stream_definition *stream)
+{
+	uint64_t delta, delta_sec, delta_nsec;
+
+	if (pos->last_real_timestamp != -1ULL) {
+		delta = stream->real_timestamp - pos->last_real_timestamp;
+		delta_sec = delta / NSEC_PER_SEC;
+		delta_nsec = delta % NSEC_PER_SEC;
+		ctf_text_putc(pos, '+');
+		ctf_text_print_uint(pos, delta_sec);
+		ctf_text_putc(pos, '.');
+		ctf_text_print_nsec(pos, delta_nsec);
+	} else {
+		ctf_text_puts(pos, "+?.?????????");
+	}
+	pos->last_real_timestamp = stream->real_timestamp;
+	pos->last_cycles_timestamp = stream->cycles_timestamp;
+}
+
+static
+int text_template_write(struct ctf_text_stream_pos *pos,
+		struct text_template *tmpl,
+		struct ctf_stream_definition *stream,
+		struct ctf_event_definition *event)
+{
+	const struct text_op *op, *end;
+	struct bt_definition *definition;
+	int field_nr_saved;
+	int ret;
+
+	op = (const struct text_op *) tmpl->ops->data;
+	end = op + tmpl->ops->len;
+	for (; op < end; op++) {
+		switch (op->type) {
+		case TEXT_OP_LITERAL:
+			ctf_text_write(pos, op->before->str, op->before->len);
+			pos->field_nr += op->field_nr;
+			break;
+		case TEXT_OP_TIMESTAMP:
+			if (!stream->has_timestamp)
+				break;
+			ctf_text_write(pos, op->before->str, op->before->len);
+			if (opt_clock_cycles) {
+				ctf_text_print_timestamp(pos, stream,
+					stream->cycles_timestamp);
+			} else {
+				ctf_text_print_timestamp(pos, stream,
+					stream->real_timestamp);
+			}
+			ctf_text_write(pos, op->after->str, op->after->len);
+			break;
+		case TEXT_OP_DELTA:
+			if (!stream->has_timestamp)
+				break;
+			ctf_text_write(pos, op->before->str, op->before->len);
+			text_op_write_delta(pos, stream);
+			ctf_text_write(pos, op->after->str, op->after->len);
+			break;
+		case TEXT_OP_SCOPE:
+			/* Read event payload */
+			if (op->scope == TEXT_SCOPE_EVENT_FIELDS) {
+				ret = ctf_decode_event_fields(event);
+				if (ret)
+					return ret;
+			}
+			definition = text_scope_definition(stream, event,
+					op->scope);
+			if (!definition)
+				break;
+			if (pos->field_nr++ != 0)
+				ctf_text_putc(pos, ',');
+			ctf_text_write(pos, op->before->str, op->before->len);
+			field_nr_saved = pos->field_nr;
+			pos->field_nr = 0;
+			pos->print_names = op->print_names;
+			ret = generic_rw(&pos->parent, definition);
+			if (ret)
+				return ret;
+			pos->field_nr = field_nr_saved;
+			break;
+		default:
+			assert(0);
+		}
+	}
+	return 0;
+}
+
+static
+int ctf_text_write_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *stream)
+			 
+{
+	struct ctf_text_stream_pos *pos =
+		container_of(ppos, struct ctf_text_stream_pos, parent);
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	struct text_template *tmpl;
+	uint64_t id;
+	int ret;
+
+	id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return -EINVAL;
+	}
+	event = g_ptr_array_index(stream->events_by_id, id);
+	if (!event) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
 	}
+
+	tmpl = text_template_get(pos, stream_class, event_class);
+	ret = text_template_write(pos, tmpl, stream, event);
+	if (ret)
+		goto error;
 	/* newline */
-	fprintf(pos->fp, "\n");
+	ctf_text_putc(pos, '\n');
 	pos->field_nr = 0;
 
+	if (pos->flush_events)
+		(void) ctf_text_flush(pos);
+	if (unlikely(pos->error))
+		return -pos->error;
 	return 0;
 
 error:
@@ -556,6 +834,12 @@ struct bt_trace_descriptor *ctf_text_open_trace(const char *path, int flags,
 		if (!fp)
 			goto error;
 		pos->fp = fp;
+		pos->buf_size = CTF_TEXT_BUF_SIZE;
+		pos->buf = g_malloc(pos->buf_size);
+		pos->templates = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, text_template_destroy);
+		/* Keep terminal output interleaved with warnings. */
+		pos->flush_events = isatty(fileno(fp));
 		pos->parent.rw_table = write_dispatch_table;
 		pos->parent.event_cb = ctf_text_write_event;
 		pos->parent.trace = &pos->trace_descriptor;
@@ -577,11 +861,21 @@ error:
 static
 int ctf_text_close_trace(struct bt_trace_descriptor *td)
 {
-	int ret;
+	int ret, flush_ret;
 	struct ctf_text_stream_pos *pos =
 		container_of(td, struct ctf_text_stream_pos, trace_descriptor);
 
 	babeltrace_ctf_console_output--;
+	flush_ret = ctf_text_flush(pos);
+	/* Output written to fp directly, as by conversion jobs, too. */
+	if (!pos->error && fflush(pos->fp)) {
+		pos->error = errno;
+		perror("Error on fflush");
+	}
+	if (pos->error)
+		flush_ret = -1;
+	g_free(pos->buf);
+	g_hash_table_destroy(pos->templates);
 	if (pos->fp != stdout) {
 		ret = fclose(pos->fp);
 		if (ret) {
@@ -590,7 +884,455 @@ int ctf_text_close_trace(struct bt_trace_descriptor *td)
 		}
 	}
 	g_free(pos);
-	return 0;
+	return flush_ret;
+}
+
+struct ctf_text_stream_pos *ctf_text_worker_create(
+		struct ctf_text_stream_pos *pos)
+{
+	struct ctf_text_stream_pos *worker;
+
+	worker = g_new0(struct ctf_text_stream_pos, 1);
+	worker->last_real_timestamp = -1ULL;
+	worker->last_cycles_timestamp = -1ULL;
+	/* Templates are not shared: each worker creates its own. */
+	worker->templates = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL, text_template_destroy);
+	worker->parent.rw_table = pos->parent.rw_table;
+	worker->parent.event_cb = pos->parent.event_cb;
+	worker->print_names = pos->print_names;
+	return worker;
+}
+
+void ctf_text_worker_destroy(struct ctf_text_stream_pos *worker)
+{
+	g_free(worker->buf);
+	g_hash_table_destroy(worker->templates);
+	g_free(worker);
+}
+
+/*
+ * Parallel text formatting. The thread calling
+ * ctf_text_write_events_threads() reads the events in order, and copies
+ * each of them into a snapshot, which stays valid after the iterator
+ * moves on. Snapshots are handed to the formatter threads in batches,
+ * split into jobs of consecutive events formatted into a buffer of
+ * their own. The writer thread writes out the output of the jobs in
+ * order. Batches go round FORMAT_NR_BATCHES slots, so that reading,
+ * formatting and writing overlap.
+ *
+ * Snapshots are only created, copied into and destroyed by the reading
+ * thread. They are recycled once their batch is written out.
+ */
+#define FORMAT_NR_BATCHES	3
+#define FORMAT_BATCH_EVENTS	1024
+#define FORMAT_JOB_EVENTS	64
+#define FORMAT_NR_JOBS		(FORMAT_BATCH_EVENTS / FORMAT_JOB_EVENTS)
+
+struct format_job {
+	uint64_t last_real_timestamp;	/* before the job, for delta */
+	uint64_t last_cycles_timestamp;
+	char *buf;			/* output of the job */
+	size_t buf_len, buf_size;
+};
+
+struct format_batch {
+	struct ctf_stream_definition *events[FORMAT_BATCH_EVENTS];
+	int nr_events;
+	int nr_jobs;
+	int next_job;			/* next job to format */
+	int nr_done;			/* jobs formatted */
+	struct format_job jobs[FORMAT_NR_JOBS];
+};
+
+struct format_pipeline;
+
+struct format_thread {
+	struct format_pipeline *p;
+	struct ctf_text_stream_pos *worker;
+	pthread_t thread;
+	int started;
+};
+
+struct format_pipeline {
+	struct ctf_text_stream_pos *sout;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* signaled on any progress */
+	struct format_batch batches[FORMAT_NR_BATCHES];
+	uint64_t nr_filled;		/* batches handed to the formatters */
+	uint64_t nr_written;		/* batches written out */
+	int stop;
+	int ret;			/* first formatting error */
+	GHashTable *snapshots;		/* free snapshots by event class */
+	struct format_thread *formatters;
+	int nr_formatters;
+	pthread_t writer;
+	int writer_started;
+};
+
+static
+struct ctf_event_declaration *format_event_class(
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+
+	if (stream->event_id >= stream_class->events_by_id->len)
+		return NULL;
+	return g_ptr_array_index(stream_class->events_by_id, stream->event_id);
+}
+
+static
+void format_free_snapshots(gpointer data)
+{
+	GPtrArray *free_snapshots = data;
+	unsigned int i;
+
+	for (i = 0; i < free_snapshots->len; i++)
+		ctf_event_snapshot_destroy(g_ptr_array_index(free_snapshots, i));
+	g_ptr_array_free(free_snapshots, TRUE);
+}
+
+/*
+ * Copy the last event read from stream into a snapshot, reusing a free
+ * snapshot of its event class if there is one.
+ */
+static
+struct ctf_stream_definition *format_snapshot_get(struct format_pipeline *p,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_event_declaration *event_class;
+	struct ctf_stream_definition *snapshot = NULL;
+	GPtrArray *free_snapshots;
+
+	event_class = format_event_class(stream);
+	if (event_class) {
+		free_snapshots = g_hash_table_lookup(p->snapshots, event_class);
+		if (free_snapshots && free_snapshots->len)
+			snapshot = g_ptr_array_remove_index_fast(free_snapshots,
+					free_snapshots->len - 1);
+	}
+	if (!snapshot) {
+		snapshot = ctf_event_snapshot_create(stream);
+		if (!snapshot)
+			return NULL;
+	}
+	if (ctf_event_snapshot_copy(snapshot, stream)) {
+		fprintf(stderr, "[error] Unable to copy event.\n");
+		ctf_event_snapshot_destroy(snapshot);
+		return NULL;
+	}
+	return snapshot;
+}
+
+static
+void format_snapshot_put(struct format_pipeline *p,
+		struct ctf_stream_definition *snapshot)
+{
+	struct ctf_event_declaration *event_class;
+	GPtrArray *free_snapshots;
+
+	event_class = format_event_class(snapshot);
+	free_snapshots = g_hash_table_lookup(p->snapshots, event_class);
+	if (!free_snapshots) {
+		free_snapshots = g_ptr_array_new();
+		g_hash_table_insert(p->snapshots, event_class, free_snapshots);
+	}
+	g_ptr_array_add(free_snapshots, snapshot);
+}
+
+/*
+ * Format job i of batch with worker. Called without the pipeline lock.
+ */
+static
+int format_job(struct ctf_text_stream_pos *worker, struct format_batch *batch,
+		int i)
+{
+	struct format_job *job = &batch->jobs[i];
+	int j, end, ret = 0;
+
+	worker->buf = job->buf;
+	worker->buf_size = job->buf_size;
+	worker->buf_len = 0;
+	worker->last_real_timestamp = job->last_real_timestamp;
+	worker->last_cycles_timestamp = job->last_cycles_timestamp;
+	end = MIN((i + 1) * FORMAT_JOB_EVENTS, batch->nr_events);
+	for (j = i * FORMAT_JOB_EVENTS; j < end; j++) {
+		ret = worker->parent.event_cb(&worker->parent,
+				batch->events[j]);
+		if (ret) {
+			fprintf(stderr, "[error] Writing event failed.\n");
+			break;
+		}
+	}
+	job->buf = worker->buf;
+	job->buf_size = worker->buf_size;
+	job->buf_len = worker->buf_len;
+	worker->buf = NULL;
+	return ret;
+}
+
+static
+void *format_thread(void *arg)
+{
+	struct format_thread *t = arg;
+	struct format_pipeline *p = t->p;
+	struct format_batch *batch;
+	uint64_t seq;
+	int i, ret;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		batch = NULL;
+		for (seq = p->nr_written; seq < p->nr_filled; seq++) {
+			struct format_batch *b =
+				&p->batches[seq % FORMAT_NR_BATCHES];
+
+			if (b->next_job < b->nr_jobs) {
+				batch = b;
+				break;
+			}
+		}
+		if (batch && !p->ret) {
+			i = batch->next_job++;
+			pthread_mutex_unlock(&p->lock);
+			ret = format_job(t->worker, batch, i);
+			pthread_mutex_lock(&p->lock);
+			if (ret && !p->ret)
+				p->ret = ret;
+			if (++batch->nr_done == batch->nr_jobs)
+				pthread_cond_broadcast(&p->cond);
+			continue;
+		}
+		if (p->stop || p->ret)
+			break;
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+static
+void *format_writer_thread(void *arg)
+{
+	struct format_pipeline *p = arg;
+	struct ctf_text_stream_pos *sout = p->sout;
+	struct format_batch *batch;
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		if (p->ret)
+			break;
+		batch = &p->batches[p->nr_written % FORMAT_NR_BATCHES];
+		if (p->nr_written < p->nr_filled
+				&& batch->nr_done == batch->nr_jobs) {
+			pthread_mutex_unlock(&p->lock);
+			for (i = 0; i < batch->nr_jobs; i++)
+				ctf_text_write(sout, batch->jobs[i].buf,
+					batch->jobs[i].buf_len);
+			if (sout->flush_events)
+				(void) ctf_text_flush(sout);
+			pthread_mutex_lock(&p->lock);
+			if (sout->error && !p->ret)
+				p->ret = -sout->error;
+			p->nr_written++;
+			pthread_cond_broadcast(&p->cond);
+			continue;
+		}
+		if (p->stop)
+			break;
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/*
+ * Return the next batch slot to fill, once it is written out. Returns
+ * NULL if formatting failed.
+ */
+static
+struct format_batch *format_batch_get(struct format_pipeline *p)
+{
+	struct format_batch *batch;
+	int i, ret;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->ret && p->nr_filled - p->nr_written >= FORMAT_NR_BATCHES)
+		pthread_cond_wait(&p->cond, &p->lock);
+	ret = p->ret;
+	pthread_mutex_unlock(&p->lock);
+	if (ret)
+		return NULL;
+	batch = &p->batches[p->nr_filled % FORMAT_NR_BATCHES];
+	for (i = 0; i < batch->nr_events; i++)
+		format_snapshot_put(p, batch->events[i]);
+	batch->nr_events = 0;
+	return batch;
+}
+
+static
+void format_batch_put(struct format_pipeline *p, struct format_batch *batch)
+{
+	batch->nr_jobs = (batch->nr_events + FORMAT_JOB_EVENTS - 1)
+			/ FORMAT_JOB_EVENTS;
+	batch->next_job = 0;
+	batch->nr_done = 0;
+	pthread_mutex_lock(&p->lock);
+	p->nr_filled++;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Wait for the batches handed to the formatters to be written out, or
+ * for an error, and stop the threads.
+ */
+static
+int format_pipeline_stop(struct format_pipeline *p)
+{
+	int i, ret;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->ret && p->nr_written < p->nr_filled)
+		pthread_cond_wait(&p->cond, &p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	ret = p->ret;
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 0; i < p->nr_formatters; i++) {
+		if (p->formatters[i].started)
+			pthread_join(p->formatters[i].thread, NULL);
+		p->formatters[i].started = 0;
+	}
+	if (p->writer_started)
+		pthread_join(p->writer, NULL);
+	p->writer_started = 0;
+	return ret;
+}
+
+static
+void format_pipeline_destroy(struct format_pipeline *p)
+{
+	int i, j;
+
+	(void) format_pipeline_stop(p);
+	for (i = 0; i < FORMAT_NR_BATCHES; i++) {
+		struct format_batch *batch = &p->batches[i];
+
+		for (j = 0; j < batch->nr_events; j++)
+			ctf_event_snapshot_destroy(batch->events[j]);
+		for (j = 0; j < FORMAT_NR_JOBS; j++)
+			g_free(batch->jobs[j].buf);
+	}
+	g_hash_table_destroy(p->snapshots);
+	for (i = 0; i < p->nr_formatters; i++)
+		ctf_text_worker_destroy(p->formatters[i].worker);
+	g_free(p->formatters);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	g_free(p);
+}
+
+static
+struct format_pipeline *format_pipeline_create(struct ctf_text_stream_pos *sout,
+		int nr_formatters)
+{
+	struct format_pipeline *p;
+	int i;
+
+	p = g_new0(struct format_pipeline, 1);
+	p->sout = sout;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->snapshots = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, format_free_snapshots);
+	p->formatters = g_new0(struct format_thread, nr_formatters);
+	p->nr_formatters = nr_formatters;
+	for (i = 0; i < p->nr_formatters; i++) {
+		p->formatters[i].p = p;
+		p->formatters[i].worker = ctf_text_worker_create(sout);
+	}
+	for (i = 0; i < p->nr_formatters; i++) {
+		if (pthread_create(&p->formatters[i].thread, NULL,
+				format_thread, &p->formatters[i]))
+			goto error;
+		p->formatters[i].started = 1;
+	}
+	if (pthread_create(&p->writer, NULL, format_writer_thread, p))
+		goto error;
+	p->writer_started = 1;
+	return p;
+
+error:
+	perror("pthread_create");
+	format_pipeline_destroy(p);
+	return NULL;
+}
+
+int ctf_text_write_events_threads(struct ctf_text_stream_pos *sout,
+		struct bt_ctf_iter *iter, int nr_threads)
+{
+	struct format_pipeline *p;
+	struct format_batch *batch = NULL;
+	struct bt_ctf_event *ctf_event;
+	uint64_t last_real, last_cycles;
+	int ret = 0;
+
+	p = format_pipeline_create(sout, nr_threads);
+	if (!p)
+		return -1;
+	last_real = sout->last_real_timestamp;
+	last_cycles = sout->last_cycles_timestamp;
+	while ((ctf_event = bt_ctf_iter_read_event(iter))) {
+		struct ctf_stream_definition *stream = ctf_event->parent->stream;
+		struct ctf_stream_definition *snapshot;
+
+		if (!batch) {
+			batch = format_batch_get(p);
+			if (!batch) {
+				ret = -1;
+				break;
+			}
+		}
+		if (!(batch->nr_events % FORMAT_JOB_EVENTS)) {
+			struct format_job *job =
+				&batch->jobs[batch->nr_events / FORMAT_JOB_EVENTS];
+
+			job->last_real_timestamp = last_real;
+			job->last_cycles_timestamp = last_cycles;
+		}
+		snapshot = format_snapshot_get(p, stream);
+		if (!snapshot) {
+			fprintf(stderr, "[error] Writing event failed.\n");
+			ret = -1;
+			break;
+		}
+		batch->events[batch->nr_events++] = snapshot;
+		/* Timestamps the delta field is printed from. */
+		if (opt_delta_field && stream->has_timestamp) {
+			last_real = stream->real_timestamp;
+			last_cycles = stream->cycles_timestamp;
+		}
+		if (batch->nr_events == FORMAT_BATCH_EVENTS) {
+			format_batch_put(p, batch);
+			batch = NULL;
+		}
+		ret = bt_iter_next(bt_ctf_get_iter(iter));
+		if (ret < 0)
+			break;
+		ret = 0;
+	}
+	/* Write out the events read before an error too. */
+	if (batch && batch->nr_events)
+		format_batch_put(p, batch);
+	if (format_pipeline_stop(p) && !ret)
+		ret = -1;
+	format_pipeline_destroy(p);
+	sout->last_real_timestamp = last_real;
+	sout->last_cycles_timestamp = last_cycles;
+	return ret;
 }
 
 static
@@ -45,11 +45,10 @@ int ctf_text_array_write(struct bt_stream_pos *ppos, struct bt_definition *defin
 
 	if (!pos->dummy) {
 		if (pos->field_nr++ != 0)
-			fprintf(pos->fp, ",");
-		fprintf(pos->fp, " ");
+			ctf_text_putc(pos, ',');
+		ctf_text_putc(pos, ' ');
 		if (pos->print_names)
-			fprintf(pos->fp, "%s = ",
-				rem_(g_quark_to_string(definition->name)));
+			print_field_name(pos, definition->name);
 	}
 
 	if (elem->id == CTF_TYPE_INTEGER) {
@@ -65,14 +64,21 @@ int ctf_text_array_write(struct bt_stream_pos *ppos, struct bt_definition *defin
 				g_string_assign(array_definition->string, "");
 				ret = bt_array_rw(ppos, definition);
 				pos->string = NULL;
+			} else if (opt_zero_copy) {
+				ctf_text_putc(pos, '"');
+				ctf_text_write(pos, array_definition->bytes,
+					strnlen(array_definition->bytes,
+						array_definition->bytes_len));
+				ctf_text_putc(pos, '"');
+				return ret;
 			}
-			fprintf(pos->fp, "\"%s\"", array_definition->string->str);
+			print_quoted(pos, array_definition->string->str);
 			return ret;
 		}
 	}
 
 	if (!pos->dummy) {
-		fprintf(pos->fp, "[");
+		ctf_text_putc(pos, '[');
 		pos->depth++;
 	}
 	field_nr_saved = pos->field_nr;
@@ -80,7 +86,7 @@ int ctf_text_array_write(struct bt_stream_pos *ppos, struct bt_definition *defin
 	ret = bt_array_rw(ppos, definition);
 	if (!pos->dummy) {
 		pos->depth--;
-		fprintf(pos->fp, " ]");
+		ctf_text_puts(pos, " ]");
 	}
 	pos->field_nr = field_nr_saved;
 	return ret;
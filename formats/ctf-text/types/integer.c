@@ -47,11 +47,10 @@ int ctf_text_integer_write(struct bt_stream_pos *ppos, struct bt_definition *def
 		return 0;
 
 	if (pos->field_nr++ != 0)
-		fprintf(pos->fp, ",");
-	fprintf(pos->fp, " ");
+		ctf_text_putc(pos, ',');
+	ctf_text_putc(pos, ' ');
 	if (pos->print_names)
-		fprintf(pos->fp, "%s = ",
-			rem_(g_quark_to_string(definition->name)));
+		print_field_name(pos, definition->name);
 
 	if (pos->string
 	    && (integer_declaration->encoding == CTF_STRING_ASCII
@@ -71,10 +70,10 @@ int ctf_text_integer_write(struct bt_stream_pos *ppos, struct bt_definition *def
 	case 0:	/* default */
 	case 10:
 		if (!integer_declaration->signedness) {
-			fprintf(pos->fp, "%" PRIu64,
+			ctf_text_print_uint(pos,
 				integer_definition->value._unsigned);
 		} else {
-			fprintf(pos->fp, "%" PRId64,
+			ctf_text_print_int(pos,
 				integer_definition->value._signed);
 		}
 		break;
@@ -88,10 +87,10 @@ int ctf_text_integer_write(struct bt_stream_pos *ppos, struct bt_definition *def
 		else
 			v = (uint64_t) integer_definition->value._signed;
 
-		fprintf(pos->fp, "0b");
+		ctf_text_puts(pos, "0b");
 		v = _bt_piecewise_lshift(v, 64 - integer_declaration->len);
 		for (bitnr = 0; bitnr < integer_declaration->len; bitnr++) {
-			fprintf(pos->fp, "%u", (v & (1ULL << 63)) ? 1 : 0);
+			ctf_text_putc(pos, (v & (1ULL << 63)) ? '1' : '0');
 			v = _bt_piecewise_lshift(v, 1);
 		}
 		break;
@@ -105,7 +104,7 @@ int ctf_text_integer_write(struct bt_stream_pos *ppos, struct bt_definition *def
 		else
 			v = (uint64_t) integer_definition->value._signed;
 
-		fprintf(pos->fp, "0%" PRIo64, v);
+		ctf_text_printf(pos, "0%" PRIo64, v);
 		break;
 	}
 	case 16:
@@ -122,7 +121,8 @@ int ctf_text_integer_write(struct bt_stream_pos *ppos, struct bt_definition *def
 			v &= ((uint64_t) 1 << rounded_len) - 1;
 		}
 
-		fprintf(pos->fp, "0x%" PRIX64, v);
+		ctf_text_puts(pos, "0x");
+		ctf_text_print_hex(pos, v);
 		break;
 	}
 	default:
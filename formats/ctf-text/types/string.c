@@ -47,12 +47,11 @@ int ctf_text_string_write(struct bt_stream_pos *ppos,
 		return 0;
 
 	if (pos->field_nr++ != 0)
-		fprintf(pos->fp, ",");
-	fprintf(pos->fp, " ");
+		ctf_text_putc(pos, ',');
+	ctf_text_putc(pos, ' ');
 	if (pos->print_names)
-		fprintf(pos->fp, "%s = ",
-			rem_(g_quark_to_string(definition->name)));
+		print_field_name(pos, definition->name);
 
-	fprintf(pos->fp, "\"%s\"", string_definition->value);
+	print_quoted(pos, string_definition->value);
 	return 0;
 }
@@ -67,6 +67,27 @@ struct bt_dependencies *bt_dependencies_create(const char *first, ...)
 	return deps;
 }
 
+/*
+ * Add an event name to the event filter of iter.
+ */
+static
+int iter_filter_event(struct bt_ctf_iter *iter, GQuark event)
+{
+	GArray *names = iter->event_filter.names;
+	int i, ret;
+
+	for (i = 0; i < names->len; i++) {
+		if (g_array_index(names, GQuark, i) == event)
+			return 0;
+	}
+	bt_iter_stop_decoders(&iter->parent);
+	g_array_append_val(names, event);
+	ret = ctf_iter_update_event_filter(iter);
+	if (ret)
+		g_array_set_size(names, names->len - 1);
+	return ret;
+}
+
 /*
  * bt_ctf_iter_add_callback: Add a callback to CTF iterator.
  */
@@ -78,13 +99,20 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 		struct bt_dependencies *weak_depends,
 		struct bt_dependencies *provides)
 {
-	int i, stream_id;
+	int i, stream_id, ret;
 	gpointer *event_id_ptr;
 	unsigned long event_id;
 	struct trace_collection *tc;
 
 	if (!iter || !callback)
 		return -EINVAL;
+	if (flags & BT_FLAGS_FILTER_EVENTS) {
+		if (!event)
+			return -EINVAL;
+		ret = iter_filter_event(iter, event);
+		if (ret)
+			return ret;
+	}
 
 	tc = iter->parent.ctx->tc;
 	for (i = 0; i < tc->array->len; i++) {
@@ -34,8 +34,11 @@
 #include <babeltrace/trace-handle-internal.h>
 #include <babeltrace/context-internal.h>
 #include <babeltrace/compat/uuid.h>
+#include <babeltrace/compat/stat.h>
 #include <babeltrace/endian.h>
 #include <babeltrace/ctf/ctf-index.h>
+#include <babeltrace/ctf/decode-program.h>
+#include <babeltrace/ctf/packet-loader.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <sys/mman.h>
@@ -47,6 +50,7 @@
 #include <glib.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "metadata/ctf-scanner.h"
 #include "metadata/ctf-parser.h"
@@ -74,13 +78,40 @@
 
 #define INDEX_PATH "./index/%s.idx"
 
+/*
+ * Address space budget for whole-file mappings, in bytes. Stream files
+ * which do not fit in the remaining budget use per-packet mappings.
+ */
+#define FILE_MAP_BUDGET		(sizeof(void *) >= 8 ? \
+					(1ULL << 42) : (512ULL << 20))
+
+/*
+ * Number of packets read ahead of the current packet of each stream,
+ * by default.
+ */
+#define DEFAULT_READAHEAD_PACKETS	4
+
 int opt_clock_cycles,
 	opt_clock_seconds,
 	opt_clock_date,
-	opt_clock_gmt;
+	opt_clock_gmt,
+	opt_map_whole_file,
+	opt_no_index_cache,
+	opt_zero_copy,
+	opt_lazy_payload,
+	opt_read_packets,
+	opt_decode_threads;
+
+/*
+ * Address space used by whole-file mappings. Traces may be opened and
+ * closed from several threads: protected by file_map_budget_mutex.
+ */
+static uint64_t file_map_budget_used;
+static pthread_mutex_t file_map_budget_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 uint64_t opt_clock_offset;
 uint64_t opt_clock_offset_ns;
+int opt_readahead_packets = DEFAULT_READAHEAD_PACKETS;
 
 extern int yydebug;
 
@@ -310,15 +341,54 @@ void ctf_update_timestamp(struct ctf_stream_definition *stream,
 }
 
 /*
- * Print timestamp, rescaling clock frequency to nanoseconds and
+ * Format v in decimal, left-padded with pad up to width characters.
+ * Returns the number of characters written (not NUL-terminated).
+ */
+static
+size_t format_digits(char *buf, uint64_t v, int width, char pad)
+{
+	char digits[20];
+	int nr_digits = 0;
+	size_t len = 0;
+
+	do {
+		digits[nr_digits++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (width-- > nr_digits)
+		buf[len++] = pad;
+	while (nr_digits)
+		buf[len++] = digits[--nr_digits];
+	return len;
+}
+
+/*
+ * Date and time of day of the last second formatted, so the time zone
+ * lookup and broken-down time computation are done once per second of
+ * trace rather than once per event.
+ */
+struct timestamp_cache {
+	int valid;
+	int gmt, date;			/* options it was formatted with */
+	uint64_t sec;
+	char prefix[CTF_TIMESTAMP_STR_LEN];	/* "[date ]HH:MM:SS." */
+	size_t prefix_len;
+};
+
+static __thread struct timestamp_cache timestamp_cache;
+
+/*
+ * Format timestamp, rescaling clock frequency to nanoseconds and
  * applying offsets as needed (unix time).
  */
 static
-void ctf_print_timestamp_real(FILE *fp,
+size_t ctf_format_timestamp_real(char *buf,
 			struct ctf_stream_definition *stream,
 			uint64_t timestamp)
 {
+	struct timestamp_cache *cache = &timestamp_cache;
 	uint64_t ts_sec = 0, ts_nsec;
+	size_t len;
 
 	ts_nsec = timestamp;
 
@@ -332,74 +402,99 @@ void ctf_print_timestamp_real(FILE *fp,
 	ts_nsec = ts_nsec % NSEC_PER_SEC;
 
 	if (!opt_clock_seconds) {
-		struct tm tm;
-		time_t time_s = (time_t) ts_sec;
-
-		if (!opt_clock_gmt) {
-			struct tm *res;
-
-			res = localtime_r(&time_s, &tm);
-			if (!res) {
-				fprintf(stderr, "[warning] Unable to get localtime.\n");
-				goto seconds;
-			}
-		} else {
-			struct tm *res;
+		if (!cache->valid || cache->sec != ts_sec
+				|| cache->gmt != opt_clock_gmt
+				|| cache->date != opt_clock_date) {
+			struct tm tm;
+			time_t time_s = (time_t) ts_sec;
+			char *p = cache->prefix;
+
+			cache->valid = 0;
+			if (!opt_clock_gmt) {
+				struct tm *res;
+
+				res = localtime_r(&time_s, &tm);
+				if (!res) {
+					fprintf(stderr, "[warning] Unable to get localtime.\n");
+					goto seconds;
+				}
+			} else {
+				struct tm *res;
 
-			res = gmtime_r(&time_s, &tm);
-			if (!res) {
-				fprintf(stderr, "[warning] Unable to get gmtime.\n");
-				goto seconds;
+				res = gmtime_r(&time_s, &tm);
+				if (!res) {
+					fprintf(stderr, "[warning] Unable to get gmtime.\n");
+					goto seconds;
+				}
 			}
-		}
-		if (opt_clock_date) {
-			char timestr[26];
-			size_t res;
-
-			/* Print date and time */
-			res = strftime(timestr, sizeof(timestr),
-				"%F ", &tm);
-			if (!res) {
-				fprintf(stderr, "[warning] Unable to print ascii time.\n");
-				goto seconds;
+			if (opt_clock_date) {
+				size_t res;
+
+				/* Date */
+				res = strftime(p, 26, "%F ", &tm);
+				if (!res) {
+					fprintf(stderr, "[warning] Unable to print ascii time.\n");
+					goto seconds;
+				}
+				p += res;
 			}
-			fprintf(fp, "%s", timestr);
-		}
-		/* Print time in HH:MM:SS.ns */
-		fprintf(fp, "%02d:%02d:%02d.%09" PRIu64,
-			tm.tm_hour, tm.tm_min, tm.tm_sec, ts_nsec);
-		goto end;
+			/* Time in HH:MM:SS. */
+			p += format_digits(p, tm.tm_hour, 2, '0');
+			*p++ = ':';
+			p += format_digits(p, tm.tm_min, 2, '0');
+			*p++ = ':';
+			p += format_digits(p, tm.tm_sec, 2, '0');
+			*p++ = '.';
+			cache->prefix_len = p - cache->prefix;
+			cache->sec = ts_sec;
+			cache->gmt = opt_clock_gmt;
+			cache->date = opt_clock_date;
+			cache->valid = 1;
+		}
+		memcpy(buf, cache->prefix, cache->prefix_len);
+		len = cache->prefix_len;
+		len += format_digits(buf + len, ts_nsec, 9, '0');
+		return len;
 	}
 seconds:
-	fprintf(fp, "%3" PRIu64 ".%09" PRIu64,
-		ts_sec, ts_nsec);
-
-end:
-	return;
+	len = format_digits(buf, ts_sec, 3, ' ');
+	buf[len++] = '.';
+	len += format_digits(buf + len, ts_nsec, 9, '0');
+	return len;
 }
 
 /*
- * Print timestamp, in cycles
+ * Format timestamp, in cycles
  */
 static
-void ctf_print_timestamp_cycles(FILE *fp,
+size_t ctf_format_timestamp_cycles(char *buf,
 		struct ctf_stream_definition *stream,
 		uint64_t timestamp)
 {
-	fprintf(fp, "%020" PRIu64, timestamp);
+	return format_digits(buf, timestamp, 20, '0');
 }
 
-void ctf_print_timestamp(FILE *fp,
-		struct ctf_stream_definition *stream,
+size_t ctf_format_timestamp(char *buf, struct ctf_stream_definition *stream,
 		uint64_t timestamp)
 {
 	if (opt_clock_cycles) {
-		ctf_print_timestamp_cycles(fp, stream, timestamp);
+		return ctf_format_timestamp_cycles(buf, stream, timestamp);
 	} else {
-		ctf_print_timestamp_real(fp, stream, timestamp);
+		return ctf_format_timestamp_real(buf, stream, timestamp);
 	}
 }
 
+void ctf_print_timestamp(FILE *fp,
+		struct ctf_stream_definition *stream,
+		uint64_t timestamp)
+{
+	char buf[CTF_TIMESTAMP_STR_LEN];
+	size_t len;
+
+	len = ctf_format_timestamp(buf, stream, timestamp);
+	fwrite(buf, 1, len, fp);
+}
+
 static
 void print_uuid(FILE *fp, unsigned char *uuid)
 {
@@ -458,12 +553,134 @@ void ctf_print_discarded(FILE *fp, struct ctf_stream_definition *stream)
 	fflush(fp);
 }
 
+/*
+ * Return the event header fields of the "v" variant choice read for
+ * the current event. The variant has just been read, so its current
+ * field is up to date.
+ */
+static inline
+const struct ctf_event_header_choice *
+	ctf_event_header_current_choice(struct ctf_stream_definition *stream)
+{
+	struct bt_definition *field = stream->header_v->current_field;
+	unsigned int i;
+
+	for (i = 0; i < stream->header_v_nr_choices; i++) {
+		if (stream->header_v_choices[i].field == field)
+			return &stream->header_v_choices[i];
+	}
+	return NULL;
+}
+
+int ctf_event_filter_match(const struct ctf_event_filter *filter,
+		GQuark name)
+{
+	const char *str;
+	unsigned int i;
+
+	for (i = 0; i < filter->names->len; i++) {
+		if (g_array_index(filter->names, GQuark, i) == name)
+			return 1;
+	}
+	str = g_quark_to_string(name);
+	for (i = 0; i < filter->patterns->len; i++) {
+		if (g_pattern_match_simple(
+				g_ptr_array_index(filter->patterns, i), str))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Match an event id against the event filter of pos, and remember the
+ * result for the next events with this id.
+ */
 static
-int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *stream)
+int ctf_event_filter_resolve(struct ctf_stream_pos *pos,
+		struct ctf_stream_declaration *stream_class, uint64_t id)
+{
+	struct ctf_event_declaration *event_class;
+	enum ctf_event_filter_state state;
+
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class)
+		return 0;
+	state = ctf_event_filter_match(pos->event_filter, event_class->name) ?
+		CTF_EVENT_READ : CTF_EVENT_SKIP;
+	if (!pos->event_filter_ids)
+		pos->event_filter_ids = g_array_new(FALSE, TRUE, sizeof(guint8));
+	/* Metadata updates may have added event classes. */
+	if (id >= pos->event_filter_ids->len)
+		g_array_set_size(pos->event_filter_ids,
+			stream_class->events_by_id->len);
+	g_array_index(pos->event_filter_ids, guint8, id) = state;
+	return state == CTF_EVENT_SKIP;
+}
+
+static inline
+int ctf_event_filtered_out(struct ctf_stream_pos *pos,
+		struct ctf_stream_declaration *stream_class, uint64_t id)
+{
+	GArray *ids = pos->event_filter_ids;
+
+	if (likely(!pos->event_filter))
+		return 0;
+	if (likely(ids && id < ids->len)) {
+		guint8 state = g_array_index(ids, guint8, id);
+
+		if (likely(state != CTF_EVENT_UNRESOLVED))
+			return state == CTF_EVENT_SKIP;
+	}
+	return ctf_event_filter_resolve(pos, stream_class, id);
+}
+
+/*
+ * Skip the event-declared context and payload of an event, using their
+ * size known from the metadata. Moving past the end of the packet
+ * content fails, so this also validates the event size against the
+ * packet.
+ */
+static inline
+int ctf_skip_event_fixed(struct ctf_stream_pos *pos,
+		const struct ctf_event_declaration *event_class)
+{
+	if (unlikely(!ctf_align_pos(pos, event_class->context_align)
+			|| !ctf_move_pos(pos, event_class->context_len)))
+		return -EFAULT;
+	if (unlikely(!ctf_align_pos(pos, event_class->fields_align)
+			|| !ctf_move_pos(pos, event_class->fields_len)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Hand the packet-level state of a file stream over to one of its
+ * views.
+ */
+static inline
+void ctf_stream_view_sync_packet(struct ctf_stream_definition *view,
+		struct ctf_stream_definition *stream)
+{
+	view->cycles_timestamp = stream->cycles_timestamp;
+	view->real_timestamp = stream->real_timestamp;
+	view->prev = stream->prev;
+	view->current = stream->current;
+	view->events_discarded = stream->events_discarded;
+}
+
+/*
+ * Read the header of the next event, and look up its event definition.
+ * Returns 0 on success, EOF or EAGAIN if no event is available, and a
+ * negative error value otherwise.
+ */
+static
+int ctf_read_event_header(struct ctf_stream_pos *pos,
+		struct ctf_stream_definition *stream,
+		struct ctf_event_definition **_event)
 {
-	struct ctf_stream_pos *pos =
-		container_of(ppos, struct ctf_stream_pos, parent);
 	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_file_stream *file_stream =
+		container_of(pos, struct ctf_file_stream, pos);
 	struct ctf_event_definition *event;
 	uint64_t id = 0;
 	int ret;
@@ -472,7 +689,13 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 	if (unlikely(pos->offset == EOF))
 		return EOF;
 
-	ctf_pos_get_event(pos);
+	if (unlikely(pos->offset == pos->content_size)) {
+		ctf_pos_get_event(pos);
+		/* Packet switches update the state of the file stream. */
+		if (stream != &file_stream->parent)
+			ctf_stream_view_sync_packet(stream,
+				&file_stream->parent);
+	}
 
 	/* save the current position as a restore point */
 	pos->last_offset = pos->offset;
@@ -498,60 +721,46 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 
 	assert(pos->offset < pos->content_size);
 
-	/* Read event header */
-	if (likely(stream->stream_event_header)) {
-		struct definition_integer *integer_definition;
-		struct bt_definition *variant;
+	/* Read event header and stream-declared event context */
+	ret = ctf_decode_program_read(stream->event_header_program, &pos->parent);
+	if (unlikely(ret)) {
+		fprintf(stderr, "[error] Unexpected end of packet. Either the trace data stream is corrupted or metadata description does not match data layout.\n");
+		return ret;
+	}
 
-		ret = generic_rw(ppos, &stream->stream_event_header->p);
-		if (unlikely(ret))
-			goto error;
-		/* lookup event id */
-		integer_definition = bt_lookup_integer(&stream->stream_event_header->p, "id", FALSE);
-		if (integer_definition) {
-			id = integer_definition->value._unsigned;
-		} else {
-			struct definition_enum *enum_definition;
+	if (likely(stream->stream_event_header)) {
+		struct definition_integer *timestamp = stream->header_timestamp;
 
-			enum_definition = bt_lookup_enum(&stream->stream_event_header->p, "id", FALSE);
-			if (enum_definition) {
-				id = enum_definition->integer->value._unsigned;
-			}
+		/* event id */
+		if (stream->header_id) {
+			id = stream->header_id->value._unsigned;
+		} else if (stream->header_id_enum) {
+			id = stream->header_id_enum->integer->value._unsigned;
 		}
 
-		variant = bt_lookup_variant(&stream->stream_event_header->p, "v");
-		if (variant) {
-			integer_definition = bt_lookup_integer(variant, "id", FALSE);
-			if (integer_definition) {
-				id = integer_definition->value._unsigned;
+		if (stream->header_v) {
+			const struct ctf_event_header_choice *choice;
+
+			choice = ctf_event_header_current_choice(stream);
+			if (choice) {
+				if (choice->id) {
+					id = choice->id->value._unsigned;
+				}
+				if (!timestamp) {
+					timestamp = choice->timestamp;
+				}
 			}
 		}
 		stream->event_id = id;
 
-		/* lookup timestamp */
+		/* timestamp */
 		stream->has_timestamp = 0;
-		integer_definition = bt_lookup_integer(&stream->stream_event_header->p, "timestamp", FALSE);
-		if (integer_definition) {
-			ctf_update_timestamp(stream, integer_definition);
+		if (timestamp) {
+			ctf_update_timestamp(stream, timestamp);
 			stream->has_timestamp = 1;
-		} else {
-			if (variant) {
-				integer_definition = bt_lookup_integer(variant, "timestamp", FALSE);
-				if (integer_definition) {
-					ctf_update_timestamp(stream, integer_definition);
-					stream->has_timestamp = 1;
-				}
-			}
 		}
 	}
 
-	/* Read stream-declared event context */
-	if (stream->stream_event_context) {
-		ret = generic_rw(ppos, &stream->stream_event_context->p);
-		if (ret)
-			goto error;
-	}
-
 	if (unlikely(id >= stream_class->events_by_id->len)) {
 		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
 		return -EINVAL;
@@ -561,24 +770,81 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
 		return -EINVAL;
 	}
+	*_event = event;
+	return 0;
+}
 
-	/* Read event-declared event context */
-	if (event->event_context) {
-		ret = generic_rw(ppos, &event->event_context->p);
-		if (ret)
-			goto error;
-	}
+static
+int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *stream)
+{
+	struct ctf_stream_pos *pos =
+		container_of(ppos, struct ctf_stream_pos, parent);
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_event_definition *event;
+	int64_t last_offset = pos->last_offset;
+	int skip, ret;
 
-	/* Read event payload */
-	if (likely(event->event_fields)) {
-		ret = generic_rw(ppos, &event->event_fields->p);
+	for (;;) {
+		if (unlikely(pos->hold_packet
+				&& pos->offset == pos->content_size)) {
+			/* Events of this packet are still in use. */
+			pos->last_offset = last_offset;
+			return EBUSY;
+		}
+		ret = ctf_read_event_header(pos, stream, &event);
 		if (ret)
-			goto error;
-	}
-
-	if (pos->last_offset == pos->offset) {
-		fprintf(stderr, "[error] Invalid 0 byte event encountered.\n");
-		return -EINVAL;
+			return ret;
+		/* Skip filtered out events, and events before a seek target */
+		skip = ctf_event_filtered_out(pos, stream_class,
+				stream->event_id)
+			|| (stream->has_timestamp
+				&& stream->real_timestamp < stream->skip_until);
+
+		if (skip) {
+			struct ctf_event_declaration *event_class =
+				g_ptr_array_index(stream_class->events_by_id,
+					stream->event_id);
+
+			if (event_class->context_fixed
+					&& event_class->fields_fixed) {
+				ret = ctf_skip_event_fixed(pos, event_class);
+				if (unlikely(ret))
+					goto error;
+				goto next;
+			}
+		}
+		if (event->fields_program) {
+			/* Read event-declared event context, skip event payload */
+			ret = ctf_decode_program_read(event->context_program, ppos);
+			if (unlikely(ret))
+				goto error;
+			if (unlikely(!ctf_align_pos(pos, event->fields_align))) {
+				ret = -EFAULT;
+				goto error;
+			}
+			event->fields_offset = pos->offset;
+			if (unlikely(!ctf_move_pos(pos, event->fields_len))) {
+				ret = -EFAULT;
+				goto error;
+			}
+			event->fields_pos = skip ? NULL : ppos;
+		} else {
+			/*
+			 * Read event-declared event context and event payload.
+			 * Skipped events of variable size are decoded too, to
+			 * find where they end.
+			 */
+			ret = ctf_decode_program_read(event->program, ppos);
+			if (unlikely(ret))
+				goto error;
+		}
+next:
+		if (pos->last_offset == pos->offset) {
+			fprintf(stderr, "[error] Invalid 0 byte event encountered.\n");
+			return -EINVAL;
+		}
+		if (likely(!skip))
+			break;
 	}
 
 	return 0;
@@ -621,6 +887,9 @@ int ctf_write_event(struct bt_stream_pos *pos, struct ctf_stream_definition *str
 		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
 		return -EINVAL;
 	}
+	ret = ctf_decode_event_fields(event);
+	if (ret)
+		return ret;
 
 	/* print event-declared event context */
 	if (event->event_context) {
@@ -643,6 +912,228 @@ error:
 	return ret;
 }
 
+/*
+ * Map the whole stream file for reading, if it fits within the address
+ * space budget. Packet switches then only update mmap_base_offset.
+ * Failing to map the file is not an error: the stream falls back to
+ * per-packet mappings.
+ */
+static
+void ctf_pos_map_file(struct ctf_stream_pos *pos, off_t filesize)
+{
+	struct mmap_align *mma;
+
+	if (!filesize)
+		return;
+	/* Reserve the budget first, so concurrent opens cannot exceed it. */
+	pthread_mutex_lock(&file_map_budget_mutex);
+	if ((uint64_t) filesize > FILE_MAP_BUDGET - file_map_budget_used) {
+		pthread_mutex_unlock(&file_map_budget_mutex);
+		return;
+	}
+	file_map_budget_used += filesize;
+	pthread_mutex_unlock(&file_map_budget_mutex);
+
+	mma = mmap_align(filesize, PROT_READ, MAP_PRIVATE, pos->fd, 0);
+	if (mma == MAP_FAILED) {
+		printf_verbose("Unable to map whole stream file, using per-packet mappings: %s.\n",
+			strerror(errno));
+		pthread_mutex_lock(&file_map_budget_mutex);
+		file_map_budget_used -= filesize;
+		pthread_mutex_unlock(&file_map_budget_mutex);
+		return;
+	}
+	(void) madvise(mma->page_aligned_addr, mma->page_aligned_length,
+		MADV_SEQUENTIAL);
+	pos->file_mma = mma;
+}
+
+static
+int ctf_pos_unmap_file(struct ctf_stream_pos *pos)
+{
+	size_t length;
+	int ret;
+
+	if (!pos->file_mma)
+		return 0;
+	length = pos->file_mma->length;
+	ret = munmap_align(pos->file_mma);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap stream file: %s.\n",
+			strerror(errno));
+		return ret;
+	}
+	pthread_mutex_lock(&file_map_budget_mutex);
+	file_map_budget_used -= length;
+	pthread_mutex_unlock(&file_map_budget_mutex);
+	pos->file_mma = NULL;
+	return 0;
+}
+
+/*
+ * Queue the reads of the current packet and of the
+ * opt_readahead_packets packets following it into the buffers of the
+ * packet loader of the stream.
+ */
+static
+void ctf_pos_queue_packets(struct ctf_stream_pos *pos)
+{
+	uint64_t i, end;
+	int ret;
+
+	end = min(pos->cur_index + 1 + opt_readahead_packets,
+		pos->packet_index->len);
+	ctf_packet_loader_begin(pos->loader);
+	for (i = pos->cur_index; i < end; i++) {
+		struct packet_index *index =
+			&g_array_index(pos->packet_index, struct packet_index, i);
+
+		if (ctf_packet_loader_queue(pos->loader,
+				index->packet_size / CHAR_BIT, index->offset))
+			break;
+	}
+	ret = ctf_packet_loader_submit(pos->loader);
+	if (ret)
+		printf_verbose("Unable to queue packet reads: %s.\n",
+			strerror(-ret));
+}
+
+/*
+ * Ask the kernel to read the opt_readahead_packets packets following
+ * the current packet of a stream file into the page cache. The reads
+ * are issued asynchronously by the kernel, so that switching to these
+ * packets later does not stall on storage latency. Packets are only
+ * advised once as the stream moves forward. Streams with a packet
+ * loader read these packets into its buffers instead.
+ */
+static
+void ctf_pos_readahead(struct ctf_stream_pos *pos)
+{
+	struct packet_index *first, *last;
+	uint64_t begin, end;
+	off_t len;
+
+	if (opt_readahead_packets <= 0 || pos->fd < 0)
+		return;
+	if (pos->loader) {
+		ctf_pos_queue_packets(pos);
+		return;
+	}
+	begin = pos->cur_index + 1;
+	if (pos->readahead_index > begin)
+		begin = pos->readahead_index;
+	end = min(pos->cur_index + 1 + opt_readahead_packets,
+		pos->packet_index->len);
+	if (begin >= end)
+		return;
+	first = &g_array_index(pos->packet_index, struct packet_index, begin);
+	last = &g_array_index(pos->packet_index, struct packet_index, end - 1);
+	len = last->offset + last->packet_size / CHAR_BIT - first->offset;
+	if (len > 0)
+		(void) posix_fadvise(pos->fd, first->offset, len,
+			POSIX_FADV_WILLNEED);
+	pos->readahead_index = end;
+}
+
+/*
+ * Read "len" bytes of the stream file at file offset "offset" into a
+ * buffer of the packet loader of the stream, or, without loader, into
+ * the read buffer of the stream, which is kept across packets and only
+ * grows. Bytes past the end of the file read as zero.
+ */
+static
+int ctf_pos_read_packet(struct ctf_stream_pos *pos, size_t len, off_t offset)
+{
+	struct mmap_align *mma = pos->read_mma;
+	int ret;
+
+	if (pos->loader) {
+		mma = ctf_packet_loader_get(pos->loader, len, offset);
+		if (!mma)
+			return -errno;
+		pos->base_mma = mma;
+		pos->mmap_base_offset = 0;
+		return 0;
+	}
+	if (!mma) {
+		mma = g_new0(struct mmap_align, 1);
+		pos->read_mma = mma;
+	}
+	if (mma->page_aligned_length < len) {
+		size_t alloc_len = ALIGN(len, getpagesize());
+		void *buf;
+
+		if (posix_memalign(&buf, getpagesize(), alloc_len))
+			return -ENOMEM;
+		free(mma->page_aligned_addr);
+		mma->page_aligned_addr = buf;
+		mma->page_aligned_length = alloc_len;
+	}
+	mma->addr = mma->page_aligned_addr;
+	mma->length = len;
+	ret = ctf_packet_pread(pos->fd, mma->addr, len, offset, 0);
+	if (ret)
+		return ret;
+	pos->base_mma = mma;
+	pos->mmap_base_offset = 0;
+	return 0;
+}
+
+static
+void ctf_pos_free_read_buffer(struct ctf_stream_pos *pos)
+{
+	if (!pos->read_mma)
+		return;
+	free(pos->read_mma->page_aligned_addr);
+	g_free(pos->read_mma);
+	pos->read_mma = NULL;
+}
+
+/*
+ * Make "len" bytes of the stream file at file offset "offset"
+ * addressable from pos->base_mma. Only sets up a new mapping when the
+ * whole file is not already mapped. With opt_read_packets, read-only
+ * packets are read into a buffer instead of being mapped.
+ */
+static
+int ctf_pos_map_packet(struct ctf_stream_pos *pos, size_t len, off_t offset)
+{
+	if (pos->file_mma) {
+		pos->base_mma = pos->file_mma;
+		pos->mmap_base_offset = offset;
+		return 0;
+	}
+	if (opt_read_packets && !(pos->prot & PROT_WRITE))
+		return ctf_pos_read_packet(pos, len, offset);
+	pos->base_mma = mmap_align(len, pos->prot, pos->flags, pos->fd, offset);
+	if (pos->base_mma == MAP_FAILED) {
+		pos->base_mma = NULL;
+		return -errno;
+	}
+	pos->mmap_base_offset = 0;
+	return 0;
+}
+
+static
+int ctf_pos_unmap_packet(struct ctf_stream_pos *pos)
+{
+	int ret;
+
+	if (!pos->base_mma)
+		return 0;
+	if (pos->base_mma != pos->file_mma
+			&& pos->base_mma != pos->read_mma
+			&& !(pos->loader && ctf_packet_loader_release(pos->loader,
+				pos->base_mma))) {
+		ret = munmap_align(pos->base_mma);
+		if (ret)
+			return ret;
+	}
+	pos->base_mma = NULL;
+	pos->mmap_base_offset = 0;
+	return 0;
+}
+
 /*
  * One side-effect of this function is to unmap pos mmap base if one is
  * mapped.
@@ -674,20 +1165,17 @@ begin:
 		packet_map_len = (filesize - pos->mmap_offset) << LOG2_CHAR_BIT;
 	}
 
-	if (pos->base_mma) {
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-					strerror(errno));
-			return ret;
-		}
-		pos->base_mma = NULL;
+	/* unmap old base */
+	ret = ctf_pos_unmap_packet(pos);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
+				strerror(errno));
+		return ret;
 	}
 	/* map new base. Need mapping length from header. */
-	pos->base_mma = mmap_align(packet_map_len >> LOG2_CHAR_BIT, PROT_READ,
-			MAP_PRIVATE, pos->fd, pos->mmap_offset);
-	assert(pos->base_mma != MAP_FAILED);
+	ret = ctf_pos_map_packet(pos, packet_map_len >> LOG2_CHAR_BIT,
+			pos->mmap_offset);
+	assert(!ret);
 
 	pos->content_size = packet_map_len;
 	pos->packet_size = packet_map_len;
@@ -713,13 +1201,12 @@ begin:
 	packet_index->data_offset = pos->offset;
 
 	/* unmap old base */
-	ret = munmap_align(pos->base_mma);
+	ret = ctf_pos_unmap_packet(pos);
 	if (ret) {
 		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
 				strerror(errno));
 		return ret;
 	}
-	pos->base_mma = NULL;
 
 	return 0;
 
@@ -748,6 +1235,12 @@ int ctf_init_pos(struct ctf_stream_pos *pos, struct bt_trace_descriptor *trace,
 		int fd, int open_flags)
 {
 	pos->fd = fd;
+	pos->readahead_index = 0;
+	pos->hold_packet = 0;
+	pos->event_filter = NULL;
+	pos->event_filter_ids = NULL;
+	pos->read_mma = NULL;
+	pos->loader = NULL;
 	if (fd >= 0) {
 		pos->packet_index = g_array_new(FALSE, TRUE,
 				sizeof(struct packet_index));
@@ -777,21 +1270,30 @@ int ctf_init_pos(struct ctf_stream_pos *pos, struct bt_trace_descriptor *trace,
 
 int ctf_fini_pos(struct ctf_stream_pos *pos)
 {
+	int ret;
+
 	if ((pos->prot & PROT_WRITE) && pos->content_size_loc)
 		*pos->content_size_loc = pos->offset;
-	if (pos->base_mma) {
-		int ret;
-
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-				strerror(errno));
-			return -1;
-		}
+	/* unmap old base */
+	ret = ctf_pos_unmap_packet(pos);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
+			strerror(errno));
+		return -1;
 	}
+	ret = ctf_pos_unmap_file(pos);
+	if (ret)
+		return -1;
+	ctf_pos_free_read_buffer(pos);
+	ctf_packet_loader_destroy(pos->loader);
+	pos->loader = NULL;
 	if (pos->packet_index)
 		(void) g_array_free(pos->packet_index, TRUE);
+	if (pos->event_filter_ids) {
+		g_array_free(pos->event_filter_ids, TRUE);
+		pos->event_filter_ids = NULL;
+	}
+	pos->event_filter = NULL;
 	return 0;
 }
 
@@ -874,15 +1376,12 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 	if ((pos->prot & PROT_WRITE) && pos->content_size_loc)
 		*pos->content_size_loc = pos->offset;
 
-	if (pos->base_mma) {
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-				strerror(errno));
-			assert(0);
-		}
-		pos->base_mma = NULL;
+	/* unmap old base */
+	ret = ctf_pos_unmap_packet(pos);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
+			strerror(errno));
+		assert(0);
 	}
 
 	/*
@@ -927,6 +1426,8 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 				return;
 			}
 			pos->cur_index = index;
+			/* Read ahead again from the new position. */
+			pos->readahead_index = 0;
 			break;
 		default:
 			assert(0);
@@ -977,6 +1478,7 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 		pos->packet_size = packet_index->packet_size;
 		pos->mmap_offset = packet_index->offset;
 		pos->data_offset = packet_index->data_offset;
+		ctf_pos_readahead(pos);
 		if (pos->data_offset < packet_index->content_size) {
 			pos->offset = 0;	/* will read headers */
 		} else if (pos->data_offset == packet_index->content_size) {
@@ -990,11 +1492,11 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 		}
 	}
 	/* map new base. Need mapping length from header. */
-	pos->base_mma = mmap_align(pos->packet_size / CHAR_BIT, pos->prot,
-			pos->flags, pos->fd, pos->mmap_offset);
-	if (pos->base_mma == MAP_FAILED) {
+	ret = ctf_pos_map_packet(pos, pos->packet_size / CHAR_BIT,
+			pos->mmap_offset);
+	if (ret) {
 		fprintf(stderr, "[error] mmap error %s.\n",
-			strerror(errno));
+			strerror(-ret));
 		assert(0);
 	}
 
@@ -1215,6 +1717,50 @@ int ctf_trace_metadata_stream_read(struct ctf_trace *td, FILE **fp,
 	return 0;
 }
 
+/*
+ * Find out which scopes of an event have a size known from the
+ * metadata, so the reader can skip them without decoding.
+ */
+static
+void ctf_event_compute_layout(struct ctf_event_declaration *event)
+{
+	event->context_fixed = 1;
+	event->context_len = 0;
+	event->context_align = 1;
+	if (event->context_decl) {
+		event->context_align = event->context_decl->p.alignment;
+		if (ctf_decode_fixed_len(&event->context_decl->p,
+				&event->context_len))
+			event->context_fixed = 0;
+	}
+	event->fields_fixed = 1;
+	event->fields_len = 0;
+	event->fields_align = 1;
+	if (event->fields_decl) {
+		event->fields_align = event->fields_decl->p.alignment;
+		if (ctf_decode_fixed_len(&event->fields_decl->p,
+				&event->fields_len))
+			event->fields_fixed = 0;
+	}
+}
+
+/*
+ * Compute the layout of every event class, including the ones added by
+ * a metadata update.
+ */
+static
+void ctf_trace_compute_event_layouts(struct ctf_trace *td)
+{
+	unsigned int i;
+
+	for (i = 0; i < td->event_declarations->len; i++) {
+		struct bt_ctf_event_decl *event_decl =
+			g_ptr_array_index(td->event_declarations, i);
+
+		ctf_event_compute_layout(&event_decl->parent);
+	}
+}
+
 static
 int ctf_trace_metadata_read(struct ctf_trace *td, FILE *metadata_fp,
 		struct ctf_scanner *scanner, int append)
@@ -1303,6 +1849,7 @@ int ctf_trace_metadata_read(struct ctf_trace *td, FILE *metadata_fp,
 		fprintf(stderr, "[error] Error in CTF metadata constructor %d\n", ret);
 		goto end;
 	}
+	ctf_trace_compute_event_layouts(td);
 end:
 	if (fp) {
 		closeret = fclose(fp);
@@ -1323,6 +1870,37 @@ end_free:
 	return ret;
 }
 
+int ctf_decode_event_fields(struct ctf_event_definition *event)
+{
+	struct bt_stream_pos *ppos = event->fields_pos;
+	struct ctf_stream_pos *pos;
+	int64_t offset;
+	int ret;
+
+	if (likely(!ppos))
+		return 0;
+	event->fields_pos = NULL;
+	pos = ctf_pos(ppos);
+	offset = pos->offset;
+	pos->offset = event->fields_offset;
+	ret = ctf_decode_program_read(event->fields_program, ppos);
+	pos->offset = offset;
+	if (ret)
+		fprintf(stderr, "[error] Unable to decode event payload.\n");
+	return ret;
+}
+
+static
+void destroy_event_programs(struct ctf_event_definition *stream_event)
+{
+	ctf_decode_program_destroy(stream_event->program);
+	stream_event->program = NULL;
+	ctf_decode_program_destroy(stream_event->context_program);
+	stream_event->context_program = NULL;
+	ctf_decode_program_destroy(stream_event->fields_program);
+	stream_event->fields_program = NULL;
+}
+
 static
 struct ctf_event_definition *create_event_definitions(struct ctf_trace *td,
 						  struct ctf_stream_definition *stream,
@@ -1352,10 +1930,40 @@ struct ctf_event_definition *create_event_definitions(struct ctf_trace *td,
 					struct definition_struct, p);
 		stream->parent_def_scope = stream_event->event_fields->p.scope;
 	}
+	stream_event->program = ctf_decode_program_create(read_dispatch_table);
+	if (stream_event->event_context) {
+		if (ctf_decode_program_append(stream_event->program,
+				&stream_event->event_context->p))
+			goto error;
+	}
+	if (stream_event->event_fields) {
+		if (ctf_decode_program_append(stream_event->program,
+				&stream_event->event_fields->p))
+			goto error;
+	}
+	/* Fixed-size payloads can be skipped until accessed. */
+	if (opt_lazy_payload && stream_event->event_fields
+			&& event->fields_fixed) {
+		stream_event->fields_len = event->fields_len;
+		stream_event->fields_align = event->fields_align;
+		stream_event->context_program =
+			ctf_decode_program_create(read_dispatch_table);
+		if (stream_event->event_context) {
+			if (ctf_decode_program_append(stream_event->context_program,
+					&stream_event->event_context->p))
+				goto error;
+		}
+		stream_event->fields_program =
+			ctf_decode_program_create(read_dispatch_table);
+		if (ctf_decode_program_append(stream_event->fields_program,
+				&stream_event->event_fields->p))
+			goto error;
+	}
 	stream_event->stream = stream;
 	return stream_event;
 
 error:
+	destroy_event_programs(stream_event);
 	if (stream_event->event_fields)
 		bt_definition_unref(&stream_event->event_fields->p);
 	if (stream_event->event_context)
@@ -1395,8 +2003,51 @@ error:
 	return ret;
 }
 
+/*
+ * Resolve the event header "id" and "timestamp" fields, including those
+ * found within each choice of the "v" variant, so reading an event
+ * header does not need any field name lookup.
+ */
 static
-int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition *stream)
+void resolve_event_header_fields(struct ctf_stream_definition *stream)
+{
+	struct bt_definition *header = &stream->stream_event_header->p;
+	struct bt_definition *v;
+
+	stream->header_id = bt_lookup_integer(header, "id", FALSE);
+	if (!stream->header_id)
+		stream->header_id_enum = bt_lookup_enum(header, "id", FALSE);
+	stream->header_timestamp = bt_lookup_integer(header, "timestamp", FALSE);
+
+	v = bt_lookup_definition(header, "v");
+	if (v && v->declaration->id == CTF_TYPE_VARIANT) {
+		struct definition_variant *variant =
+			container_of(v, struct definition_variant, p);
+		unsigned int i;
+
+		stream->header_v = variant;
+		stream->header_v_nr_choices = variant->fields->len;
+		stream->header_v_choices = g_new0(struct ctf_event_header_choice,
+				variant->fields->len);
+		for (i = 0; i < variant->fields->len; i++) {
+			struct ctf_event_header_choice *choice =
+				&stream->header_v_choices[i];
+
+			choice->field = g_ptr_array_index(variant->fields, i);
+			choice->id = bt_lookup_integer(choice->field, "id", FALSE);
+			choice->timestamp = bt_lookup_integer(choice->field,
+					"timestamp", FALSE);
+		}
+	}
+}
+
+/*
+ * Create the stream-level definitions of stream, and the event-level
+ * definitions of all its event classes if all_events is set.
+ */
+static
+int _create_stream_definitions(struct ctf_trace *td,
+		struct ctf_stream_definition *stream, int all_events)
 {
 	struct ctf_stream_declaration *stream_class;
 	int ret;
@@ -1407,7 +2058,8 @@ int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition
 
 	stream_class = stream->stream_class;
 
-	if (stream_class->packet_context_decl) {
+	/* Stream views share the packet context of their file stream. */
+	if (stream_class->packet_context_decl && !stream->stream_packet_context) {
 		struct bt_definition *definition =
 			stream_class->packet_context_decl->p.definition_new(&stream_class->packet_context_decl->p,
 				stream->parent_def_scope, 0, 0, "stream.packet.context");
@@ -1430,6 +2082,7 @@ int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition
 		stream->stream_event_header =
 			container_of(definition, struct definition_struct, p);
 		stream->parent_def_scope = stream->stream_event_header->p.scope;
+		resolve_event_header_fields(stream);
 	}
 	if (stream_class->event_context_decl) {
 		struct bt_definition *definition =
@@ -1443,7 +2096,22 @@ int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition
 			container_of(definition, struct definition_struct, p);
 		stream->parent_def_scope = stream->stream_event_context->p.scope;
 	}
+	stream->event_header_program = ctf_decode_program_create(read_dispatch_table);
+	if (stream->stream_event_header) {
+		ret = ctf_decode_program_append(stream->event_header_program,
+				&stream->stream_event_header->p);
+		if (ret)
+			goto error;
+	}
+	if (stream->stream_event_context) {
+		ret = ctf_decode_program_append(stream->event_header_program,
+				&stream->stream_event_context->p);
+		if (ret)
+			goto error;
+	}
 	stream->events_by_id = g_ptr_array_new();
+	if (!all_events)
+		return 0;
 	ret = copy_event_declarations_stream_class_to_stream(td,
 			stream_class, stream);
 	if (ret)
@@ -1453,22 +2121,46 @@ int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition
 error_event:
 	for (i = 0; i < stream->events_by_id->len; i++) {
 		struct ctf_event_definition *stream_event = g_ptr_array_index(stream->events_by_id, i);
-		if (stream_event)
+		if (stream_event) {
+			destroy_event_programs(stream_event);
 			g_free(stream_event);
+		}
 	}
 	g_ptr_array_free(stream->events_by_id, TRUE);
+	stream->events_by_id = NULL;
 error:
+	ctf_decode_program_destroy(stream->event_header_program);
+	stream->event_header_program = NULL;
+	g_free(stream->header_v_choices);
+	stream->header_v_choices = NULL;
+	stream->header_v_nr_choices = 0;
+	stream->header_v = NULL;
 	if (stream->stream_event_context)
 		bt_definition_unref(&stream->stream_event_context->p);
+	stream->stream_event_context = NULL;
 	if (stream->stream_event_header)
 		bt_definition_unref(&stream->stream_event_header->p);
+	stream->stream_event_header = NULL;
 	if (stream->stream_packet_context)
 		bt_definition_unref(&stream->stream_packet_context->p);
+	stream->stream_packet_context = NULL;
 	fprintf(stderr, "[error] Unable to create stream (%" PRIu64 ") definitions: %s\n",
 		stream_class->stream_id, strerror(-ret));
 	return ret;
 }
 
+static
+int create_stream_definitions(struct ctf_trace *td, struct ctf_stream_definition *stream)
+{
+	return _create_stream_definitions(td, stream, 1);
+}
+
+/*
+ * Stream files are indexed concurrently at trace open. Creating stream
+ * definitions walks the shared metadata declarations: serialize it.
+ */
+static pthread_mutex_t stream_assign_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static
 int stream_assign_class(struct ctf_trace *td,
 		struct ctf_file_stream *file_stream,
@@ -1488,7 +2180,9 @@ int stream_assign_class(struct ctf_trace *td,
 		return -EINVAL;
 	}
 	file_stream->parent.stream_class = stream;
+	pthread_mutex_lock(&stream_assign_mutex);
 	ret = create_stream_definitions(td, &file_stream->parent);
+	pthread_mutex_unlock(&stream_assign_mutex);
 	if (ret)
 		return ret;
 	return 0;
@@ -1516,20 +2210,17 @@ begin:
 		packet_map_len = (filesize - pos->mmap_offset) << LOG2_CHAR_BIT;
 	}
 
-	if (pos->base_mma) {
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-				strerror(errno));
-			return ret;
-		}
-		pos->base_mma = NULL;
+	/* unmap old base */
+	ret = ctf_pos_unmap_packet(pos);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
+			strerror(errno));
+		return ret;
 	}
 	/* map new base. Need mapping length from header. */
-	pos->base_mma = mmap_align(packet_map_len >> LOG2_CHAR_BIT, PROT_READ,
-			 MAP_PRIVATE, pos->fd, pos->mmap_offset);
-	assert(pos->base_mma != MAP_FAILED);
+	ret = ctf_pos_map_packet(pos, packet_map_len >> LOG2_CHAR_BIT,
+			pos->mmap_offset);
+	assert(!ret);
 	/*
 	 * Use current mapping size as temporary content and packet
 	 * size.
@@ -1914,33 +2605,282 @@ int import_stream_packet_index(struct ctf_trace *td,
 		g_array_append_val(file_stream->pos.packet_index, index);
 	}
 
-	/* Index containing only the header. */
-	if (!file_stream->parent.stream_class) {
-		ret = -1;
+	/* Index containing only the header. */
+	if (!file_stream->parent.stream_class) {
+		ret = -1;
+		goto error;
+	}
+
+	ret = 0;
+
+error:
+	g_free(ctf_index);
+	return ret;
+}
+
+/*
+ * Packet index cache directory of a trace:
+ * $XDG_CACHE_HOME/babeltrace/index/<absolute trace path>, with
+ * $XDG_CACHE_HOME defaulting to $HOME/.cache. Returns NULL if it cannot
+ * be determined. Returned string must be freed with g_free().
+ */
+static
+char *index_cache_dir(struct ctf_trace *td)
+{
+	char trace_path[PATH_MAX];
+	const char *cache_home, *home;
+
+	if (!realpath(td->parent.path, trace_path))
+		return NULL;
+	cache_home = getenv("XDG_CACHE_HOME");
+	if (cache_home && cache_home[0] == '/')
+		return g_build_filename(cache_home, "babeltrace", "index",
+				trace_path, NULL);
+	home = getenv("HOME");
+	if (!home || home[0] != '/')
+		return NULL;
+	return g_build_filename(home, ".cache", "babeltrace", "index",
+			trace_path, NULL);
+}
+
+static
+char *index_cache_path(struct ctf_trace *td, const char *path)
+{
+	char *dir, *cache_path;
+
+	dir = index_cache_dir(td);
+	if (!dir)
+		return NULL;
+	cache_path = g_strdup_printf("%s/%s.idx", dir, path);
+	g_free(dir);
+	return cache_path;
+}
+
+/*
+ * The packet index depends on the metadata describing the packet
+ * headers and contexts: a cached index is only valid for the metadata
+ * file it was built with. Fails for traces without a metadata file in
+ * their directory, which are then never cached.
+ */
+static
+int index_cache_stat_metadata(struct ctf_trace *td, struct stat *statbuf)
+{
+	if (td->dirfd < 0)
+		return -1;
+	return fstatat(td->dirfd, "metadata", statbuf, 0);
+}
+
+/*
+ * Import the packet index of a stream file from the index cache.
+ * Returns 0 on success, negative value if there is no valid cache for
+ * this file, in which case the caller should build the index.
+ */
+static
+int import_stream_packet_index_cache(struct ctf_trace *td,
+		struct ctf_file_stream *file_stream,
+		const struct stat *statbuf)
+{
+	struct ctf_packet_index_file_hdr index_hdr;
+	struct ctf_packet_index_cache_hdr cache_hdr;
+	struct ctf_packet_index_cache entry;
+	struct stat metadata_statbuf;
+	GArray *entries = NULL;
+	uint64_t stream_id = 0, next_offset = 0;
+	char *cache_path;
+	FILE *fp = NULL;
+	int ret = -1;
+	unsigned int i;
+
+	if (index_cache_stat_metadata(td, &metadata_statbuf))
+		return -1;
+	cache_path = index_cache_path(td, file_stream->parent.path);
+	if (!cache_path)
+		return -1;
+	fp = fopen(cache_path, "r");
+	if (!fp)
+		goto end;
+	if (fread(&index_hdr, sizeof(index_hdr), 1, fp) != 1
+			|| fread(&cache_hdr, sizeof(cache_hdr), 1, fp) != 1)
+		goto end;
+	if (be32toh(index_hdr.magic) != CTF_INDEX_MAGIC
+			|| be32toh(index_hdr.index_major) != CTF_INDEX_MAJOR
+			|| be32toh(index_hdr.packet_index_len) != sizeof(entry))
+		goto end;
+	/* The stream file changed since the index was cached. */
+	if (be64toh(cache_hdr.stream_size) != (uint64_t) statbuf->st_size
+			|| be64toh(cache_hdr.stream_mtime_sec)
+				!= babeltrace_stat_mtime_sec(statbuf)
+			|| be64toh(cache_hdr.stream_mtime_nsec)
+				!= babeltrace_stat_mtime_nsec(statbuf))
+		goto end;
+	/* The metadata changed since the index was cached. */
+	if (be64toh(cache_hdr.metadata_size)
+				!= (uint64_t) metadata_statbuf.st_size
+			|| be64toh(cache_hdr.metadata_mtime_sec)
+				!= babeltrace_stat_mtime_sec(&metadata_statbuf)
+			|| be64toh(cache_hdr.metadata_mtime_nsec)
+				!= babeltrace_stat_mtime_nsec(&metadata_statbuf))
+		goto end;
+
+	/* Validate all entries before touching the file stream. */
+	entries = g_array_new(FALSE, TRUE, sizeof(struct packet_index));
+	while (fread(&entry, sizeof(entry), 1, fp) == 1) {
+		struct packet_index index;
+
+		memset(&index, 0, sizeof(index));
+		index.offset = be64toh(entry.p.offset);
+		index.packet_size = be64toh(entry.p.packet_size);
+		index.content_size = be64toh(entry.p.content_size);
+		index.ts_cycles.timestamp_begin = be64toh(entry.p.timestamp_begin);
+		index.ts_cycles.timestamp_end = be64toh(entry.p.timestamp_end);
+		index.events_discarded = be64toh(entry.p.events_discarded);
+		index.events_discarded_len = be64toh(entry.events_discarded_len);
+		index.data_offset = be64toh(entry.data_offset);
+		index.ts_real.timestamp_begin = be64toh(entry.ts_real_begin);
+		index.ts_real.timestamp_end = be64toh(entry.ts_real_end);
+		if (!entries->len) {
+			stream_id = be64toh(entry.p.stream_id);
+		} else if (be64toh(entry.p.stream_id) != stream_id) {
+			goto end;
+		}
+		if (index.offset != next_offset
+				|| !index.packet_size
+				|| index.content_size > index.packet_size
+				|| index.packet_size > ((uint64_t) statbuf->st_size - index.offset) * CHAR_BIT)
+			goto end;
+		next_offset += index.packet_size >> LOG2_CHAR_BIT;
+		g_array_append_val(entries, index);
+	}
+	if (!entries->len || next_offset != (uint64_t) statbuf->st_size)
+		goto end;
+
+	ret = stream_assign_class(td, file_stream, stream_id);
+	if (ret)
+		goto end;
+	for (i = 0; i < entries->len; i++) {
+		g_array_append_val(file_stream->pos.packet_index,
+			g_array_index(entries, struct packet_index, i));
+	}
+	printf_verbose("Using cached packet index \"%s\".\n", cache_path);
+	ret = 0;
+end:
+	if (entries)
+		g_array_free(entries, TRUE);
+	if (fp)
+		fclose(fp);
+	g_free(cache_path);
+	return ret;
+}
+
+/*
+ * Write the packet index of a stream file to the index cache. Errors
+ * are not fatal: the index will simply be built again next time.
+ */
+static
+void write_stream_packet_index_cache(struct ctf_trace *td,
+		struct ctf_file_stream *file_stream,
+		const struct stat *statbuf)
+{
+	struct ctf_packet_index_file_hdr index_hdr;
+	struct ctf_packet_index_cache_hdr cache_hdr;
+	struct stat metadata_statbuf;
+	GArray *packet_index = file_stream->pos.packet_index;
+	char *cache_path, *cache_dir = NULL, *tmp_path = NULL;
+	FILE *fp = NULL;
+	unsigned int i;
+
+	if (!packet_index->len)
+		return;
+	if (index_cache_stat_metadata(td, &metadata_statbuf))
+		return;
+	cache_path = index_cache_path(td, file_stream->parent.path);
+	if (!cache_path)
+		return;
+	cache_dir = g_path_get_dirname(cache_path);
+	if (g_mkdir_with_parents(cache_dir, 0755))
+		goto error;
+	/* Write to a temporary file, then rename, for concurrent readers. */
+	tmp_path = g_strdup_printf("%s.tmp.%d", cache_path, (int) getpid());
+	fp = fopen(tmp_path, "w");
+	if (!fp)
+		goto error;
+
+	index_hdr.magic = htobe32(CTF_INDEX_MAGIC);
+	index_hdr.index_major = htobe32(CTF_INDEX_MAJOR);
+	index_hdr.index_minor = htobe32(CTF_INDEX_MINOR);
+	index_hdr.packet_index_len = htobe32(sizeof(struct ctf_packet_index_cache));
+	cache_hdr.stream_size = htobe64(statbuf->st_size);
+	cache_hdr.stream_mtime_sec = htobe64(babeltrace_stat_mtime_sec(statbuf));
+	cache_hdr.stream_mtime_nsec = htobe64(babeltrace_stat_mtime_nsec(statbuf));
+	cache_hdr.metadata_size = htobe64(metadata_statbuf.st_size);
+	cache_hdr.metadata_mtime_sec =
+		htobe64(babeltrace_stat_mtime_sec(&metadata_statbuf));
+	cache_hdr.metadata_mtime_nsec =
+		htobe64(babeltrace_stat_mtime_nsec(&metadata_statbuf));
+	if (fwrite(&index_hdr, sizeof(index_hdr), 1, fp) != 1
+			|| fwrite(&cache_hdr, sizeof(cache_hdr), 1, fp) != 1)
 		goto error;
-	}
 
-	ret = 0;
+	for (i = 0; i < packet_index->len; i++) {
+		struct packet_index *index =
+			&g_array_index(packet_index, struct packet_index, i);
+		struct ctf_packet_index_cache entry;
+
+		entry.p.offset = htobe64(index->offset);
+		entry.p.packet_size = htobe64(index->packet_size);
+		entry.p.content_size = htobe64(index->content_size);
+		entry.p.timestamp_begin = htobe64(index->ts_cycles.timestamp_begin);
+		entry.p.timestamp_end = htobe64(index->ts_cycles.timestamp_end);
+		entry.p.events_discarded = htobe64(index->events_discarded);
+		entry.p.stream_id = htobe64(file_stream->parent.stream_id);
+		entry.data_offset = htobe64(index->data_offset);
+		entry.events_discarded_len = htobe64(index->events_discarded_len);
+		entry.ts_real_begin = htobe64(index->ts_real.timestamp_begin);
+		entry.ts_real_end = htobe64(index->ts_real.timestamp_end);
+		if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+			goto error;
+	}
+	if (fclose(fp))
+		goto error_close;
+	fp = NULL;
+	if (rename(tmp_path, cache_path))
+		goto error_close;
+	goto end;
 
 error:
-	g_free(ctf_index);
-	return ret;
+	if (fp)
+		fclose(fp);
+error_close:
+	if (tmp_path)
+		(void) unlink(tmp_path);
+	printf_verbose("Unable to write packet index cache \"%s\".\n",
+		cache_path);
+end:
+	g_free(tmp_path);
+	g_free(cache_dir);
+	g_free(cache_path);
 }
 
 /*
+ * Open a stream file and create its trace packet header definitions.
+ * *_file_stream is left NULL for files which do not hold a stream
+ * (subdirectories, empty files). The stream class is only known once
+ * the first packet is read by ctf_file_stream_index().
+ *
  * Note: many file streams can inherit from the same stream class
  * description (metadata).
  */
 static
 int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
-			int whence))
+			int whence),
+		struct ctf_file_stream **_file_stream)
 {
 	int ret, fd, closeret;
 	struct ctf_file_stream *file_stream;
 	struct stat statbuf;
-	char *index_name;
 
+	*_file_stream = NULL;
 	fd = openat(td->dirfd, path, flags);
 	if (fd < 0) {
 		perror("File stream openat()");
@@ -1987,6 +2927,22 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	ret = ctf_init_pos(&file_stream->pos, &td->parent, fd, flags);
 	if (ret)
 		goto error_def;
+	if (opt_map_whole_file && (flags & O_ACCMODE) == O_RDONLY)
+		ctf_pos_map_file(&file_stream->pos, statbuf.st_size);
+	/*
+	 * Packets read ahead go through io_uring when available, with one
+	 * buffer for the current packet and one per packet read ahead.
+	 */
+	if (opt_read_packets && opt_readahead_packets > 0
+			&& !file_stream->pos.file_mma
+			&& (flags & O_ACCMODE) == O_RDONLY)
+		file_stream->pos.loader = ctf_packet_loader_create(fd,
+			opt_readahead_packets + 1);
+	if (opt_decode_threads && (flags & O_ACCMODE) == O_RDONLY) {
+		file_stream->decoder_start = ctf_stream_decoder_start;
+		file_stream->decoder_read = ctf_stream_decoder_read;
+		file_stream->decoder_stop = ctf_stream_decoder_stop;
+	}
 	ret = create_trace_definitions(td, &file_stream->parent);
 	if (ret)
 		goto error_def;
@@ -1994,6 +2950,46 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	 * For now, only a single clock per trace is supported.
 	 */
 	file_stream->parent.current_clock = td->parent.single_clock;
+	*_file_stream = file_stream;
+	return 0;
+
+error_def:
+	closeret = ctf_fini_pos(&file_stream->pos);
+	if (closeret) {
+		fprintf(stderr, "Error on ctf_fini_pos\n");
+	}
+	g_free(file_stream);
+fd_is_empty_file:
+fd_is_dir_ok:
+fstat_error:
+	closeret = close(fd);
+	if (closeret) {
+		perror("Error on fd close");
+	}
+error:
+	return ret;
+}
+
+/*
+ * Import or build the packet index of an opened stream file, and
+ * assign its stream class. This only touches the file stream itself
+ * and read-only metadata, except for stream_assign_class() which is
+ * serialized, so distinct file streams can be indexed concurrently.
+ */
+static
+int ctf_file_stream_index(struct ctf_trace *td,
+		struct ctf_file_stream *file_stream)
+{
+	const char *path = file_stream->parent.path;
+	struct stat statbuf;
+	char *index_name;
+	int ret;
+
+	ret = fstat(file_stream->pos.fd, &statbuf);
+	if (ret) {
+		perror("File stream fstat()");
+		return ret;
+	}
 
 	/*
 	 * Allocate the index name for this stream and try to open it.
@@ -2001,20 +2997,25 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	index_name = malloc((strlen(path) + sizeof(INDEX_PATH)) * sizeof(char));
 	if (!index_name) {
 		fprintf(stderr, "[error] Cannot allocate index filename\n");
-		ret = -ENOMEM;
-		goto error_def;
+		return -ENOMEM;
 	}
 	snprintf(index_name, strlen(path) + sizeof(INDEX_PATH),
 			INDEX_PATH, path);
 
-	if (faccessat(td->dirfd, index_name, O_RDONLY, flags) < 0) {
-		ret = create_stream_packet_index(td, file_stream);
-		if (ret) {
-			fprintf(stderr, "[error] Stream index creation error.\n");
-			goto error_index;
+	if (faccessat(td->dirfd, index_name, O_RDONLY, td->flags) < 0) {
+		if (opt_no_index_cache || import_stream_packet_index_cache(td,
+				file_stream, &statbuf)) {
+			ret = create_stream_packet_index(td, file_stream);
+			if (ret) {
+				fprintf(stderr, "[error] Stream index creation error.\n");
+				goto error_free;
+			}
+			if (!opt_no_index_cache)
+				write_stream_packet_index_cache(td, file_stream,
+					&statbuf);
 		}
 	} else {
-		ret = openat(td->dirfd, index_name, flags);
+		ret = openat(td->dirfd, index_name, td->flags);
 		if (ret < 0) {
 			perror("Index file openat()");
 			ret = -1;
@@ -2023,6 +3024,7 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 		file_stream->pos.index_fp = fdopen(ret, "r");
 		if (!file_stream->pos.index_fp) {
 			perror("fdopen() error");
+			ret = -1;
 			goto error_free;
 		}
 		ret = import_stream_packet_index(td, file_stream);
@@ -2031,44 +3033,168 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 			goto error_index;
 		}
 		ret = fclose(file_stream->pos.index_fp);
+		file_stream->pos.index_fp = NULL;
 		if (ret < 0) {
 			perror("close index");
 			goto error_free;
 		}
 	}
 	free(index_name);
-
-	/* Add stream file to stream class */
-	g_ptr_array_add(file_stream->parent.stream_class->streams,
-			&file_stream->parent);
 	return 0;
 
 error_index:
-	if (file_stream->pos.index_fp) {
-		ret = fclose(file_stream->pos.index_fp);
-		if (ret < 0) {
-			perror("close index");
-		}
-	}
-	if (file_stream->parent.trace_packet_header)
-		bt_definition_unref(&file_stream->parent.trace_packet_header->p);
+	if (fclose(file_stream->pos.index_fp) < 0)
+		perror("close index");
+	file_stream->pos.index_fp = NULL;
 error_free:
 	free(index_name);
-error_def:
-	closeret = ctf_fini_pos(&file_stream->pos);
-	if (closeret) {
-		fprintf(stderr, "Error on ctf_fini_pos\n");
+	return ret;
+}
+
+static
+void ctf_destroy_stream_read_state(struct ctf_stream_definition *stream)
+{
+	int i;
+
+	if (stream->events_by_id) {
+		for (i = 0; i < stream->events_by_id->len; i++) {
+			struct ctf_event_definition *event;
+
+			event = g_ptr_array_index(stream->events_by_id, i);
+			if (!event)
+				continue;
+			destroy_event_programs(event);
+		}
 	}
-	g_free(file_stream);
-fd_is_empty_file:
-fd_is_dir_ok:
-fstat_error:
-	closeret = close(fd);
-	if (closeret) {
+	ctf_decode_program_destroy(stream->event_header_program);
+	stream->event_header_program = NULL;
+	g_free(stream->header_v_choices);
+	stream->header_v_choices = NULL;
+	stream->header_v_nr_choices = 0;
+}
+
+/*
+ * Release the read state, definitions and events of a stream which is
+ * not owned by its stream class.
+ */
+static
+void ctf_destroy_stream_definitions(struct ctf_stream_definition *stream)
+{
+	int i;
+
+	ctf_destroy_stream_read_state(stream);
+	for (i = 0; stream->events_by_id && i < stream->events_by_id->len; i++) {
+		struct ctf_event_definition *event;
+
+		event = g_ptr_array_index(stream->events_by_id, i);
+		if (!event)
+			continue;
+		if (event->event_fields)
+			bt_definition_unref(&event->event_fields->p);
+		if (event->event_context)
+			bt_definition_unref(&event->event_context->p);
+		g_free(event);
+	}
+	if (stream->events_by_id)
+		g_ptr_array_free(stream->events_by_id, TRUE);
+	stream->events_by_id = NULL;
+	if (stream->stream_event_context)
+		bt_definition_unref(&stream->stream_event_context->p);
+	stream->stream_event_context = NULL;
+	if (stream->stream_event_header)
+		bt_definition_unref(&stream->stream_event_header->p);
+	stream->stream_event_header = NULL;
+	if (stream->stream_packet_context)
+		bt_definition_unref(&stream->stream_packet_context->p);
+	stream->stream_packet_context = NULL;
+	if (stream->trace_packet_header)
+		bt_definition_unref(&stream->trace_packet_header->p);
+	stream->trace_packet_header = NULL;
+}
+
+/*
+ * Release a file stream opened by ctf_open_file_stream_read() which has
+ * not been added to its stream class.
+ */
+static
+void ctf_discard_file_stream(struct ctf_file_stream *file_stream)
+{
+	ctf_destroy_stream_definitions(&file_stream->parent);
+	if (ctf_fini_pos(&file_stream->pos))
+		fprintf(stderr, "Error on ctf_fini_pos\n");
+	if (close(file_stream->pos.fd))
 		perror("Error on fd close");
+	g_free(file_stream);
+}
+
+struct ctf_index_work {
+	struct ctf_trace *td;
+	GPtrArray *file_streams;	/* Array of struct ctf_file_stream */
+	int *ret;			/* Index result of each file stream */
+	pthread_mutex_t lock;		/* Protects next */
+	unsigned int next;		/* Next file stream to index */
+};
+
+static
+void *ctf_index_worker(void *arg)
+{
+	struct ctf_index_work *work = arg;
+
+	for (;;) {
+		unsigned int i;
+
+		pthread_mutex_lock(&work->lock);
+		i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+		if (i >= work->file_streams->len)
+			break;
+		work->ret[i] = ctf_file_stream_index(work->td,
+			g_ptr_array_index(work->file_streams, i));
 	}
-error:
-	return ret;
+	return NULL;
+}
+
+/*
+ * Index all file streams, spreading them over one thread per online
+ * CPU. The calling thread takes part in the work, so failing to create
+ * threads only reduces parallelism. ret[i] receives the result for
+ * file stream i.
+ */
+static
+void ctf_index_file_streams(struct ctf_trace *td, GPtrArray *file_streams,
+		int *ret)
+{
+	struct ctf_index_work work;
+	pthread_t *threads;
+	long nr_threads;
+	int i, nr_started = 0;
+
+	work.td = td;
+	work.file_streams = file_streams;
+	work.ret = ret;
+	pthread_mutex_init(&work.lock, NULL);
+	work.next = 0;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads > file_streams->len)
+		nr_threads = file_streams->len;
+	if (nr_threads < 1)
+		nr_threads = 1;
+	/* The calling thread is the last worker. */
+	threads = g_new0(pthread_t, nr_threads);
+	for (i = 0; i < nr_threads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, ctf_index_worker,
+				&work))
+			break;
+		nr_started++;
+	}
+	printf_verbose("Indexing %u stream files with %d threads.\n",
+		file_streams->len, nr_started + 1);
+	ctf_index_worker(&work);
+	for (i = 0; i < nr_started; i++)
+		pthread_join(threads[i], NULL);
+	g_free(threads);
+	pthread_mutex_destroy(&work.lock);
 }
 
 static
@@ -2083,6 +3209,10 @@ int ctf_open_trace_read(struct ctf_trace *td,
 	struct dirent *diriter;
 	size_t dirent_len;
 	char *ext;
+	GPtrArray *file_streams;
+	struct ctf_file_stream *file_stream;
+	int *index_ret;
+	unsigned int i;
 
 	td->flags = flags;
 
@@ -2135,6 +3265,7 @@ int ctf_open_trace_read(struct ctf_trace *td,
 			fpathconf(td->dirfd, _PC_NAME_MAX) + 1;
 
 	dirent = malloc(dirent_len);
+	file_streams = g_ptr_array_new();
 
 	for (;;) {
 		ret = readdir_r(td->dir, dirent, &diriter);
@@ -2157,17 +3288,47 @@ int ctf_open_trace_read(struct ctf_trace *td,
 		}
 
 		ret = ctf_open_file_stream_read(td, diriter->d_name,
-					flags, packet_seek);
+					flags, packet_seek, &file_stream);
 		if (ret) {
 			fprintf(stderr, "[error] Open file stream error.\n");
 			goto readdir_error;
 		}
+		if (file_stream)
+			g_ptr_array_add(file_streams, file_stream);
 	}
 
+	/*
+	 * Index stream files concurrently, then add them to their stream
+	 * class in directory order, as if they had been opened one after
+	 * the other: stop at the first stream which failed.
+	 */
+	index_ret = g_new0(int, file_streams->len);
+	ctf_index_file_streams(td, file_streams, index_ret);
+	for (i = 0; i < file_streams->len; i++) {
+		file_stream = g_ptr_array_index(file_streams, i);
+		if (!ret && index_ret[i]) {
+			ret = index_ret[i];
+			fprintf(stderr, "[error] Open file stream error.\n");
+		}
+		if (ret) {
+			ctf_discard_file_stream(file_stream);
+			continue;
+		}
+		/* Add stream file to stream class */
+		g_ptr_array_add(file_stream->parent.stream_class->streams,
+				&file_stream->parent);
+	}
+	g_free(index_ret);
+	g_ptr_array_free(file_streams, TRUE);
 	free(dirent);
+	if (ret)
+		goto error_metadata;
 	return 0;
 
 readdir_error:
+	for (i = 0; i < file_streams->len; i++)
+		ctf_discard_file_stream(g_ptr_array_index(file_streams, i));
+	g_ptr_array_free(file_streams, TRUE);
 	free(dirent);
 error_metadata:
 	closeret = close(td->dirfd);
@@ -2480,11 +3641,298 @@ int ctf_convert_index_timestamp(struct bt_trace_descriptor *tdp)
 	return 0;
 }
 
+/*
+ * Batch reads (bt_ctf_iter_read_events()) keep several decoded events
+ * of a file stream valid at once by decoding them into alternate sets
+ * of event-level definitions, or views. Views share the trace packet
+ * header and stream packet context of their file stream, which keeps
+ * the decoder state: the batch reader makes sure a stream does not
+ * switch packet while some of its events are in use.
+ */
+static
+struct ctf_stream_definition *ctf_stream_view_create(
+		struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	struct ctf_stream_definition *view;
+	int ret;
+
+	view = g_new0(struct ctf_stream_definition, 1);
+	view->stream_class = stream->stream_class;
+	view->stream_id = stream->stream_id;
+	view->current_clock = stream->current_clock;
+	strcpy(view->path, stream->path);
+	if (stream->trace_packet_header) {
+		bt_definition_ref(&stream->trace_packet_header->p);
+		view->trace_packet_header = stream->trace_packet_header;
+		view->parent_def_scope = stream->trace_packet_header->p.scope;
+	}
+	if (stream->stream_packet_context) {
+		bt_definition_ref(&stream->stream_packet_context->p);
+		view->stream_packet_context = stream->stream_packet_context;
+		view->parent_def_scope = stream->stream_packet_context->p.scope;
+	}
+	ret = create_stream_definitions(stream->stream_class->trace, view);
+	if (ret) {
+		if (view->trace_packet_header)
+			bt_definition_unref(&view->trace_packet_header->p);
+		g_free(view);
+		return NULL;
+	}
+	return view;
+}
+
+static
+void ctf_stream_view_destroy(struct ctf_stream_definition *view)
+{
+	ctf_destroy_stream_definitions(view);
+	g_free(view);
+}
+
+/*
+ * Event snapshots hold a copy of all the definitions of an event, so
+ * it can be used after its stream moves on, possibly from another
+ * thread. A snapshot only has the event-level definitions of the event
+ * class it is created for, and can be reused for other events of this
+ * class.
+ */
+struct ctf_stream_definition *ctf_event_snapshot_create(
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_trace *td = stream_class->trace;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	struct ctf_stream_definition *snapshot;
+	uint64_t id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return NULL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return NULL;
+	}
+
+	snapshot = g_new0(struct ctf_stream_definition, 1);
+	snapshot->stream_class = stream_class;
+	snapshot->stream_id = stream->stream_id;
+	snapshot->current_clock = stream->current_clock;
+	strcpy(snapshot->path, stream->path);
+	if (create_trace_definitions(td, snapshot))
+		goto error;
+	if (_create_stream_definitions(td, snapshot, 0))
+		goto error;
+	g_ptr_array_set_size(snapshot->events_by_id, id + 1);
+	event = create_event_definitions(td, snapshot, event_class);
+	if (!event)
+		goto error;
+	g_ptr_array_index(snapshot->events_by_id, id) = event;
+	snapshot->event_id = id;
+	return snapshot;
+
+error:
+	ctf_event_snapshot_destroy(snapshot);
+	return NULL;
+}
+
+int ctf_event_snapshot_copy(struct ctf_stream_definition *snapshot,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_event_definition *src, *dst;
+	int ret;
+
+	if (stream->event_id >= snapshot->events_by_id->len)
+		return -EINVAL;
+	src = g_ptr_array_index(stream->events_by_id, stream->event_id);
+	dst = g_ptr_array_index(snapshot->events_by_id, stream->event_id);
+	if (!src || !dst)
+		return -EINVAL;
+	ret = ctf_decode_event_fields(src);
+	if (ret)
+		return ret;
+
+	snapshot->stream_id = stream->stream_id;
+	snapshot->event_id = stream->event_id;
+	snapshot->has_timestamp = stream->has_timestamp;
+	snapshot->real_timestamp = stream->real_timestamp;
+	snapshot->cycles_timestamp = stream->cycles_timestamp;
+
+	if (stream->trace_packet_header) {
+		ret = bt_definition_copy(&snapshot->trace_packet_header->p,
+				&stream->trace_packet_header->p);
+		if (ret)
+			return ret;
+	}
+	if (stream->stream_packet_context) {
+		ret = bt_definition_copy(&snapshot->stream_packet_context->p,
+				&stream->stream_packet_context->p);
+		if (ret)
+			return ret;
+	}
+	if (stream->stream_event_header) {
+		ret = bt_definition_copy(&snapshot->stream_event_header->p,
+				&stream->stream_event_header->p);
+		if (ret)
+			return ret;
+	}
+	if (stream->stream_event_context) {
+		ret = bt_definition_copy(&snapshot->stream_event_context->p,
+				&stream->stream_event_context->p);
+		if (ret)
+			return ret;
+	}
+	if (src->event_context) {
+		ret = bt_definition_copy(&dst->event_context->p,
+				&src->event_context->p);
+		if (ret)
+			return ret;
+	}
+	if (src->event_fields) {
+		ret = bt_definition_copy(&dst->event_fields->p,
+				&src->event_fields->p);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+void ctf_event_snapshot_destroy(struct ctf_stream_definition *snapshot)
+{
+	ctf_stream_view_destroy(snapshot);
+}
+
+/*
+ * Return view i of a file stream, creating it on first use.
+ */
+static
+struct ctf_stream_definition *ctf_file_stream_get_view(
+		struct ctf_file_stream *file_stream, unsigned int i)
+{
+	struct ctf_stream_declaration *stream_class =
+		file_stream->parent.stream_class;
+	struct ctf_stream_definition *view;
+
+	if (!file_stream->views) {
+		file_stream->views = g_ptr_array_sized_new(
+				CTF_FILE_STREAM_NR_VIEWS);
+		g_ptr_array_set_size(file_stream->views,
+				CTF_FILE_STREAM_NR_VIEWS);
+	}
+	view = g_ptr_array_index(file_stream->views, i);
+	if (!view) {
+		view = ctf_stream_view_create(file_stream);
+		if (!view)
+			return NULL;
+		g_ptr_array_index(file_stream->views, i) = view;
+	}
+	/* Event classes may have been added by a metadata update. */
+	if (view->events_by_id->len < stream_class->events_by_id->len) {
+		if (copy_event_declarations_stream_class_to_stream(
+				stream_class->trace, stream_class, view))
+			return NULL;
+	}
+	return view;
+}
+
+void ctf_file_stream_reserve_view(struct ctf_file_stream *file_stream,
+		unsigned int nr_held)
+{
+	GPtrArray *views = file_stream->views;
+	unsigned int i = file_stream->next_view;
+
+	if (!views || nr_held < views->len)
+		return;
+	/*
+	 * The held events fill the ring up to the view preceding
+	 * next_view: insert an empty view before the oldest one.
+	 */
+	g_ptr_array_add(views, NULL);
+	memmove(&views->pdata[i + 1], &views->pdata[i],
+		(views->len - 1 - i) * sizeof(gpointer));
+	views->pdata[i] = NULL;
+}
+
+int ctf_file_stream_alloc_views(struct ctf_file_stream *file_stream)
+{
+	unsigned int i;
+
+	for (i = 0; i < CTF_FILE_STREAM_NR_VIEWS; i++) {
+		if (!ctf_file_stream_get_view(file_stream, i))
+			return -EINVAL;
+	}
+	return 0;
+}
+
+int ctf_file_stream_decode_view(struct ctf_file_stream *file_stream,
+		struct ctf_stream_definition *view)
+{
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	struct ctf_stream_pos *pos = &file_stream->pos;
+
+	view->prev = stream->prev;
+	view->current = stream->current;
+	view->events_discarded = stream->events_discarded;
+	return pos->parent.event_cb(&pos->parent, view);
+}
+
+int ctf_file_stream_read_view(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	struct ctf_stream_definition *view;
+	int ret;
+
+	/* The decoder thread owns the position while it runs. */
+	assert(!file_stream->decoder);
+	view = ctf_file_stream_get_view(file_stream, file_stream->next_view);
+	if (!view)
+		return -EINVAL;
+	view->cycles_timestamp = stream->cycles_timestamp;
+	view->real_timestamp = stream->real_timestamp;
+	ret = ctf_file_stream_decode_view(file_stream, view);
+	if (ret)
+		return ret;
+	stream->cycles_timestamp = view->cycles_timestamp;
+	stream->real_timestamp = view->real_timestamp;
+	stream->event_id = view->event_id;
+	stream->has_timestamp = view->has_timestamp;
+	file_stream->cur_def = view;
+	file_stream->next_view = (file_stream->next_view + 1)
+		% file_stream->views->len;
+	return 0;
+}
+
+static
+void ctf_file_stream_destroy_views(struct ctf_file_stream *file_stream)
+{
+	unsigned int i;
+
+	if (file_stream->views) {
+		for (i = 0; i < file_stream->views->len; i++) {
+			struct ctf_stream_definition *view;
+
+			view = g_ptr_array_index(file_stream->views, i);
+			if (view)
+				ctf_stream_view_destroy(view);
+		}
+		g_ptr_array_free(file_stream->views, TRUE);
+		file_stream->views = NULL;
+	}
+	file_stream->next_view = 0;
+	file_stream->cur_def = NULL;
+}
+
 static
 int ctf_close_file_stream(struct ctf_file_stream *file_stream)
 {
 	int ret;
 
+	if (file_stream->decoder)
+		file_stream->decoder_stop(file_stream);
+	ctf_file_stream_destroy_views(file_stream);
+	ctf_destroy_stream_read_state(&file_stream->parent);
 	ret = ctf_fini_pos(&file_stream->pos);
 	if (ret) {
 		fprintf(stderr, "Error on ctf_fini_pos\n");
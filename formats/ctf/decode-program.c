@@ -0,0 +1,428 @@
+/*
+ * decode-program.c
+ *
+ * Babeltrace Library
+ *
+ * Precompiled event decode programs.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/decode-program.h>
+#include <babeltrace/endian.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+
+struct ctf_decode_program *ctf_decode_program_create(rw_dispatch *rw_table)
+{
+	struct ctf_decode_program *program;
+
+	program = g_new0(struct ctf_decode_program, 1);
+	program->ops = g_array_new(FALSE, TRUE, sizeof(struct ctf_decode_op));
+	program->rw_table = rw_table;
+	/* Nothing is known about the position a program starts at. */
+	program->known_align = 1;
+	program->known_offset = 0;
+	return program;
+}
+
+void ctf_decode_program_destroy(struct ctf_decode_program *program)
+{
+	if (!program)
+		return;
+	g_array_free(program->ops, TRUE);
+	g_free(program);
+}
+
+static
+void program_emit(struct ctf_decode_program *program,
+		const struct ctf_decode_op *op)
+{
+	g_array_append_val(program->ops, *op);
+}
+
+/*
+ * Account for an alignment of "align" bits. Emits an ALIGN op unless
+ * the current position is statically known to be aligned already.
+ * "emit" is 0 when the alignment is performed by a called read
+ * function, in which case only the compile-time state is updated.
+ */
+static
+void program_align(struct ctf_decode_program *program, uint64_t align,
+		int emit)
+{
+	if (align <= 1)
+		return;
+	if (align <= program->known_align) {
+		if (!(program->known_offset & (align - 1)))
+			return;
+		program->known_offset = ALIGN(program->known_offset, align)
+			& (program->known_align - 1);
+	} else {
+		program->known_align = align;
+		program->known_offset = 0;
+	}
+	if (emit) {
+		struct ctf_decode_op op;
+
+		memset(&op, 0, sizeof(op));
+		op.opcode = CTF_DECODE_OP_ALIGN;
+		op.align = align;
+		program_emit(program, &op);
+	}
+}
+
+static
+void program_move(struct ctf_decode_program *program, uint64_t len)
+{
+	program->known_offset = (program->known_offset + len)
+		& (program->known_align - 1);
+}
+
+/* Forget everything known about the position (variable-size field). */
+static
+void program_unknown(struct ctf_decode_program *program)
+{
+	program->known_align = 1;
+	program->known_offset = 0;
+}
+
+static
+void program_emit_call(struct ctf_decode_program *program,
+		struct bt_definition *definition)
+{
+	struct ctf_decode_op op;
+
+	memset(&op, 0, sizeof(op));
+	op.opcode = CTF_DECODE_OP_CALL;
+	op.read = program->rw_table[definition->declaration->id];
+	op.definition = definition;
+	assert(op.read != NULL);
+	program_emit(program, &op);
+}
+
+static
+void program_append_integer(struct ctf_decode_program *program,
+		struct bt_definition *definition)
+{
+	struct definition_integer *integer_definition =
+		container_of(definition, struct definition_integer, p);
+	const struct declaration_integer *integer_declaration =
+		integer_definition->declaration;
+	enum bt_integer_access access = integer_declaration->access;
+	struct ctf_decode_op op;
+
+	memset(&op, 0, sizeof(op));
+	if (access == BT_INTEGER_ACCESS_UNKNOWN)
+		access = bt_integer_declaration_access(integer_declaration);
+	if (access == BT_INTEGER_ACCESS_BITFIELD)
+		goto call;
+	switch (integer_declaration->len) {
+	case 8:
+		op.opcode = CTF_DECODE_OP_INT8;
+		break;
+	case 16:
+		op.opcode = CTF_DECODE_OP_INT16;
+		break;
+	case 32:
+		op.opcode = CTF_DECODE_OP_INT32;
+		break;
+	case 64:
+		op.opcode = CTF_DECODE_OP_INT64;
+		break;
+	default:
+		goto call;
+	}
+	program_align(program, integer_declaration->p.alignment, 1);
+	op.signedness = !!integer_declaration->signedness;
+	op.rbo = (access == BT_INTEGER_ACCESS_REVERSE);
+	op.definition = definition;
+	program_emit(program, &op);
+	program_move(program, integer_declaration->len);
+	return;
+
+call:
+	/* Bitfield: the integer read function aligns by itself. */
+	program_emit_call(program, definition);
+	program_align(program, integer_declaration->p.alignment, 0);
+	program_move(program, integer_declaration->len);
+}
+
+int ctf_decode_program_append(struct ctf_decode_program *program,
+		struct bt_definition *definition)
+{
+	struct bt_declaration *declaration = definition->declaration;
+	int ret;
+
+	switch (declaration->id) {
+	case CTF_TYPE_STRUCT:
+	{
+		struct definition_struct *struct_definition =
+			container_of(definition, struct definition_struct, p);
+		unsigned long i;
+
+		/* Unroll structure fields into the program. */
+		program_align(program, declaration->alignment, 1);
+		for (i = 0; i < struct_definition->fields->len; i++) {
+			struct bt_definition *field =
+				g_ptr_array_index(struct_definition->fields, i);
+
+			ret = ctf_decode_program_append(program, field);
+			if (ret)
+				return ret;
+		}
+		break;
+	}
+	case CTF_TYPE_INTEGER:
+		program_append_integer(program, definition);
+		break;
+	case CTF_TYPE_ENUM:
+	{
+		struct definition_enum *enum_definition =
+			container_of(definition, struct definition_enum, p);
+		const struct declaration_integer *integer_declaration =
+			enum_definition->integer->declaration;
+
+		/* Fixed size, but the quark set must be updated. */
+		program_emit_call(program, definition);
+		program_align(program, integer_declaration->p.alignment, 0);
+		program_move(program, integer_declaration->len);
+		break;
+	}
+	case CTF_TYPE_STRING:
+		program_emit_call(program, definition);
+		/* Strings always end on a byte boundary. */
+		program_unknown(program);
+		program_align(program, CHAR_BIT, 0);
+		break;
+	case CTF_TYPE_FLOAT:
+	case CTF_TYPE_VARIANT:
+	case CTF_TYPE_ARRAY:
+	case CTF_TYPE_SEQUENCE:
+		program_emit_call(program, definition);
+		program_unknown(program);
+		break;
+	default:
+		fprintf(stderr, "[error] %s: unexpected type %d\n",
+			__func__, (int) declaration->id);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static inline
+int decode_aligned_integer(struct ctf_stream_pos *pos,
+		const struct ctf_decode_op *op, size_t len)
+{
+	struct definition_integer *integer_definition =
+		container_of(op->definition, struct definition_integer, p);
+	const char *addr;
+
+	if (unlikely(!ctf_pos_access_ok(pos, len)))
+		return -EFAULT;
+	addr = ctf_get_pos_addr(pos);
+	switch (len) {
+	case 8:
+	{
+		uint8_t v;
+
+		memcpy(&v, addr, sizeof(v));
+		if (op->signedness)
+			integer_definition->value._signed = (int8_t) v;
+		else
+			integer_definition->value._unsigned = v;
+		break;
+	}
+	case 16:
+	{
+		uint16_t v;
+
+		memcpy(&v, addr, sizeof(v));
+		if (op->rbo)
+			v = GUINT16_SWAP_LE_BE(v);
+		if (op->signedness)
+			integer_definition->value._signed = (int16_t) v;
+		else
+			integer_definition->value._unsigned = v;
+		break;
+	}
+	case 32:
+	{
+		uint32_t v;
+
+		memcpy(&v, addr, sizeof(v));
+		if (op->rbo)
+			v = GUINT32_SWAP_LE_BE(v);
+		if (op->signedness)
+			integer_definition->value._signed = (int32_t) v;
+		else
+			integer_definition->value._unsigned = v;
+		break;
+	}
+	case 64:
+	{
+		uint64_t v;
+
+		memcpy(&v, addr, sizeof(v));
+		if (op->rbo)
+			v = GUINT64_SWAP_LE_BE(v);
+		integer_definition->value._unsigned = v;
+		break;
+	}
+	default:
+		assert(0);
+	}
+	pos->offset += len;
+	return 0;
+}
+
+int ctf_decode_program_read(struct ctf_decode_program *program,
+		struct bt_stream_pos *ppos)
+{
+	struct ctf_stream_pos *pos = ctf_pos(ppos);
+	const struct ctf_decode_op *op, *end;
+	int ret;
+
+	op = (const struct ctf_decode_op *) program->ops->data;
+	end = op + program->ops->len;
+	for (; op < end; op++) {
+		switch (op->opcode) {
+		case CTF_DECODE_OP_ALIGN:
+			if (unlikely(!ctf_align_pos(pos, op->align)))
+				return -EFAULT;
+			break;
+		case CTF_DECODE_OP_INT8:
+			ret = decode_aligned_integer(pos, op, 8);
+			if (unlikely(ret))
+				return ret;
+			break;
+		case CTF_DECODE_OP_INT16:
+			ret = decode_aligned_integer(pos, op, 16);
+			if (unlikely(ret))
+				return ret;
+			break;
+		case CTF_DECODE_OP_INT32:
+			ret = decode_aligned_integer(pos, op, 32);
+			if (unlikely(ret))
+				return ret;
+			break;
+		case CTF_DECODE_OP_INT64:
+			ret = decode_aligned_integer(pos, op, 64);
+			if (unlikely(ret))
+				return ret;
+			break;
+		case CTF_DECODE_OP_CALL:
+			ret = op->read(ppos, op->definition);
+			if (unlikely(ret))
+				return ret;
+			break;
+		default:
+			assert(0);
+		}
+	}
+	return 0;
+}
+
+static
+int fixed_len(const struct bt_declaration *declaration, uint64_t *offset)
+{
+	switch (declaration->id) {
+	case CTF_TYPE_INTEGER:
+	{
+		const struct declaration_integer *integer_declaration =
+			container_of(declaration, const struct declaration_integer, p);
+
+		*offset = ALIGN(*offset, declaration->alignment)
+			+ integer_declaration->len;
+		return 0;
+	}
+	case CTF_TYPE_ENUM:
+	{
+		const struct declaration_enum *enum_declaration =
+			container_of(declaration, const struct declaration_enum, p);
+
+		return fixed_len(&enum_declaration->integer_declaration->p,
+				offset);
+	}
+	case CTF_TYPE_FLOAT:
+	{
+		const struct declaration_float *float_declaration =
+			container_of(declaration, const struct declaration_float, p);
+
+		*offset = ALIGN(*offset, declaration->alignment)
+			+ float_declaration->sign->len
+			+ float_declaration->mantissa->len
+			+ float_declaration->exp->len;
+		return 0;
+	}
+	case CTF_TYPE_STRUCT:
+	{
+		const struct declaration_struct *struct_declaration =
+			container_of(declaration, const struct declaration_struct, p);
+		unsigned long i;
+
+		*offset = ALIGN(*offset, declaration->alignment);
+		for (i = 0; i < struct_declaration->fields->len; i++) {
+			struct declaration_field *field =
+				&g_array_index(struct_declaration->fields,
+					struct declaration_field, i);
+
+			if (fixed_len(field->declaration, offset))
+				return -1;
+		}
+		return 0;
+	}
+	case CTF_TYPE_ARRAY:
+	{
+		const struct declaration_array *array_declaration =
+			container_of(declaration, const struct declaration_array, p);
+		size_t i;
+
+		/* Whether empty arrays align depends on their element type. */
+		if (!array_declaration->len)
+			return -1;
+		for (i = 0; i < array_declaration->len; i++) {
+			if (fixed_len(array_declaration->elem, offset))
+				return -1;
+		}
+		return 0;
+	}
+	default:
+		return -1;
+	}
+}
+
+int ctf_decode_fixed_len(const struct bt_declaration *declaration,
+		uint64_t *len)
+{
+	uint64_t offset = 0;
+
+	if (fixed_len(declaration, &offset))
+		return -1;
+	*len = offset;
+	return 0;
+}
@@ -0,0 +1,440 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Event decoder threads, at most one per processor.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Decoder threads read the events of file streams ahead of the
+ * iterator, each event into one of the views of its stream. There are
+ * at most as many decoder threads as processors: each thread decodes
+ * the streams of its group in turn, one event at a time, and new
+ * streams join the group with the fewest streams once all threads are
+ * started. A thread exits when the last stream of its group leaves.
+ *
+ * Decoded events are handed over through a ring of
+ * CTF_FILE_STREAM_NR_VIEWS records per stream: ring slot i always
+ * decodes into view i. Batch reads may have added views to the stream:
+ * the decoder only uses the first ones, and the view following the
+ * held event wraps over all of them. The iterator keeps merging
+ * streams in timestamp order on its own thread, so the output order is
+ * the same as with synchronous reads.
+ *
+ * The event last returned to the iterator is "held": its view is not
+ * reused, and the decoder does not switch packet while the iterator
+ * holds an event or has events left to consume, since events share the
+ * packet-level definitions of the stream. Lazy payload decoding is
+ * done by the decoder too, as it moves the stream position.
+ *
+ * While a decoder runs, the thread of its group owns the stream
+ * position: offset, content size, hold_packet and packet switches. The
+ * iterator thread only takes events through the ring, under the group
+ * lock, and reads the packet-level fields of the position (packet
+ * index, current index, content size) of the held event's packet,
+ * which do not change while the event is held. Anything else needs the
+ * decoder stopped first: synchronous reads of the stream assert it.
+ *
+ * Stopping a decoder moves the stream position back right after the
+ * held event, so synchronous reads, seeks and position saves see the
+ * stream as if the events decoded ahead had never been read.
+ */
+
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+#include <pthread.h>
+
+struct ctf_decoder_record {
+	int status;			/* 0 for an event, else event_cb result */
+	int64_t last_offset;		/* start of the event */
+	int64_t offset;			/* end of the event */
+};
+
+struct ctf_decoder_group {
+	pthread_t thread;
+	pthread_mutex_t lock;		/* Protects the group and its decoders */
+	pthread_cond_t cond;		/* Signaled on any change */
+	GPtrArray *decoders;		/* struct ctf_stream_decoder * */
+	unsigned int next;		/* decoder to look at first */
+	int exit;			/* group thread must exit */
+};
+
+struct ctf_stream_decoder {
+	struct ctf_file_stream *file_stream;
+	struct ctf_decoder_group *group;
+	/* Protected by the group lock */
+	struct ctf_decoder_record records[CTF_FILE_STREAM_NR_VIEWS];
+	unsigned int head, tail;	/* ring counters, slot = count % size */
+	int held;			/* iterator holds an event */
+	int stop;			/* decoder is leaving its group */
+	int busy;			/* group thread decodes an event */
+	int blocked;			/* next event is in another packet */
+	int done;			/* status posted, nothing left to decode */
+	/* Consumer state */
+	struct ctf_decoder_record held_record;
+	unsigned int resume_view;	/* view following the held event */
+	/* Group thread state */
+	uint64_t cycles_timestamp;
+	uint64_t real_timestamp;
+};
+
+/* Serializes group creation, destruction and membership changes. */
+static pthread_mutex_t decoder_groups_lock = PTHREAD_MUTEX_INITIALIZER;
+static GPtrArray *decoder_groups;	/* struct ctf_decoder_group * */
+
+/*
+ * Decode the next event of the stream into the view of ring slot.
+ * Returns the stream event_cb result.
+ */
+static
+int decoder_decode(struct ctf_stream_decoder *decoder, unsigned int slot)
+{
+	struct ctf_file_stream *file_stream = decoder->file_stream;
+	struct ctf_decoder_record *record = &decoder->records[slot];
+	struct ctf_stream_definition *view =
+		g_ptr_array_index(file_stream->views, slot);
+	struct ctf_event_definition *event;
+	int ret;
+
+	view->cycles_timestamp = decoder->cycles_timestamp;
+	view->real_timestamp = decoder->real_timestamp;
+	ret = ctf_file_stream_decode_view(file_stream, view);
+	if (ret)
+		goto end;
+	event = g_ptr_array_index(view->events_by_id, view->event_id);
+	ret = ctf_decode_event_fields(event);
+	if (ret)
+		goto end;
+	decoder->cycles_timestamp = view->cycles_timestamp;
+	decoder->real_timestamp = view->real_timestamp;
+	record->last_offset = file_stream->pos.last_offset;
+	record->offset = file_stream->pos.offset;
+end:
+	record->status = ret;
+	return ret;
+}
+
+/*
+ * Whether the group thread can decode the next event of decoder.
+ * Called with the group lock held.
+ */
+static
+int decoder_ready(struct ctf_stream_decoder *decoder)
+{
+	if (decoder->stop || decoder->done)
+		return 0;
+	/* Only switch packet once the iterator released its events. */
+	if (decoder->blocked)
+		return decoder->tail == decoder->head && !decoder->held;
+	return decoder->tail - decoder->head + decoder->held
+		< CTF_FILE_STREAM_NR_VIEWS;
+}
+
+/*
+ * Pick the next decoder of the group with an event to decode, in turn.
+ * Called with the group lock held.
+ */
+static
+struct ctf_stream_decoder *group_next_decoder(struct ctf_decoder_group *group)
+{
+	unsigned int i, len = group->decoders->len;
+
+	for (i = 0; i < len; i++) {
+		struct ctf_stream_decoder *decoder;
+		unsigned int index = (group->next + i) % len;
+
+		decoder = g_ptr_array_index(group->decoders, index);
+		if (decoder_ready(decoder)) {
+			group->next = index + 1;
+			return decoder;
+		}
+	}
+	return NULL;
+}
+
+static
+void *group_thread(void *arg)
+{
+	struct ctf_decoder_group *group = arg;
+	struct ctf_stream_decoder *decoder;
+	struct ctf_stream_pos *pos;
+	unsigned int slot;
+	int ret;
+
+	pthread_mutex_lock(&group->lock);
+	while (!group->exit) {
+		decoder = group_next_decoder(group);
+		if (!decoder) {
+			pthread_cond_wait(&group->cond, &group->lock);
+			continue;
+		}
+		/*
+		 * The position is ours until the decoder is stopped:
+		 * only the ring state it depends on needs the lock.
+		 */
+		pos = &decoder->file_stream->pos;
+		pos->hold_packet = (decoder->tail != decoder->head
+				|| decoder->held);
+		slot = decoder->tail % CTF_FILE_STREAM_NR_VIEWS;
+		decoder->busy = 1;
+		decoder->blocked = 0;
+		pthread_mutex_unlock(&group->lock);
+
+		ret = decoder_decode(decoder, slot);
+
+		pthread_mutex_lock(&group->lock);
+		decoder->busy = 0;
+		if (ret == EBUSY) {
+			decoder->blocked = 1;
+		} else {
+			decoder->tail++;
+			/* EOF, inactive stream or error: the iterator takes over. */
+			if (ret)
+				decoder->done = 1;
+		}
+		pthread_cond_broadcast(&group->cond);
+	}
+	pthread_mutex_unlock(&group->lock);
+	return NULL;
+}
+
+static
+struct ctf_decoder_group *group_create(void)
+{
+	struct ctf_decoder_group *group;
+
+	group = g_new0(struct ctf_decoder_group, 1);
+	pthread_mutex_init(&group->lock, NULL);
+	pthread_cond_init(&group->cond, NULL);
+	group->decoders = g_ptr_array_new();
+	if (pthread_create(&group->thread, NULL, group_thread, group)) {
+		g_ptr_array_free(group->decoders, TRUE);
+		pthread_cond_destroy(&group->cond);
+		pthread_mutex_destroy(&group->lock);
+		g_free(group);
+		return NULL;
+	}
+	return group;
+}
+
+static
+void group_destroy(struct ctf_decoder_group *group)
+{
+	pthread_mutex_lock(&group->lock);
+	group->exit = 1;
+	pthread_cond_broadcast(&group->cond);
+	pthread_mutex_unlock(&group->lock);
+	pthread_join(group->thread, NULL);
+	g_ptr_array_free(group->decoders, TRUE);
+	pthread_cond_destroy(&group->cond);
+	pthread_mutex_destroy(&group->lock);
+	g_free(group);
+}
+
+/*
+ * Add decoder to a new group while there are fewer groups than
+ * processors, else to the group with the fewest decoders. Called with
+ * decoder_groups_lock held.
+ */
+static
+int group_add_decoder(struct ctf_stream_decoder *decoder)
+{
+	struct ctf_decoder_group *group = NULL;
+	long nr_groups;
+	unsigned int i;
+
+	if (!decoder_groups)
+		decoder_groups = g_ptr_array_new();
+	nr_groups = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_groups < 1)
+		nr_groups = 1;
+	if (decoder_groups->len < nr_groups)
+		group = group_create();
+	if (group) {
+		g_ptr_array_add(decoder_groups, group);
+	} else {
+		/* Also when a thread cannot be started. */
+		for (i = 0; i < decoder_groups->len; i++) {
+			struct ctf_decoder_group *iter_group;
+
+			iter_group = g_ptr_array_index(decoder_groups, i);
+			if (!group || iter_group->decoders->len
+					< group->decoders->len)
+				group = iter_group;
+		}
+		if (!group)
+			return -EAGAIN;
+	}
+	pthread_mutex_lock(&group->lock);
+	decoder->group = group;
+	g_ptr_array_add(group->decoders, decoder);
+	pthread_cond_broadcast(&group->cond);
+	pthread_mutex_unlock(&group->lock);
+	return 0;
+}
+
+/*
+ * Remove the decoder of file_stream from its group, waiting for the
+ * event it may be decoding, and destroy the group if it is left empty.
+ */
+static
+void decoder_destroy(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_decoder *decoder = file_stream->decoder;
+	struct ctf_decoder_group *group = decoder->group;
+	int empty;
+
+	pthread_mutex_lock(&decoder_groups_lock);
+	pthread_mutex_lock(&group->lock);
+	decoder->stop = 1;
+	while (decoder->busy)
+		pthread_cond_wait(&group->cond, &group->lock);
+	g_ptr_array_remove(group->decoders, decoder);
+	empty = !group->decoders->len;
+	pthread_mutex_unlock(&group->lock);
+	if (empty) {
+		g_ptr_array_remove(decoder_groups, group);
+		group_destroy(group);
+		if (!decoder_groups->len) {
+			g_ptr_array_free(decoder_groups, TRUE);
+			decoder_groups = NULL;
+		}
+	}
+	pthread_mutex_unlock(&decoder_groups_lock);
+	file_stream->pos.hold_packet = 0;
+	file_stream->decoder = NULL;
+	g_free(decoder);
+}
+
+int ctf_stream_decoder_start(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_decoder *decoder;
+	int ret;
+
+	/* Views cannot be created concurrently: create them all now. */
+	ret = ctf_file_stream_alloc_views(file_stream);
+	if (ret)
+		goto error;
+
+	decoder = g_new0(struct ctf_stream_decoder, 1);
+	decoder->file_stream = file_stream;
+	/*
+	 * The current event of the stream, if any, stays held until the
+	 * first read, in the view preceding next_view. When that view is
+	 * in the ring, it is the last slot the decoder reads into.
+	 */
+	decoder->head = decoder->tail =
+		file_stream->next_view % CTF_FILE_STREAM_NR_VIEWS;
+	decoder->held = 1;
+	decoder->held_record.last_offset = file_stream->pos.last_offset;
+	decoder->held_record.offset = file_stream->pos.offset;
+	decoder->resume_view = file_stream->next_view;
+	decoder->cycles_timestamp = file_stream->parent.cycles_timestamp;
+	decoder->real_timestamp = file_stream->parent.real_timestamp;
+
+	file_stream->decoder = decoder;
+	pthread_mutex_lock(&decoder_groups_lock);
+	ret = group_add_decoder(decoder);
+	pthread_mutex_unlock(&decoder_groups_lock);
+	if (ret) {
+		file_stream->decoder = NULL;
+		g_free(decoder);
+		goto error;
+	}
+	return 0;
+
+error:
+	fprintf(stderr, "[warning] Unable to start decoder thread for stream %s, reading it synchronously.\n",
+		file_stream->parent.path);
+	/* Do not try again. */
+	file_stream->decoder_start = NULL;
+	return ret;
+}
+
+int ctf_stream_decoder_read(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_decoder *decoder = file_stream->decoder;
+	struct ctf_decoder_group *group = decoder->group;
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	struct ctf_stream_definition *view;
+	struct ctf_decoder_record record;
+	unsigned int slot;
+
+	pthread_mutex_lock(&group->lock);
+	/* The previous event is released. */
+	decoder->held = 0;
+	pthread_cond_broadcast(&group->cond);
+	while (decoder->head == decoder->tail)
+		pthread_cond_wait(&group->cond, &group->lock);
+	slot = decoder->head % CTF_FILE_STREAM_NR_VIEWS;
+	record = decoder->records[slot];
+	decoder->head++;
+	if (!record.status) {
+		decoder->held = 1;
+		decoder->held_record = record;
+		decoder->resume_view = (slot + 1) % file_stream->views->len;
+	}
+	pthread_mutex_unlock(&group->lock);
+
+	if (record.status) {
+		/* The group thread is done with the stream. */
+		decoder_destroy(file_stream);
+		file_stream->cur_def = NULL;
+		file_stream->next_view = slot;
+		return record.status;
+	}
+	view = g_ptr_array_index(file_stream->views, slot);
+	stream->cycles_timestamp = view->cycles_timestamp;
+	stream->real_timestamp = view->real_timestamp;
+	stream->event_id = view->event_id;
+	stream->has_timestamp = view->has_timestamp;
+	file_stream->cur_def = view;
+	return 0;
+}
+
+void ctf_stream_decoder_stop(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_decoder *decoder = file_stream->decoder;
+	struct ctf_decoder_record held_record;
+	unsigned int resume_view;
+
+	if (!decoder)
+		return;
+	held_record = decoder->held_record;
+	resume_view = decoder->resume_view;
+	decoder_destroy(file_stream);
+
+	/*
+	 * The decoder never switches packet while an event is held, so
+	 * the events read ahead are in the packet of the held event.
+	 */
+	file_stream->pos.offset = held_record.offset;
+	file_stream->pos.last_offset = held_record.last_offset;
+	file_stream->next_view = resume_view;
+}
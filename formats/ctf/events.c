@@ -31,7 +31,6 @@
 #include <babeltrace/format.h>
 #include <babeltrace/ctf/events.h>
 #include <babeltrace/ctf-ir/metadata.h>
-#include <babeltrace/prio_heap.h>
 #include <babeltrace/iterator-internal.h>
 #include <babeltrace/ctf/events-internal.h>
 #include <babeltrace/ctf/metadata.h>
@@ -86,6 +85,9 @@ const struct bt_definition *bt_ctf_get_top_level_scope(const struct bt_ctf_event
 			tmp = &event->event_context->p;
 		break;
 	case BT_EVENT_FIELDS:
+		/* The payload may have been skipped when read. */
+		if (ctf_decode_event_fields((struct ctf_event_definition *) event))
+			goto error;
 		if (event->event_fields)
 			tmp = &event->event_fields->p;
 		break;
@@ -232,11 +234,13 @@ int bt_ctf_get_field_list(const struct bt_ctf_event *ctf_event,
 	}
 	case CTF_TYPE_ARRAY:
 	{
-		const struct definition_array *def_array;
+		struct definition_array *def_array;
 
-		def_array = container_of(scope, const struct definition_array, p);
+		def_array = container_of(scope, struct definition_array, p);
 		if (!def_array)
 			goto error;
+		/* Elements decoded in bulk are updated on access. */
+		bt_array_bulk_sync(def_array);
 		if (def_array->elems->pdata) {
 			*list = (struct bt_definition const* const*) def_array->elems->pdata;
 			*count = def_array->elems->len;
@@ -248,11 +252,12 @@ int bt_ctf_get_field_list(const struct bt_ctf_event *ctf_event,
 	}
 	case CTF_TYPE_SEQUENCE:
 	{
-		const struct definition_sequence *def_sequence;
+		struct definition_sequence *def_sequence;
 
-		def_sequence = container_of(scope, const struct definition_sequence, p);
+		def_sequence = container_of(scope, struct definition_sequence, p);
 		if (!def_sequence)
 			goto error;
+		bt_sequence_bulk_sync(def_sequence);
 		if (def_sequence->elems->pdata) {
 			*list = (struct bt_definition const* const*) def_sequence->elems->pdata;
 			*count = (unsigned int) def_sequence->length->value._unsigned;
@@ -586,6 +591,16 @@ char *bt_ctf_get_char_array(const struct bt_definition *field)
 	if (field && bt_ctf_field_type(bt_ctf_get_decl_from_def(field)) == CTF_TYPE_ARRAY) {
 		char_array = bt_get_char_array(field);
 		if (char_array) {
+			struct definition_array *array_definition =
+				container_of(field, struct definition_array, p);
+
+			/* Zero-copy reads leave the string to be filled. */
+			if (opt_zero_copy && array_definition->bytes) {
+				g_string_assign(char_array, "");
+				g_string_insert_len(char_array, 0,
+					array_definition->bytes,
+					array_definition->bytes_len);
+			}
 			ret = char_array->str;
 			goto end;
 		}
@@ -608,6 +623,101 @@ char *bt_ctf_get_string(const struct bt_definition *field)
 	return ret;
 }
 
+const char *bt_ctf_get_bytes(const struct bt_definition *field, size_t *len)
+{
+	const char *ret = NULL;
+
+	if (!field || !len)
+		goto error;
+
+	switch (bt_ctf_field_type(bt_ctf_get_decl_from_def(field))) {
+	case CTF_TYPE_STRING:
+	{
+		struct definition_string *string_definition =
+			container_of(field, struct definition_string, p);
+
+		if (!string_definition->value)
+			goto error;
+		ret = string_definition->value;
+		*len = string_definition->len - 1;	/* Not counting \0 */
+		break;
+	}
+	case CTF_TYPE_ARRAY:
+	{
+		struct definition_array *array_definition =
+			container_of(field, struct definition_array, p);
+
+		if (!array_definition->bytes)
+			goto error;
+		ret = array_definition->bytes;
+		*len = array_definition->bytes_len;
+		break;
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		struct definition_sequence *sequence_definition =
+			container_of(field, struct definition_sequence, p);
+
+		if (!sequence_definition->bytes)
+			goto error;
+		ret = sequence_definition->bytes;
+		*len = sequence_definition->bytes_len;
+		break;
+	}
+	default:
+		goto error;
+	}
+	return ret;
+
+error:
+	bt_ctf_field_set_error(-EINVAL);
+	return NULL;
+}
+
+const void *bt_ctf_get_array_values(const struct bt_definition *field,
+		size_t *elem_size, uint64_t *len)
+{
+	const struct definition_bulk *bulk;
+	const struct bt_declaration *elem;
+	int reverse;
+
+	if (!field || !elem_size || !len)
+		goto error;
+
+	switch (bt_ctf_field_type(bt_ctf_get_decl_from_def(field))) {
+	case CTF_TYPE_ARRAY:
+	{
+		const struct definition_array *array_definition =
+			container_of(field, const struct definition_array, p);
+
+		bulk = &array_definition->bulk;
+		elem = array_definition->declaration->elem;
+		break;
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		const struct definition_sequence *sequence_definition =
+			container_of(field, const struct definition_sequence, p);
+
+		bulk = &sequence_definition->bulk;
+		elem = sequence_definition->declaration->elem;
+		break;
+	}
+	default:
+		goto error;
+	}
+	*elem_size = bt_bulk_elem_size(elem, &reverse);
+	if (!*elem_size)
+		goto error;
+	*len = bulk->len;
+	/* Empty buffer: any non-NULL pointer will do. */
+	return bulk->len ? bulk->values : (const void *) bulk;
+
+error:
+	bt_ctf_field_set_error(-EINVAL);
+	return NULL;
+}
+
 double bt_ctf_get_float(const struct bt_definition *field)
 {
 	double ret = 0.0;
@@ -1913,7 +1913,7 @@ int bt_ctf_field_string_serialize(struct bt_ctf_field *field,
 
 	for (i = 0; i < string->payload->len + 1; i++) {
 		ret = bt_ctf_field_unsigned_integer_set_value(character,
-			(uint64_t) string->payload->str[i]);
+			(uint8_t) string->payload->str[i]);
 		if (ret) {
 			goto end;
 		}
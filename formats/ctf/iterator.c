@@ -30,11 +30,13 @@
 #include <babeltrace/babeltrace.h>
 #include <babeltrace/format.h>
 #include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/iterator.h>
 #include <babeltrace/ctf-ir/metadata.h>
-#include <babeltrace/prio_heap.h>
+#include <babeltrace/loser_tree.h>
 #include <babeltrace/iterator-internal.h>
 #include <babeltrace/ctf/events-internal.h>
 #include <babeltrace/ctf/metadata.h>
+#include <fcntl.h>
 #include <glib.h>
 
 #include "events-private.h"
@@ -60,6 +62,8 @@ struct bt_ctf_iter *bt_ctf_iter_create(struct bt_context *ctx,
 	iter->recalculate_dep_graph = 0;
 	iter->main_callbacks.callback = NULL;
 	iter->dep_gc = g_ptr_array_new();
+	iter->event_filter.patterns = g_ptr_array_new_with_free_func(g_free);
+	iter->event_filter.names = g_array_new(FALSE, FALSE, sizeof(GQuark));
 	return iter;
 }
 
@@ -92,6 +96,16 @@ void bt_ctf_iter_destroy(struct bt_ctf_iter *iter)
 	}
 	g_array_free(iter->callbacks, TRUE);
 	g_ptr_array_free(iter->dep_gc, TRUE);
+	/* Detach the event filter from the streams before freeing it. */
+	bt_iter_stop_decoders(&iter->parent);
+	g_ptr_array_set_size(iter->event_filter.patterns, 0);
+	g_array_set_size(iter->event_filter.names, 0);
+	(void) ctf_iter_update_event_filter(iter);
+	g_ptr_array_free(iter->event_filter.patterns, TRUE);
+	g_array_free(iter->event_filter.names, TRUE);
+	if (iter->batch_streams)
+		g_ptr_array_free(iter->batch_streams, TRUE);
+	g_free(iter->batch);
 
 	bt_iter_fini(&iter->parent);
 	g_free(iter);
@@ -105,13 +119,44 @@ struct bt_iter *bt_ctf_get_iter(struct bt_ctf_iter *iter)
 	return &iter->parent;
 }
 
+/*
+ * Account for the events lost before the current event of file_stream,
+ * and call the callbacks registered for this event.
+ */
+static
+void iter_process_event(struct bt_ctf_iter *iter,
+		struct ctf_file_stream *file_stream,
+		struct ctf_event_definition *event, int *flags)
+{
+	struct packet_index *packet_index;
+
+	if (!file_stream->pos.packet_index)
+		packet_index = NULL;
+	else
+		packet_index = &g_array_index(file_stream->pos.packet_index,
+				struct packet_index, file_stream->pos.cur_index);
+	if (packet_index && packet_index->events_discarded >
+			file_stream->pos.last_events_discarded) {
+		if (flags)
+			*flags |= BT_ITER_FLAG_LOST_EVENTS;
+		iter->events_lost += packet_index->events_discarded -
+			file_stream->pos.last_events_discarded;
+		file_stream->pos.last_events_discarded =
+			packet_index->events_discarded;
+	}
+
+	if (event->stream->stream_id > iter->callbacks->len)
+		return;
+
+	process_callbacks(iter, event->stream);
+}
+
 struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 		int *flags)
 {
 	struct ctf_file_stream *file_stream;
 	struct bt_ctf_event *ret;
 	struct ctf_stream_definition *stream;
-	struct packet_index *packet_index;
 
 	/*
 	 * We do not want to fail for any other reason than end of
@@ -123,7 +168,7 @@ struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 		*flags = 0;
 
 	ret = &iter->current_ctf_event;
-	file_stream = bt_heap_maximum(iter->parent.stream_heap);
+	file_stream = bt_loser_tree_top(iter->parent.stream_tree);
 	if (!file_stream) {
 		/* end of file for all streams */
 		goto stop;
@@ -149,29 +194,14 @@ struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 		stream->real_timestamp > iter->parent.end_pos->u.seek_time) {
 		goto stop;
 	}
+	/* The current event may have been read by a batch. */
+	if (file_stream->cur_def)
+		stream = file_stream->cur_def;
 	ret->parent = g_ptr_array_index(stream->events_by_id,
 			stream->event_id);
 
-	if (!file_stream->pos.packet_index)
-		packet_index = NULL;
-	else
-		packet_index = &g_array_index(file_stream->pos.packet_index,
-				struct packet_index, file_stream->pos.cur_index);
 	iter->events_lost = 0;
-	if (packet_index && packet_index->events_discarded >
-			file_stream->pos.last_events_discarded) {
-		if (flags)
-			*flags |= BT_ITER_FLAG_LOST_EVENTS;
-		iter->events_lost += packet_index->events_discarded -
-			file_stream->pos.last_events_discarded;
-		file_stream->pos.last_events_discarded =
-			packet_index->events_discarded;
-	}
-
-	if (ret->parent->stream->stream_id > iter->callbacks->len)
-		goto end;
-
-	process_callbacks(iter, ret->parent->stream);
+	iter_process_event(iter, file_stream, ret->parent, flags);
 
 end:
 	return ret;
@@ -184,6 +214,279 @@ struct bt_ctf_event *bt_ctf_iter_read_event(struct bt_ctf_iter *iter)
 	return bt_ctf_iter_read_event_flags(iter, NULL);
 }
 
+/*
+ * Move file_stream past its current event, reading the next one into
+ * one of its views, and update its place in the stream tree.
+ *
+ * Return 0 on success (or end of stream), EAGAIN if the stream is
+ * inactive for now, EBUSY if the next event is in another packet while
+ * pos->hold_packet is set, a negative error value otherwise.
+ */
+static
+int batch_stream_next(struct bt_ctf_iter *iter,
+		struct ctf_file_stream *file_stream)
+{
+	struct loser_tree *tree = iter->parent.stream_tree;
+	struct ctf_stream_definition *cur_def = file_stream->cur_def;
+	struct loser_tree_key key;
+	int ret, is_top;
+
+	is_top = (bt_loser_tree_top(tree) == file_stream);
+	if (!is_top) {
+		/* Traces were added to the iterator since the last batch. */
+		if (!bt_loser_tree_cherrypick(tree, file_stream))
+			return 0;
+	}
+	file_stream->cur_def = NULL;
+	ret = ctf_file_stream_read_view(file_stream);
+	if (ret == EOF) {
+		if (is_top)
+			(void) bt_loser_tree_remove_top(tree);
+		return 0;
+	} else if (ret == EBUSY) {
+		/* The stream stays on its current event. */
+		file_stream->cur_def = cur_def;
+	} else if (ret && ret != EAGAIN) {
+		fprintf(stderr, "[error] Reading event failed.\n");
+	}
+	bt_stream_merge_key(file_stream, &key);
+	if (is_top)
+		(void) bt_loser_tree_replace_top(tree, file_stream, &key);
+	else if (bt_loser_tree_insert(tree, file_stream, &key))
+		return -ENOMEM;
+	return ret;
+}
+
+static
+int file_stream_current_filtered_out(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_pos *pos = &file_stream->pos;
+	struct ctf_stream_definition *stream;
+	struct ctf_event_declaration *event_class;
+
+	if (!pos->event_filter || pos->offset == EOF
+			|| pos->data_offset == pos->content_size
+			|| pos->content_size == 0)
+		return 0;
+	stream = file_stream->cur_def ? : &file_stream->parent;
+	event_class = g_ptr_array_index(stream->stream_class->events_by_id,
+			stream->event_id);
+	return event_class
+		&& !ctf_event_filter_match(pos->event_filter, event_class->name);
+}
+
+/*
+ * The decoder threads read the filter: the caller stops them with
+ * bt_iter_stop_decoders() before changing it. The iterator starts them
+ * again on the next event read.
+ */
+int ctf_iter_update_event_filter(struct bt_ctf_iter *iter)
+{
+	struct trace_collection *tc = iter->parent.ctx->tc;
+	const struct ctf_event_filter *filter = NULL;
+	int i, j, k, ret;
+
+	/* Check all traces before changing any filter. */
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_trace *tin;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		if (!td_read)
+			return -EINVAL;
+		tin = container_of(td_read, struct ctf_trace, parent);
+		if ((tin->flags & O_ACCMODE) != O_RDONLY)
+			return -EINVAL;
+	}
+	if (iter->event_filter.patterns->len || iter->event_filter.names->len)
+		filter = &iter->event_filter;
+	iter->parent.event_filter = filter;
+
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_trace *tin;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		tin = container_of(td_read, struct ctf_trace, parent);
+		if (!tin->streams)
+			continue;
+		for (j = 0; j < tin->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(tin->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct ctf_file_stream *file_stream;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				file_stream = container_of(stream,
+						struct ctf_file_stream, parent);
+				ctf_pos_set_event_filter(&file_stream->pos,
+						filter);
+				if (!file_stream_current_filtered_out(file_stream))
+					continue;
+				/*
+				 * Move past the current event, which was
+				 * read before the filter changed.
+				 */
+				ret = batch_stream_next(iter, file_stream);
+				if (ret < 0)
+					return ret;
+				if (iter->batch_pending == file_stream)
+					iter->batch_pending = NULL;
+			}
+		}
+	}
+	return 0;
+}
+
+int bt_ctf_iter_set_event_filter(struct bt_ctf_iter *iter,
+		const char * const *patterns, int nr_patterns)
+{
+	GPtrArray *old_patterns;
+	int i, ret;
+
+	if (!iter || nr_patterns < 0 || (!patterns && nr_patterns))
+		return -EINVAL;
+
+	bt_iter_stop_decoders(&iter->parent);
+	old_patterns = iter->event_filter.patterns;
+	iter->event_filter.patterns = g_ptr_array_new_with_free_func(g_free);
+	for (i = 0; i < nr_patterns; i++)
+		g_ptr_array_add(iter->event_filter.patterns,
+				g_strdup(patterns[i]));
+	ret = ctf_iter_update_event_filter(iter);
+	if (ret) {
+		g_ptr_array_free(iter->event_filter.patterns, TRUE);
+		iter->event_filter.patterns = old_patterns;
+		return ret;
+	}
+	g_ptr_array_free(old_patterns, TRUE);
+	return 0;
+}
+
+/*
+ * Each stream only keeps one set of packet-level definitions: a batch
+ * stops before a stream would switch packet. Streams get more sets of
+ * event-level definitions (views) when the events of the batch fill
+ * all of them. A stream is only moved past its last returned
+ * event when the next event is needed, so the iterator stays positioned
+ * on the last event of the batch until the next one.
+ */
+int bt_ctf_iter_read_events(struct bt_ctf_iter *iter,
+		struct bt_ctf_event **events, int max)
+{
+	struct ctf_file_stream *file_stream, *pending;
+	struct ctf_stream_pos *pos;
+	int i, n = 0, ret;
+
+	if (!iter || !events || max <= 0)
+		return -EINVAL;
+
+	bt_iter_stop_decoders(&iter->parent);
+
+	if (max > iter->batch_alloc_len) {
+		iter->batch = g_renew(struct bt_ctf_event, iter->batch, max);
+		iter->batch_alloc_len = max;
+	}
+	if (!iter->batch_streams)
+		iter->batch_streams = g_ptr_array_new();
+	for (i = 0; i < iter->batch_streams->len; i++) {
+		file_stream = g_ptr_array_index(iter->batch_streams, i);
+		file_stream->batch_nr_events = 0;
+	}
+	g_ptr_array_set_size(iter->batch_streams, 0);
+	iter->events_lost = 0;
+
+	/* Moving the iterator moved it past the last batch already. */
+	pending = NULL;
+	if (iter->batch_generation == iter->parent.generation)
+		pending = iter->batch_pending;
+
+	for (;;) {
+		if (n == max)
+			break;
+		if (pending) {
+			pos = &pending->pos;
+			if (pending->batch_nr_events
+					&& pos->offset == pos->content_size)
+				break;
+			/* Keep the views of the events of the batch. */
+			ctf_file_stream_reserve_view(pending,
+					pending->batch_nr_events);
+			/*
+			 * Skipping filtered out events must not switch
+			 * packet under the events of the batch either.
+			 */
+			pos->hold_packet = (pending->batch_nr_events != 0);
+			ret = batch_stream_next(iter, pending);
+			pos->hold_packet = 0;
+			if (ret == EBUSY)
+				break;
+			pending = NULL;
+			if (ret < 0)
+				goto error;
+			if (ret == EAGAIN) {
+				if (n)
+					break;
+				ret = -EAGAIN;
+				goto error;
+			}
+		}
+		file_stream = bt_loser_tree_top(iter->parent.stream_tree);
+		if (!file_stream)
+			break;
+		pos = &file_stream->pos;
+		if (iter->parent.end_pos &&
+			iter->parent.end_pos->type == BT_SEEK_TIME &&
+			file_stream->parent.real_timestamp >
+				iter->parent.end_pos->u.seek_time)
+			break;
+		if (pos->data_offset == pos->content_size
+				|| pos->content_size == 0) {
+			/* Empty packet: move to the next one. */
+			pending = file_stream;
+			continue;
+		}
+		if (!file_stream->cur_def) {
+			/*
+			 * The current event was read by bt_iter_next():
+			 * decode it again into a view.
+			 */
+			pos->offset = pos->last_offset;
+			ret = ctf_file_stream_read_view(file_stream);
+			if (ret) {
+				fprintf(stderr, "[error] Reading event failed.\n");
+				if (ret > 0)
+					ret = -EINVAL;
+				goto error;
+			}
+		}
+
+		iter->batch[n].parent = g_ptr_array_index(
+				file_stream->cur_def->events_by_id,
+				file_stream->cur_def->event_id);
+		iter_process_event(iter, file_stream, iter->batch[n].parent,
+				NULL);
+		events[n] = &iter->batch[n];
+		n++;
+		if (!file_stream->batch_nr_events++)
+			g_ptr_array_add(iter->batch_streams, file_stream);
+		pending = file_stream;
+	}
+	iter->batch_pending = pending;
+	iter->batch_generation = iter->parent.generation;
+	return n;
+
+error:
+	iter->batch_pending = NULL;
+	return ret;
+}
+
 uint64_t bt_ctf_get_lost_events_count(struct bt_ctf_iter *iter)
 {
 	if (!iter)
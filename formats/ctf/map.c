@@ -0,0 +1,279 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Parallel event map over the stream files of a context.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/map.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/trace-collection.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+#include <pthread.h>
+
+struct ctf_map_work {
+	const struct bt_ctf_map_cb *cb;
+	GPtrArray *file_streams;	/* Array of struct ctf_file_stream */
+	pthread_mutex_t lock;		/* Protects next and ret */
+	unsigned int next;		/* Next file stream to map */
+	int ret;			/* First error, stops the map */
+};
+
+struct ctf_map_thread {
+	struct ctf_map_work *work;
+	void *data;			/* State returned by thread_init */
+	pthread_t thread;
+};
+
+static
+uint64_t file_stream_size(struct ctf_file_stream *file_stream)
+{
+	GArray *packet_index = file_stream->pos.packet_index;
+	uint64_t size = 0;
+	unsigned int i;
+
+	for (i = 0; i < packet_index->len; i++)
+		size += g_array_index(packet_index, struct packet_index,
+			i).content_size;
+	return size;
+}
+
+/* Map the largest stream files first, for a better load balance. */
+static
+gint file_stream_size_compare(gconstpointer a, gconstpointer b)
+{
+	uint64_t size_a = file_stream_size(*(struct ctf_file_stream **) a);
+	uint64_t size_b = file_stream_size(*(struct ctf_file_stream **) b);
+
+	if (size_a > size_b)
+		return -1;
+	return size_a < size_b;
+}
+
+/*
+ * Gather the stream files of all traces which have a packet index.
+ */
+static
+GPtrArray *get_file_streams(struct bt_context *ctx)
+{
+	struct trace_collection *tc = ctx->tc;
+	GPtrArray *file_streams;
+	int i, j, k;
+
+	file_streams = g_ptr_array_new();
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_trace *tin;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		if (!td_read)
+			continue;
+		tin = container_of(td_read, struct ctf_trace, parent);
+		for (j = 0; j < tin->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(tin->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct ctf_file_stream *cfs;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				cfs = container_of(stream, struct ctf_file_stream,
+					parent);
+				if (!cfs->pos.packet_index)
+					continue;
+				g_ptr_array_add(file_streams, cfs);
+			}
+		}
+	}
+	g_ptr_array_sort(file_streams, file_stream_size_compare);
+	return file_streams;
+}
+
+static
+int map_stopped(struct ctf_map_work *work)
+{
+	int ret;
+
+	pthread_mutex_lock(&work->lock);
+	ret = work->ret;
+	pthread_mutex_unlock(&work->lock);
+	return ret;
+}
+
+/*
+ * Read the events of a stream file one packet at a time: the stream
+ * is held on each packet, and moved to the next one explicitly.
+ */
+static
+int map_file_stream(struct ctf_map_work *work,
+		struct ctf_file_stream *file_stream, void *data)
+{
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	struct ctf_stream_pos *pos = &file_stream->pos;
+	struct bt_ctf_event event;
+	unsigned int i;
+	int ret = 0;
+
+	assert(!file_stream->decoder);
+	file_stream->cur_def = NULL;
+	pos->hold_packet = 1;
+	for (i = 0; i < pos->packet_index->len; i = pos->cur_index + 1) {
+		if (map_stopped(work))
+			break;
+		/*
+		 * The seek skips empty packets: go on from the packet it
+		 * stopped at.
+		 */
+		pos->packet_seek(&pos->parent, i, SEEK_SET);
+		if (pos->offset == EOF)
+			break;
+		for (;;) {
+			ret = pos->parent.event_cb(&pos->parent, stream);
+			if (ret == EBUSY || ret == EAGAIN || ret == EOF) {
+				/* End of packet, or empty packet. */
+				ret = 0;
+				break;
+			} else if (ret) {
+				fprintf(stderr, "[error] Reading event failed.\n");
+				goto end;
+			}
+			event.parent = g_ptr_array_index(stream->events_by_id,
+					stream->event_id);
+			ret = work->cb->event(&event, data);
+			if (ret)
+				goto end;
+		}
+	}
+end:
+	pos->hold_packet = 0;
+	/* Leave the stream at its beginning, as after opening it. */
+	pos->packet_seek(&pos->parent, 0, SEEK_SET);
+	return ret;
+}
+
+static
+void *map_thread(void *arg)
+{
+	struct ctf_map_thread *thread = arg;
+	struct ctf_map_work *work = thread->work;
+
+	for (;;) {
+		unsigned int i;
+		int ret;
+
+		pthread_mutex_lock(&work->lock);
+		i = work->next++;
+		ret = work->ret;
+		pthread_mutex_unlock(&work->lock);
+		if (ret || i >= work->file_streams->len)
+			break;
+		ret = map_file_stream(work,
+			g_ptr_array_index(work->file_streams, i),
+			thread->data);
+		if (ret) {
+			pthread_mutex_lock(&work->lock);
+			if (!work->ret)
+				work->ret = ret;
+			pthread_mutex_unlock(&work->lock);
+		}
+	}
+	return NULL;
+}
+
+int bt_ctf_map_events(struct bt_context *ctx, int nr_threads,
+		const struct bt_ctf_map_cb *cb, void *private_data)
+{
+	struct ctf_map_thread *threads;
+	struct ctf_map_work work;
+	int i, nr_init = 0, nr_started = 0, ret;
+
+	if (!ctx || !ctx->tc || nr_threads < 0 || !cb || !cb->thread_init
+			|| !cb->event || !cb->reduce)
+		return -EINVAL;
+	/* The map moves the streams under the iterator. */
+	if (ctx->current_iterator)
+		return -EBUSY;
+
+	work.cb = cb;
+	work.file_streams = get_file_streams(ctx);
+	pthread_mutex_init(&work.lock, NULL);
+	work.next = 0;
+	work.ret = 0;
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads > work.file_streams->len)
+		nr_threads = work.file_streams->len;
+	if (nr_threads < 1)
+		nr_threads = 1;
+	threads = g_new0(struct ctf_map_thread, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].work = &work;
+		threads[i].data = cb->thread_init(private_data);
+		if (!threads[i].data) {
+			work.ret = -ENOMEM;
+			goto reduce;
+		}
+		nr_init++;
+	}
+
+	/* The calling thread is the last worker. */
+	for (i = 0; i < nr_threads - 1; i++) {
+		if (pthread_create(&threads[i].thread, NULL, map_thread,
+				&threads[i]))
+			break;
+		nr_started++;
+	}
+	printf_verbose("Mapping %u stream files with %d threads.\n",
+		work.file_streams->len, nr_started + 1);
+	map_thread(&threads[nr_threads - 1]);
+	for (i = 0; i < nr_started; i++)
+		pthread_join(threads[i].thread, NULL);
+
+reduce:
+	ret = work.ret;
+	for (i = 0; i < nr_init; i++) {
+		int reduce_ret;
+
+		reduce_ret = cb->reduce(threads[i].data, private_data);
+		if (reduce_ret && !ret)
+			ret = reduce_ret;
+	}
+	g_free(threads);
+	g_ptr_array_free(work.file_streams, TRUE);
+	pthread_mutex_destroy(&work.lock);
+	return ret;
+}
@@ -1152,6 +1152,7 @@ struct bt_declaration *ctf_declaration_enum_visit(FILE *fd, int depth,
 			if (ret)
 				goto error;
 		}
+		bt_enum_declaration_finalize(enum_declaration);
 		if (name) {
 			int ret;
 
@@ -0,0 +1,528 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Asynchronous packet loader, reading packets into a pool of buffers
+ * through io_uring.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/packet-loader.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+
+int ctf_packet_pread(int fd, void *buf, size_t len, off_t offset,
+		size_t done)
+{
+	while (done < len) {
+		ssize_t ret;
+
+		ret = pread(fd, (char *) buf + done, len - done, offset + done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0) {
+			memset((char *) buf + done, 0, len - done);
+			break;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+#ifdef BABELTRACE_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <assert.h>
+
+enum packet_buffer_state {
+	PACKET_BUFFER_FREE = 0,
+	PACKET_BUFFER_QUEUED,		/* read in flight */
+	PACKET_BUFFER_READY,		/* read complete, not handed out */
+	PACKET_BUFFER_USED,		/* handed out by ctf_packet_loader_get */
+};
+
+struct packet_buffer {
+	struct mmap_align mma;		/* buffer, only grows */
+	enum packet_buffer_state state;
+	int wanted;			/* queued since ctf_packet_loader_begin */
+	off_t offset;			/* file offset of the packet, in bytes */
+	size_t len;			/* length of the packet, in bytes */
+	struct iovec iov;		/* read by the kernel while queued */
+	int res;			/* bytes read, or negative errno */
+};
+
+struct ctf_packet_loader {
+	int fd;				/* stream file */
+	int ring_fd;
+	unsigned int nr_buffers;
+	struct packet_buffer *buffers;
+	unsigned int to_submit;		/* queued, not submitted yet */
+
+	/* Submission queue ring, and completion ring if cq_ring_len is 0 */
+	void *sq_ring;
+	size_t sq_ring_len;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	/* Completion queue ring */
+	void *cq_ring;
+	size_t cq_ring_len;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static
+int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static
+int sys_io_uring_enter(int ring_fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags)
+{
+	return (int) syscall(__NR_io_uring_enter, ring_fd, to_submit,
+			min_complete, flags, NULL, 0);
+}
+
+static
+void loader_unmap_rings(struct ctf_packet_loader *loader)
+{
+	if (loader->sqes != MAP_FAILED)
+		(void) munmap(loader->sqes, loader->sqes_len);
+	if (loader->cq_ring_len && loader->cq_ring != MAP_FAILED)
+		(void) munmap(loader->cq_ring, loader->cq_ring_len);
+	if (loader->sq_ring != MAP_FAILED)
+		(void) munmap(loader->sq_ring, loader->sq_ring_len);
+}
+
+struct ctf_packet_loader *ctf_packet_loader_create(int fd,
+		unsigned int nr_buffers)
+{
+	struct ctf_packet_loader *loader;
+	struct io_uring_params p;
+	size_t cq_len;
+
+	loader = g_new0(struct ctf_packet_loader, 1);
+	loader->fd = fd;
+	loader->sq_ring = MAP_FAILED;
+	loader->cq_ring = MAP_FAILED;
+	loader->sqes = MAP_FAILED;
+	memset(&p, 0, sizeof(p));
+	loader->ring_fd = sys_io_uring_setup(nr_buffers, &p);
+	if (loader->ring_fd < 0)
+		goto error_free;
+
+	loader->sq_ring_len = p.sq_off.array
+		+ p.sq_entries * sizeof(unsigned int);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		loader->sq_ring_len = MAX(loader->sq_ring_len, cq_len);
+	else
+#endif
+		loader->cq_ring_len = cq_len;
+	loader->sq_ring = mmap(NULL, loader->sq_ring_len,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		loader->ring_fd, IORING_OFF_SQ_RING);
+	if (loader->sq_ring == MAP_FAILED)
+		goto error_close;
+	if (loader->cq_ring_len) {
+		loader->cq_ring = mmap(NULL, loader->cq_ring_len,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			loader->ring_fd, IORING_OFF_CQ_RING);
+		if (loader->cq_ring == MAP_FAILED)
+			goto error_close;
+	} else {
+		loader->cq_ring = loader->sq_ring;
+	}
+	loader->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	loader->sqes = mmap(NULL, loader->sqes_len,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		loader->ring_fd, IORING_OFF_SQES);
+	if (loader->sqes == MAP_FAILED)
+		goto error_close;
+
+	loader->sq_tail = loader->sq_ring + p.sq_off.tail;
+	loader->sq_mask = loader->sq_ring + p.sq_off.ring_mask;
+	loader->sq_array = loader->sq_ring + p.sq_off.array;
+	loader->cq_head = loader->cq_ring + p.cq_off.head;
+	loader->cq_tail = loader->cq_ring + p.cq_off.tail;
+	loader->cq_mask = loader->cq_ring + p.cq_off.ring_mask;
+	loader->cqes = loader->cq_ring + p.cq_off.cqes;
+	loader->nr_buffers = nr_buffers;
+	loader->buffers = g_new0(struct packet_buffer, nr_buffers);
+	return loader;
+
+error_close:
+	loader_unmap_rings(loader);
+	(void) close(loader->ring_fd);
+error_free:
+	printf_verbose("Unable to set up io_uring, reading packets with pread(): %s.\n",
+		strerror(errno));
+	g_free(loader);
+	return NULL;
+}
+
+/*
+ * Enter the kernel to submit the queued reads, and wait for at least
+ * min_complete completions.
+ */
+static
+int loader_enter(struct ctf_packet_loader *loader, unsigned int min_complete)
+{
+	for (;;) {
+		int ret;
+
+		ret = sys_io_uring_enter(loader->ring_fd, loader->to_submit,
+			min_complete,
+			min_complete ? IORING_ENTER_GETEVENTS : 0);
+		if (ret >= 0) {
+			loader->to_submit -= ret;
+			return 0;
+		}
+		if (errno == EINTR)
+			continue;
+		/* Out of kernel resources: submit again on next enter. */
+		if (errno == EAGAIN && !min_complete)
+			return 0;
+		return -errno;
+	}
+}
+
+static
+void loader_reap(struct ctf_packet_loader *loader)
+{
+	unsigned int head, tail;
+
+	head = *loader->cq_head;
+	tail = __atomic_load_n(loader->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe =
+			&loader->cqes[head & *loader->cq_mask];
+		struct packet_buffer *buf = &loader->buffers[cqe->user_data];
+
+		buf->res = cqe->res;
+		buf->state = buf->wanted ?
+			PACKET_BUFFER_READY : PACKET_BUFFER_FREE;
+	}
+	__atomic_store_n(loader->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static
+int loader_wait(struct ctf_packet_loader *loader, struct packet_buffer *buf)
+{
+	loader_reap(loader);
+	while (buf->state == PACKET_BUFFER_QUEUED) {
+		int ret;
+
+		ret = loader_enter(loader, 1);
+		if (ret)
+			return ret;
+		loader_reap(loader);
+	}
+	return 0;
+}
+
+void ctf_packet_loader_destroy(struct ctf_packet_loader *loader)
+{
+	int leak = 0;
+	unsigned int i;
+
+	if (!loader)
+		return;
+	/* The kernel writes into the buffers of reads in flight. */
+	for (i = 0; i < loader->nr_buffers; i++) {
+		loader->buffers[i].wanted = 0;
+		if (loader_wait(loader, &loader->buffers[i]))
+			leak = 1;
+	}
+	loader_unmap_rings(loader);
+	(void) close(loader->ring_fd);
+	if (!leak) {
+		for (i = 0; i < loader->nr_buffers; i++)
+			free(loader->buffers[i].mma.page_aligned_addr);
+		g_free(loader->buffers);
+	}
+	g_free(loader);
+}
+
+static
+struct packet_buffer *loader_find(struct ctf_packet_loader *loader,
+		size_t len, off_t offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < loader->nr_buffers; i++) {
+		struct packet_buffer *buf = &loader->buffers[i];
+
+		if ((buf->state == PACKET_BUFFER_QUEUED
+				|| buf->state == PACKET_BUFFER_READY)
+				&& buf->offset == offset && buf->len == len)
+			return buf;
+	}
+	return NULL;
+}
+
+static
+struct packet_buffer *loader_find_state(struct ctf_packet_loader *loader,
+		enum packet_buffer_state state)
+{
+	unsigned int i;
+
+	for (i = 0; i < loader->nr_buffers; i++) {
+		if (loader->buffers[i].state == state)
+			return &loader->buffers[i];
+	}
+	return NULL;
+}
+
+/*
+ * Make buf hold "len" bytes of the file at "offset". Only called on
+ * buffers which are not queued.
+ */
+static
+int packet_buffer_reserve(struct packet_buffer *buf, size_t len,
+		off_t offset)
+{
+	struct mmap_align *mma = &buf->mma;
+
+	if (mma->page_aligned_length < len) {
+		size_t alloc_len = ALIGN(len, getpagesize());
+		void *addr;
+
+		if (posix_memalign(&addr, getpagesize(), alloc_len))
+			return -ENOMEM;
+		free(mma->page_aligned_addr);
+		mma->page_aligned_addr = addr;
+		mma->page_aligned_length = alloc_len;
+	}
+	mma->addr = mma->page_aligned_addr;
+	mma->length = len;
+	buf->offset = offset;
+	buf->len = len;
+	buf->res = 0;
+	return 0;
+}
+
+void ctf_packet_loader_begin(struct ctf_packet_loader *loader)
+{
+	unsigned int i;
+
+	for (i = 0; i < loader->nr_buffers; i++)
+		loader->buffers[i].wanted = 0;
+}
+
+int ctf_packet_loader_queue(struct ctf_packet_loader *loader,
+		size_t len, off_t offset)
+{
+	struct packet_buffer *buf;
+	struct io_uring_sqe *sqe;
+	unsigned int tail, index;
+
+	buf = loader_find(loader, len, offset);
+	if (buf) {
+		buf->wanted = 1;
+		return 0;
+	}
+	buf = loader_find_state(loader, PACKET_BUFFER_FREE);
+	if (!buf || packet_buffer_reserve(buf, len, offset))
+		return -1;
+	buf->iov.iov_base = buf->mma.addr;
+	buf->iov.iov_len = len;
+	buf->wanted = 1;
+	buf->state = PACKET_BUFFER_QUEUED;
+
+	/* The submission queue has an entry for each buffer. */
+	tail = *loader->sq_tail;
+	index = tail & *loader->sq_mask;
+	sqe = &loader->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = loader->fd;
+	sqe->off = offset;
+	sqe->addr = (uint64_t) (uintptr_t) &buf->iov;
+	sqe->len = 1;
+	sqe->user_data = buf - loader->buffers;
+	loader->sq_array[index] = index;
+	__atomic_store_n(loader->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	loader->to_submit++;
+	return 0;
+}
+
+int ctf_packet_loader_submit(struct ctf_packet_loader *loader)
+{
+	unsigned int i;
+
+	loader_reap(loader);
+	/* Reads still in flight are dropped on completion. */
+	for (i = 0; i < loader->nr_buffers; i++) {
+		struct packet_buffer *buf = &loader->buffers[i];
+
+		if (buf->state == PACKET_BUFFER_READY && !buf->wanted)
+			buf->state = PACKET_BUFFER_FREE;
+	}
+	if (!loader->to_submit)
+		return 0;
+	return loader_enter(loader, 0);
+}
+
+/*
+ * Find a buffer to read a packet which was not queued into: a free
+ * buffer, else a buffer read ahead, else the first read completing.
+ */
+static
+struct packet_buffer *loader_take_buffer(struct ctf_packet_loader *loader)
+{
+	for (;;) {
+		struct packet_buffer *buf;
+		int ret;
+
+		loader_reap(loader);
+		buf = loader_find_state(loader, PACKET_BUFFER_FREE);
+		if (buf)
+			return buf;
+		buf = loader_find_state(loader, PACKET_BUFFER_READY);
+		if (buf)
+			return buf;
+		if (!loader_find_state(loader, PACKET_BUFFER_QUEUED)) {
+			errno = EBUSY;
+			return NULL;
+		}
+		ret = loader_enter(loader, 1);
+		if (ret) {
+			errno = -ret;
+			return NULL;
+		}
+	}
+}
+
+struct mmap_align *ctf_packet_loader_get(struct ctf_packet_loader *loader,
+		size_t len, off_t offset)
+{
+	struct packet_buffer *buf;
+	size_t done = 0;
+	int ret;
+
+	buf = loader_find(loader, len, offset);
+	if (buf) {
+		buf->wanted = 1;
+		ret = loader_wait(loader, buf);
+		if (ret) {
+			errno = -ret;
+			return NULL;
+		}
+		/* Failed reads are done again with pread(). */
+		if (buf->res > 0)
+			done = buf->res;
+	} else {
+		buf = loader_take_buffer(loader);
+		if (!buf)
+			return NULL;
+		ret = packet_buffer_reserve(buf, len, offset);
+		if (ret)
+			goto error;
+	}
+	/* Complete short reads, at end of file or interrupted. */
+	ret = ctf_packet_pread(loader->fd, buf->mma.addr, len, offset, done);
+	if (ret)
+		goto error;
+	buf->state = PACKET_BUFFER_USED;
+	return &buf->mma;
+
+error:
+	buf->state = PACKET_BUFFER_FREE;
+	errno = -ret;
+	return NULL;
+}
+
+int ctf_packet_loader_release(struct ctf_packet_loader *loader,
+		struct mmap_align *mma)
+{
+	unsigned int i;
+
+	for (i = 0; i < loader->nr_buffers; i++) {
+		struct packet_buffer *buf = &loader->buffers[i];
+
+		if (&buf->mma == mma) {
+			assert(buf->state == PACKET_BUFFER_USED);
+			buf->state = PACKET_BUFFER_FREE;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#else /* BABELTRACE_HAVE_IO_URING */
+
+struct ctf_packet_loader *ctf_packet_loader_create(int fd,
+		unsigned int nr_buffers)
+{
+	return NULL;
+}
+
+void ctf_packet_loader_destroy(struct ctf_packet_loader *loader)
+{
+}
+
+void ctf_packet_loader_begin(struct ctf_packet_loader *loader)
+{
+}
+
+int ctf_packet_loader_queue(struct ctf_packet_loader *loader,
+		size_t len, off_t offset)
+{
+	return -1;
+}
+
+int ctf_packet_loader_submit(struct ctf_packet_loader *loader)
+{
+	return 0;
+}
+
+struct mmap_align *ctf_packet_loader_get(struct ctf_packet_loader *loader,
+		size_t len, off_t offset)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+int ctf_packet_loader_release(struct ctf_packet_loader *loader,
+		struct mmap_align *mma)
+{
+	return 0;
+}
+
+#endif /* BABELTRACE_HAVE_IO_URING */
@@ -37,34 +37,53 @@ int ctf_array_read(struct bt_stream_pos *ppos, struct bt_definition *definition)
 	struct bt_declaration *elem = array_declaration->elem;
 	struct ctf_stream_pos *pos =
 		container_of(ppos, struct ctf_stream_pos, parent);
+	size_t elem_size;
+	int reverse;
 
 	if (elem->id == CTF_TYPE_INTEGER) {
 		struct declaration_integer *integer_declaration =
 			container_of(elem, struct declaration_integer, p);
 
-		if (integer_declaration->encoding == CTF_STRING_UTF8
-		      || integer_declaration->encoding == CTF_STRING_ASCII) {
-
-			if (integer_declaration->len == CHAR_BIT
-			    && integer_declaration->p.alignment == CHAR_BIT) {
+		if (integer_declaration->len == CHAR_BIT
+		    && integer_declaration->p.alignment == CHAR_BIT) {
+			int encoded = (integer_declaration->encoding == CTF_STRING_UTF8
+				|| integer_declaration->encoding == CTF_STRING_ASCII);
 
-				if (!ctf_align_pos(pos, integer_declaration->p.alignment))
-					return -EFAULT;
-				if (!ctf_pos_access_ok(pos, array_declaration->len * CHAR_BIT))
-					return -EFAULT;
+			/*
+			 * Reading no element one by one does not align
+			 * the position.
+			 */
+			if (!array_declaration->len && !encoded) {
+				array_definition->bytes = "";
+				array_definition->bytes_len = 0;
+				goto elements;
+			}
+			if (!ctf_align_pos(pos, integer_declaration->p.alignment))
+				return -EFAULT;
+			if (!ctf_pos_access_ok(pos, array_declaration->len * CHAR_BIT))
+				return -EFAULT;
 
+			array_definition->bytes = ctf_get_pos_addr(pos);
+			array_definition->bytes_len = array_declaration->len;
+			/* Zero-copy mode fills the string on access. */
+			if (encoded && !opt_zero_copy) {
 				g_string_assign(array_definition->string, "");
 				g_string_insert_len(array_definition->string,
-					0, (char *) ctf_get_pos_addr(pos),
+					0, array_definition->bytes,
 					array_declaration->len);
-				/*
-				 * We want to populate both the string
-				 * and the underlying values, so carry
-				 * on calling bt_array_rw().
-				 */
 			}
+			/*
+			 * We want to populate both the string
+			 * and the underlying values, so carry
+			 * on calling bt_array_rw().
+			 */
 		}
 	}
+elements:
+	elem_size = bt_bulk_elem_size(elem, &reverse);
+	if (elem_size && !array_definition->bulk.disabled)
+		return ctf_bulk_read(pos, &array_definition->bulk, elem,
+				array_declaration->len, elem_size, reverse);
 	return bt_array_rw(ppos, definition);
 }
 
@@ -0,0 +1,104 @@
+/*
+ * Common Trace Format
+ *
+ * Bulk decoding of arrays and sequences of fixed-size elements.
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/compat/limits.h>	/* C99 limits */
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+
+/*
+ * Kept as plain loops over typed buffers, which the compiler turns into
+ * vector byte swaps.
+ */
+static
+void bulk_swap(void *values, uint64_t len, size_t elem_size)
+{
+	uint64_t i;
+
+	switch (elem_size) {
+	case 2:
+	{
+		uint16_t *v = values;
+
+		for (i = 0; i < len; i++)
+			v[i] = GUINT16_SWAP_LE_BE(v[i]);
+		break;
+	}
+	case 4:
+	{
+		uint32_t *v = values;
+
+		for (i = 0; i < len; i++)
+			v[i] = GUINT32_SWAP_LE_BE(v[i]);
+		break;
+	}
+	case 8:
+	{
+		uint64_t *v = values;
+
+		for (i = 0; i < len; i++)
+			v[i] = GUINT64_SWAP_LE_BE(v[i]);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+int ctf_bulk_read(struct ctf_stream_pos *pos, struct definition_bulk *bulk,
+		const struct bt_declaration *elem, uint64_t len,
+		size_t elem_size, int reverse)
+{
+	size_t size;
+
+	bulk->len = 0;
+	bulk->stale = 1;
+	/* Same position as reading no element one by one. */
+	if (!len)
+		return 0;
+	if (len > SIZE_MAX / CHAR_BIT / elem_size)
+		return -EFAULT;
+	size = len * elem_size;
+	if (!ctf_align_pos(pos, elem->alignment))
+		return -EFAULT;
+	if (!ctf_pos_access_ok(pos, size * CHAR_BIT))
+		return -EFAULT;
+	if (bulk->alloc_len < size) {
+		bulk->values = g_realloc(bulk->values, size);
+		bulk->alloc_len = size;
+	}
+	memcpy(bulk->values, ctf_get_pos_addr(pos), size);
+	if (reverse)
+		bulk_swap(bulk->values, len, elem_size);
+	bulk->len = len;
+	if (!ctf_move_pos(pos, size * CHAR_BIT))
+		return -EFAULT;
+	return 0;
+}
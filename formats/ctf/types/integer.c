@@ -33,21 +33,24 @@
 #include <babeltrace/endian.h>
 
 /*
- * The aligned read/write functions are expected to be faster than the
- * bitfield variants. They will be enabled eventually as an
- * optimisation.
+ * Aligned integers of 8, 16, 32 or 64 bits are read and written
+ * directly in memory. The access class of each integer declaration is
+ * computed when the declaration is created (see
+ * bt_integer_declaration_access()), so reads dispatch straight to the
+ * native or reverse byte order reader. Only genuine bitfields use the
+ * bitfield accessors.
  */
 
-static
+static inline
 int _aligned_integer_read(struct bt_stream_pos *ppos,
-			  struct bt_definition *definition)
+			  struct bt_definition *definition,
+			  int rbo)	/* reverse byte order */
 {
 	struct definition_integer *integer_definition =
 		container_of(definition, struct definition_integer, p);
 	const struct declaration_integer *integer_declaration =
 		integer_definition->declaration;
 	struct ctf_stream_pos *pos = ctf_pos(ppos);
-	int rbo = (integer_declaration->byte_order != BYTE_ORDER);	/* reverse byte order */
 
 	if (!ctf_align_pos(pos, integer_declaration->p.alignment))
 		return -EFAULT;
@@ -142,6 +145,64 @@ int _aligned_integer_read(struct bt_stream_pos *ppos,
 	return 0;
 }
 
+static
+int _aligned_native_integer_read(struct bt_stream_pos *ppos,
+				 struct bt_definition *definition)
+{
+	return _aligned_integer_read(ppos, definition, 0);
+}
+
+static
+int _aligned_reverse_integer_read(struct bt_stream_pos *ppos,
+				  struct bt_definition *definition)
+{
+	return _aligned_integer_read(ppos, definition, 1);
+}
+
+static
+int _bitfield_integer_read(struct bt_stream_pos *ppos,
+			   struct bt_definition *definition)
+{
+	struct definition_integer *integer_definition =
+		container_of(definition, struct definition_integer, p);
+	const struct declaration_integer *integer_declaration =
+		integer_definition->declaration;
+	struct ctf_stream_pos *pos = ctf_pos(ppos);
+
+	if (!ctf_align_pos(pos, integer_declaration->p.alignment))
+		return -EFAULT;
+
+	if (!ctf_pos_access_ok(pos, integer_declaration->len))
+		return -EFAULT;
+
+	if (!integer_declaration->signedness) {
+		if (integer_declaration->byte_order == LITTLE_ENDIAN)
+			bt_bitfield_read_le(mmap_align_addr(pos->base_mma) +
+					pos->mmap_base_offset, unsigned char,
+				pos->offset, integer_declaration->len,
+				&integer_definition->value._unsigned);
+		else
+			bt_bitfield_read_be(mmap_align_addr(pos->base_mma) +
+					pos->mmap_base_offset, unsigned char,
+				pos->offset, integer_declaration->len,
+				&integer_definition->value._unsigned);
+	} else {
+		if (integer_declaration->byte_order == LITTLE_ENDIAN)
+			bt_bitfield_read_le(mmap_align_addr(pos->base_mma) +
+					pos->mmap_base_offset, unsigned char,
+				pos->offset, integer_declaration->len,
+				&integer_definition->value._signed);
+		else
+			bt_bitfield_read_be(mmap_align_addr(pos->base_mma) +
+					pos->mmap_base_offset, unsigned char,
+				pos->offset, integer_declaration->len,
+				&integer_definition->value._signed);
+	}
+	if (!ctf_move_pos(pos, integer_declaration->len))
+		return -EFAULT;
+	return 0;
+}
+
 static
 int _aligned_integer_write(struct bt_stream_pos *ppos,
 			    struct bt_definition *definition)
@@ -253,45 +314,20 @@ int ctf_integer_read(struct bt_stream_pos *ppos, struct bt_definition *definitio
 		container_of(definition, struct definition_integer, p);
 	const struct declaration_integer *integer_declaration =
 		integer_definition->declaration;
-	struct ctf_stream_pos *pos = ctf_pos(ppos);
-
-	if (!(integer_declaration->p.alignment % CHAR_BIT)
-	    && !(integer_declaration->len % CHAR_BIT)) {
-		return _aligned_integer_read(ppos, definition);
+	enum bt_integer_access access = integer_declaration->access;
+
+	if (unlikely(access == BT_INTEGER_ACCESS_UNKNOWN))
+		access = bt_integer_declaration_access(integer_declaration);
+
+	switch (access) {
+	case BT_INTEGER_ACCESS_NATIVE:
+		return _aligned_native_integer_read(ppos, definition);
+	case BT_INTEGER_ACCESS_REVERSE:
+		return _aligned_reverse_integer_read(ppos, definition);
+	case BT_INTEGER_ACCESS_BITFIELD:
+	default:
+		return _bitfield_integer_read(ppos, definition);
 	}
-
-	if (!ctf_align_pos(pos, integer_declaration->p.alignment))
-		return -EFAULT;
-
-	if (!ctf_pos_access_ok(pos, integer_declaration->len))
-		return -EFAULT;
-
-	if (!integer_declaration->signedness) {
-		if (integer_declaration->byte_order == LITTLE_ENDIAN)
-			bt_bitfield_read_le(mmap_align_addr(pos->base_mma) +
-					pos->mmap_base_offset, unsigned char,
-				pos->offset, integer_declaration->len,
-				&integer_definition->value._unsigned);
-		else
-			bt_bitfield_read_be(mmap_align_addr(pos->base_mma) +
-					pos->mmap_base_offset, unsigned char,
-				pos->offset, integer_declaration->len,
-				&integer_definition->value._unsigned);
-	} else {
-		if (integer_declaration->byte_order == LITTLE_ENDIAN)
-			bt_bitfield_read_le(mmap_align_addr(pos->base_mma) +
-					pos->mmap_base_offset, unsigned char,
-				pos->offset, integer_declaration->len,
-				&integer_definition->value._signed);
-		else
-			bt_bitfield_read_be(mmap_align_addr(pos->base_mma) +
-					pos->mmap_base_offset, unsigned char,
-				pos->offset, integer_declaration->len,
-				&integer_definition->value._signed);
-	}
-	if (!ctf_move_pos(pos, integer_declaration->len))
-		return -EFAULT;
-	return 0;
 }
 
 int ctf_integer_write(struct bt_stream_pos *ppos, struct bt_definition *definition)
@@ -302,8 +338,12 @@ int ctf_integer_write(struct bt_stream_pos *ppos, struct bt_definition *definiti
 		integer_definition->declaration;
 	struct ctf_stream_pos *pos = ctf_pos(ppos);
 
-	if (!(integer_declaration->p.alignment % CHAR_BIT)
-	    && !(integer_declaration->len % CHAR_BIT)) {
+	/*
+	 * Classify on each write: declarations built by the CTF writer
+	 * are updated after their creation.
+	 */
+	if (bt_integer_declaration_access(integer_declaration)
+			!= BT_INTEGER_ACCESS_BITFIELD) {
 		return _aligned_integer_write(ppos, definition);
 	}
 
@@ -36,32 +36,54 @@ int ctf_sequence_read(struct bt_stream_pos *ppos, struct bt_definition *definiti
 		sequence_definition->declaration;
 	struct bt_declaration *elem = sequence_declaration->elem;
 	struct ctf_stream_pos *pos = ctf_pos(ppos);
+	size_t elem_size;
+	int reverse;
 
 	if (elem->id == CTF_TYPE_INTEGER) {
 		struct declaration_integer *integer_declaration =
 			container_of(elem, struct declaration_integer, p);
 
-		if (integer_declaration->encoding == CTF_STRING_UTF8
-		      || integer_declaration->encoding == CTF_STRING_ASCII) {
-
-			if (integer_declaration->len == CHAR_BIT
-			    && integer_declaration->p.alignment == CHAR_BIT) {
-				uint64_t len = bt_sequence_len(sequence_definition);
+		if (integer_declaration->len == CHAR_BIT
+		    && integer_declaration->p.alignment == CHAR_BIT) {
+			uint64_t len = bt_sequence_len(sequence_definition);
+			int encoded = (integer_declaration->encoding == CTF_STRING_UTF8
+				|| integer_declaration->encoding == CTF_STRING_ASCII);
 
-				if (!ctf_align_pos(pos, integer_declaration->p.alignment))
-					return -EFAULT;
-				if (!ctf_pos_access_ok(pos, len * CHAR_BIT))
-					return -EFAULT;
+			/*
+			 * Reading no element one by one does not align
+			 * the position.
+			 */
+			if (!len && !encoded) {
+				sequence_definition->bytes = "";
+				sequence_definition->bytes_len = 0;
+				goto elements;
+			}
+			if (!ctf_align_pos(pos, integer_declaration->p.alignment))
+				return -EFAULT;
+			if (!ctf_pos_access_ok(pos, len * CHAR_BIT))
+				return -EFAULT;
 
-				g_string_assign(sequence_definition->string, "");
-				g_string_insert_len(sequence_definition->string,
-					0, (char *) ctf_get_pos_addr(pos), len);
+			sequence_definition->bytes = ctf_get_pos_addr(pos);
+			sequence_definition->bytes_len = len;
+			if (encoded) {
+				/* Zero-copy mode fills the string on access. */
+				if (!opt_zero_copy) {
+					g_string_assign(sequence_definition->string, "");
+					g_string_insert_len(sequence_definition->string,
+						0, sequence_definition->bytes, len);
+				}
 				if (!ctf_move_pos(pos, len * CHAR_BIT))
 					return -EFAULT;
 				return 0;
 			}
 		}
 	}
+elements:
+	elem_size = bt_bulk_elem_size(elem, &reverse);
+	if (elem_size && !sequence_definition->bulk.disabled)
+		return ctf_bulk_read(pos, &sequence_definition->bulk, elem,
+				bt_sequence_len(sequence_definition),
+				elem_size, reverse);
 	return bt_sequence_rw(ppos, definition);
 }
 
@@ -58,13 +58,18 @@ int ctf_string_read(struct bt_stream_pos *ppos, struct bt_definition *definition
 	if (srcaddr[len - 1] != '\0')
 		return -EFAULT;
 
-	if (string_definition->alloc_len < len) {
-		string_definition->value =
-			g_realloc(string_definition->value, len);
-		string_definition->alloc_len = len;
-	}
 	printf_debug("CTF string read %s\n", srcaddr);
-	memcpy(string_definition->value, srcaddr, len);
+	if (opt_zero_copy) {
+		string_definition->value = srcaddr;
+	} else {
+		if (string_definition->alloc_len < len) {
+			string_definition->buf =
+				g_realloc(string_definition->buf, len);
+			string_definition->alloc_len = len;
+		}
+		memcpy(string_definition->buf, srcaddr, len);
+		string_definition->value = string_definition->buf;
+	}
 	string_definition->len = len;
 	if (!ctf_move_pos(pos, len * CHAR_BIT))
 		return -EFAULT;
@@ -191,10 +191,17 @@ extern int opt_all_field_names,
 	opt_clock_seconds,
 	opt_clock_date,
 	opt_clock_gmt,
-	opt_clock_force_correlate;
+	opt_clock_force_correlate,
+	opt_map_whole_file,
+	opt_no_index_cache,
+	opt_zero_copy,
+	opt_lazy_payload,
+	opt_read_packets,
+	opt_decode_threads;
 
 extern uint64_t opt_clock_offset;
 extern uint64_t opt_clock_offset_ns;
+extern int opt_readahead_packets;
 extern int babeltrace_ctf_console_output;
 
 #endif
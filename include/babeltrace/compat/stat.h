@@ -0,0 +1,53 @@
+#ifndef _BABELTRACE_COMPAT_STAT_H
+#define _BABELTRACE_COMPAT_STAT_H
+
+/*
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+static inline
+uint64_t babeltrace_stat_mtime_sec(const struct stat *st)
+{
+	return (uint64_t) st->st_mtime;
+}
+
+/*
+ * Nanoseconds of the modification time, 0 on systems without
+ * sub-second timestamps in struct stat.
+ */
+static inline
+uint64_t babeltrace_stat_mtime_nsec(const struct stat *st)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+	return (uint64_t) st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+	return (uint64_t) st->st_mtimespec.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+#endif /* _BABELTRACE_COMPAT_STAT_H */
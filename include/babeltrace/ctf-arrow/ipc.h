@@ -0,0 +1,111 @@
+#ifndef _BABELTRACE_CTF_ARROW_IPC_H
+#define _BABELTRACE_CTF_ARROW_IPC_H
+
+/*
+ * Common Trace Format (Arrow Output)
+ *
+ * Arrow IPC stream writer
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Minimal writer for the Arrow IPC streaming format: a schema message,
+ * followed by dictionary and record batch messages, and an
+ * end-of-stream marker. Message metadata is encoded as FlatBuffers,
+ * without depending on the FlatBuffers or Arrow libraries. Data
+ * buffers are written in native byte order, which the schema records.
+ */
+
+enum arrow_type {
+	ARROW_TYPE_INT,			/* bit_width, is_signed */
+	ARROW_TYPE_DOUBLE,
+	ARROW_TYPE_UTF8,
+	ARROW_TYPE_TIMESTAMP_NS,	/* UTC, in ns, 64-bit */
+	ARROW_TYPE_LIST,		/* of elem_type */
+};
+
+struct arrow_field {
+	const char *name;
+	enum arrow_type type;
+	enum arrow_type elem_type;	/* LIST: INT or DOUBLE */
+	int bit_width;			/* INT, LIST of INT */
+	int is_signed;			/* INT, LIST of INT */
+	int64_t dictionary_id;		/* UTF8: dictionary id, -1 if none */
+};
+
+struct arrow_field_node {
+	int64_t length;
+	int64_t null_count;
+};
+
+struct arrow_buffer {
+	const void *data;
+	uint64_t len;			/* in bytes */
+};
+
+/*
+ * All functions below return 0 on success, -1 on write error.
+ */
+
+/*
+ * arrow_write_schema: write the schema message of a stream.
+ *
+ * metadata holds nr_metadata (key, value) string pairs, saved as the
+ * schema custom metadata.
+ */
+BT_HIDDEN
+int arrow_write_schema(FILE *fp, const struct arrow_field *fields,
+		unsigned int nr_fields, const char * const *metadata,
+		unsigned int nr_metadata);
+
+/*
+ * arrow_write_record_batch: write a record batch of length rows.
+ *
+ * Field nodes and buffers are listed in schema order, depth first, as
+ * specified by the Arrow columnar format.
+ */
+BT_HIDDEN
+int arrow_write_record_batch(FILE *fp, int64_t length,
+		const struct arrow_field_node *nodes, unsigned int nr_nodes,
+		const struct arrow_buffer *buffers, unsigned int nr_buffers);
+
+/*
+ * arrow_write_dictionary_batch: write length UTF8 dictionary entries.
+ *
+ * buffers holds the validity, offsets and data buffers of the entries.
+ * Delta batches append entries to the dictionary, other batches
+ * replace it.
+ */
+BT_HIDDEN
+int arrow_write_dictionary_batch(FILE *fp, int64_t id, int is_delta,
+		int64_t length, const struct arrow_buffer *buffers);
+
+BT_HIDDEN
+int arrow_write_eos(FILE *fp);
+
+#endif /* _BABELTRACE_CTF_ARROW_IPC_H */
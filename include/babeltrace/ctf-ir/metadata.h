@@ -43,6 +43,7 @@ struct ctf_event_declaration;
 struct ctf_clock;
 struct ctf_callsite;
 struct ctf_scanner;
+struct ctf_decode_program;
 
 struct ctf_stream_packet_limits {
 	uint64_t begin;
@@ -54,18 +55,40 @@ struct ctf_stream_packet_timestamp {
 	struct ctf_stream_packet_limits real;
 };
 
+/*
+ * Event header fields of one choice of the "v" variant (LTTng
+ * compact/extended headers).
+ */
+struct ctf_event_header_choice {
+	struct bt_definition *field;		/* variant choice */
+	struct definition_integer *id;
+	struct definition_integer *timestamp;
+};
+
 struct ctf_stream_definition {
 	struct ctf_stream_declaration *stream_class;
 	uint64_t real_timestamp;		/* Current timestamp, in ns */
 	uint64_t cycles_timestamp;		/* Current timestamp, in cycles */
+	uint64_t merge_order;			/* Rank of path, for merge ties */
 	uint64_t event_id;			/* Current event ID */
 	int has_timestamp;
+	/* Events before this timestamp (in ns) are skipped, 0 if none. */
+	uint64_t skip_until;
 	uint64_t stream_id;
 
 	struct definition_struct *trace_packet_header;
 	struct definition_struct *stream_packet_context;
 	struct definition_struct *stream_event_header;
 	struct definition_struct *stream_event_context;
+	/* Event header and stream event context decode program */
+	struct ctf_decode_program *event_header_program;
+	/* Event header fields, resolved when definitions are created */
+	struct definition_integer *header_id;
+	struct definition_enum *header_id_enum;
+	struct definition_integer *header_timestamp;
+	struct definition_variant *header_v;
+	struct ctf_event_header_choice *header_v_choices;
+	unsigned int header_v_nr_choices;
 	GPtrArray *events_by_id;		/* Array of struct ctf_event_definition pointers indexed by id */
 	struct definition_scope *parent_def_scope;	/* for initialization */
 	int stream_definitions_created;
@@ -83,6 +106,21 @@ struct ctf_event_definition {
 	struct ctf_stream_definition *stream;
 	struct definition_struct *event_context;
 	struct definition_struct *event_fields;
+	/* Event context and payload decode program */
+	struct ctf_decode_program *program;
+	/*
+	 * Fixed-size payloads are skipped by ctf_read_event() in lazy
+	 * payload mode (opt_lazy_payload), and decoded on first access
+	 * by ctf_decode_event_fields(). Programs are NULL if the payload
+	 * has a variable size.
+	 */
+	struct ctf_decode_program *context_program;
+	struct ctf_decode_program *fields_program;
+	uint64_t fields_len;		/* in bits */
+	uint64_t fields_align;		/* in bits */
+	/* Position of a payload left to decode, NULL if none. */
+	struct bt_stream_pos *fields_pos;
+	uint64_t fields_offset;
 };
 
 #define CTF_CLOCK_SET_FIELD(ctf_clock, field)				\
@@ -289,6 +327,17 @@ struct ctf_event_declaration {
 	int loglevel;
 	GQuark model_emf_uri;
 
+	/*
+	 * Static layout, computed by the metadata visitor. If the event
+	 * context (resp. payload) has a fixed size, it always spans
+	 * context_len (resp. fields_len) bits from its alignment. Absent
+	 * scopes have a fixed size of 0.
+	 */
+	unsigned int context_fixed:1;
+	unsigned int fields_fixed:1;
+	uint64_t context_len, context_align;	/* in bits */
+	uint64_t fields_len, fields_align;	/* in bits */
+
 	enum {					/* Fields populated mask */
 		CTF_EVENT_name	=		(1 << 0),
 		CTF_EVENT_id 	= 		(1 << 1),
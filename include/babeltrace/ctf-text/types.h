@@ -30,6 +30,8 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 #include <babeltrace/babeltrace-internal.h>
@@ -37,6 +39,8 @@
 #include <babeltrace/format.h>
 #include <babeltrace/format-internal.h>
 
+struct bt_ctf_iter;
+
 /*
  * Inherit from both struct bt_stream_pos and struct bt_trace_descriptor.
  */
@@ -51,8 +55,22 @@ struct ctf_text_stream_pos {
 	uint64_t last_real_timestamp;	/* to print delta */
 	uint64_t last_cycles_timestamp;	/* to print delta */
 	GString *string;	/* Current string */
+	char *buf;		/* output buffer, NULL if unset */
+	size_t buf_len;		/* bytes used in buf */
+	size_t buf_size;	/* allocated size of buf */
+	uint64_t written;	/* bytes written out to fp */
+	int error;		/* errno of the first write error, or 0 */
+	int flush_events;	/* flush buf after each event */
+	GHashTable *templates;	/* event class output templates */
 };
 
+/*
+ * Output buffer size. Text output is appended to the output buffer, and
+ * written out with a single write() when it is full. Positions without
+ * output file (workers) grow their buffer instead.
+ */
+#define CTF_TEXT_BUF_SIZE	(1024 * 1024)
+
 static inline
 struct ctf_text_stream_pos *ctf_text_pos(struct bt_stream_pos *pos)
 {
@@ -79,13 +97,99 @@ int ctf_text_array_write(struct bt_stream_pos *pos, struct bt_definition *defini
 BT_HIDDEN
 int ctf_text_sequence_write(struct bt_stream_pos *pos, struct bt_definition *definition);
 
+/*
+ * ctf_text_flush: write out the output buffer of pos.
+ *
+ * Returns 0 on success, -1 on error. Write errors are sticky: the errno
+ * of the first one is kept in pos->error, and output is dropped from
+ * then on. Event callbacks return -pos->error once it is set.
+ */
+int ctf_text_flush(struct ctf_text_stream_pos *pos);
+
+/*
+ * The output buffer functions below are also used by the other text
+ * based output formats, such as json.
+ */
+void ctf_text_write_slow(struct ctf_text_stream_pos *pos, const char *s,
+		size_t len);
+void ctf_text_printf(struct ctf_text_stream_pos *pos, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void ctf_text_print_uint(struct ctf_text_stream_pos *pos, uint64_t v);
+void ctf_text_print_int(struct ctf_text_stream_pos *pos, int64_t v);
+void ctf_text_print_hex(struct ctf_text_stream_pos *pos, uint64_t v);
+
+/*
+ * ctf_text_worker_create: create a position formatting events like
+ * pos, from another thread. Workers have no output file nor buffer:
+ * the caller sets buf, buf_size and buf_len before formatting events
+ * with the event callback, and takes the output back from them. The
+ * buffer is grown as needed. The last timestamps of the worker, used
+ * for the delta field, are also up to the caller.
+ */
+struct ctf_text_stream_pos *ctf_text_worker_create(
+		struct ctf_text_stream_pos *pos);
+void ctf_text_worker_destroy(struct ctf_text_stream_pos *worker);
+
+/*
+ * ctf_text_write_events_threads: write the events of iter to pos, as
+ * its event callback would, formatting them in nr_threads threads. The
+ * events are copied while iter moves on, formatted out of order, and
+ * written out in order from another thread. Returns 0 on success, a
+ * negative value on error, including write errors of pos.
+ */
+int ctf_text_write_events_threads(struct ctf_text_stream_pos *pos,
+		struct bt_ctf_iter *iter, int nr_threads);
+
+static inline
+void ctf_text_write(struct ctf_text_stream_pos *pos, const char *s,
+		size_t len)
+{
+	if (unlikely(pos->buf_len + len > pos->buf_size)) {
+		ctf_text_write_slow(pos, s, len);
+		return;
+	}
+	memcpy(pos->buf + pos->buf_len, s, len);
+	pos->buf_len += len;
+}
+
+static inline
+void ctf_text_puts(struct ctf_text_stream_pos *pos, const char *s)
+{
+	ctf_text_write(pos, s, strlen(s));
+}
+
+static inline
+void ctf_text_putc(struct ctf_text_stream_pos *pos, char c)
+{
+	if (unlikely(pos->buf_len == pos->buf_size)) {
+		ctf_text_write_slow(pos, &c, 1);
+		return;
+	}
+	pos->buf[pos->buf_len++] = c;
+}
+
+static inline
+void print_field_name(struct ctf_text_stream_pos *pos, GQuark name)
+{
+	ctf_text_puts(pos, rem_(g_quark_to_string(name)));
+	ctf_text_write(pos, " = ", 3);
+}
+
+static inline
+void print_quoted(struct ctf_text_stream_pos *pos, const char *str)
+{
+	ctf_text_putc(pos, '"');
+	ctf_text_puts(pos, str);
+	ctf_text_putc(pos, '"');
+}
+
 static inline
 void print_pos_tabs(struct ctf_text_stream_pos *pos)
 {
 	int i;
 
 	for (i = 0; i < pos->depth; i++)
-		fprintf(pos->fp, "\t");
+		ctf_text_putc(pos, '\t');
 }
 
 /*
@@ -107,6 +107,13 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
  */
 enum {
 	BT_FLAGS_FREE_PRIVATE_DATA	= (1 << 0),
+	/*
+	 * Only read the events having a callback added with this flag,
+	 * and the events selected by bt_ctf_iter_set_event_filter(): the
+	 * other events are skipped by the trace reader. Only for
+	 * callbacks targeting an event.
+	 */
+	BT_FLAGS_FILTER_EVENTS		= (1 << 1),
 };
 
 #ifdef __cplusplus
@@ -57,4 +57,31 @@ struct ctf_packet_index {
 	uint64_t stream_id;
 } __attribute__((__packed__));
 
+/*
+ * Packet index cache, written by babeltrace for stream files which do
+ * not come with an index. A cache file starts with a struct
+ * ctf_packet_index_file_hdr (packet_index_len being the size of
+ * struct ctf_packet_index_cache), followed by a struct
+ * ctf_packet_index_cache_hdr and one struct ctf_packet_index_cache per
+ * packet. All integer fields are stored in big endian. The cache is
+ * only used while both the stream file and the trace metadata file are
+ * unchanged.
+ */
+struct ctf_packet_index_cache_hdr {
+	uint64_t stream_size;		/* size of the indexed file, in bytes */
+	uint64_t stream_mtime_sec;	/* mtime of the indexed file */
+	uint64_t stream_mtime_nsec;
+	uint64_t metadata_size;		/* size of the metadata file, in bytes */
+	uint64_t metadata_mtime_sec;	/* mtime of the metadata file */
+	uint64_t metadata_mtime_nsec;
+} __attribute__((__packed__));
+
+struct ctf_packet_index_cache {
+	struct ctf_packet_index p;
+	uint64_t data_offset;		/* offset of data within the packet, in bits */
+	uint64_t events_discarded_len;	/* length of the field, in bits */
+	uint64_t ts_real_begin;		/* realtime timestamp, in ns */
+	uint64_t ts_real_end;
+} __attribute__((__packed__));
+
 #endif /* LTTNG_INDEX_H */
@@ -0,0 +1,111 @@
+#ifndef _BABELTRACE_CTF_DECODE_PROGRAM_H
+#define _BABELTRACE_CTF_DECODE_PROGRAM_H
+
+/*
+ * BabelTrace
+ *
+ * CTF precompiled event decode programs (internal)
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/types.h>
+#include <stdint.h>
+#include <glib.h>
+
+/*
+ * A decode program is the flattened form of one or more definition
+ * trees. Structures are unrolled into their fields, byte-aligned
+ * integers become dedicated opcodes, and alignment that can be proven
+ * statically is elided. Anything whose layout depends on the data
+ * (strings, variants, arrays, sequences, floats, bitfields) is kept as
+ * a direct call to its read function, resolved once at compile time.
+ *
+ * Programs are bound to the definitions they were compiled from: the
+ * values read land in those definitions, exactly as generic_rw() would
+ * leave them.
+ */
+
+enum ctf_decode_opcode {
+	CTF_DECODE_OP_ALIGN = 0,	/* align position on "align" bits */
+	CTF_DECODE_OP_INT8,		/* byte-aligned 8-bit integer */
+	CTF_DECODE_OP_INT16,		/* byte-aligned 16-bit integer */
+	CTF_DECODE_OP_INT32,		/* byte-aligned 32-bit integer */
+	CTF_DECODE_OP_INT64,		/* byte-aligned 64-bit integer */
+	CTF_DECODE_OP_CALL,		/* call "read" on definition */
+};
+
+struct ctf_decode_op {
+	enum ctf_decode_opcode opcode;
+	unsigned int signedness:1;
+	unsigned int rbo:1;		/* reverse byte order */
+	uint64_t align;			/* alignment, in bits (ALIGN) */
+	rw_dispatch read;		/* read function (CALL) */
+	struct bt_definition *definition;
+};
+
+struct ctf_decode_program {
+	GArray *ops;			/* Array of struct ctf_decode_op */
+	rw_dispatch *rw_table;		/* read dispatch table */
+	/* Alignment state known at compile time */
+	uint64_t known_align;		/* in bits, power of 2 */
+	uint64_t known_offset;		/* offset modulo known_align */
+};
+
+BT_HIDDEN
+struct ctf_decode_program *ctf_decode_program_create(rw_dispatch *rw_table);
+BT_HIDDEN
+void ctf_decode_program_destroy(struct ctf_decode_program *program);
+
+/*
+ * ctf_decode_program_append: compile definition at the end of program.
+ *
+ * Returns 0 on success, negative error value otherwise.
+ */
+BT_HIDDEN
+int ctf_decode_program_append(struct ctf_decode_program *program,
+		struct bt_definition *definition);
+
+/*
+ * ctf_decode_program_read: run program at the current read position.
+ *
+ * Returns 0 on success, negative error value otherwise (same
+ * semantic as generic_rw()).
+ */
+BT_HIDDEN
+int ctf_decode_program_read(struct ctf_decode_program *program,
+		struct bt_stream_pos *pos);
+
+/*
+ * ctf_decode_fixed_len: compute the size of a fixed-size declaration.
+ *
+ * On success, returns 0 and stores in len the number of bits read by
+ * a definition of declaration starting on its alignment. Returns -1 if
+ * this size depends on the data (strings, sequences, variants).
+ */
+BT_HIDDEN
+int ctf_decode_fixed_len(const struct bt_declaration *declaration,
+		uint64_t *len);
+
+#endif /* _BABELTRACE_CTF_DECODE_PROGRAM_H */
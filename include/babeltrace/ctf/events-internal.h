@@ -77,10 +77,25 @@ struct bt_ctf_iter {
 	 */
 	GPtrArray *dep_gc;
 	uint64_t events_lost;
+	/* State of bt_ctf_iter_read_events() */
+	struct bt_ctf_event *batch;		/* events of the last batch */
+	int batch_alloc_len;
+	GPtrArray *batch_streams;		/* streams of the last batch */
+	struct ctf_file_stream *batch_pending;	/* stream to move past */
+	unsigned long batch_generation;		/* iterator generation */
+	/* Patterns and callback event names read by the trace reader */
+	struct ctf_event_filter event_filter;
 };
 
 void ctf_update_current_packet_index(struct ctf_stream_definition *stream,
 		struct packet_index *prev_index,
 		struct packet_index *cur_index);
 
+/*
+ * Apply the event filter of iter to all its streams, including their
+ * current events.
+ */
+BT_HIDDEN
+int ctf_iter_update_event_filter(struct bt_ctf_iter *iter);
+
 #endif /*_BABELTRACE_CTF_EVENTS_INTERNAL_H */
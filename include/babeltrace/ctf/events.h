@@ -230,6 +230,22 @@ uint64_t bt_ctf_get_struct_field_count(const struct bt_definition *field);
  * bt_ctf_get_enum_int gets the integer field of an enumeration.
  * bt_ctf_get_enum_str gets the string matching the current enumeration
  * value, or NULL if the current value does not match any string.
+ *
+ * bt_ctf_get_bytes gets the content of a string (without its final
+ * null character), or of an array or sequence of byte-aligned 8-bit
+ * integers, and stores its length in bytes in len. The returned
+ * pointer may point directly into the trace packet, and is only valid
+ * until the stream of the event moves to its next packet. The same
+ * holds for strings returned by bt_ctf_get_string when zero-copy reads
+ * (opt_zero_copy, --zero-copy) are enabled.
+ *
+ * bt_ctf_get_array_values gets the values of an array or sequence of
+ * 8, 16, 32 or 64-bit byte-aligned integers, or of single or double
+ * precision floats, as a contiguous buffer of len elements of elem_size
+ * bytes (int8_t to int64_t, uint8_t to uint64_t, float or double,
+ * depending on the element type) in host byte order. It returns NULL
+ * for other arrays and sequences. The buffer is valid until the next
+ * event of the stream is read.
  */
 uint64_t bt_ctf_get_uint64(const struct bt_definition *field);
 int64_t bt_ctf_get_int64(const struct bt_definition *field);
@@ -237,6 +253,9 @@ const struct bt_definition *bt_ctf_get_enum_int(const struct bt_definition *fiel
 const char *bt_ctf_get_enum_str(const struct bt_definition *field);
 char *bt_ctf_get_char_array(const struct bt_definition *field);
 char *bt_ctf_get_string(const struct bt_definition *field);
+const char *bt_ctf_get_bytes(const struct bt_definition *field, size_t *len);
+const void *bt_ctf_get_array_values(const struct bt_definition *field,
+		size_t *elem_size, uint64_t *len);
 double bt_ctf_get_float(const struct bt_definition *field);
 const struct bt_definition *bt_ctf_get_variant(const struct bt_definition *field);
 const struct bt_definition *bt_ctf_get_struct_field_index(
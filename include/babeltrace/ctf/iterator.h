@@ -94,6 +94,60 @@ struct bt_ctf_event *bt_ctf_iter_read_event(struct bt_ctf_iter *iter);
 struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 		int *flags);
 
+/*
+ * bt_ctf_iter_read_events: Read a batch of events.
+ *
+ * @iter: trace collection iterator (input). Should NOT be NULL.
+ * @events: array receiving up to @max events (output).
+ * @max: number of entries of @events.
+ *
+ * Fill @events with the next events of the trace collection, in the
+ * order bt_ctf_iter_read_event() and bt_iter_next() would return them.
+ * The first batch starts with the iterator's current event, each
+ * following batch starts right after the last event of the previous
+ * one. On return, the iterator is positioned on the last event of the
+ * batch: moving it with bt_iter_next() or bt_iter_set_pos() restarts
+ * the next batch from its new position.
+ *
+ * Events remain valid until the next call to bt_ctf_iter_read_events(),
+ * bt_iter_next() or bt_iter_set_pos() on this iterator. Callbacks are
+ * called for each event, and bt_ctf_get_lost_events_count() returns the
+ * number of events lost within the batch.
+ *
+ * A batch may hold fewer than @max events before the end of the trace:
+ * it stops before any of its streams moves to its next packet, since
+ * events of a stream share the definitions of their packet. Each
+ * stream keeps one set of event definitions per event of the batch.
+ *
+ * Return the number of events read, 0 on end of trace, -EAGAIN if no
+ * event is available for now (live reading or empty packets), or
+ * another negative value on error.
+ */
+int bt_ctf_iter_read_events(struct bt_ctf_iter *iter,
+		struct bt_ctf_event **events, int max);
+
+/*
+ * bt_ctf_iter_set_event_filter: Only read events matching patterns.
+ *
+ * @iter: trace collection iterator (input). Should NOT be NULL.
+ * @patterns: event names, which may contain '*' and '?' wildcards.
+ * @nr_patterns: number of entries of @patterns.
+ *
+ * Events whose name matches none of @patterns, and which have no
+ * callback added with BT_FLAGS_FILTER_EVENTS, are skipped by the trace
+ * reader, and never returned by the iterator nor passed to callbacks.
+ * The filter applies to the current event of each stream too, and to
+ * event classes added later by live metadata updates. A NULL @patterns
+ * or a @nr_patterns of 0 removes the patterns. Changing the filter
+ * stops the decoder threads, which are started again by the next read,
+ * and invalidates the events of the last bt_ctf_iter_read_events() call.
+ *
+ * Return 0 on success, -EINVAL if a trace of the iterator is not
+ * opened for reading, or another negative value on error.
+ */
+int bt_ctf_iter_set_event_filter(struct bt_ctf_iter *iter,
+		const char * const *patterns, int nr_patterns);
+
 /*
  * bt_ctf_get_lost_events_count: returns the number of events discarded
  * immediately prior to the last event read
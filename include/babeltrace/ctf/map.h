@@ -0,0 +1,85 @@
+#ifndef _BABELTRACE_CTF_MAP_H
+#define _BABELTRACE_CTF_MAP_H
+
+/*
+ * BabelTrace
+ *
+ * CTF parallel event map API
+ *
+ * Copyright 2011-2012 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bt_context;
+struct bt_ctf_event;
+
+/*
+ * Callbacks of bt_ctf_map_events().
+ *
+ * thread_init: create the state of one thread. Called on the calling
+ *   thread, before the map starts. Returns NULL on error.
+ * event: process one event with the state of the thread it is read on.
+ *   The event is only valid during the call. Returns 0 to continue,
+ *   nonzero to stop the map.
+ * reduce: merge and free the state of one thread. Called on the
+ *   calling thread once the map is over, for each thread state, in
+ *   thread order. Also called after errors, to free the states.
+ *   Returns 0 on success, nonzero on error.
+ */
+struct bt_ctf_map_cb {
+	void *(*thread_init)(void *private_data);
+	int (*event)(struct bt_ctf_event *event, void *thread_data);
+	int (*reduce)(void *thread_data, void *private_data);
+};
+
+/*
+ * bt_ctf_map_events: call cb->event on every event of the traces of a
+ * context, across nr_threads threads, in no particular order.
+ *
+ * Each stream file is read by a single thread, one packet at a time,
+ * in packet order, and stream files are spread dynamically over the
+ * threads. Events are not merged in timestamp order, which makes this
+ * much faster than an iterator for order-insensitive analyses such as
+ * counts and histograms.
+ *
+ * @ctx: context of the traces. Must not have an iterator.
+ * @nr_threads: number of threads, 0 for one per online CPU. The calling
+ *   thread is one of them.
+ * @cb: callbacks, see struct bt_ctf_map_cb.
+ * @private_data: passed to thread_init and reduce.
+ *
+ * Return 0 on success, the first nonzero value returned by a callback,
+ * or a negative value on error.
+ */
+int bt_ctf_map_events(struct bt_context *ctx, int nr_threads,
+		const struct bt_ctf_map_cb *cb, void *private_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BABELTRACE_CTF_MAP_H */
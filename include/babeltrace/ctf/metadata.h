@@ -41,11 +41,116 @@
 #define CTF_MAGIC	0xC1FC1FC1
 #define TSDL_MAGIC	0x75D11D57
 
+/*
+ * Initial number of alternate event definition sets (views) of a file
+ * stream, and size of the ring of views read into by a decoder thread.
+ * Batch reads add views as needed to hold more events of a stream.
+ */
+#define CTF_FILE_STREAM_NR_VIEWS	4
+
+struct ctf_stream_decoder;
+
 struct ctf_file_stream {
 	struct ctf_stream_definition parent;
 	struct ctf_stream_pos pos;	/* current stream position */
+	/*
+	 * Ring of views used by batch reads and decoder threads, of at
+	 * least CTF_FILE_STREAM_NR_VIEWS entries, each allocated on
+	 * first use. cur_def holds the definitions of the current event,
+	 * NULL when it was read into parent.
+	 */
+	GPtrArray *views;		/* struct ctf_stream_definition * */
+	struct ctf_stream_definition *cur_def;
+	unsigned int next_view;		/* next view to read into */
+	unsigned int batch_nr_events;	/* events in the current batch */
+	/*
+	 * Decoder reading events ahead into the views, from a decoder
+	 * thread shared with other streams, NULL when not running. Set
+	 * up by the format, driven by the iterator through the callbacks
+	 * below. decoder_read has the same return values as the stream
+	 * event_cb.
+	 */
+	struct ctf_stream_decoder *decoder;
+	int (*decoder_start)(struct ctf_file_stream *file_stream);
+	int (*decoder_read)(struct ctf_file_stream *file_stream);
+	void (*decoder_stop)(struct ctf_file_stream *file_stream);
 };
 
+/*
+ * ctf_file_stream_read_view: read the next event of a file stream into
+ * its next view, which becomes cur_def.
+ *
+ * Same return values as the stream event_cb.
+ */
+BT_HIDDEN
+int ctf_file_stream_read_view(struct ctf_file_stream *file_stream);
+
+/*
+ * ctf_file_stream_reserve_view: make sure the next view of a file
+ * stream does not hold one of the nr_held events last read into its
+ * views, by adding a view to the ring if needed.
+ */
+BT_HIDDEN
+void ctf_file_stream_reserve_view(struct ctf_file_stream *file_stream,
+		unsigned int nr_held);
+
+/*
+ * ctf_file_stream_alloc_views: create the views of a file stream used
+ * by its decoder.
+ * ctf_file_stream_decode_view: read the next event of a file stream
+ * into view, without making it cur_def nor updating the timestamps of
+ * the file stream.
+ */
+BT_HIDDEN
+int ctf_file_stream_alloc_views(struct ctf_file_stream *file_stream);
+BT_HIDDEN
+int ctf_file_stream_decode_view(struct ctf_file_stream *file_stream,
+		struct ctf_stream_definition *view);
+
+/*
+ * Decoder thread callbacks, see struct ctf_file_stream.
+ */
+BT_HIDDEN
+int ctf_stream_decoder_start(struct ctf_file_stream *file_stream);
+BT_HIDDEN
+int ctf_stream_decoder_read(struct ctf_file_stream *file_stream);
+BT_HIDDEN
+void ctf_stream_decoder_stop(struct ctf_file_stream *file_stream);
+
+/*
+ * ctf_decode_event_fields: decode the payload of the last event read
+ * into event, if it was skipped in lazy payload mode. Must be called
+ * before the stream of the event switches packet.
+ *
+ * Returns 0 on success, negative error value otherwise.
+ */
+int ctf_decode_event_fields(struct ctf_event_definition *event);
+
+/*
+ * ctf_event_snapshot_create: create a snapshot for the event class of
+ * the last event read from stream. A snapshot is a stream definition
+ * holding its own copy of the definitions of an event, which remains
+ * valid, and can be read from another thread, after stream moves on.
+ *
+ * Snapshots create and destroy definitions: they must only be created,
+ * copied into and destroyed from the thread reading the trace.
+ *
+ * Returns the snapshot, or NULL on error.
+ */
+struct ctf_stream_definition *ctf_event_snapshot_create(
+		struct ctf_stream_definition *stream);
+
+/*
+ * ctf_event_snapshot_copy: copy the last event read from stream into
+ * snapshot, which must have been created for its event class.
+ *
+ * Returns 0 on success, negative error value otherwise.
+ */
+int ctf_event_snapshot_copy(struct ctf_stream_definition *snapshot,
+		struct ctf_stream_definition *stream);
+
+void ctf_event_snapshot_destroy(struct ctf_stream_definition *snapshot);
+
 #define HEADER_END		char end_field
 #define header_sizeof(type)	offsetof(typeof(type), end_field)
 
@@ -0,0 +1,116 @@
+#ifndef _BABELTRACE_CTF_PACKET_LOADER_H
+#define _BABELTRACE_CTF_PACKET_LOADER_H
+
+/*
+ * BabelTrace
+ *
+ * CTF asynchronous packet loader (internal)
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * Author: Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/mmap-align.h>
+#include <sys/types.h>
+
+/*
+ * A packet loader reads the packets of one stream file into a pool of
+ * page-aligned buffers through io_uring, so that the reads of the next
+ * packets are in flight while the current one is decoded. Buffers are
+ * handed out as struct mmap_align, like packet mappings.
+ *
+ * Packets are identified by their offset and length in the file. A
+ * loader is used by one thread at a time.
+ */
+struct ctf_packet_loader;
+
+/*
+ * ctf_packet_loader_create: create a loader of nr_buffers buffers for
+ * the stream file fd.
+ *
+ * Returns NULL if io_uring is not available, in which case packets
+ * should be read with ctf_packet_pread().
+ */
+BT_HIDDEN
+struct ctf_packet_loader *ctf_packet_loader_create(int fd,
+		unsigned int nr_buffers);
+
+/*
+ * ctf_packet_loader_destroy: wait for the reads in flight and free the
+ * loader with its buffers.
+ */
+BT_HIDDEN
+void ctf_packet_loader_destroy(struct ctf_packet_loader *loader);
+
+/*
+ * Queue the reads of the packets expected next: call
+ * ctf_packet_loader_begin, then ctf_packet_loader_queue for each
+ * packet, in the order they will be read, then ctf_packet_loader_submit.
+ * Packets queued before and not queued again are dropped.
+ *
+ * ctf_packet_loader_queue returns 0 on success, -1 if all buffers are
+ * in use. ctf_packet_loader_submit returns 0 on success, negative error
+ * value otherwise.
+ */
+BT_HIDDEN
+void ctf_packet_loader_begin(struct ctf_packet_loader *loader);
+BT_HIDDEN
+int ctf_packet_loader_queue(struct ctf_packet_loader *loader,
+		size_t len, off_t offset);
+BT_HIDDEN
+int ctf_packet_loader_submit(struct ctf_packet_loader *loader);
+
+/*
+ * ctf_packet_loader_get: get the buffer holding "len" bytes of the file
+ * at "offset", waiting for its read if it was queued, reading it right
+ * away otherwise. Bytes past the end of the file read as zero. The
+ * buffer stays valid until released.
+ *
+ * Returns NULL and sets errno on error.
+ */
+BT_HIDDEN
+struct mmap_align *ctf_packet_loader_get(struct ctf_packet_loader *loader,
+		size_t len, off_t offset);
+
+/*
+ * ctf_packet_loader_release: give back a buffer returned by
+ * ctf_packet_loader_get.
+ *
+ * Returns 1 if mma is a buffer of the loader, 0 otherwise.
+ */
+BT_HIDDEN
+int ctf_packet_loader_release(struct ctf_packet_loader *loader,
+		struct mmap_align *mma);
+
+/*
+ * ctf_packet_pread: read "len" bytes of fd at "offset" into buf,
+ * starting "done" bytes in. Bytes past the end of the file read as
+ * zero.
+ *
+ * Returns 0 on success, negative error value otherwise.
+ */
+BT_HIDDEN
+int ctf_packet_pread(int fd, void *buf, size_t len, off_t offset,
+		size_t done);
+
+#endif /* _BABELTRACE_CTF_PACKET_LOADER_H */
@@ -43,6 +43,7 @@
 #define LAST_OFFSET_POISON	((int64_t) ~0ULL)
 
 struct bt_stream_callbacks;
+struct ctf_packet_loader;
 
 struct packet_index_time {
 	uint64_t timestamp_begin;
@@ -60,6 +61,23 @@ struct packet_index {
 	struct packet_index_time ts_real;	/* realtime timestamp */
 };
 
+/*
+ * Events read by a trace reader: an event is read if its name is one
+ * of names, or matches one of patterns. Each file stream resolves the
+ * filter for an event id the first time it reads that id, so event
+ * classes added by metadata updates are filtered too.
+ */
+struct ctf_event_filter {
+	GPtrArray *patterns;	/* char *, with '*' and '?' wildcards */
+	GArray *names;		/* GQuark */
+};
+
+enum ctf_event_filter_state {
+	CTF_EVENT_UNRESOLVED = 0,
+	CTF_EVENT_SKIP,
+	CTF_EVENT_READ,
+};
+
 /*
  * Always update ctf_stream_pos with ctf_move_pos and ctf_init_pos.
  */
@@ -78,11 +96,18 @@ struct ctf_stream_pos {
 	uint64_t content_size;	/* current content size, in bits */
 	uint64_t *content_size_loc; /* pointer to current content size */
 	struct mmap_align *base_mma;/* mmap base address */
+	struct mmap_align *file_mma;/* whole file mapping, NULL if unused */
+	struct mmap_align *read_mma;/* packet read buffer, NULL if unused */
+	struct ctf_packet_loader *loader; /* packet reads, NULL if unused */
 	int64_t offset;		/* offset from base, in bits. EOF for end of file. */
 	int64_t last_offset;	/* offset before the last read_event */
 	int64_t data_offset;	/* offset of data in current packet */
 	uint64_t cur_index;	/* current index in packet index */
+	uint64_t readahead_index; /* first packet not read ahead yet */
 	uint64_t last_events_discarded;	/* last known amount of event discarded */
+	int hold_packet;	/* read_event stops at end of packet (EBUSY) */
+	const struct ctf_event_filter *event_filter; /* NULL if unset */
+	GArray *event_filter_ids; /* enum ctf_event_filter_state per event id */
 	void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
 			int whence); /* function called to switch packet */
 
@@ -97,6 +122,19 @@ struct ctf_stream_pos *ctf_pos(struct bt_stream_pos *pos)
 	return container_of(pos, struct ctf_stream_pos, parent);
 }
 
+/*
+ * Set the event filter of a stream, to be resolved again for each event
+ * id. The decoder thread of the stream must be stopped.
+ */
+static inline
+void ctf_pos_set_event_filter(struct ctf_stream_pos *pos,
+		const struct ctf_event_filter *filter)
+{
+	pos->event_filter = filter;
+	if (pos->event_filter_ids)
+		g_array_set_size(pos->event_filter_ids, 0);
+}
+
 BT_HIDDEN
 int ctf_integer_read(struct bt_stream_pos *pos, struct bt_definition *definition);
 BT_HIDDEN
@@ -126,8 +164,25 @@ int ctf_sequence_read(struct bt_stream_pos *pos, struct bt_definition *definitio
 BT_HIDDEN
 int ctf_sequence_write(struct bt_stream_pos *pos, struct bt_definition *definition);
 
+/*
+ * ctf_bulk_read: read len elements of elem_size bytes (as returned by
+ * bt_bulk_elem_size()) into the bulk buffer of an array or sequence.
+ */
+BT_HIDDEN
+int ctf_bulk_read(struct ctf_stream_pos *pos, struct definition_bulk *bulk,
+		const struct bt_declaration *elem, uint64_t len,
+		size_t elem_size, int reverse);
+
 void ctf_packet_seek(struct bt_stream_pos *pos, size_t index, int whence);
 
+/*
+ * ctf_event_filter_match: return 1 if events named name are read with
+ * filter, 0 otherwise.
+ */
+BT_HIDDEN
+int ctf_event_filter_match(const struct ctf_event_filter *filter,
+		GQuark name);
+
 int ctf_init_pos(struct ctf_stream_pos *pos, struct bt_trace_descriptor *trace,
 		int fd, int open_flags);
 int ctf_fini_pos(struct ctf_stream_pos *pos);
@@ -242,6 +297,19 @@ void ctf_pos_get_event(struct ctf_stream_pos *pos)
 	}
 }
 
+/*
+ * Maximum length of a formatted timestamp.
+ */
+#define CTF_TIMESTAMP_STR_LEN	64
+
+/*
+ * ctf_format_timestamp: format timestamp as ctf_print_timestamp()
+ * prints it, into buf, which must hold CTF_TIMESTAMP_STR_LEN
+ * characters. Returns the length of the result, which is not
+ * NUL-terminated.
+ */
+size_t ctf_format_timestamp(char *buf, struct ctf_stream_definition *stream,
+			uint64_t timestamp);
 void ctf_print_timestamp(FILE *fp, struct ctf_stream_definition *stream,
 			uint64_t timestamp);
 int ctf_append_trace_metadata(struct bt_trace_descriptor *tdp,
@@ -30,15 +30,21 @@
  */
 
 #include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/loser_tree.h>
 
 /*
  * struct bt_iter: data structure representing an iterator on a trace
  * collection.
  */
 struct bt_iter {
-	struct ptr_heap *stream_heap;
+	struct loser_tree *stream_tree;
 	struct bt_context *ctx;
 	const struct bt_iter_pos *end_pos;
+	/* Incremented each time the iterator is moved. */
+	unsigned long generation;
+	/* Event filter of the streams, NULL if unset. */
+	const struct ctf_event_filter *event_filter;
 };
 
 /*
@@ -70,4 +76,33 @@ void bt_iter_fini(struct bt_iter *iter);
 int bt_iter_add_trace(struct bt_iter *iter,
 		struct bt_trace_descriptor *td_read);
 
+/*
+ * bt_iter_stop_decoders - Stop the decoder threads of all streams.
+ *
+ * Leaves each stream positioned on its current event, so it can be
+ * read synchronously again.
+ */
+void bt_iter_stop_decoders(struct bt_iter *iter);
+
+/*
+ * bt_stream_merge_key - Merge tree key of a struct ctf_file_stream.
+ *
+ * Streams are merged in timestamp order. If time stamps are exactly the
+ * same, streams are ordered by path. This ensures we get the same
+ * result between runs on the same trace collection on different
+ * environments. Paths are compared once, when streams are added to the
+ * iterator, and their rank is kept in merge_order so the merge itself
+ * only compares integers.
+ * The result will be random for memory-mapped traces since there is no
+ * fixed path leading to those (they have empty path string).
+ */
+static inline
+void bt_stream_merge_key(void *p, struct loser_tree_key *key)
+{
+	struct ctf_file_stream *cfs = p;
+
+	key->primary = cfs->parent.real_timestamp;
+	key->secondary = cfs->parent.merge_order;
+}
+
 #endif /* _BABELTRACE_ITERATOR_INTERNAL_H */
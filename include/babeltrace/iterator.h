@@ -105,14 +105,14 @@ void bt_iter_free_pos(struct bt_iter_pos *pos);
 /*
  * bt_iter_set_pos: move the iterator to a given position.
  *
- * On error, the stream_heap is reinitialized and returned empty.
+ * On error, the stream merge tree is reinitialized and returned empty.
  *
  * Return 0 for success.
  *
  * Return EOF if the position requested is after the last event of the
  * trace collection.
  * Return -EINVAL when called with invalid parameter.
- * Return -ENOMEM if the stream_heap could not be properly initialized.
+ * Return -ENOMEM if the stream merge tree could not be properly initialized.
  */
 int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *pos);
 
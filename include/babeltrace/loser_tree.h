@@ -0,0 +1,167 @@
+#ifndef _BABELTRACE_LOSER_TREE_H
+#define _BABELTRACE_LOSER_TREE_H
+
+/*
+ * loser_tree.h
+ *
+ * Tournament (loser) tree for k-way merge of pointers ordered by
+ * integer keys.
+ *
+ * Copyright 2011 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <unistd.h>
+#include <babeltrace/babeltrace-internal.h>
+
+/*
+ * Elements are ordered by primary key, then by secondary key. The
+ * element with the smallest key is at the top of the tree.
+ */
+struct loser_tree_key {
+	uint64_t primary;
+	uint64_t secondary;
+};
+
+struct loser_tree_leaf {
+	struct loser_tree_key key;
+	void *ptr;			/* NULL if the leaf is empty */
+};
+
+/*
+ * Leaves are kept in a contiguous array along with their keys, so
+ * matches only compare integers, without dereferencing the elements.
+ * losers[0] is the index of the winning leaf, losers[1..nr_leaves-1]
+ * are the indexes of the leaves which lost each match, in heap order.
+ */
+struct loser_tree {
+	size_t nr_leaves;		/* power of 2 */
+	size_t len;			/* number of non-empty leaves */
+	size_t *losers;
+	struct loser_tree_leaf *leaves;
+	size_t *free_leaves;		/* stack of empty leaf indexes */
+	size_t nr_free;
+	int dirty;			/* matches need to be replayed */
+};
+
+/**
+ * bt_loser_tree_build - replay all matches of the tree
+ * @tree: the tree to be operated on
+ *
+ * Only needed after insertions or key updates, which are batched.
+ * This is an O(n) operation.
+ */
+extern void bt_loser_tree_build(struct loser_tree *tree);
+
+/**
+ * bt_loser_tree_top - return the element with the smallest key
+ * @tree: the tree to be operated on
+ *
+ * Returns the element with the smallest key, without removing it.
+ * Returns NULL if the tree is empty.
+ */
+static inline void *bt_loser_tree_top(struct loser_tree *tree)
+{
+	if (unlikely(tree->dirty))
+		bt_loser_tree_build(tree);
+	return likely(tree->len) ? tree->leaves[tree->losers[0]].ptr : NULL;
+}
+
+/**
+ * bt_loser_tree_init - initialize the tree
+ * @tree: the tree to initialize
+ * @alloc_len: number of elements initially allocated
+ *
+ * Returns -ENOMEM if out of memory.
+ */
+extern int bt_loser_tree_init(struct loser_tree *tree, size_t alloc_len);
+
+/**
+ * bt_loser_tree_free - free the tree
+ * @tree: the tree to free
+ */
+extern void bt_loser_tree_free(struct loser_tree *tree);
+
+/**
+ * bt_loser_tree_insert - insert an element into the tree
+ * @tree: the tree to be operated on
+ * @p: the element to add
+ * @key: the key of the element
+ *
+ * Matches are replayed lazily by the next access to the top of the
+ * tree, so a batch of insertions costs O(n) overall.
+ *
+ * Returns -ENOMEM if out of memory.
+ */
+extern int bt_loser_tree_insert(struct loser_tree *tree, void *p,
+		const struct loser_tree_key *key);
+
+/**
+ * bt_loser_tree_remove_top - remove the element with the smallest key
+ * @tree: the tree to be operated on
+ *
+ * Returns the element with the smallest key, and removes it from the
+ * tree. Returns NULL if the tree is empty.
+ */
+extern void *bt_loser_tree_remove_top(struct loser_tree *tree);
+
+/**
+ * bt_loser_tree_replace_top - replace the element with the smallest key
+ * @tree: the tree to be operated on
+ * @p: the element to be inserted as replacement
+ * @key: the key of the new element
+ *
+ * Returns the element with the smallest key, and replaces it by p.
+ * Only the matches on the path of the top leaf are replayed: this is
+ * O(log(n)) and never allocates memory. Returns NULL (and does not
+ * insert p) if the tree is empty.
+ */
+extern void *bt_loser_tree_replace_top(struct loser_tree *tree, void *p,
+		const struct loser_tree_key *key);
+
+/**
+ * bt_loser_tree_cherrypick - remove a given element from the tree
+ * @tree: the tree to be operated on
+ * @p: the element to be removed
+ *
+ * Returns p if it was present in the tree, NULL otherwise. This is an
+ * O(n) operation: matches are replayed by the next access to the top.
+ */
+extern void *bt_loser_tree_cherrypick(struct loser_tree *tree, void *p);
+
+/**
+ * bt_loser_tree_rekey - recompute the key of every element
+ * @tree: the tree to be operated on
+ * @get_key: function returning the key of an element
+ */
+extern void bt_loser_tree_rekey(struct loser_tree *tree,
+		void (*get_key)(void *p, struct loser_tree_key *key));
+
+/**
+ * bt_loser_tree_copy - copy a tree
+ * @dst: the destination tree (must be allocated)
+ * @src: the source tree
+ *
+ * Returns -ENOMEM if out of memory.
+ */
+extern int bt_loser_tree_copy(struct loser_tree *dst, struct loser_tree *src);
+
+#endif /* _BABELTRACE_LOSER_TREE_H */
@@ -32,6 +32,7 @@
 #include <babeltrace/align.h>
 #include <babeltrace/list.h>
 #include <babeltrace/ctf/events.h>
+#include <babeltrace/endian.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <babeltrace/compat/limits.h>
@@ -133,6 +134,19 @@ int generic_rw(struct bt_stream_pos *pos, struct bt_definition *definition)
 	return call(pos, definition);
 }
 
+/*
+ * Integer memory access class. Integers aligned on CHAR_BIT with a
+ * length of 8, 16, 32 or 64 bits can be accessed directly in memory,
+ * either in native or reverse byte order. Everything else needs the
+ * bitfield accessors.
+ */
+enum bt_integer_access {
+	BT_INTEGER_ACCESS_UNKNOWN = 0,	/* not classified yet */
+	BT_INTEGER_ACCESS_BITFIELD,
+	BT_INTEGER_ACCESS_NATIVE,
+	BT_INTEGER_ACCESS_REVERSE,
+};
+
 /*
  * Because we address in bits, bitfields end up being exactly the same as
  * integers, except that their read/write functions must be able to deal with
@@ -146,8 +160,30 @@ struct declaration_integer {
 	int base;		/* Base for pretty-printing: 2, 8, 10, 16 */
 	enum ctf_string_encoding encoding;
 	struct ctf_clock *clock;
+	/* Access class computed at declaration creation, used for reads. */
+	enum bt_integer_access access;
 };
 
+static inline
+enum bt_integer_access
+	bt_integer_declaration_access(const struct declaration_integer *integer_declaration)
+{
+	if (integer_declaration->p.alignment % CHAR_BIT)
+		return BT_INTEGER_ACCESS_BITFIELD;
+	switch (integer_declaration->len) {
+	case 8:
+	case 16:
+	case 32:
+	case 64:
+		break;
+	default:
+		return BT_INTEGER_ACCESS_BITFIELD;
+	}
+	if (integer_declaration->byte_order != BYTE_ORDER)
+		return BT_INTEGER_ACCESS_REVERSE;
+	return BT_INTEGER_ACCESS_NATIVE;
+}
+
 struct definition_integer {
 	struct bt_definition p;
 	struct declaration_integer *declaration;
@@ -197,22 +233,37 @@ struct enum_range_to_quark {
 	GQuark quark;
 };
 
+/*
+ * Entry of the enumeration range index. Range bounds are stored as
+ * unsigned keys: signed values have their sign bit flipped so that
+ * both orders compare the same way.
+ */
+struct enum_range_node {
+	uint64_t start, end;		/* range bounds (keys) */
+	uint64_t max_end;		/* highest end in subtree (key) */
+	unsigned int order;		/* position in range_to_quark */
+	GQuark quark;
+	GArray *quark_set;		/* GQuark set holding only quark */
+};
+
 /*
  * We optimize the common case (range of size 1: single value) by creating a
  * hash table mapping values to quark sets. We then lookup the ranges to
  * complete the quark set.
  *
- * TODO: The proper structure to hold the range to quark set mapping would be an
- * interval tree, with O(n) size, O(n*log(n)) build time and O(log(n)) query
- * time. Using a simple O(n) list search for now for implementation speed and
- * given that we can expect to have a _relatively_ small number of enumeration
- * ranges. This might become untrue if we are fed with symbol tables often
- * required to lookup function names from instruction pointer value.
+ * Ranges are kept in a list while the enumeration is being populated.
+ * bt_enum_declaration_finalize() then builds range_index, an interval
+ * tree laid out in an array sorted by range start: the root of the
+ * sub-array [lo, hi) is its middle entry, and each entry records the
+ * highest range end of its subtree. Queries are O(log(n) + k) for k
+ * matching ranges, returned in list order like the list walk does.
+ * Lookups walk the list if the index is not built.
  */
 struct enum_table {
 	GHashTable *value_to_quark_set;		/* (value, GQuark GArray) */
 	struct bt_list_head range_to_quark;	/* (range, GQuark) */
 	GHashTable *quark_to_range_set;		/* (GQuark, range GArray) */
+	GArray *range_index;			/* struct enum_range_node */
 };
 
 struct declaration_enum {
@@ -237,7 +288,12 @@ struct declaration_string {
 struct definition_string {
 	struct bt_definition p;
 	struct declaration_string *declaration;
-	char *value;	/* freed at definition_string teardown */
+	/*
+	 * Points to buf, or into the packet in zero-copy mode, in which
+	 * case it is only valid until the stream switches packet.
+	 */
+	char *value;
+	char *buf;	/* freed at definition_string teardown */
 	size_t len, alloc_len;
 };
 
@@ -281,6 +337,24 @@ struct definition_variant {
 	struct bt_definition *current_field;	/* Last field read */
 };
 
+/*
+ * Values of the elements of an array or sequence of fixed-size,
+ * byte-aligned integers or floats, decoded in bulk by the trace reader
+ * into a contiguous buffer, in native byte order. The element
+ * definitions are only updated from this buffer when accessed.
+ */
+struct definition_bulk {
+	void *values;			/* uintN_t/intN_t, float or double */
+	size_t alloc_len;		/* in bytes */
+	uint64_t len;			/* number of elements */
+	int stale;			/* element definitions out of date */
+	/*
+	 * Elements are the target of a sequence length or variant tag
+	 * lookup: always read them into their definitions.
+	 */
+	int disabled;
+};
+
 struct declaration_array {
 	struct bt_declaration p;
 	size_t len;
@@ -293,6 +367,13 @@ struct definition_array {
 	struct declaration_array *declaration;
 	GPtrArray *elems;		/* Array of pointers to struct bt_definition */
 	GString *string;		/* String for encoded integer children */
+	/*
+	 * Last bytes read for byte-aligned 8-bit integer children, in
+	 * the packet: valid until the stream switches packet.
+	 */
+	const char *bytes;
+	size_t bytes_len;
+	struct definition_bulk bulk;
 };
 
 struct declaration_sequence {
@@ -308,6 +389,10 @@ struct definition_sequence {
 	struct definition_integer *length;
 	GPtrArray *elems;		/* Array of pointers to struct bt_definition */
 	GString *string;		/* String for encoded integer children */
+	/* Same as struct definition_array. */
+	const char *bytes;
+	size_t bytes_len;
+	struct definition_bulk bulk;
 };
 
 int bt_register_declaration(GQuark declaration_name,
@@ -400,6 +485,12 @@ struct declaration_float *bt_float_declaration_new(size_t mantissa_len,
  * g_quark_to_string().
  */
 
+/*
+ * The quark sets returned for a value matching a single enumerator are
+ * shared by the declaration: only values matching several enumerators
+ * allocate a new GArray.
+ */
+
 /*
  * Returns a GArray of GQuark or NULL.
  * Caller must release the GArray with g_array_unref().
@@ -426,6 +517,11 @@ void bt_enum_signed_insert(struct declaration_enum *enum_declaration,
 void bt_enum_unsigned_insert(struct declaration_enum *enum_declaration,
 			  uint64_t start, uint64_t end, GQuark q);
 size_t bt_enum_get_nr_enumerators(struct declaration_enum *enum_declaration);
+/*
+ * Build the range lookup index of an enumeration. Must be called once
+ * all enumerators are inserted; inserting more ranges drops the index.
+ */
+void bt_enum_declaration_finalize(struct declaration_enum *enum_declaration);
 
 struct declaration_enum *
 	bt_enum_declaration_new(struct declaration_integer *integer_declaration);
@@ -501,6 +597,7 @@ struct declaration_array *
 		struct declaration_scope *parent_scope);
 uint64_t bt_array_len(struct definition_array *array);
 struct bt_definition *bt_array_index(struct definition_array *array, uint64_t i);
+void bt_array_bulk_sync(struct definition_array *array);
 int bt_array_rw(struct bt_stream_pos *pos, struct bt_definition *definition);
 GString *bt_get_char_array(const struct bt_definition *field);
 int bt_get_array_len(const struct bt_definition *field);
@@ -515,8 +612,42 @@ struct declaration_sequence *
 		struct declaration_scope *parent_scope);
 uint64_t bt_sequence_len(struct definition_sequence *sequence);
 struct bt_definition *bt_sequence_index(struct definition_sequence *sequence, uint64_t i);
+void bt_sequence_bulk_sync(struct definition_sequence *sequence);
+/*
+ * bt_sequence_grow: create the definitions of the elements of the
+ * sequence up to len. Never shrinks the sequence.
+ */
+void bt_sequence_grow(struct definition_sequence *sequence, uint64_t len);
 int bt_sequence_rw(struct bt_stream_pos *pos, struct bt_definition *definition);
 
+/*
+ * bt_bulk_elem_size: size in bytes of the elements of an array or
+ * sequence whose element declaration is elem, if they can be decoded in
+ * bulk, 0 otherwise. *reverse is set if the byte order of the elements
+ * differs from the host byte order.
+ */
+size_t bt_bulk_elem_size(const struct bt_declaration *elem, int *reverse);
+
+/*
+ * bt_bulk_sync: update the definitions of the first bulk->len elements
+ * from the bulk buffer, if they are out of date.
+ */
+void bt_bulk_sync(struct definition_bulk *bulk,
+		const struct bt_declaration *elem, GPtrArray *elems);
+
+/*
+ * bt_definition_copy: copy the last values read into src to dst, a
+ * definition of the same declaration, so that they stay valid after
+ * src reads its next values. Values pointing into the packet are
+ * copied too. Sequences of dst may grow, creating definitions: this
+ * must not race with other definition creation or teardown. Bulk
+ * arrays and sequences of dst are synced before returning, so dst can
+ * then be read from other threads without creating definitions.
+ *
+ * Returns 0 on success, -EINVAL if the declarations differ.
+ */
+int bt_definition_copy(struct bt_definition *dst, struct bt_definition *src);
+
 /*
  * in: path (dot separated), out: q (GArray of GQuark)
  */
@@ -32,7 +32,7 @@
 #include <babeltrace/context-internal.h>
 #include <babeltrace/iterator-internal.h>
 #include <babeltrace/iterator.h>
-#include <babeltrace/prio_heap.h>
+#include <babeltrace/loser_tree.h>
 #include <babeltrace/ctf/metadata.h>
 #include <babeltrace/ctf/events.h>
 #include <inttypes.h>
@@ -62,7 +62,12 @@ static int stream_read_event(struct ctf_file_stream *sin)
 {
 	int ret;
 
-	ret = sin->pos.parent.event_cb(&sin->pos.parent, &sin->parent);
+	if (sin->decoder) {
+		ret = sin->decoder_read(sin);
+	} else {
+		sin->cur_def = NULL;
+		ret = sin->pos.parent.event_cb(&sin->pos.parent, &sin->parent);
+	}
 	if (ret == EOF)
 		return EOF;
 	else if (ret == EAGAIN)
@@ -75,25 +80,113 @@ static int stream_read_event(struct ctf_file_stream *sin)
 	return 0;
 }
 
+struct stream_rank {
+	struct ctf_file_stream *cfs;
+	uint64_t seq;		/* order of the stream in the collection */
+};
+
+static gint stream_rank_compare(gconstpointer a, gconstpointer b)
+{
+	const struct stream_rank *r_a = a, *r_b = b;
+	int ret;
+
+	ret = strcmp(r_a->cfs->parent.path, r_b->cfs->parent.path);
+	if (ret)
+		return ret;
+	return r_a->seq < r_b->seq ? -1 : (r_a->seq > r_b->seq);
+}
+
 /*
- * Return true if a < b, false otherwise.
- * If time stamps are exactly the same, compare by stream path. This
- * ensures we get the same result between runs on the same trace
- * collection on different environments.
- * The result will be random for memory-mapped traces since there is no
- * fixed path leading to those (they have empty path string).
+ * Rank all streams of the trace collection by path, and update the
+ * keys of the streams already in the merge tree.
  */
-static int stream_compare(void *a, void *b)
+static void update_merge_order(struct bt_iter *iter)
 {
-	struct ctf_file_stream *s_a = a, *s_b = b;
+	struct trace_collection *tc = iter->ctx->tc;
+	GArray *ranks;
+	int i, j, k;
 
-	if (s_a->parent.real_timestamp < s_b->parent.real_timestamp) {
-		return 1;
-	} else if (likely(s_a->parent.real_timestamp > s_b->parent.real_timestamp)) {
-		return 0;
-	} else {
-		return strcmp(s_a->parent.path, s_b->parent.path);
+	ranks = g_array_new(FALSE, FALSE, sizeof(struct stream_rank));
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_trace *tin;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		if (!td_read)
+			continue;
+		tin = container_of(td_read, struct ctf_trace, parent);
+		for (j = 0; j < tin->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(tin->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct stream_rank rank;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				rank.cfs = container_of(stream,
+					struct ctf_file_stream, parent);
+				rank.seq = ranks->len;
+				g_array_append_val(ranks, rank);
+			}
+		}
 	}
+	g_array_sort(ranks, stream_rank_compare);
+	for (i = 0; i < ranks->len; i++)
+		g_array_index(ranks, struct stream_rank, i).cfs->parent.merge_order = i;
+	g_array_free(ranks, TRUE);
+	bt_loser_tree_rekey(iter->stream_tree, bt_stream_merge_key);
+}
+
+void bt_iter_stop_decoders(struct bt_iter *iter)
+{
+	struct trace_collection *tc = iter->ctx->tc;
+	int i, j, k;
+
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_trace *tin;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		if (!td_read)
+			continue;
+		tin = container_of(td_read, struct ctf_trace, parent);
+		for (j = 0; j < tin->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(tin->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct ctf_file_stream *cfs;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				cfs = container_of(stream, struct ctf_file_stream,
+					parent);
+				if (cfs->decoder)
+					cfs->decoder_stop(cfs);
+			}
+		}
+	}
+}
+
+/*
+ * Insert a file stream in the merge tree, at its current timestamp.
+ */
+static int stream_tree_insert(struct loser_tree *tree,
+		struct ctf_file_stream *cfs)
+{
+	struct loser_tree_key key;
+
+	bt_stream_merge_key(cfs, &key);
+	return bt_loser_tree_insert(tree, cfs, &key);
 }
 
 void bt_iter_free_pos(struct bt_iter_pos *iter_pos)
@@ -120,40 +213,51 @@ void bt_iter_free_pos(struct bt_iter_pos *iter_pos)
  * are looking for (either the exact timestamp or the event just after the
  * timestamp).
  *
+ * Packets of a stream are ordered in time, so the first packet ending
+ * at or after the timestamp is found by binary search on the index.
+ *
  * Return 0 if the seek succeded, EOF if we didn't find any packet
  * containing the timestamp, or a positive integer for error.
- *
- * TODO: this should be turned into a binary search! It is currently
- * doing a linear search in the packets. This is a O(n) operation on a
- * very frequent code path.
  */
 static int seek_file_stream_by_timestamp(struct ctf_file_stream *cfs,
 		uint64_t timestamp)
 {
 	struct ctf_stream_pos *stream_pos;
 	struct packet_index *index;
-	int i, ret;
+	size_t low, high;
+	int ret;
 
 	stream_pos = &cfs->pos;
-	for (i = 0; i < stream_pos->packet_index->len; i++) {
+	low = 0;
+	high = stream_pos->packet_index->len;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
 		index = &g_array_index(stream_pos->packet_index,
-				struct packet_index, i);
+				struct packet_index, mid);
 		if (index->ts_real.timestamp_end < timestamp)
-			continue;
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == stream_pos->packet_index->len) {
+		/*
+		 * Cannot find the timestamp within the stream packets,
+		 * return EOF.
+		 */
+		return EOF;
+	}
 
-		stream_pos->packet_seek(&stream_pos->parent, i, SEEK_SET);
-		do {
-			ret = stream_read_event(cfs);
-		} while (cfs->parent.real_timestamp < timestamp && ret == 0);
+	stream_pos->packet_seek(&stream_pos->parent, low, SEEK_SET);
+	/* Let the reader skip the events before timestamp within packets. */
+	cfs->parent.skip_until = timestamp;
+	do {
+		ret = stream_read_event(cfs);
+	} while (cfs->parent.real_timestamp < timestamp && ret == 0);
+	cfs->parent.skip_until = 0;
 
-		/* Can return either EOF, 0, or error (> 0). */
-		return ret;
-	}
-	/*
-	 * Cannot find the timestamp within the stream packets, return
-	 * EOF.
-	 */
-	return EOF;
+	/* Can return either EOF, 0, or error (> 0). */
+	return ret;
 }
 
 /*
@@ -166,7 +270,7 @@ static int seek_file_stream_by_timestamp(struct ctf_file_stream *cfs,
  * On other errors, return positive value.
  */
 static int seek_ctf_trace_by_timestamp(struct ctf_trace *tin,
-		uint64_t timestamp, struct ptr_heap *stream_heap)
+		uint64_t timestamp, struct loser_tree *stream_tree)
 {
 	int i, j, ret;
 	int found = 0;
@@ -190,8 +294,8 @@ static int seek_ctf_trace_by_timestamp(struct ctf_trace *tin,
 					parent);
 			ret = seek_file_stream_by_timestamp(cfs, timestamp);
 			if (ret == 0) {
-				/* Add to heap */
-				ret = bt_heap_insert(stream_heap, cfs);
+				/* Add to merge tree */
+				ret = stream_tree_insert(stream_tree, cfs);
 				if (ret) {
 					/* Return positive error. */
 					return -ret;
@@ -203,7 +307,7 @@ static int seek_ctf_trace_by_timestamp(struct ctf_trace *tin,
 				 */
 				return ret;
 			}
-			/* on EOF just do not put stream into heap. */
+			/* on EOF just do not put stream into merge tree. */
 		}
 	}
 
@@ -364,15 +468,17 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 	if (!iter || !iter_pos)
 		return -EINVAL;
 
+	bt_iter_stop_decoders(iter);
+	iter->generation++;
 	switch (iter_pos->type) {
 	case BT_SEEK_RESTORE:
 		if (!iter_pos->u.restore)
 			return -EINVAL;
 
-		bt_heap_free(iter->stream_heap);
-		ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
+		bt_loser_tree_free(iter->stream_tree);
+		ret = bt_loser_tree_init(iter->stream_tree, 0);
 		if (ret < 0)
-			goto error_heap_init;
+			goto error_tree_init;
 
 		for (i = 0; i < iter_pos->u.restore->stream_saved_pos->len;
 				i++) {
@@ -419,8 +525,8 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 				goto error;
 			}
 
-			/* Add to heap */
-			ret = bt_heap_insert(iter->stream_heap,
+			/* Add to merge tree */
+			ret = stream_tree_insert(iter->stream_tree,
 					saved_pos->file_stream);
 			if (ret)
 				goto error;
@@ -429,10 +535,10 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 	case BT_SEEK_TIME:
 		tc = iter->ctx->tc;
 
-		bt_heap_free(iter->stream_heap);
-		ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
+		bt_loser_tree_free(iter->stream_tree);
+		ret = bt_loser_tree_init(iter->stream_tree, 0);
 		if (ret < 0)
-			goto error_heap_init;
+			goto error_tree_init;
 
 		/* for each trace in the trace_collection */
 		for (i = 0; i < tc->array->len; i++) {
@@ -446,7 +552,7 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 
 			ret = seek_ctf_trace_by_timestamp(tin,
 					iter_pos->u.seek_time,
-					iter->stream_heap);
+					iter->stream_tree);
 			/*
 			 * Positive errors are failure. Negative value
 			 * is EOF (for which we continue with other
@@ -460,10 +566,10 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 		return 0;
 	case BT_SEEK_BEGIN:
 		tc = iter->ctx->tc;
-		bt_heap_free(iter->stream_heap);
-		ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
+		bt_loser_tree_free(iter->stream_tree);
+		ret = bt_loser_tree_init(iter->stream_tree, 0);
 		if (ret < 0)
-			goto error_heap_init;
+			goto error_tree_init;
 
 		for (i = 0; i < tc->array->len; i++) {
 			struct ctf_trace *tin;
@@ -475,7 +581,7 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 				continue;
 			tin = container_of(td_read, struct ctf_trace, parent);
 
-			/* Populate heap with each stream */
+			/* Populate merge tree with each stream */
 			for (stream_id = 0; stream_id < tin->streams->len;
 					stream_id++) {
 				struct ctf_stream_declaration *stream;
@@ -503,7 +609,8 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 						/* Do not add EOF streams */
 						continue;
 					}
-					ret = bt_heap_insert(iter->stream_heap, file_stream);
+					ret = stream_tree_insert(iter->stream_tree,
+							file_stream);
 					if (ret)
 						goto error;
 				}
@@ -518,14 +625,14 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 		ret = seek_last_ctf_trace_collection(tc, &cfs);
 		if (ret != 0 || !cfs)
 			goto error;
-		/* remove all streams from the heap */
-		bt_heap_free(iter->stream_heap);
-		/* Create a new empty heap */
-		ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
+		/* remove all streams from the merge tree */
+		bt_loser_tree_free(iter->stream_tree);
+		/* Create a new empty merge tree */
+		ret = bt_loser_tree_init(iter->stream_tree, 0);
 		if (ret < 0)
 			goto error;
 		/* Insert the stream that contains the last event */
-		ret = bt_heap_insert(iter->stream_heap, cfs);
+		ret = stream_tree_insert(iter->stream_tree, cfs);
 		if (ret)
 			goto error;
 		break;
@@ -538,12 +645,11 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 	return 0;
 
 error:
-	bt_heap_free(iter->stream_heap);
-error_heap_init:
-	if (bt_heap_init(iter->stream_heap, 0, stream_compare) < 0) {
-		bt_heap_free(iter->stream_heap);
-		g_free(iter->stream_heap);
-		iter->stream_heap = NULL;
+	bt_loser_tree_free(iter->stream_tree);
+error_tree_init:
+	if (bt_loser_tree_init(iter->stream_tree, 0) < 0) {
+		g_free(iter->stream_tree);
+		iter->stream_tree = NULL;
 		ret = -ENOMEM;
 	}
 
@@ -555,12 +661,13 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 	struct bt_iter_pos *pos;
 	struct trace_collection *tc;
 	struct ctf_file_stream *file_stream = NULL, *removed;
-	struct ptr_heap iter_heap_copy;
+	struct loser_tree iter_tree_copy;
 	int ret;
 
 	if (!iter)
 		return NULL;
 
+	bt_iter_stop_decoders(iter);
 	tc = iter->ctx->tc;
 	pos = g_new0(struct bt_iter_pos, 1);
 	pos->type = BT_SEEK_RESTORE;
@@ -571,12 +678,12 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 	if (!pos->u.restore->stream_saved_pos)
 		goto error;
 
-	ret = bt_heap_copy(&iter_heap_copy, iter->stream_heap);
+	ret = bt_loser_tree_copy(&iter_tree_copy, iter->stream_tree);
 	if (ret < 0)
-		goto error_heap;
+		goto error_tree;
 
-	/* iterate over each stream in the heap */
-	file_stream = bt_heap_maximum(&iter_heap_copy);
+	/* iterate over each stream in the merge tree */
+	file_stream = bt_loser_tree_top(&iter_tree_copy);
 	while (file_stream != NULL) {
 		struct stream_saved_pos saved_pos;
 
@@ -599,16 +706,16 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 				saved_pos.cur_index, saved_pos.offset,
 				saved_pos.current_real_timestamp);
 
-		/* remove the stream from the heap copy */
-		removed = bt_heap_remove(&iter_heap_copy);
+		/* remove the stream from the merge tree copy */
+		removed = bt_loser_tree_remove_top(&iter_tree_copy);
 		assert(removed == file_stream);
 
-		file_stream = bt_heap_maximum(&iter_heap_copy);
+		file_stream = bt_loser_tree_top(&iter_tree_copy);
 	}
-	bt_heap_free(&iter_heap_copy);
+	bt_loser_tree_free(&iter_tree_copy);
 	return pos;
 
-error_heap:
+error_tree:
 	g_array_free(pos->u.restore->stream_saved_pos, TRUE);
 error:
 	g_free(pos);
@@ -646,7 +753,7 @@ static int babeltrace_filestream_seek(struct ctf_file_stream *file_stream,
 	switch (begin_pos->type) {
 	case BT_SEEK_CUR:
 		/*
-		 * just insert into the heap we should already know
+		 * just insert into the merge tree we should already know
 		 * the timestamps
 		 */
 		break;
@@ -664,7 +771,7 @@ static int babeltrace_filestream_seek(struct ctf_file_stream *file_stream,
 	return ret;
 }
 
-int bt_iter_add_trace(struct bt_iter *iter,
+static int iter_add_trace(struct bt_iter *iter,
 		struct bt_trace_descriptor *td_read)
 {
 	struct ctf_trace *tin;
@@ -672,7 +779,7 @@ int bt_iter_add_trace(struct bt_iter *iter,
 
 	tin = container_of(td_read, struct ctf_trace, parent);
 
-	/* Populate heap with each stream */
+	/* Populate merge tree with each stream */
 	for (stream_id = 0; stream_id < tin->streams->len;
 			stream_id++) {
 		struct ctf_stream_declaration *stream;
@@ -691,6 +798,8 @@ int bt_iter_add_trace(struct bt_iter *iter,
 			if (!file_stream)
 				continue;
 
+			ctf_pos_set_event_filter(&file_stream->pos,
+					iter->event_filter);
 			pos.type = BT_SEEK_BEGIN;
 			ret = babeltrace_filestream_seek(file_stream,
 					&pos, stream_id);
@@ -701,8 +810,9 @@ int bt_iter_add_trace(struct bt_iter *iter,
 			} else if (ret != 0 && ret != EAGAIN) {
 				goto error;
 			}
-			/* Add to heap */
-			ret = bt_heap_insert(iter->stream_heap, file_stream);
+			/* Add to merge tree */
+			ret = stream_tree_insert(iter->stream_tree,
+					file_stream);
 			if (ret)
 				goto error;
 		}
@@ -712,6 +822,17 @@ error:
 	return ret;
 }
 
+int bt_iter_add_trace(struct bt_iter *iter,
+		struct bt_trace_descriptor *td_read)
+{
+	int ret;
+
+	ret = iter_add_trace(iter, td_read);
+	/* The new streams may change the rank of existing ones. */
+	update_merge_order(iter);
+	return ret;
+}
+
 int bt_iter_init(struct bt_iter *iter,
 		struct bt_context *ctx,
 		const struct bt_iter_pos *begin_pos,
@@ -728,14 +849,14 @@ int bt_iter_init(struct bt_iter *iter,
 		goto error_ctx;
 	}
 
-	iter->stream_heap = g_new(struct ptr_heap, 1);
+	iter->stream_tree = g_new(struct loser_tree, 1);
 	iter->end_pos = end_pos;
 	bt_context_get(ctx);
 	iter->ctx = ctx;
 
-	ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
+	ret = bt_loser_tree_init(iter->stream_tree, 0);
 	if (ret < 0)
-		goto error_heap_init;
+		goto error_tree_init;
 
 	for (i = 0; i < ctx->tc->array->len; i++) {
 		struct bt_trace_descriptor *td_read;
@@ -743,10 +864,11 @@ int bt_iter_init(struct bt_iter *iter,
 		td_read = g_ptr_array_index(ctx->tc->array, i);
 		if (!td_read)
 			continue;
-		ret = bt_iter_add_trace(iter, td_read);
+		ret = iter_add_trace(iter, td_read);
 		if (ret < 0)
 			goto error;
 	}
+	update_merge_order(iter);
 
 	ctx->current_iterator = iter;
 	if (begin_pos && begin_pos->type != BT_SEEK_BEGIN) {
@@ -756,10 +878,10 @@ int bt_iter_init(struct bt_iter *iter,
 	return ret;
 
 error:
-	bt_heap_free(iter->stream_heap);
-error_heap_init:
-	g_free(iter->stream_heap);
-	iter->stream_heap = NULL;
+	bt_loser_tree_free(iter->stream_tree);
+error_tree_init:
+	g_free(iter->stream_tree);
+	iter->stream_tree = NULL;
 error_ctx:
 	return ret;
 }
@@ -786,9 +908,10 @@ struct bt_iter *bt_iter_create(struct bt_context *ctx,
 void bt_iter_fini(struct bt_iter *iter)
 {
 	assert(iter);
-	if (iter->stream_heap) {
-		bt_heap_free(iter->stream_heap);
-		g_free(iter->stream_heap);
+	bt_iter_stop_decoders(iter);
+	if (iter->stream_tree) {
+		bt_loser_tree_free(iter->stream_tree);
+		g_free(iter->stream_tree);
 	}
 	iter->ctx->current_iterator = NULL;
 	bt_context_put(iter->ctx);
@@ -804,21 +927,25 @@ void bt_iter_destroy(struct bt_iter *iter)
 int bt_iter_next(struct bt_iter *iter)
 {
 	struct ctf_file_stream *file_stream, *removed;
+	struct loser_tree_key key;
 	int ret;
 
 	if (!iter)
 		return -EINVAL;
 
-	file_stream = bt_heap_maximum(iter->stream_heap);
+	iter->generation++;
+	file_stream = bt_loser_tree_top(iter->stream_tree);
 	if (!file_stream) {
 		/* end of file for all streams */
 		ret = 0;
 		goto end;
 	}
 
+	if (!file_stream->decoder && file_stream->decoder_start)
+		(void) file_stream->decoder_start(file_stream);
 	ret = stream_read_event(file_stream);
 	if (ret == EOF) {
-		removed = bt_heap_remove(iter->stream_heap);
+		removed = bt_loser_tree_remove_top(iter->stream_tree);
 		assert(removed == file_stream);
 		ret = 0;
 		goto end;
@@ -842,8 +969,10 @@ int bt_iter_next(struct bt_iter *iter)
 	}
 
 reinsert:
-	/* Reinsert the file stream into the heap, and rebalance. */
-	removed = bt_heap_replace_max(iter->stream_heap, file_stream);
+	/* Replay the matches of the file stream with its new timestamp. */
+	bt_stream_merge_key(file_stream, &key);
+	removed = bt_loser_tree_replace_top(iter->stream_tree, file_stream,
+			&key);
 	assert(removed == file_stream);
 end:
 	return ret;
@@ -0,0 +1,281 @@
+/*
+ * loser_tree.c
+ *
+ * Tournament (loser) tree for k-way merge of pointers ordered by
+ * integer keys. Based on Knuth, TAOCP vol. 3, section 5.4.1.
+ *
+ * Copyright 2011 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/loser_tree.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Returns whether leaf a wins over leaf b. Empty leaves lose against
+ * anything.
+ */
+static inline
+int leaf_wins(const struct loser_tree_leaf *a, const struct loser_tree_leaf *b)
+{
+	if (unlikely(!a->ptr))
+		return 0;
+	if (unlikely(!b->ptr))
+		return 1;
+	if (a->key.primary != b->key.primary)
+		return a->key.primary < b->key.primary;
+	return a->key.secondary < b->key.secondary;
+}
+
+static
+int tree_alloc(struct loser_tree *tree, size_t nr_leaves)
+{
+	tree->losers = calloc(nr_leaves, sizeof(size_t));
+	tree->leaves = calloc(nr_leaves, sizeof(struct loser_tree_leaf));
+	tree->free_leaves = calloc(nr_leaves, sizeof(size_t));
+	if (unlikely(!tree->losers || !tree->leaves || !tree->free_leaves)) {
+		free(tree->losers);
+		free(tree->leaves);
+		free(tree->free_leaves);
+		return -ENOMEM;
+	}
+	tree->nr_leaves = nr_leaves;
+	return 0;
+}
+
+/*
+ * Push leaves [from, to) on the free stack, so the lowest index is
+ * used first.
+ */
+static
+void push_free_leaves(struct loser_tree *tree, size_t from, size_t to)
+{
+	size_t i;
+
+	for (i = to; i > from; i--)
+		tree->free_leaves[tree->nr_free++] = i - 1;
+}
+
+static
+int tree_grow(struct loser_tree *tree)
+{
+	struct loser_tree old = *tree;
+	size_t i;
+	int ret;
+
+	ret = tree_alloc(tree, old.nr_leaves << 1);
+	if (unlikely(ret)) {
+		*tree = old;
+		return ret;
+	}
+	memcpy(tree->leaves, old.leaves,
+		old.nr_leaves * sizeof(struct loser_tree_leaf));
+	tree->nr_free = 0;
+	push_free_leaves(tree, old.nr_leaves, tree->nr_leaves);
+	for (i = old.nr_free; i > 0; i--)
+		tree->free_leaves[tree->nr_free++] = old.free_leaves[i - 1];
+	tree->dirty = 1;
+	free(old.losers);
+	free(old.leaves);
+	free(old.free_leaves);
+	return 0;
+}
+
+int bt_loser_tree_init(struct loser_tree *tree, size_t alloc_len)
+{
+	size_t nr_leaves = 1;
+	int ret;
+
+	while (nr_leaves < alloc_len)
+		nr_leaves <<= 1;
+	/*
+	 * At least one leaf is allocated, so the top of the tree can
+	 * always be read.
+	 */
+	ret = tree_alloc(tree, nr_leaves);
+	if (ret)
+		return ret;
+	tree->len = 0;
+	tree->nr_free = 0;
+	push_free_leaves(tree, 0, nr_leaves);
+	tree->dirty = 0;
+	return 0;
+}
+
+void bt_loser_tree_free(struct loser_tree *tree)
+{
+	free(tree->losers);
+	free(tree->leaves);
+	free(tree->free_leaves);
+	tree->losers = NULL;
+	tree->leaves = NULL;
+	tree->free_leaves = NULL;
+	tree->nr_leaves = tree->len = tree->nr_free = 0;
+}
+
+/* Play the matches of the subtree rooted at node, return its winner. */
+static
+size_t build_subtree(struct loser_tree *tree, size_t node)
+{
+	size_t l, r;
+
+	if (node >= tree->nr_leaves)
+		return node - tree->nr_leaves;
+	l = build_subtree(tree, node << 1);
+	r = build_subtree(tree, (node << 1) + 1);
+	if (leaf_wins(&tree->leaves[r], &tree->leaves[l])) {
+		tree->losers[node] = l;
+		return r;
+	} else {
+		tree->losers[node] = r;
+		return l;
+	}
+}
+
+void bt_loser_tree_build(struct loser_tree *tree)
+{
+	tree->losers[0] = build_subtree(tree, 1);
+	tree->dirty = 0;
+}
+
+/*
+ * Replay the matches from the top leaf up to the root, after its
+ * content changed.
+ */
+static
+void replay_top(struct loser_tree *tree)
+{
+	size_t winner = tree->losers[0], node;
+
+	for (node = (winner + tree->nr_leaves) >> 1; node; node >>= 1) {
+		size_t loser = tree->losers[node];
+
+		if (leaf_wins(&tree->leaves[loser], &tree->leaves[winner])) {
+			tree->losers[node] = winner;
+			winner = loser;
+		}
+	}
+	tree->losers[0] = winner;
+}
+
+int bt_loser_tree_insert(struct loser_tree *tree, void *p,
+		const struct loser_tree_key *key)
+{
+	struct loser_tree_leaf *leaf;
+	int ret;
+
+	assert(p);
+	if (unlikely(!tree->nr_free)) {
+		ret = tree_grow(tree);
+		if (ret)
+			return ret;
+	}
+	leaf = &tree->leaves[tree->free_leaves[--tree->nr_free]];
+	leaf->key = *key;
+	leaf->ptr = p;
+	tree->len++;
+	tree->dirty = 1;
+	return 0;
+}
+
+void *bt_loser_tree_remove_top(struct loser_tree *tree)
+{
+	struct loser_tree_leaf *leaf;
+	void *res;
+
+	res = bt_loser_tree_top(tree);
+	if (!res)
+		return NULL;
+	leaf = &tree->leaves[tree->losers[0]];
+	leaf->ptr = NULL;
+	tree->free_leaves[tree->nr_free++] = tree->losers[0];
+	tree->len--;
+	replay_top(tree);
+	return res;
+}
+
+void *bt_loser_tree_cherrypick(struct loser_tree *tree, void *p)
+{
+	size_t i;
+
+	for (i = 0; i < tree->nr_leaves; i++) {
+		if (tree->leaves[i].ptr != p)
+			continue;
+		tree->leaves[i].ptr = NULL;
+		tree->free_leaves[tree->nr_free++] = i;
+		tree->len--;
+		tree->dirty = 1;
+		return p;
+	}
+	return NULL;
+}
+
+void *bt_loser_tree_replace_top(struct loser_tree *tree, void *p,
+		const struct loser_tree_key *key)
+{
+	struct loser_tree_leaf *leaf;
+	void *res;
+
+	assert(p);
+	res = bt_loser_tree_top(tree);
+	if (!res)
+		return NULL;
+	leaf = &tree->leaves[tree->losers[0]];
+	leaf->key = *key;
+	leaf->ptr = p;
+	replay_top(tree);
+	return res;
+}
+
+void bt_loser_tree_rekey(struct loser_tree *tree,
+		void (*get_key)(void *p, struct loser_tree_key *key))
+{
+	size_t i;
+
+	for (i = 0; i < tree->nr_leaves; i++) {
+		struct loser_tree_leaf *leaf = &tree->leaves[i];
+
+		if (leaf->ptr)
+			get_key(leaf->ptr, &leaf->key);
+	}
+	tree->dirty = 1;
+}
+
+int bt_loser_tree_copy(struct loser_tree *dst, struct loser_tree *src)
+{
+	int ret;
+
+	ret = tree_alloc(dst, src->nr_leaves);
+	if (ret)
+		return ret;
+	dst->len = src->len;
+	dst->nr_free = src->nr_free;
+	dst->dirty = src->dirty;
+	memcpy(dst->losers, src->losers, src->nr_leaves * sizeof(size_t));
+	memcpy(dst->leaves, src->leaves,
+		src->nr_leaves * sizeof(struct loser_tree_leaf));
+	memcpy(dst->free_leaves, src->free_leaves,
+		src->nr_leaves * sizeof(size_t));
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * bench_integer_read.c
+ *
+ * CTF integer read throughput micro-benchmark
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Prints the read throughput of each integer access class. Not run by
+ * make check: correctness is checked by test_integer_read.
+ *
+ * Usage: bench_integer_read [PASSES]
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/bitfield.h>
+#include <babeltrace/endian.h>
+#include <babeltrace/mmap-align.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Benchmark buffer size, in bytes */
+#define BUF_LEN		(4 * 1024 * 1024)
+/* Default number of passes over the buffer */
+#define NR_PASSES	8
+
+struct integer_case {
+	const char *name;
+	size_t len;		/* in bits */
+	size_t alignment;	/* in bits */
+	int reverse;		/* reverse byte order */
+};
+
+static const struct integer_case cases[] = {
+	{ "aligned 8-bit", 8, 8, 0 },
+	{ "aligned 16-bit native", 16, 8, 0 },
+	{ "aligned 32-bit native", 32, 8, 0 },
+	{ "aligned 64-bit native", 64, 8, 0 },
+	{ "aligned 16-bit reverse", 16, 8, 1 },
+	{ "aligned 32-bit reverse", 32, 8, 1 },
+	{ "aligned 64-bit reverse", 64, 8, 1 },
+	{ "aligned 24-bit", 24, 8, 0 },
+	{ "unaligned 13-bit bitfield", 13, 1, 0 },
+	{ "unaligned 32-bit bitfield", 32, 1, 1 },
+};
+
+#define NR_CASES	(sizeof(cases) / sizeof(cases[0]))
+
+static
+double time_diff(const struct timespec *begin, const struct timespec *end)
+{
+	return (double) (end->tv_sec - begin->tv_sec)
+		+ (double) (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+static
+void run_case(const struct integer_case *c, unsigned char *buf,
+		unsigned int nr_passes)
+{
+	struct declaration_integer *declaration;
+	struct definition_integer definition;
+	struct ctf_stream_pos pos;
+	struct mmap_align mma;
+	struct timespec begin, end;
+	unsigned int pass;
+	uint64_t i, nr;
+	int byte_order;
+	double seconds;
+
+	if (c->reverse)
+		byte_order = (BYTE_ORDER == LITTLE_ENDIAN) ?
+			BIG_ENDIAN : LITTLE_ENDIAN;
+	else
+		byte_order = BYTE_ORDER;
+
+	declaration = bt_integer_declaration_new(c->len, byte_order, 0,
+			c->alignment, 10, CTF_STRING_NONE, NULL);
+
+	nr = (uint64_t) BUF_LEN * CHAR_BIT / c->len;
+	for (i = 0; i < BUF_LEN; i++)
+		buf[i] = (unsigned char) (i * 0x9E3779B1U >> 24);
+
+	memset(&definition, 0, sizeof(definition));
+	definition.p.declaration = &declaration->p;
+	definition.declaration = declaration;
+
+	memset(&mma, 0, sizeof(mma));
+	mma.addr = buf;
+	mma.length = BUF_LEN;
+	memset(&pos, 0, sizeof(pos));
+	pos.fd = -1;
+	pos.prot = PROT_READ;
+	pos.base_mma = &mma;
+	pos.packet_size = pos.content_size = (uint64_t) nr * c->len;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (pass = 0; pass < nr_passes; pass++) {
+		pos.offset = 0;
+		for (i = 0; i < nr; i++)
+			(void) ctf_integer_read(&pos.parent, &definition.p);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = time_diff(&begin, &end);
+	if (seconds > 0)
+		printf("%-28s access class %d: %8.1f MB/s\n", c->name,
+			(int) declaration->access,
+			(double) nr * c->len / CHAR_BIT * nr_passes
+				/ seconds / 1e6);
+
+	bt_declaration_unref(&declaration->p);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, nr_passes = NR_PASSES;
+	unsigned char *buf;
+
+	if (argc > 1) {
+		nr_passes = strtoul(argv[1], NULL, 0);
+		if (!nr_passes) {
+			fprintf(stderr, "Usage: %s [PASSES]\n", argv[0]);
+			return 1;
+		}
+	}
+	buf = malloc(BUF_LEN);
+	if (!buf) {
+		fprintf(stderr, "Unable to allocate benchmark buffer\n");
+		return 1;
+	}
+	for (i = 0; i < NR_CASES; i++)
+		run_case(&cases[i], buf, nr_passes);
+	free(buf);
+	return 0;
+}
@@ -22,6 +22,15 @@
 
 #include <babeltrace/context.h>
 #include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+
+#include <glib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "common.h"
 
 struct bt_context *create_context_with_path(const char *path)
 {
@@ -40,3 +49,54 @@ struct bt_context *create_context_with_path(const char *path)
 	}
 	return ctx;
 }
+
+/* Number of events of each event name of the trace */
+GHashTable *count_events(const char *trace_path)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	GHashTable *counts;
+
+	ctx = create_context_with_path(trace_path);
+	if (!ctx)
+		return NULL;
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		bt_context_put(ctx);
+		return NULL;
+	}
+	counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		const char *name = bt_ctf_event_name(event);
+		uint64_t *count = g_hash_table_lookup(counts, name);
+
+		if (!count) {
+			count = g_new0(uint64_t, 1);
+			g_hash_table_insert(counts, g_strdup(name), count);
+		}
+		(*count)++;
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+	return counts;
+}
+
+/* Remove a directory and the files it contains */
+void remove_dir(const char *path)
+{
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] != '.')
+			unlinkat(dirfd(dir), entry->d_name, 0);
+	}
+	closedir(dir);
+	rmdir(path);
+}
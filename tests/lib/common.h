@@ -21,8 +21,18 @@
 #ifndef _TESTS_COMMON_H
 #define _TESTS_COMMON_H
 
+#include <glib.h>
+
 struct bt_context;
 
 struct bt_context *create_context_with_path(const char *path);
 
+/*
+ * Count the events of the trace at trace_path: returns a table from
+ * event names to uint64_t counts, or NULL on error.
+ */
+GHashTable *count_events(const char *trace_path);
+
+void remove_dir(const char *path);
+
 #endif /* _TESTS_COMMON_H */
@@ -0,0 +1,800 @@
+/*
+ * test_arrow_ipc.c
+ *
+ * Arrow output test: convert traces to Arrow IPC streams, and check
+ * the structure of the streams written.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf-writer/writer.h>
+#include <babeltrace/ctf-writer/clock.h>
+#include <babeltrace/ctf-writer/stream.h>
+#include <babeltrace/ctf-writer/event.h>
+#include <babeltrace/ctf-writer/event-types.h>
+#include <babeltrace/ctf-writer/event-fields.h>
+#include <babeltrace/ctf-ir/stream-class.h>
+#include <babeltrace/ref.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+/* Limits of the Arrow output, as in formats/ctf-arrow/ctf-arrow.c */
+#define ARROW_BATCH_ROWS	65536
+#define ARROW_DICT_MAX_BYTES	(64 * 1024 * 1024)
+
+/* Message.fbs and Schema.fbs identifiers */
+#define ARROW_HEADER_SCHEMA		1
+#define ARROW_HEADER_DICTIONARY_BATCH	2
+#define ARROW_HEADER_RECORD_BATCH	3
+#define ARROW_FB_TYPE_LIST		12
+#define ARROW_CONTINUATION		0xFFFFFFFFU
+
+/*
+ * Generated trace: the "rows" events are enough to cut record batches
+ * on their row count. The "text" events all have a different string,
+ * so that their dictionary grows with each batch, batches are cut on
+ * their size, and the dictionary is replaced once it exceeds
+ * ARROW_DICT_MAX_BYTES.
+ */
+#define ROWS_EVENTS		(2 * ARROW_BATCH_ROWS + 1000)
+#define TEXT_LEN		1024
+#define TEXT_EVENTS		(ARROW_DICT_MAX_BYTES / TEXT_LEN * 3 / 2)
+#define EVENTS_PER_PACKET	1000
+
+/* Structure of the Arrow stream of one table */
+struct stream_stats {
+	char *event_name;		/* ctf.event.name schema metadata */
+	uint64_t nr_rows;
+	uint64_t nr_batches;		/* record batches */
+	uint64_t max_batch_rows;
+	uint64_t nr_full_batches;	/* of ARROW_BATCH_ROWS rows */
+	uint64_t nr_delta_dicts;	/* delta dictionary batches */
+	uint64_t nr_replaced_dicts;	/* dictionaries replaced */
+};
+
+/* Column of a schema */
+struct column {
+	int is_list;
+	int64_t dictionary_id;		/* -1 if none */
+};
+
+/* Dictionary of a stream */
+struct dict {
+	int64_t id;
+	int64_t len;			/* -1 until its first batch */
+};
+
+/* FlatBuffer being read, with bound checks. */
+struct fb {
+	const uint8_t *buf;
+	uint64_t len;
+	int error;
+};
+
+static
+int fb_check(struct fb *fb, uint64_t pos, uint64_t len)
+{
+	if (pos > fb->len || len > fb->len - pos) {
+		fb->error = 1;
+		return 0;
+	}
+	return 1;
+}
+
+static
+uint64_t fb_read(struct fb *fb, uint64_t pos, size_t size)
+{
+	uint64_t v = 0;
+	uint8_t bytes[8];
+	size_t i;
+
+	if (!fb_check(fb, pos, size))
+		return 0;
+	memcpy(bytes, fb->buf + pos, size);
+	/* FlatBuffers and Arrow metadata are little endian. */
+	for (i = size; i > 0; i--)
+		v = (v << 8) | bytes[i - 1];
+	return v;
+}
+
+/* Position of field i of the table at pos, 0 if not set. */
+static
+uint64_t fb_field(struct fb *fb, uint64_t table, unsigned int i)
+{
+	int32_t soffset = (int32_t) fb_read(fb, table, 4);
+	uint64_t vtable = table - soffset;
+	uint16_t vtable_len, offset;
+
+	vtable_len = fb_read(fb, vtable, 2);
+	if (4 + 2 * i + 2 > vtable_len)
+		return 0;
+	offset = fb_read(fb, vtable + 4 + 2 * i, 2);
+	return offset ? table + offset : 0;
+}
+
+static
+uint64_t fb_scalar(struct fb *fb, uint64_t table, unsigned int i, size_t size)
+{
+	uint64_t pos = fb_field(fb, table, i);
+
+	return pos ? fb_read(fb, pos, size) : 0;
+}
+
+/* Table, vector or string pointed to by field i, 0 if not set. */
+static
+uint64_t fb_ref(struct fb *fb, uint64_t table, unsigned int i)
+{
+	uint64_t pos = fb_field(fb, table, i);
+
+	return pos ? pos + fb_read(fb, pos, 4) : 0;
+}
+
+static
+uint64_t fb_vector_len(struct fb *fb, uint64_t vector)
+{
+	return vector ? fb_read(fb, vector, 4) : 0;
+}
+
+/* Table element i of the vector */
+static
+uint64_t fb_vector_table(struct fb *fb, uint64_t vector, uint64_t i)
+{
+	uint64_t pos = vector + 4 + 4 * i;
+
+	return pos + fb_read(fb, pos, 4);
+}
+
+/* Member of the 16-byte Buffer or FieldNode struct i of the vector */
+static
+uint64_t fb_vector_u64_pair(struct fb *fb, uint64_t vector, uint64_t i,
+		unsigned int member)
+{
+	return fb_read(fb, vector + 4 + 16 * i + 8 * member, 8);
+}
+
+static
+int fb_string_equal(struct fb *fb, uint64_t string, const char *str)
+{
+	uint64_t len = fb_read(fb, string, 4);
+
+	return fb_check(fb, string + 4, len) && len == strlen(str)
+		&& !memcmp(fb->buf + string + 4, str, len);
+}
+
+static
+char *fb_string_dup(struct fb *fb, uint64_t string)
+{
+	uint64_t len = fb_read(fb, string, 4);
+
+	if (!fb_check(fb, string + 4, len))
+		return NULL;
+	return g_strndup((const char *) fb->buf + string + 4, len);
+}
+
+static
+struct dict *find_dict(GArray *dicts, int64_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < dicts->len; i++) {
+		if (g_array_index(dicts, struct dict, i).id == id)
+			return &g_array_index(dicts, struct dict, i);
+	}
+	return NULL;
+}
+
+static
+int read_schema(struct fb *fb, uint64_t schema, GArray *columns,
+		GArray *dicts, struct stream_stats *stats)
+{
+	uint64_t fields, metadata, i;
+
+	fields = fb_ref(fb, schema, 1);
+	for (i = 0; i < fb_vector_len(fb, fields); i++) {
+		uint64_t field = fb_vector_table(fb, fields, i);
+		struct column column;
+
+		column.is_list = fb_scalar(fb, field, 2, 1) == ARROW_FB_TYPE_LIST;
+		column.dictionary_id = -1;
+		if (fb_field(fb, field, 4)) {
+			struct dict dict;
+
+			column.dictionary_id =
+				fb_scalar(fb, fb_ref(fb, field, 4), 0, 8);
+			if (find_dict(dicts, column.dictionary_id)) {
+				diag("Dictionary id %" PRId64 " is used twice",
+					column.dictionary_id);
+				return -1;
+			}
+			dict.id = column.dictionary_id;
+			dict.len = -1;
+			g_array_append_val(dicts, dict);
+		}
+		g_array_append_val(columns, column);
+	}
+	metadata = fb_ref(fb, schema, 2);
+	for (i = 0; i < fb_vector_len(fb, metadata); i++) {
+		uint64_t kv = fb_vector_table(fb, metadata, i);
+
+		if (fb_string_equal(fb, fb_ref(fb, kv, 0), "ctf.event.name"))
+			stats->event_name = fb_string_dup(fb, fb_ref(fb, kv, 1));
+	}
+	if (!columns->len || !stats->event_name) {
+		diag("Schema without columns or event name");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Check the buffers of a record batch, in body, and return their
+ * vector in *buffers.
+ */
+static
+int read_buffers(struct fb *fb, uint64_t batch, uint64_t body_len,
+		uint64_t nr_buffers, uint64_t *buffers)
+{
+	uint64_t i;
+
+	*buffers = fb_ref(fb, batch, 2);
+	if (fb_vector_len(fb, *buffers) != nr_buffers) {
+		diag("Record batch has %" PRIu64 " buffers instead of %" PRIu64,
+			fb_vector_len(fb, *buffers), nr_buffers);
+		return -1;
+	}
+	for (i = 0; i < nr_buffers; i++) {
+		uint64_t offset = fb_vector_u64_pair(fb, *buffers, i, 0);
+		uint64_t len = fb_vector_u64_pair(fb, *buffers, i, 1);
+
+		if (offset % 8 || offset > body_len || len > body_len - offset) {
+			diag("Buffer %" PRIu64 " is outside of the message body", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int read_dictionary_batch(struct fb *fb, uint64_t header,
+		const uint8_t *body, uint64_t body_len, GArray *dicts,
+		struct stream_stats *stats)
+{
+	uint64_t batch, buffers, offsets, offsets_len, data_len;
+	int64_t id, length;
+	struct dict *dict;
+	int is_delta;
+	int32_t last;
+
+	id = fb_scalar(fb, header, 0, 8);
+	batch = fb_ref(fb, header, 1);
+	is_delta = fb_scalar(fb, header, 2, 1);
+	dict = find_dict(dicts, id);
+	if (!dict) {
+		diag("Dictionary id %" PRId64 " is not in the schema", id);
+		return -1;
+	}
+	if (!batch)
+		return -1;
+	length = fb_scalar(fb, batch, 0, 8);
+	/* Validity, offsets and data of the entries */
+	if (read_buffers(fb, batch, body_len, 3, &buffers))
+		return -1;
+	offsets = fb_vector_u64_pair(fb, buffers, 1, 0);
+	offsets_len = fb_vector_u64_pair(fb, buffers, 1, 1);
+	data_len = fb_vector_u64_pair(fb, buffers, 2, 1);
+	if (offsets_len != (length + 1) * sizeof(int32_t)) {
+		diag("Dictionary %" PRId64 " has %" PRIu64 " bytes of offsets for %" PRId64 " entries",
+			id, offsets_len, length);
+		return -1;
+	}
+	memcpy(&last, body + offsets + length * sizeof(int32_t), sizeof(last));
+	if (last != data_len) {
+		diag("Dictionary %" PRId64 " entries end at %" PRId32 " instead of %" PRIu64,
+			id, last, data_len);
+		return -1;
+	}
+	if (is_delta) {
+		if (dict->len < 0) {
+			diag("Delta batch before the first batch of dictionary %" PRId64, id);
+			return -1;
+		}
+		dict->len += length;
+		stats->nr_delta_dicts++;
+	} else {
+		if (dict->len >= 0)
+			stats->nr_replaced_dicts++;
+		dict->len = length;
+	}
+	return 0;
+}
+
+static
+int read_record_batch(struct fb *fb, uint64_t header,
+		const uint8_t *body, uint64_t body_len, GArray *columns,
+		GArray *dicts, struct stream_stats *stats)
+{
+	uint64_t nodes, buffers, nr_nodes = 0, node = 0, buffer = 0, i;
+	int64_t length;
+
+	for (i = 0; i < columns->len; i++)
+		nr_nodes += g_array_index(columns, struct column, i).is_list ? 2 : 1;
+	length = fb_scalar(fb, header, 0, 8);
+	nodes = fb_ref(fb, header, 1);
+	if (fb_vector_len(fb, nodes) != nr_nodes) {
+		diag("Record batch has %" PRIu64 " field nodes instead of %" PRIu64,
+			fb_vector_len(fb, nodes), nr_nodes);
+		return -1;
+	}
+	if (read_buffers(fb, header, body_len, 2 * nr_nodes, &buffers))
+		return -1;
+
+	for (i = 0; i < columns->len; i++) {
+		struct column *column = &g_array_index(columns, struct column, i);
+		uint64_t validity, validity_len, values, values_len, row;
+		struct dict *dict;
+
+		if (fb_vector_u64_pair(fb, nodes, node, 0) != length) {
+			diag("Column %" PRIu64 " does not have %" PRId64 " rows",
+				i, length);
+			return -1;
+		}
+		validity = fb_vector_u64_pair(fb, buffers, buffer, 0);
+		validity_len = fb_vector_u64_pair(fb, buffers, buffer, 1);
+		values = fb_vector_u64_pair(fb, buffers, buffer + 1, 0);
+		values_len = fb_vector_u64_pair(fb, buffers, buffer + 1, 1);
+		node += column->is_list ? 2 : 1;
+		buffer += column->is_list ? 4 : 2;
+		if (column->dictionary_id < 0)
+			continue;
+
+		/* Indexes of valid rows must be in the dictionary. */
+		dict = find_dict(dicts, column->dictionary_id);
+		if (dict->len < 0) {
+			diag("Record batch before dictionary %" PRId64,
+				column->dictionary_id);
+			return -1;
+		}
+		if (values_len < length * sizeof(int32_t)
+				|| (validity_len && validity_len < (length + 7) / 8)) {
+			diag("Column %" PRIu64 " is missing rows", i);
+			return -1;
+		}
+		for (row = 0; row < length; row++) {
+			int32_t index;
+
+			if (validity_len && !(body[validity + row / 8]
+					& (1U << (row % 8))))
+				continue;
+			memcpy(&index, body + values + row * sizeof(index),
+				sizeof(index));
+			if (index < 0 || index >= dict->len) {
+				diag("Index %" PRId32 " is outside dictionary %" PRId64 " of %" PRId64 " entries",
+					index, column->dictionary_id, dict->len);
+				return -1;
+			}
+		}
+	}
+	stats->nr_rows += length;
+	stats->nr_batches++;
+	if (length > stats->max_batch_rows)
+		stats->max_batch_rows = length;
+	if (length == ARROW_BATCH_ROWS)
+		stats->nr_full_batches++;
+	if (length > ARROW_BATCH_ROWS) {
+		diag("Record batch of %" PRId64 " rows", length);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Check the messages of the Arrow stream in buf: a schema, dictionary
+ * and record batches, and an end-of-stream marker.
+ */
+static
+int read_stream(const uint8_t *buf, uint64_t len, struct stream_stats *stats)
+{
+	GArray *columns, *dicts;
+	uint64_t pos = 0;
+	int ret = -1;
+
+	columns = g_array_new(FALSE, FALSE, sizeof(struct column));
+	dicts = g_array_new(FALSE, FALSE, sizeof(struct dict));
+	for (;;) {
+		struct fb header_fb = { buf, len, 0 };
+		struct fb fb;
+		uint64_t meta_len, message, header, body_len;
+		int header_type;
+
+		if (fb_read(&header_fb, pos, 4) != ARROW_CONTINUATION
+				|| header_fb.error) {
+			diag("Missing continuation marker at offset %" PRIu64, pos);
+			goto end;
+		}
+		meta_len = fb_read(&header_fb, pos + 4, 4);
+		pos += 8;
+		if (!meta_len)
+			break;		/* End of stream */
+		if (meta_len % 8 || !fb_check(&header_fb, pos, meta_len)) {
+			diag("Invalid metadata length at offset %" PRIu64, pos);
+			goto end;
+		}
+		fb.buf = buf + pos;
+		fb.len = meta_len;
+		fb.error = 0;
+		message = fb_read(&fb, 0, 4);
+		header_type = fb_scalar(&fb, message, 1, 1);
+		header = fb_ref(&fb, message, 2);
+		body_len = fb_scalar(&fb, message, 3, 8);
+		pos += meta_len;
+		if (!header || body_len % 8
+				|| !fb_check(&header_fb, pos, body_len)) {
+			diag("Invalid message at offset %" PRIu64, pos);
+			goto end;
+		}
+		if (!columns->len && header_type != ARROW_HEADER_SCHEMA) {
+			diag("Stream does not start with a schema");
+			goto end;
+		}
+		switch (header_type) {
+		case ARROW_HEADER_SCHEMA:
+			if (columns->len) {
+				diag("Schema message repeated");
+				goto end;
+			}
+			if (read_schema(&fb, header, columns, dicts, stats))
+				goto end;
+			break;
+		case ARROW_HEADER_DICTIONARY_BATCH:
+			if (read_dictionary_batch(&fb, header, buf + pos,
+					body_len, dicts, stats))
+				goto end;
+			break;
+		case ARROW_HEADER_RECORD_BATCH:
+			if (read_record_batch(&fb, header, buf + pos,
+					body_len, columns, dicts, stats))
+				goto end;
+			break;
+		default:
+			diag("Unexpected message type %d", header_type);
+			goto end;
+		}
+		if (fb.error) {
+			diag("Message metadata out of bounds");
+			goto end;
+		}
+		pos += body_len;
+	}
+	if (pos != len) {
+		diag("Data after the end of stream marker");
+		goto end;
+	}
+	ret = 0;
+end:
+	g_array_free(columns, TRUE);
+	g_array_free(dicts, TRUE);
+	return ret;
+}
+
+static
+int read_file(const char *path, struct stream_stats *stats)
+{
+	uint8_t *buf;
+	long len;
+	FILE *fp;
+	int ret = -1;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		diag("Cannot open %s", path);
+		return -1;
+	}
+	if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0) {
+		fclose(fp);
+		return -1;
+	}
+	rewind(fp);
+	buf = g_malloc(len);
+	if (fread(buf, 1, len, fp) == len)
+		ret = read_stream(buf, len, stats);
+	g_free(buf);
+	fclose(fp);
+	return ret;
+}
+
+static
+void stats_free(gpointer data)
+{
+	struct stream_stats *stats = data;
+
+	g_free(stats->event_name);
+	g_free(stats);
+}
+
+static
+int run_babeltrace(const char *babeltrace_path, const char *trace_path,
+		const char *output_path)
+{
+	int status = 0;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		int fd = open("/dev/null", O_WRONLY);
+
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		execl(babeltrace_path, "babeltrace", "-o", "arrow",
+			"-w", output_path, trace_path, NULL);
+		exit(-1);
+	}
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * Convert the trace to Arrow, check each stream written, and that the
+ * tables have one row per event. Returns the stream stats by file name.
+ */
+static
+GHashTable *test_trace(const char *babeltrace_path, const char *trace_path)
+{
+	char output_path[] = "/tmp/arrow_output_XXXXXX";
+	GHashTable *counts, *streams, *rows;
+	GHashTableIter it;
+	gpointer key, value;
+	struct dirent *entry;
+	DIR *dir;
+	int ret;
+
+	counts = count_events(trace_path);
+	if (!counts || !mkdtemp(output_path)) {
+		fail("Read trace %s", trace_path);
+		if (counts)
+			g_hash_table_destroy(counts);
+		return NULL;
+	}
+	ret = run_babeltrace(babeltrace_path, trace_path, output_path);
+	ok(ret == 0, "Convert trace %s to Arrow", trace_path);
+
+	streams = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			stats_free);
+	rows = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+	dir = opendir(output_path);
+	while (dir && (entry = readdir(dir))) {
+		struct stream_stats *stats;
+		uint64_t *nr_rows;
+		char *path;
+
+		if (entry->d_name[0] == '.')
+			continue;
+		stats = g_new0(struct stream_stats, 1);
+		path = g_strdup_printf("%s/%s", output_path, entry->d_name);
+		ok(read_file(path, stats) == 0,
+			"Arrow stream %s of trace %s is well-formed",
+			entry->d_name, trace_path);
+		g_free(path);
+		g_hash_table_insert(streams, g_strdup(entry->d_name), stats);
+		if (!stats->event_name)
+			continue;
+		nr_rows = g_hash_table_lookup(rows, stats->event_name);
+		if (!nr_rows) {
+			nr_rows = g_new0(uint64_t, 1);
+			g_hash_table_insert(rows, stats->event_name, nr_rows);
+		}
+		*nr_rows += stats->nr_rows;
+	}
+	if (dir)
+		closedir(dir);
+
+	/* Tables of events of the same name add up. */
+	ret = g_hash_table_size(rows) == g_hash_table_size(counts);
+	g_hash_table_iter_init(&it, counts);
+	while (ret && g_hash_table_iter_next(&it, &key, &value)) {
+		uint64_t *nr_rows = g_hash_table_lookup(rows, key);
+
+		if (!nr_rows || *nr_rows != *(uint64_t *) value) {
+			diag("Event %s: %" PRIu64 " events, %" PRIu64 " rows",
+				(char *) key, *(uint64_t *) value,
+				nr_rows ? *nr_rows : 0);
+			ret = 0;
+		}
+	}
+	ok(ret, "Arrow tables of trace %s have one row per event", trace_path);
+
+	g_hash_table_destroy(rows);
+	g_hash_table_destroy(counts);
+	remove_dir(output_path);
+	return streams;
+}
+
+static
+struct stream_stats *find_stream(GHashTable *streams, const char *event_name)
+{
+	GHashTableIter it;
+	gpointer value;
+
+	g_hash_table_iter_init(&it, streams);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct stream_stats *stats = value;
+
+		if (stats->event_name && !strcmp(stats->event_name, event_name))
+			return stats;
+	}
+	return NULL;
+}
+
+/*
+ * Write a trace with many rows, and many distinct strings, to exercise
+ * the batch and dictionary limits.
+ */
+static
+int write_big_trace(const char *trace_path)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_clock *clock;
+	struct bt_ctf_stream_class *stream_class;
+	struct bt_ctf_stream *stream;
+	struct bt_ctf_event_class *rows_class, *text_class;
+	struct bt_ctf_field_type *integer_type, *string_type;
+	char text[TEXT_LEN];
+	uint64_t time = 0;
+	int i, ret = 0;
+
+	writer = bt_ctf_writer_create(trace_path);
+	if (!writer)
+		return -1;
+	clock = bt_ctf_clock_create("test_clock");
+	stream_class = bt_ctf_stream_class_create("test_stream");
+	rows_class = bt_ctf_event_class_create("rows");
+	text_class = bt_ctf_event_class_create("text");
+	integer_type = bt_ctf_field_type_integer_create(32);
+	string_type = bt_ctf_field_type_string_create();
+	ret |= bt_ctf_writer_add_clock(writer, clock);
+	ret |= bt_ctf_stream_class_set_clock(stream_class, clock);
+	ret |= bt_ctf_event_class_add_field(rows_class, integer_type, "value");
+	ret |= bt_ctf_event_class_add_field(rows_class, string_type, "label");
+	ret |= bt_ctf_event_class_add_field(text_class, string_type, "text");
+	ret |= bt_ctf_stream_class_add_event_class(stream_class, rows_class);
+	ret |= bt_ctf_stream_class_add_event_class(stream_class, text_class);
+	stream = ret ? NULL : bt_ctf_writer_create_stream(writer, stream_class);
+	if (!stream)
+		ret = -1;
+
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	for (i = 0; !ret && i < ROWS_EVENTS + TEXT_EVENTS; i++) {
+		struct bt_ctf_event *event;
+		struct bt_ctf_field *field;
+		char label[16];
+
+		ret |= bt_ctf_clock_set_time(clock, ++time);
+		if (i < ROWS_EVENTS) {
+			event = bt_ctf_event_create(rows_class);
+			field = bt_ctf_event_get_payload(event, "value");
+			ret |= bt_ctf_field_unsigned_integer_set_value(field, i);
+			bt_put(field);
+			field = bt_ctf_event_get_payload(event, "label");
+			snprintf(label, sizeof(label), "label %d", i % 10);
+			ret |= bt_ctf_field_string_set_value(field, label);
+			bt_put(field);
+		} else {
+			event = bt_ctf_event_create(text_class);
+			field = bt_ctf_event_get_payload(event, "text");
+			/* Distinct strings of TEXT_LEN - 1 characters */
+			snprintf(label, sizeof(label), "%010d", i);
+			memcpy(text, label, strlen(label));
+			ret |= bt_ctf_field_string_set_value(field, text);
+			bt_put(field);
+		}
+		ret |= bt_ctf_stream_append_event(stream, event);
+		bt_put(event);
+		if (!ret && !((i + 1) % EVENTS_PER_PACKET))
+			ret = bt_ctf_stream_flush(stream);
+	}
+	if (!ret)
+		ret = bt_ctf_stream_flush(stream);
+	bt_ctf_writer_flush_metadata(writer);
+
+	bt_put(integer_type);
+	bt_put(string_type);
+	bt_put(rows_class);
+	bt_put(text_class);
+	bt_put(stream);
+	bt_put(stream_class);
+	bt_put(clock);
+	bt_put(writer);
+	return ret;
+}
+
+static
+void test_big_trace(const char *babeltrace_path)
+{
+	char trace_path[] = "/tmp/arrow_trace_XXXXXX";
+	struct stream_stats *rows, *text;
+	GHashTable *streams;
+
+	if (!mkdtemp(trace_path) || write_big_trace(trace_path)) {
+		fail("Write a trace of %d events", ROWS_EVENTS + TEXT_EVENTS);
+		remove_dir(trace_path);
+		return;
+	}
+	pass("Write a trace of %d events", ROWS_EVENTS + TEXT_EVENTS);
+	streams = test_trace(babeltrace_path, trace_path);
+	remove_dir(trace_path);
+	if (!streams) {
+		skip(5, "Cannot read the trace written");
+		return;
+	}
+	rows = find_stream(streams, "rows");
+	text = find_stream(streams, "text");
+	ok(rows && rows->nr_full_batches == ROWS_EVENTS / ARROW_BATCH_ROWS,
+		"Record batches are cut at %d rows", ARROW_BATCH_ROWS);
+	ok(text && text->nr_batches > 1
+		&& text->max_batch_rows < ARROW_BATCH_ROWS,
+		"Record batches are cut on their size");
+	ok(text && text->nr_delta_dicts > 0,
+		"New dictionary entries are written as delta batches");
+	ok(text && text->nr_replaced_dicts > 0,
+		"Dictionaries larger than %d bytes are replaced",
+		ARROW_DICT_MAX_BYTES);
+	ok(rows && !rows->nr_delta_dicts && !rows->nr_replaced_dicts,
+		"Dictionaries without new entries are not written again");
+	g_hash_table_destroy(streams);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2) {
+		printf("Usage: test_arrow_ipc path_to_babeltrace [trace...]\n");
+		return -1;
+	}
+
+	plan_no_plan();
+
+	for (i = 2; i < argc; i++) {
+		GHashTable *streams;
+
+		streams = test_trace(argv[1], argv[i]);
+		if (streams)
+			g_hash_table_destroy(streams);
+	}
+	test_big_trace(argv[1]);
+
+	return exit_status();
+}
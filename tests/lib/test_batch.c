@@ -0,0 +1,209 @@
+/*
+ * test_batch.c
+ *
+ * Lib BabelTrace - Batch read test program: events read by batches must
+ * be the same as read one at a time.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+/* Number of events read per batch */
+#define BATCH_LEN	16
+
+/* Number of tests per trace */
+#define NR_BATCH_READ_TESTS	5
+
+/*
+ * Text of the integer and string fields of the event context and
+ * payload of an event, to compare events read in different ways.
+ */
+static
+char *event_fields_text(const struct bt_ctf_event *event)
+{
+	static const enum bt_ctf_scope scopes[] = {
+		BT_STREAM_EVENT_CONTEXT, BT_EVENT_CONTEXT, BT_EVENT_FIELDS,
+	};
+	GString *text = g_string_new(bt_ctf_event_name(event));
+	unsigned int i, j, count;
+
+	for (i = 0; i < G_N_ELEMENTS(scopes); i++) {
+		const struct bt_definition *scope;
+		struct bt_definition const * const *list;
+
+		scope = bt_ctf_get_top_level_scope(event, scopes[i]);
+		if (!scope || bt_ctf_get_field_list(event, scope, &list, &count))
+			continue;
+		for (j = 0; j < count; j++) {
+			const struct bt_declaration *decl;
+
+			decl = bt_ctf_get_decl_from_def(list[j]);
+			g_string_append_printf(text, " %s=",
+				bt_ctf_field_name(list[j]));
+			switch (bt_ctf_field_type(decl)) {
+			case CTF_TYPE_INTEGER:
+				if (bt_ctf_get_int_signedness(decl))
+					g_string_append_printf(text, "%" PRId64,
+						bt_ctf_get_int64(list[j]));
+				else
+					g_string_append_printf(text, "%" PRIu64,
+						bt_ctf_get_uint64(list[j]));
+				break;
+			case CTF_TYPE_STRING:
+				g_string_append(text,
+					bt_ctf_get_string(list[j]));
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	return g_string_free(text, FALSE);
+}
+
+static
+void run_batch_read(const char *path)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event, *events[BATCH_LEN];
+	struct bt_iter_pos newpos;
+	int ret, i, flags, ordered = 1, same_fields = 1;
+	uint64_t nr_events = 0, nr_batch_events = 0;
+	uint64_t timestamp, first = 0, last = 0;
+	uint64_t expected_begin = 0, expected_last = 0;
+	GPtrArray *fields;
+
+	/* Open the trace */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		skip(NR_BATCH_READ_TESTS, "Cannot create valid context");
+		return;
+	}
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		skip(NR_BATCH_READ_TESTS, "Cannot create valid iterator");
+		return;
+	}
+
+	/* Read events one at a time */
+	fields = g_ptr_array_new_with_free_func(g_free);
+	for (;;) {
+		event = bt_ctf_iter_read_event_flags(iter, &flags);
+		if (event) {
+			timestamp = bt_ctf_get_timestamp(event);
+			if (!nr_events)
+				expected_begin = timestamp;
+			expected_last = timestamp;
+			g_ptr_array_add(fields, event_fields_text(event));
+			nr_events++;
+		} else if (!(flags & BT_ITER_FLAG_RETRY)) {
+			break;
+		}
+		ret = bt_iter_next(bt_ctf_get_iter(iter));
+		if (ret < 0)
+			break;
+	}
+
+	newpos.type = BT_SEEK_BEGIN;
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), &newpos);
+
+	/* Read them again by batches */
+	for (;;) {
+		ret = bt_ctf_iter_read_events(iter, events, BATCH_LEN);
+		if (ret == -EAGAIN)
+			continue;
+		if (ret <= 0)
+			break;
+		for (i = 0; i < ret; i++) {
+			timestamp = bt_ctf_get_timestamp(events[i]);
+			if (!nr_batch_events && !i)
+				first = timestamp;
+			else if (timestamp < last)
+				ordered = 0;
+			last = timestamp;
+		}
+		/*
+		 * Check the fields once the whole batch is read: reading
+		 * later events must not change earlier ones.
+		 */
+		for (i = 0; i < ret; i++) {
+			char *text = event_fields_text(events[i]);
+
+			if (nr_batch_events >= fields->len
+					|| strcmp(text, g_ptr_array_index(fields,
+						nr_batch_events))) {
+				if (same_fields)
+					diag("Batch event %" PRIu64 " read as: %s",
+						nr_batch_events, text);
+				same_fields = 0;
+			}
+			g_free(text);
+			nr_batch_events++;
+		}
+	}
+
+	ok(ret == 0, "Batch read %s until end of trace retval %d", path, ret);
+	ok(nr_batch_events == nr_events,
+		"Batch read %" PRIu64 " events, expected %" PRIu64,
+		nr_batch_events, nr_events);
+	ok(ordered, "Batch events are in timestamp order");
+	ok(first == expected_begin && last == expected_last,
+		"Batch first and last timestamps");
+	ok(same_fields, "Batch events have the fields read one at a time");
+	g_ptr_array_free(fields, TRUE);
+
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	/*
+	 * Side-effects ensuring libs are not optimized away by static
+	 * linking.
+	 */
+	babeltrace_debug = 0;	/* libbabeltrace.la */
+	opt_clock_offset = 0;	/* libbabeltrace-ctf.la */
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need trace paths");
+
+	plan_tests(NR_BATCH_READ_TESTS * (argc - 1));
+
+	for (i = 1; i < argc; i++)
+		run_batch_read(argv[i]);
+
+	return exit_status();
+}
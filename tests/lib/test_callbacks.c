@@ -0,0 +1,154 @@
+/*
+ * test_callbacks.c
+ *
+ * Lib BabelTrace - Iterator callbacks test program: a callback added
+ * with BT_FLAGS_FILTER_EVENTS must only read the events it is called
+ * for.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/callbacks.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+/* Number of tests per trace */
+#define NR_CALLBACK_FILTER_TESTS	4
+
+static
+enum bt_cb_ret count_callback(struct bt_ctf_event *event, void *private_data)
+{
+	uint64_t *nr_callbacks = private_data;
+
+	(*nr_callbacks)++;
+	return BT_CB_OK;
+}
+
+static
+void run_callback_filter(const char *path)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	char *name = NULL;
+	int ret = -1, flags, same_name = 1;
+	uint64_t nr_named = 0, nr_events = 0, nr_callbacks = 0;
+
+	/* Open the trace */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		skip(NR_CALLBACK_FILTER_TESTS, "Cannot create valid context");
+		return;
+	}
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		skip(NR_CALLBACK_FILTER_TESTS, "Cannot create valid iterator");
+		return;
+	}
+
+	/* Count the events named as the first one */
+	for (;;) {
+		event = bt_ctf_iter_read_event_flags(iter, &flags);
+		if (event) {
+			if (!name)
+				name = strdup(bt_ctf_event_name(event));
+			if (!strcmp(bt_ctf_event_name(event), name))
+				nr_named++;
+		} else if (!(flags & BT_ITER_FLAG_RETRY)) {
+			break;
+		}
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+	iter = NULL;
+	if (!name) {
+		skip(NR_CALLBACK_FILTER_TESTS, "No event in %s", path);
+		goto end;
+	}
+
+	/* Only read them, through a filtering callback */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (iter)
+		ret = bt_ctf_iter_add_callback(iter,
+			g_quark_from_string(name), &nr_callbacks,
+			BT_FLAGS_FILTER_EVENTS, count_callback,
+			NULL, NULL, NULL);
+	ok(ret == 0, "Add filtering callback on %s retval %d", path, ret);
+	if (ret) {
+		skip(NR_CALLBACK_FILTER_TESTS - 1, "No filtering callback");
+		goto end;
+	}
+	for (;;) {
+		event = bt_ctf_iter_read_event_flags(iter, &flags);
+		if (event) {
+			if (strcmp(bt_ctf_event_name(event), name))
+				same_name = 0;
+			nr_events++;
+		} else if (!(flags & BT_ITER_FLAG_RETRY)) {
+			break;
+		}
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	ok(same_name, "Filtering callback only reads events named %s", name);
+	ok(nr_events == nr_named,
+		"Filtering callback read %" PRIu64 " events, expected %" PRIu64,
+		nr_events, nr_named);
+	ok(nr_callbacks == nr_named,
+		"Filtering callback called %" PRIu64 " times, expected %" PRIu64,
+		nr_callbacks, nr_named);
+end:
+	if (iter)
+		bt_ctf_iter_destroy(iter);
+	free(name);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	/*
+	 * Side-effects ensuring libs are not optimized away by static
+	 * linking.
+	 */
+	babeltrace_debug = 0;	/* libbabeltrace.la */
+	opt_clock_offset = 0;	/* libbabeltrace-ctf.la */
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need trace paths");
+
+	plan_tests(NR_CALLBACK_FILTER_TESTS * (argc - 1));
+
+	for (i = 1; i < argc; i++)
+		run_callback_filter(argv[i]);
+
+	return exit_status();
+}
@@ -0,0 +1,296 @@
+/*
+ * test_decoder.c
+ *
+ * Lib BabelTrace - Decoder threads test program: events read with a
+ * decoder thread per stream must be the same as read synchronously.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+/* Number of events read per batch */
+#define BATCH_LEN	5
+
+#define FNV_OFFSET	0xcbf29ce484222325ULL
+#define FNV_PRIME	0x100000001b3ULL
+
+/* What is compared of each event */
+struct event_record {
+	uint64_t timestamp;
+	const char *name;	/* GQuark string, never freed */
+	uint64_t digest;	/* hash of the values of all scopes */
+};
+
+enum read_mode {
+	READ_NEXT,		/* bt_iter_next() only */
+	READ_BATCH,		/* bt_iter_next() and batches, alternated */
+	READ_FILTER,		/* filter set on the middle event */
+};
+
+static
+uint64_t hash_bytes(uint64_t hash, const void *p, size_t len)
+{
+	const unsigned char *c = p;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= c[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static
+uint64_t hash_field(const struct bt_ctf_event *event, uint64_t hash,
+		const struct bt_definition *field)
+{
+	const struct bt_declaration *decl = bt_ctf_get_decl_from_def(field);
+	struct bt_definition const * const *list;
+	unsigned int count, i;
+	const char *str;
+	size_t len;
+	uint64_t v;
+	double d;
+
+	switch (bt_ctf_field_type(decl)) {
+	case CTF_TYPE_INTEGER:
+		v = bt_ctf_get_uint64(field);
+		return hash_bytes(hash, &v, sizeof(v));
+	case CTF_TYPE_ENUM:
+		v = bt_ctf_get_uint64(bt_ctf_get_enum_int(field));
+		return hash_bytes(hash, &v, sizeof(v));
+	case CTF_TYPE_FLOAT:
+		d = bt_ctf_get_float(field);
+		return hash_bytes(hash, &d, sizeof(d));
+	case CTF_TYPE_STRING:
+		str = bt_ctf_get_string(field);
+		return hash_bytes(hash, str, strlen(str) + 1);
+	case CTF_TYPE_VARIANT:
+		return hash_field(event, hash, bt_ctf_get_variant(field));
+	case CTF_TYPE_ARRAY:
+	case CTF_TYPE_SEQUENCE:
+		/* Text, or array of bytes */
+		str = bt_ctf_get_bytes(field, &len);
+		if (str)
+			return hash_bytes(hash, str, len);
+		/* Fall-through */
+	case CTF_TYPE_STRUCT:
+		if (bt_ctf_get_field_list(event, field, &list, &count))
+			count = 0;
+		for (i = 0; i < count; i++)
+			hash = hash_field(event, hash, list[i]);
+		return hash_bytes(hash, &count, sizeof(count));
+	default:
+		return hash;
+	}
+}
+
+static
+void record_event(GArray *records, const struct bt_ctf_event *event)
+{
+	static const enum bt_ctf_scope scopes[] = {
+		BT_TRACE_PACKET_HEADER, BT_STREAM_PACKET_CONTEXT,
+		BT_STREAM_EVENT_HEADER, BT_STREAM_EVENT_CONTEXT,
+		BT_EVENT_CONTEXT, BT_EVENT_FIELDS,
+	};
+	struct event_record record;
+	unsigned int i;
+
+	record.timestamp = bt_ctf_get_timestamp(event);
+	record.name = bt_ctf_event_name(event);
+	record.digest = FNV_OFFSET;
+	for (i = 0; i < sizeof(scopes) / sizeof(scopes[0]); i++) {
+		const struct bt_definition *scope;
+
+		scope = bt_ctf_get_top_level_scope(event, scopes[i]);
+		if (scope)
+			record.digest = hash_field(event, record.digest,
+					scope);
+	}
+	g_array_append_val(records, record);
+}
+
+/*
+ * Read all events of the trace at path, with or without decoder
+ * threads. Returns the events read, NULL on error.
+ */
+static
+GArray *read_trace(const char *path, int decode_threads,
+		enum read_mode mode, uint64_t filter_at)
+{
+	struct bt_ctf_event *batch[BATCH_LEN];
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	GArray *records;
+	int flags, ret, n, i;
+
+	opt_decode_threads = decode_threads;
+	ctx = create_context_with_path(path);
+	opt_decode_threads = 0;
+	if (!ctx)
+		return NULL;
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		bt_context_put(ctx);
+		return NULL;
+	}
+	records = g_array_new(FALSE, FALSE, sizeof(struct event_record));
+	for (;;) {
+		if (mode == READ_BATCH && records->len % 2) {
+			n = bt_ctf_iter_read_events(iter, batch, BATCH_LEN);
+			if (n == 0)
+				break;
+			if (n < 0 && n != -EAGAIN)
+				goto error;
+			for (i = 0; i < n; i++)
+				record_event(records, batch[i]);
+			/* Move past the last event of the batch. */
+			ret = bt_iter_next(bt_ctf_get_iter(iter));
+			if (ret < 0)
+				goto error;
+			continue;
+		}
+		event = bt_ctf_iter_read_event_flags(iter, &flags);
+		if (event) {
+			record_event(records, event);
+			if (mode == READ_FILTER && records->len == filter_at) {
+				const char *pattern = bt_ctf_event_name(event);
+
+				if (bt_ctf_iter_set_event_filter(iter,
+						&pattern, 1))
+					goto error;
+			}
+		} else if (!(flags & BT_ITER_FLAG_RETRY)) {
+			break;
+		}
+		ret = bt_iter_next(bt_ctf_get_iter(iter));
+		if (ret < 0)
+			goto error;
+	}
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+	return records;
+
+error:
+	g_array_free(records, TRUE);
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+	return NULL;
+}
+
+/* Returns 0 if both runs read the same events. */
+static
+int compare_records(GArray *expected, GArray *records)
+{
+	unsigned int i;
+
+	if (!expected || !records)
+		return -1;
+	if (expected->len != records->len) {
+		diag("Read %u events, expected %u", records->len,
+			expected->len);
+		return -1;
+	}
+	for (i = 0; i < expected->len; i++) {
+		struct event_record *a, *b;
+
+		a = &g_array_index(expected, struct event_record, i);
+		b = &g_array_index(records, struct event_record, i);
+		if (a->timestamp == b->timestamp && a->name == b->name
+				&& a->digest == b->digest)
+			continue;
+		diag("Event %u is %s at %" PRIu64 ", expected %s at %" PRIu64,
+			i, b->name, b->timestamp, a->name, a->timestamp);
+		return -1;
+	}
+	return 0;
+}
+
+static
+void test_trace(const char *path)
+{
+	static const char * const mode_names[] = {
+		[READ_NEXT] = "one event at a time",
+		[READ_BATCH] = "with batches",
+		[READ_FILTER] = "with an event filter",
+	};
+	enum read_mode mode;
+	GArray *sync_records;
+	uint64_t filter_at;
+
+	sync_records = read_trace(path, 0, READ_NEXT, 0);
+	if (!sync_records) {
+		skip(3, "Cannot read trace %s", path);
+		return;
+	}
+	filter_at = sync_records->len / 2;
+	for (mode = READ_NEXT; mode <= READ_FILTER; mode++) {
+		GArray *expected, *records;
+
+		if (mode == READ_NEXT)
+			expected = sync_records;
+		else
+			expected = read_trace(path, 0, mode, filter_at);
+		records = read_trace(path, 1, mode, filter_at);
+		ok(compare_records(expected, records) == 0,
+			"Decoder threads read the events of %s %s", path,
+			mode_names[mode]);
+		if (records)
+			g_array_free(records, TRUE);
+		if (expected && expected != sync_records)
+			g_array_free(expected, TRUE);
+	}
+	g_array_free(sync_records, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	/*
+	 * Side-effects ensuring libs are not optimized away by static
+	 * linking.
+	 */
+	babeltrace_debug = 0;	/* libbabeltrace.la */
+	opt_clock_offset = 0;	/* libbabeltrace-ctf.la */
+
+	plan_no_plan();
+
+	if (argc < 2) {
+		diag("Usage: %s TRACE...", argv[0]);
+		return -1;
+	}
+	for (i = 1; i < argc; i++)
+		test_trace(argv[i]);
+
+	return exit_status();
+}
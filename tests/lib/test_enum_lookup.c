@@ -0,0 +1,230 @@
+/*
+ * test_enum_lookup.c
+ *
+ * Enumeration value to quark set lookup tests
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/types.h>
+#include <babeltrace/endian.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <tap/tap.h>
+
+/* Number of generated ranges */
+#define NR_RANGES	300
+/* Values looked up, from -LOOKUP_SPAN to LOOKUP_SPAN */
+#define LOOKUP_SPAN	2000
+
+struct test_range {
+	int64_t start, end;
+	GQuark q;
+};
+
+static struct test_range ranges[NR_RANGES];
+
+/* Count the ranges containing v, as the lookup should. */
+static
+unsigned int expected_matches(int64_t v, int signedness)
+{
+	unsigned int i, nr = 0;
+
+	for (i = 0; i < NR_RANGES; i++) {
+		if (signedness) {
+			if (ranges[i].start <= v && v <= ranges[i].end)
+				nr++;
+		} else {
+			if ((uint64_t) ranges[i].start <= (uint64_t) v
+					&& (uint64_t) v <= (uint64_t) ranges[i].end)
+				nr++;
+		}
+	}
+	return nr;
+}
+
+static
+int quark_set_matches(GArray *qs, int64_t v, int signedness)
+{
+	unsigned int i, j, nr = expected_matches(v, signedness);
+
+	if (!qs)
+		return nr == 0;
+	if (qs->len != nr)
+		return 0;
+	for (i = 0; i < qs->len; i++) {
+		GQuark q = g_array_index(qs, GQuark, i);
+
+		for (j = 0; j < NR_RANGES; j++) {
+			if (ranges[j].q == q)
+				break;
+		}
+		if (j == NR_RANGES)
+			return 0;
+		if (signedness) {
+			if (v < ranges[j].start || v > ranges[j].end)
+				return 0;
+		} else {
+			if ((uint64_t) v < (uint64_t) ranges[j].start
+					|| (uint64_t) v > (uint64_t) ranges[j].end)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Whether both quark sets hold the same quarks in the same order. */
+static
+int quark_set_equal(GArray *a, GArray *b)
+{
+	if (!a || !b)
+		return a == b;
+	return a->len == b->len
+		&& !memcmp(a->data, b->data, a->len * sizeof(GQuark));
+}
+
+static
+void run_lookup(int signedness)
+{
+	struct declaration_integer *integer_declaration;
+	struct declaration_enum *enum_declaration;
+	uint64_t errors_list = 0, errors_index = 0, errors_order = 0;
+	GArray *list_qs[2 * LOOKUP_SPAN + 1];
+	int64_t v;
+	GArray *qs;
+	unsigned int i;
+
+	integer_declaration = bt_integer_declaration_new(64, BYTE_ORDER,
+			signedness, 8, 10, CTF_STRING_NONE, NULL);
+	enum_declaration = bt_enum_declaration_new(integer_declaration);
+	bt_declaration_unref(&integer_declaration->p);
+
+	for (i = 0; i < NR_RANGES; i++) {
+		char name[32];
+		int64_t start = ((int64_t) i * 7919) % (2 * LOOKUP_SPAN)
+			- LOOKUP_SPAN;
+
+		/* Keep unsigned ranges from wrapping around. */
+		if (!signedness)
+			start += LOOKUP_SPAN;
+
+		snprintf(name, sizeof(name), "range_%u", i);
+		ranges[i].q = g_quark_from_string(name);
+		ranges[i].start = start;
+		/* Mostly single values, some overlapping ranges. */
+		ranges[i].end = (i % 3) ? start : start + (int64_t) (i % 50);
+		if (signedness)
+			bt_enum_signed_insert(enum_declaration,
+				ranges[i].start, ranges[i].end, ranges[i].q);
+		else
+			bt_enum_unsigned_insert(enum_declaration,
+				ranges[i].start, ranges[i].end, ranges[i].q);
+	}
+
+	/* List walk, before the index is built. */
+	for (v = -LOOKUP_SPAN; v <= LOOKUP_SPAN; v++) {
+		if (signedness)
+			qs = bt_enum_int_to_quark_set(enum_declaration, v);
+		else
+			qs = bt_enum_uint_to_quark_set(enum_declaration, v);
+		if (!quark_set_matches(qs, v, signedness))
+			errors_list++;
+		list_qs[v + LOOKUP_SPAN] = qs;
+	}
+	ok(errors_list == 0, "%s lookups without index",
+		signedness ? "signed" : "unsigned");
+
+	bt_enum_declaration_finalize(enum_declaration);
+	ok(enum_declaration->table.range_index != NULL,
+		"%s range index built", signedness ? "signed" : "unsigned");
+
+	for (v = -LOOKUP_SPAN; v <= LOOKUP_SPAN; v++) {
+		if (signedness)
+			qs = bt_enum_int_to_quark_set(enum_declaration, v);
+		else
+			qs = bt_enum_uint_to_quark_set(enum_declaration, v);
+		if (!quark_set_matches(qs, v, signedness))
+			errors_index++;
+		if (!quark_set_equal(qs, list_qs[v + LOOKUP_SPAN]))
+			errors_order++;
+		if (qs)
+			g_array_unref(qs);
+		if (list_qs[v + LOOKUP_SPAN])
+			g_array_unref(list_qs[v + LOOKUP_SPAN]);
+	}
+	ok(errors_index == 0, "%s lookups with index",
+		signedness ? "signed" : "unsigned");
+	ok(errors_order == 0, "%s lookups with index return labels in list order",
+		signedness ? "signed" : "unsigned");
+
+	bt_declaration_unref(&enum_declaration->p);
+}
+
+/*
+ * Nested ranges inserted out of range start order: the index must
+ * return their labels in the same order as the list walk.
+ */
+static
+void run_label_order(void)
+{
+	static const struct {
+		int64_t start, end;
+		const char *label;
+	} nested[] = {
+		{ 10, 20, "middle" },
+		{ 0, 30, "outer" },
+		{ 15, 16, "inner" },
+		{ 5, 25, "wide" },
+	};
+	struct declaration_integer *integer_declaration;
+	struct declaration_enum *enum_declaration;
+	GArray *list_qs, *index_qs;
+	unsigned int i;
+
+	integer_declaration = bt_integer_declaration_new(32, BYTE_ORDER,
+			1, 8, 10, CTF_STRING_NONE, NULL);
+	enum_declaration = bt_enum_declaration_new(integer_declaration);
+	bt_declaration_unref(&integer_declaration->p);
+	for (i = 0; i < sizeof(nested) / sizeof(nested[0]); i++)
+		bt_enum_signed_insert(enum_declaration, nested[i].start,
+			nested[i].end, g_quark_from_string(nested[i].label));
+
+	list_qs = bt_enum_int_to_quark_set(enum_declaration, 15);
+	bt_enum_declaration_finalize(enum_declaration);
+	index_qs = bt_enum_int_to_quark_set(enum_declaration, 15);
+	ok(list_qs && list_qs->len == 4 && quark_set_equal(list_qs, index_qs),
+		"Nested range labels in list order");
+	if (list_qs)
+		g_array_unref(list_qs);
+	if (index_qs)
+		g_array_unref(index_qs);
+	bt_declaration_unref(&enum_declaration->p);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(9);
+
+	run_lookup(0);
+	run_lookup(1);
+	run_label_order();
+
+	return exit_status();
+}
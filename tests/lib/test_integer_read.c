@@ -0,0 +1,144 @@
+/*
+ * test_integer_read.c
+ *
+ * CTF integer read tests
+ *
+ * Copyright 2010-2011 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/bitfield.h>
+#include <babeltrace/endian.h>
+#include <babeltrace/mmap-align.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+/* Test buffer size, in bytes */
+#define BUF_LEN		(4 * 1024 * 1024)
+
+struct integer_case {
+	const char *name;
+	size_t len;		/* in bits */
+	size_t alignment;	/* in bits */
+	int reverse;		/* reverse byte order */
+	enum bt_integer_access expected_access;
+};
+
+static const struct integer_case cases[] = {
+	{ "aligned 8-bit", 8, 8, 0, BT_INTEGER_ACCESS_NATIVE },
+	{ "aligned 16-bit native", 16, 8, 0, BT_INTEGER_ACCESS_NATIVE },
+	{ "aligned 32-bit native", 32, 8, 0, BT_INTEGER_ACCESS_NATIVE },
+	{ "aligned 64-bit native", 64, 8, 0, BT_INTEGER_ACCESS_NATIVE },
+	{ "aligned 16-bit reverse", 16, 8, 1, BT_INTEGER_ACCESS_REVERSE },
+	{ "aligned 32-bit reverse", 32, 8, 1, BT_INTEGER_ACCESS_REVERSE },
+	{ "aligned 64-bit reverse", 64, 8, 1, BT_INTEGER_ACCESS_REVERSE },
+	{ "aligned 24-bit", 24, 8, 0, BT_INTEGER_ACCESS_BITFIELD },
+	{ "unaligned 13-bit bitfield", 13, 1, 0, BT_INTEGER_ACCESS_BITFIELD },
+	{ "unaligned 32-bit bitfield", 32, 1, 1, BT_INTEGER_ACCESS_BITFIELD },
+};
+
+#define NR_CASES	(sizeof(cases) / sizeof(cases[0]))
+
+static
+uint64_t expected_value(uint64_t i, size_t len)
+{
+	uint64_t v = i * 0x9E3779B97F4A7C15ULL;
+
+	if (len < 64)
+		v &= (1ULL << len) - 1;
+	return v;
+}
+
+static
+void run_case(const struct integer_case *c, unsigned char *buf)
+{
+	struct declaration_integer *declaration;
+	struct definition_integer definition;
+	struct ctf_stream_pos pos;
+	struct mmap_align mma;
+	uint64_t i, nr, errors = 0;
+	int byte_order;
+
+	if (c->reverse)
+		byte_order = (BYTE_ORDER == LITTLE_ENDIAN) ?
+			BIG_ENDIAN : LITTLE_ENDIAN;
+	else
+		byte_order = BYTE_ORDER;
+
+	declaration = bt_integer_declaration_new(c->len, byte_order, 0,
+			c->alignment, 10, CTF_STRING_NONE, NULL);
+	ok(declaration->access == c->expected_access,
+		"%s classified as access class %d", c->name,
+		(int) declaration->access);
+
+	nr = (uint64_t) BUF_LEN * CHAR_BIT / c->len;
+	memset(buf, 0, BUF_LEN);
+	for (i = 0; i < nr; i++) {
+		if (byte_order == LITTLE_ENDIAN)
+			bt_bitfield_write_le(buf, unsigned char, i * c->len,
+				c->len, expected_value(i, c->len));
+		else
+			bt_bitfield_write_be(buf, unsigned char, i * c->len,
+				c->len, expected_value(i, c->len));
+	}
+
+	memset(&definition, 0, sizeof(definition));
+	definition.p.declaration = &declaration->p;
+	definition.declaration = declaration;
+
+	memset(&mma, 0, sizeof(mma));
+	mma.addr = buf;
+	mma.length = BUF_LEN;
+	memset(&pos, 0, sizeof(pos));
+	pos.fd = -1;
+	pos.prot = PROT_READ;
+	pos.base_mma = &mma;
+	pos.packet_size = pos.content_size = (uint64_t) nr * c->len;
+
+	for (i = 0; i < nr; i++) {
+		if (ctf_integer_read(&pos.parent, &definition.p)
+				|| definition.value._unsigned
+					!= expected_value(i, c->len))
+			errors++;
+	}
+	ok(errors == 0 && pos.offset == pos.packet_size,
+		"%s: %" PRIu64 " values read back", c->name, nr);
+
+	bt_declaration_unref(&declaration->p);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *buf;
+	unsigned int i;
+
+	plan_tests(2 * NR_CASES);
+
+	buf = malloc(BUF_LEN);
+	if (!buf) {
+		diag("Unable to allocate test buffer");
+		return -1;
+	}
+	for (i = 0; i < NR_CASES; i++)
+		run_case(&cases[i], buf);
+	free(buf);
+
+	return exit_status();
+}
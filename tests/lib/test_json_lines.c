@@ -0,0 +1,573 @@
+/*
+ * test_json_lines.c
+ *
+ * JSON output test: convert traces to JSON Lines, and check that every
+ * line is a JSON object describing one event.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf-writer/writer.h>
+#include <babeltrace/ctf-writer/clock.h>
+#include <babeltrace/ctf-writer/stream.h>
+#include <babeltrace/ctf-writer/event.h>
+#include <babeltrace/ctf-writer/event-types.h>
+#include <babeltrace/ctf-writer/event-fields.h>
+#include <babeltrace/ctf-ir/stream-class.h>
+#include <babeltrace/ref.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+#define JSON_MAX_DEPTH	64
+
+/* Member of a JSON object: its key, and the text of its value. */
+struct json_member {
+	const char *key;	/* without quotes nor escapes */
+	size_t key_len;
+	const char *value;
+	size_t value_len;
+};
+
+/* Members written by the JSON output for events */
+static const char * const event_members[] = {
+	"timestamp", "name", "stream_id", "trace", "trace:hostname",
+	"trace:domain", "trace:procname", "trace:vpid", "loglevel",
+	"model.emf.uri", "stream.packet.context", "stream.event.header",
+	"stream.event.context", "event.context", "event.fields",
+};
+
+/* Options the traces are converted with */
+static const char * const output_options[] = {
+	"",
+	"-f all --clock-cycles",
+	"--no-delta -f trace:hostname,trace:procname",
+};
+
+/*
+ * String of the generated trace, with invalid UTF-8 bytes, and how it
+ * is written.
+ */
+#define TEXT_VALUE	"caf\xc3\xa9 \xff\xc3 end"
+#define TEXT_JSON	"\"caf\xc3\xa9 \\ufffd\\ufffd end\""
+
+/* Floats of the generated trace */
+static const double float_values[] = {
+	0.0, 0.5, -1.25e-300, 1e300, 4.9406564584124654e-324,
+	1.0 / 3.0, NAN, INFINITY, -INFINITY,
+};
+
+static
+int json_value(const char **p, const char *end, int depth);
+
+static
+int json_string(const char **p, const char *end)
+{
+	const char *s = *p;
+
+	if (s >= end || *s++ != '"')
+		return -1;
+	while (s < end && *s != '"') {
+		if ((unsigned char) *s < 0x20)
+			return -1;
+		if (*s++ != '\\')
+			continue;
+		if (s >= end)
+			return -1;
+		if (*s == 'u') {
+			int i;
+
+			for (i = 1; i <= 4; i++) {
+				if (s + i >= end || !isxdigit((unsigned char) s[i]))
+					return -1;
+			}
+			s += 5;
+		} else if (strchr("\"\\/bfnrt", *s)) {
+			s++;
+		} else {
+			return -1;
+		}
+	}
+	if (s >= end || !g_utf8_validate(*p + 1, s - *p - 1, NULL))
+		return -1;
+	*p = s + 1;
+	return 0;
+}
+
+static
+int json_digits(const char **p, const char *end)
+{
+	const char *s = *p;
+
+	while (*p < end && isdigit((unsigned char) **p))
+		(*p)++;
+	return *p > s ? 0 : -1;
+}
+
+static
+int json_number(const char **p, const char *end)
+{
+	if (*p < end && **p == '-')
+		(*p)++;
+	if (*p < end && **p == '0')
+		(*p)++;
+	else if (json_digits(p, end))
+		return -1;
+	if (*p < end && **p == '.') {
+		(*p)++;
+		if (json_digits(p, end))
+			return -1;
+	}
+	if (*p < end && (**p == 'e' || **p == 'E')) {
+		(*p)++;
+		if (*p < end && (**p == '+' || **p == '-'))
+			(*p)++;
+		if (json_digits(p, end))
+			return -1;
+	}
+	return 0;
+}
+
+static
+int json_literal(const char **p, const char *end, const char *literal)
+{
+	size_t len = strlen(literal);
+
+	if (end - *p < len || strncmp(*p, literal, len))
+		return -1;
+	*p += len;
+	return 0;
+}
+
+/*
+ * Parse the object at *p. Its members are appended to members if not
+ * NULL.
+ */
+static
+int json_object(const char **p, const char *end, int depth,
+		GArray *members)
+{
+	if (*p >= end || **p != '{' || depth > JSON_MAX_DEPTH)
+		return -1;
+	(*p)++;
+	if (*p < end && **p == '}') {
+		(*p)++;
+		return 0;
+	}
+	for (;;) {
+		struct json_member member;
+
+		member.key = *p + 1;
+		if (json_string(p, end))
+			return -1;
+		member.key_len = *p - member.key - 1;
+		if (*p >= end || *(*p)++ != ':')
+			return -1;
+		member.value = *p;
+		if (json_value(p, end, depth + 1))
+			return -1;
+		member.value_len = *p - member.value;
+		if (members)
+			g_array_append_val(members, member);
+		if (*p >= end)
+			return -1;
+		if (**p == '}') {
+			(*p)++;
+			return 0;
+		}
+		if (*(*p)++ != ',')
+			return -1;
+	}
+}
+
+static
+int json_array(const char **p, const char *end, int depth)
+{
+	if (*p >= end || **p != '[' || depth > JSON_MAX_DEPTH)
+		return -1;
+	(*p)++;
+	if (*p < end && **p == ']') {
+		(*p)++;
+		return 0;
+	}
+	for (;;) {
+		if (json_value(p, end, depth + 1) || *p >= end)
+			return -1;
+		if (**p == ']') {
+			(*p)++;
+			return 0;
+		}
+		if (*(*p)++ != ',')
+			return -1;
+	}
+}
+
+/* The output has no whitespace between tokens. */
+static
+int json_value(const char **p, const char *end, int depth)
+{
+	if (*p >= end)
+		return -1;
+	switch (**p) {
+	case '{':
+		return json_object(p, end, depth, NULL);
+	case '[':
+		return json_array(p, end, depth);
+	case '"':
+		return json_string(p, end);
+	case 't':
+		return json_literal(p, end, "true");
+	case 'f':
+		return json_literal(p, end, "false");
+	case 'n':
+		return json_literal(p, end, "null");
+	default:
+		return json_number(p, end);
+	}
+}
+
+/* Parse s, of len bytes, as a single JSON object. */
+static
+int json_parse_object(const char *s, size_t len, GArray *members)
+{
+	const char *p = s;
+
+	if (json_object(&p, s + len, 0, members))
+		return -1;
+	return p == s + len ? 0 : -1;
+}
+
+static
+const struct json_member *json_find(GArray *members, const char *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < members->len; i++) {
+		const struct json_member *member =
+			&g_array_index(members, struct json_member, i);
+
+		if (member->key_len == strlen(key)
+				&& !strncmp(member->key, key, member->key_len))
+			return member;
+	}
+	return NULL;
+}
+
+static
+int json_is_integer(const struct json_member *member)
+{
+	size_t i;
+
+	for (i = 0; i < member->value_len; i++) {
+		if (!isdigit((unsigned char) member->value[i]))
+			return 0;
+	}
+	return member->value_len > 0;
+}
+
+/*
+ * Check that line is an event: a JSON object with a name and stream
+ * id, and only the members written for events. The members are
+ * returned in members.
+ */
+static
+int check_event_line(const char *line, size_t len, int all_fields,
+		GArray *members)
+{
+	const struct json_member *member;
+	unsigned int i, j;
+
+	g_array_set_size(members, 0);
+	if (json_parse_object(line, len, members)) {
+		diag("Invalid JSON: %.*s", (int) MIN(len, 200), line);
+		return -1;
+	}
+	for (i = 0; i < members->len; i++) {
+		member = &g_array_index(members, struct json_member, i);
+		for (j = 0; j < G_N_ELEMENTS(event_members); j++) {
+			if (member->key_len == strlen(event_members[j])
+					&& !strncmp(member->key, event_members[j],
+						member->key_len))
+				break;
+		}
+		if (j == G_N_ELEMENTS(event_members)) {
+			diag("Unexpected member %.*s", (int) member->key_len,
+				member->key);
+			return -1;
+		}
+		/* Scopes are objects. */
+		if ((g_str_has_prefix(event_members[j], "stream.")
+				|| g_str_has_prefix(event_members[j], "event."))
+				&& member->value[0] != '{') {
+			diag("Member %s is not an object", event_members[j]);
+			return -1;
+		}
+	}
+	member = json_find(members, "name");
+	if (!member || member->value[0] != '"') {
+		diag("Missing event name: %.*s", (int) MIN(len, 200), line);
+		return -1;
+	}
+	member = json_find(members, "stream_id");
+	if (!member || !json_is_integer(member)) {
+		diag("Missing stream id: %.*s", (int) MIN(len, 200), line);
+		return -1;
+	}
+	member = json_find(members, "timestamp");
+	if (member && !json_is_integer(member)) {
+		diag("Invalid timestamp: %.*s", (int) MIN(len, 200), line);
+		return -1;
+	}
+	if (all_fields && !json_find(members, "trace")) {
+		diag("Missing trace field: %.*s", (int) MIN(len, 200), line);
+		return -1;
+	}
+	return 0;
+}
+
+static
+FILE *open_output(const char *babeltrace_path, const char *options,
+		const char *trace_path)
+{
+	char *command;
+	FILE *fp;
+
+	command = g_strdup_printf("%s -o json %s %s 2>/dev/null",
+			babeltrace_path, options, trace_path);
+	fp = popen(command, "r");
+	g_free(command);
+	return fp;
+}
+
+static
+void test_trace(const char *babeltrace_path, const char *trace_path)
+{
+	GHashTable *counts;
+	GHashTableIter iter;
+	gpointer count;
+	GArray *members;
+	int64_t nr_events = 0;
+	unsigned int i;
+
+	counts = count_events(trace_path);
+	if (!counts) {
+		skip(2 * G_N_ELEMENTS(output_options),
+			"Cannot read trace %s", trace_path);
+		return;
+	}
+	g_hash_table_iter_init(&iter, counts);
+	while (g_hash_table_iter_next(&iter, NULL, &count))
+		nr_events += *(uint64_t *) count;
+	g_hash_table_destroy(counts);
+	members = g_array_new(FALSE, FALSE, sizeof(struct json_member));
+	for (i = 0; i < G_N_ELEMENTS(output_options); i++) {
+		const char *options = output_options[i];
+		int all_fields = strstr(options, "-f all") != NULL;
+		int64_t nr_lines = 0;
+		char *line = NULL;
+		size_t size = 0;
+		ssize_t len;
+		int ret = 0;
+		FILE *fp;
+
+		fp = open_output(babeltrace_path, options, trace_path);
+		while (fp && (len = getline(&line, &size, fp)) > 0) {
+			nr_lines++;
+			if (line[len - 1] != '\n') {
+				diag("Line %" PRId64 " is not terminated", nr_lines);
+				ret = -1;
+				continue;
+			}
+			if (!ret)
+				ret = check_event_line(line, len - 1,
+					all_fields, members);
+		}
+		free(line);
+		if (!fp || pclose(fp))
+			ret = -1;
+		ok(ret == 0, "JSON output of trace %s with options \"%s\" has one object per line",
+			trace_path, options);
+		ok(nr_lines == nr_events, "JSON output of trace %s with options \"%s\" has one line per event",
+			trace_path, options);
+	}
+	g_array_free(members, TRUE);
+}
+
+static
+int write_float_trace(const char *trace_path)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_clock *clock;
+	struct bt_ctf_stream_class *stream_class;
+	struct bt_ctf_stream *stream;
+	struct bt_ctf_event_class *event_class;
+	struct bt_ctf_field_type *float_type, *string_type;
+	unsigned int i;
+	int ret = 0;
+
+	writer = bt_ctf_writer_create(trace_path);
+	if (!writer)
+		return -1;
+	clock = bt_ctf_clock_create("test_clock");
+	stream_class = bt_ctf_stream_class_create("test_stream");
+	event_class = bt_ctf_event_class_create("float_event");
+	float_type = bt_ctf_field_type_floating_point_create();
+	string_type = bt_ctf_field_type_string_create();
+	ret |= bt_ctf_field_type_floating_point_set_exponent_digits(float_type, 11);
+	ret |= bt_ctf_field_type_floating_point_set_mantissa_digits(float_type, 53);
+	ret |= bt_ctf_writer_add_clock(writer, clock);
+	ret |= bt_ctf_stream_class_set_clock(stream_class, clock);
+	ret |= bt_ctf_event_class_add_field(event_class, float_type, "value");
+	ret |= bt_ctf_event_class_add_field(event_class, string_type, "text");
+	ret |= bt_ctf_stream_class_add_event_class(stream_class, event_class);
+	stream = ret ? NULL : bt_ctf_writer_create_stream(writer, stream_class);
+	if (!stream)
+		ret = -1;
+
+	for (i = 0; !ret && i < G_N_ELEMENTS(float_values); i++) {
+		struct bt_ctf_event *event;
+		struct bt_ctf_field *field;
+
+		ret |= bt_ctf_clock_set_time(clock, i + 1);
+		event = bt_ctf_event_create(event_class);
+		field = bt_ctf_event_get_payload(event, "value");
+		ret |= bt_ctf_field_floating_point_set_value(field,
+			float_values[i]);
+		bt_put(field);
+		field = bt_ctf_event_get_payload(event, "text");
+		ret |= bt_ctf_field_string_set_value(field, TEXT_VALUE);
+		bt_put(field);
+		ret |= bt_ctf_stream_append_event(stream, event);
+		bt_put(event);
+	}
+	if (!ret)
+		ret = bt_ctf_stream_flush(stream);
+	bt_ctf_writer_flush_metadata(writer);
+
+	bt_put(float_type);
+	bt_put(string_type);
+	bt_put(event_class);
+	bt_put(stream);
+	bt_put(stream_class);
+	bt_put(clock);
+	bt_put(writer);
+	return ret;
+}
+
+/*
+ * Floats are written as numbers reading back as the same value, and
+ * strings as valid UTF-8.
+ */
+static
+void test_floats(const char *babeltrace_path)
+{
+	char trace_path[] = "/tmp/json_trace_XXXXXX";
+	GArray *members, *fields;
+	unsigned int i = 0;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int ret = 0, text_ret = 0;
+	FILE *fp;
+
+	if (!mkdtemp(trace_path) || write_float_trace(trace_path)) {
+		fail("Write a trace of floats");
+		remove_dir(trace_path);
+		return;
+	}
+	pass("Write a trace of floats");
+
+	members = g_array_new(FALSE, FALSE, sizeof(struct json_member));
+	fields = g_array_new(FALSE, FALSE, sizeof(struct json_member));
+	fp = open_output(babeltrace_path, "", trace_path);
+	while (fp && (len = getline(&line, &size, fp)) > 0) {
+		const struct json_member *member;
+		char *value;
+		double d;
+
+		if (i >= G_N_ELEMENTS(float_values)
+				|| check_event_line(line, len - 1, 0, members)) {
+			ret = -1;
+			break;
+		}
+		member = json_find(members, "event.fields");
+		g_array_set_size(fields, 0);
+		if (!member || json_parse_object(member->value,
+				member->value_len, fields)
+				|| !(member = json_find(fields, "value"))) {
+			ret = -1;
+			break;
+		}
+		value = g_strndup(member->value, member->value_len);
+		d = g_ascii_strtod(value, NULL);
+		if (isfinite(float_values[i]) ? d != float_values[i]
+				: strcmp(value, "null")) {
+			diag("Float %.17g written as %s", float_values[i], value);
+			ret = -1;
+		}
+		g_free(value);
+		member = json_find(fields, "text");
+		if (!member || member->value_len != strlen(TEXT_JSON)
+				|| memcmp(member->value, TEXT_JSON,
+					member->value_len)) {
+			diag("String written as %.*s",
+				member ? (int) member->value_len : 0,
+				member ? member->value : "");
+			text_ret = -1;
+		}
+		i++;
+	}
+	free(line);
+	if (!fp || pclose(fp) || i != G_N_ELEMENTS(float_values))
+		ret = text_ret = -1;
+	ok(ret == 0, "Floats are written as numbers, NaN and infinities as null");
+	ok(text_ret == 0, "Invalid UTF-8 is written as replacement characters");
+
+	g_array_free(fields, TRUE);
+	g_array_free(members, TRUE);
+	remove_dir(trace_path);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2) {
+		printf("Usage: test_json_lines path_to_babeltrace [trace...]\n");
+		return -1;
+	}
+
+	plan_no_plan();
+
+	for (i = 2; i < argc; i++)
+		test_trace(argv[1], argv[i]);
+	test_floats(argv[1]);
+
+	return exit_status();
+}
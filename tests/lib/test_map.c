@@ -0,0 +1,161 @@
+/*
+ * test_map.c
+ *
+ * Lib BabelTrace - Event map test program: bt_ctf_map_events() must
+ * pass every event of the trace to the callbacks.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/map.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <tap/tap.h>
+#include "common.h"
+
+/* Number of tests per trace */
+#define NR_MAP_TESTS	3
+
+struct map_count {
+	uint64_t nr_events;
+	uint64_t first, last;
+};
+
+static
+void *map_count_init(void *private_data)
+{
+	struct map_count *count;
+
+	count = calloc(1, sizeof(*count));
+	if (count)
+		count->first = -1ULL;
+	return count;
+}
+
+static
+int map_count_event(struct bt_ctf_event *event, void *thread_data)
+{
+	struct map_count *count = thread_data;
+	uint64_t timestamp = bt_ctf_get_timestamp(event);
+
+	count->nr_events++;
+	if (timestamp < count->first)
+		count->first = timestamp;
+	if (timestamp > count->last)
+		count->last = timestamp;
+	return 0;
+}
+
+static
+int map_count_reduce(void *thread_data, void *private_data)
+{
+	struct map_count *count = thread_data, *total = private_data;
+
+	total->nr_events += count->nr_events;
+	if (count->first < total->first)
+		total->first = count->first;
+	if (count->last > total->last)
+		total->last = count->last;
+	free(count);
+	return 0;
+}
+
+static
+void run_map(const char *path)
+{
+	const struct bt_ctf_map_cb cb = {
+		.thread_init = map_count_init,
+		.event = map_count_event,
+		.reduce = map_count_reduce,
+	};
+	struct map_count total = { 0, -1ULL, 0 };
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	uint64_t nr_events = 0, timestamp;
+	uint64_t expected_begin = -1ULL, expected_last = 0;
+	int ret, flags;
+
+	/* Open the trace */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		skip(NR_MAP_TESTS, "Cannot create valid context");
+		return;
+	}
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		skip(NR_MAP_TESTS, "Cannot create valid iterator");
+		return;
+	}
+	for (;;) {
+		event = bt_ctf_iter_read_event_flags(iter, &flags);
+		if (event) {
+			timestamp = bt_ctf_get_timestamp(event);
+			if (timestamp < expected_begin)
+				expected_begin = timestamp;
+			if (timestamp > expected_last)
+				expected_last = timestamp;
+			nr_events++;
+		} else if (!(flags & BT_ITER_FLAG_RETRY)) {
+			break;
+		}
+		ret = bt_iter_next(bt_ctf_get_iter(iter));
+		if (ret < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+
+	ret = bt_ctf_map_events(ctx, 2, &cb, &total);
+	ok(ret == 0, "Map over all events of %s retval %d", path, ret);
+	ok(total.nr_events == nr_events,
+		"Map read %" PRIu64 " events, expected %" PRIu64,
+		total.nr_events, nr_events);
+	ok(total.first == expected_begin && total.last == expected_last,
+		"Map first and last timestamps");
+
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	/*
+	 * Side-effects ensuring libs are not optimized away by static
+	 * linking.
+	 */
+	babeltrace_debug = 0;	/* libbabeltrace.la */
+	opt_clock_offset = 0;	/* libbabeltrace-ctf.la */
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need trace paths");
+
+	plan_tests(NR_MAP_TESTS * (argc - 1));
+
+	for (i = 1; i < argc; i++)
+		run_map(argv[i]);
+
+	return exit_status();
+}
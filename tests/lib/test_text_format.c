@@ -0,0 +1,263 @@
+/*
+ * test_text_format.c
+ *
+ * Text output number and timestamp formatting test: check that they
+ * print the same characters as the printf formats they replace.
+ *
+ * Copyright 2014 - EfficiOS Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/babeltrace-internal.h>
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <tap/tap.h>
+
+#define NSEC_PER_SEC	1000000000ULL
+
+/* Timestamp options, as set by the --clock-* options */
+struct clock_options {
+	const char *name;
+	int cycles, seconds, date, gmt;
+};
+
+static const struct clock_options clock_options[] = {
+	{ "default", 0, 0, 0, 0 },
+	{ "--clock-date", 0, 0, 1, 0 },
+	{ "--clock-gmt", 0, 0, 0, 1 },
+	{ "--clock-date --clock-gmt", 0, 0, 1, 1 },
+	{ "--clock-seconds", 0, 1, 0, 0 },
+	{ "--clock-cycles", 1, 0, 0, 0 },
+};
+
+/* --clock-offset and --clock-offset-ns values */
+static const int64_t clock_offsets[][2] = {
+	{ 0, 0 },
+	{ 0, -1 },			/* timestamp 0 becomes negative */
+	{ -5, 0 },
+	{ 0, -1500000000 },
+	{ 3600, 999999999 },
+};
+
+static const uint64_t timestamps[] = {
+	0, 1, 999999999, 1000000000, 1351532897586558519ULL,
+	1351532897999999999ULL, 1351532898000000000ULL,
+	INT64_MAX, (uint64_t) INT64_MIN, UINT64_MAX,
+};
+
+/*
+ * Reference: the timestamp as printed by printf, before the text output
+ * formatted it by hand.
+ */
+static
+int ref_format_timestamp(char *buf, size_t size, uint64_t timestamp)
+{
+	uint64_t ts_sec = 0, ts_nsec;
+	struct tm tm;
+	time_t time_s;
+	int len = 0;
+
+	if (opt_clock_cycles)
+		return snprintf(buf, size, "%020" PRIu64, timestamp);
+
+	ts_nsec = timestamp;
+	ts_nsec += opt_clock_offset_ns;
+	ts_sec += opt_clock_offset;
+	ts_sec += ts_nsec / NSEC_PER_SEC;
+	ts_nsec = ts_nsec % NSEC_PER_SEC;
+
+	if (opt_clock_seconds)
+		goto seconds;
+	time_s = (time_t) ts_sec;
+	if (!opt_clock_gmt) {
+		if (!localtime_r(&time_s, &tm))
+			goto seconds;
+	} else {
+		if (!gmtime_r(&time_s, &tm))
+			goto seconds;
+	}
+	if (opt_clock_date) {
+		len = strftime(buf, 26, "%F ", &tm);
+		if (!len)
+			goto seconds;
+	}
+	return len + snprintf(buf + len, size - len,
+		"%02d:%02d:%02d.%09" PRIu64,
+		tm.tm_hour, tm.tm_min, tm.tm_sec, ts_nsec);
+seconds:
+	return snprintf(buf, size, "%3" PRIu64 ".%09" PRIu64, ts_sec, ts_nsec);
+}
+
+/* Integers around each power of 10, and the extremes */
+static
+GArray *test_values(void)
+{
+	GArray *values = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	uint64_t v, power = 1;
+	int i;
+
+	for (i = 0; i < 20; i++) {
+		v = power - 1;
+		g_array_append_val(values, v);
+		g_array_append_val(values, power);
+		v = power + 1;
+		g_array_append_val(values, v);
+		if (i < 19)
+			power *= 10;
+	}
+	v = INT64_MAX;
+	g_array_append_val(values, v);
+	v = (uint64_t) INT64_MIN;
+	g_array_append_val(values, v);
+	v = UINT64_MAX;
+	g_array_append_val(values, v);
+	v = UINT64_MAX - 1;
+	g_array_append_val(values, v);
+	v = 0xDEADBEEFULL;
+	g_array_append_val(values, v);
+	return values;
+}
+
+enum int_format {
+	FORMAT_UINT,
+	FORMAT_INT,
+	FORMAT_HEX,
+};
+
+/* Format v both ways, and compare. Returns 0 if they match. */
+static
+int check_integer(struct ctf_text_stream_pos *pos, enum int_format format,
+		uint64_t v)
+{
+	char ref[32];
+	int len;
+
+	pos->buf_len = 0;
+	switch (format) {
+	case FORMAT_UINT:
+		ctf_text_print_uint(pos, v);
+		len = snprintf(ref, sizeof(ref), "%" PRIu64, v);
+		break;
+	case FORMAT_INT:
+		ctf_text_print_int(pos, (int64_t) v);
+		len = snprintf(ref, sizeof(ref), "%" PRId64, (int64_t) v);
+		break;
+	case FORMAT_HEX:
+	default:
+		ctf_text_print_hex(pos, v);
+		len = snprintf(ref, sizeof(ref), "%" PRIX64, v);
+		break;
+	}
+	if (pos->buf_len != len || memcmp(pos->buf, ref, len)) {
+		diag("Printed \"%.*s\" instead of \"%s\"",
+			(int) pos->buf_len, pos->buf, ref);
+		return -1;
+	}
+	return 0;
+}
+
+static
+void test_integers(void)
+{
+	static const char * const names[] = {
+		[FORMAT_UINT] = "ctf_text_print_uint",
+		[FORMAT_INT] = "ctf_text_print_int",
+		[FORMAT_HEX] = "ctf_text_print_hex",
+	};
+	struct ctf_text_stream_pos pos;
+	GArray *values = test_values();
+	int format;
+	unsigned int i;
+
+	/* Without output file, the position grows its buffer. */
+	memset(&pos, 0, sizeof(pos));
+	for (format = FORMAT_UINT; format <= FORMAT_HEX; format++) {
+		int ret = 0;
+
+		for (i = 0; i < values->len; i++)
+			ret |= check_integer(&pos, format,
+				g_array_index(values, uint64_t, i));
+		ok(ret == 0, "%s prints as printf", names[format]);
+	}
+	g_free(pos.buf);
+	g_array_free(values, TRUE);
+}
+
+static
+void test_timestamps(void)
+{
+	unsigned int i, j, k;
+	int pass;
+
+	for (i = 0; i < G_N_ELEMENTS(clock_options); i++) {
+		const struct clock_options *options = &clock_options[i];
+		int ret = 0;
+
+		opt_clock_cycles = options->cycles;
+		opt_clock_seconds = options->seconds;
+		opt_clock_date = options->date;
+		opt_clock_gmt = options->gmt;
+		for (j = 0; j < G_N_ELEMENTS(clock_offsets); j++) {
+			opt_clock_offset = clock_offsets[j][0];
+			opt_clock_offset_ns = clock_offsets[j][1];
+			/* Twice, the second time from the cached seconds. */
+			for (pass = 0; pass < 2; pass++) {
+				for (k = 0; k < G_N_ELEMENTS(timestamps); k++) {
+					char buf[CTF_TIMESTAMP_STR_LEN];
+					char ref[CTF_TIMESTAMP_STR_LEN];
+					size_t len;
+					int ref_len;
+
+					len = ctf_format_timestamp(buf, NULL,
+						timestamps[k]);
+					ref_len = ref_format_timestamp(ref,
+						sizeof(ref), timestamps[k]);
+					if (len == ref_len && !memcmp(buf, ref, len))
+						continue;
+					diag("Timestamp %" PRIu64 " with offset %" PRId64 "s %" PRId64 "ns printed \"%.*s\" instead of \"%s\"",
+						timestamps[k], clock_offsets[j][0],
+						clock_offsets[j][1], (int) len,
+						buf, ref);
+					ret = -1;
+				}
+			}
+		}
+		ok(ret == 0, "ctf_format_timestamp prints as printf with %s",
+			options->name);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	/* A time zone with an offset and daylight saving time */
+	setenv("TZ", "EST5EDT,M3.2.0,M11.1.0", 1);
+	tzset();
+
+	plan_no_plan();
+
+	test_integers();
+	test_timestamps();
+
+	return exit_status();
+}
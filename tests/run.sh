@@ -19,4 +19,9 @@
 
 [ -z "$1" ] && echo "Error: No testlist. Please specify a testlist to run." && exit 1
 
+# Test programs reading traces through the library do not take
+# --no-index-cache: keep their packet index cache in a scratch directory.
+export XDG_CACHE_HOME=$(mktemp -d)
+trap "rm -rf $XDG_CACHE_HOME" EXIT
+
 prove --merge --exec '' - < $1
@@ -30,6 +30,7 @@
 #include <babeltrace/format.h>
 #include <babeltrace/types.h>
 #include <inttypes.h>
+#include <string.h>
 
 static
 struct bt_definition *_array_definition_new(struct bt_declaration *declaration,
@@ -47,6 +48,7 @@ int bt_array_rw(struct bt_stream_pos *pos, struct bt_definition *definition)
 	uint64_t i;
 	int ret;
 
+	bt_array_bulk_sync(array_definition);
 	/* No need to align, because the first field will align itself. */
 	for (i = 0; i < array_declaration->len; i++) {
 		struct bt_definition *field =
@@ -121,6 +123,9 @@ struct bt_definition *
 					parent_scope);
 	assert(!ret);
 	array->string = NULL;
+	array->bytes = NULL;
+	array->bytes_len = 0;
+	memset(&array->bulk, 0, sizeof(array->bulk));
 	array->elems = NULL;
 
 	if (array_declaration->elem->id == CTF_TYPE_INTEGER) {
@@ -188,6 +193,7 @@ void _array_definition_free(struct bt_definition *definition)
 		}
 		(void) g_ptr_array_free(array->elems, TRUE);
 	}
+	g_free(array->bulk.values);
 	bt_free_definition_scope(array->p.scope);
 	bt_declaration_unref(array->p.declaration);
 	g_free(array);
@@ -206,9 +212,17 @@ struct bt_definition *bt_array_index(struct definition_array *array, uint64_t i)
 		return NULL;
 	if (i >= array->elems->len)
 		return NULL;
+	bt_array_bulk_sync(array);
 	return g_ptr_array_index(array->elems, i);
 }
 
+void bt_array_bulk_sync(struct definition_array *array)
+{
+	if (!array->bulk.stale)
+		return;
+	bt_bulk_sync(&array->bulk, array->declaration->elem, array->elems);
+}
+
 int bt_get_array_len(const struct bt_definition *field)
 {
 	struct definition_array *array_definition;
@@ -120,6 +120,140 @@ void enum_val_free(void *ptr)
 }
 #endif /* WORD_SIZE != 32 */
 
+static inline
+uint64_t enum_int_key(int64_t v)
+{
+	return (uint64_t) v ^ (1ULL << 63);
+}
+
+/*
+ * Quark set being looked up. Sets holding a single quark are shared
+ * with the table; a new GArray is only allocated once a second quark
+ * is found.
+ */
+struct enum_lookup {
+	GArray *qs;		/* single values quark set */
+	GArray *match;		/* quark set of first matching range */
+	GArray *ranges;		/* merged quark set */
+};
+
+static
+void enum_lookup_add(struct enum_lookup *lookup, GQuark q, GArray *quark_set)
+{
+	size_t len;
+
+	if (!lookup->ranges) {
+		if (!lookup->qs && !lookup->match && quark_set) {
+			lookup->match = quark_set;
+			return;
+		}
+		len = (lookup->qs ? lookup->qs->len : 0)
+			+ (lookup->match ? lookup->match->len : 0);
+		lookup->ranges = g_array_sized_new(FALSE, TRUE,
+				sizeof(GQuark), len + 1);
+		if (lookup->qs)
+			g_array_append_vals(lookup->ranges, lookup->qs->data,
+					lookup->qs->len);
+		if (lookup->match)
+			g_array_append_vals(lookup->ranges,
+					lookup->match->data,
+					lookup->match->len);
+	}
+	g_array_append_val(lookup->ranges, q);
+}
+
+static
+GArray *enum_lookup_result(struct enum_lookup *lookup)
+{
+	GArray *result;
+
+	if (lookup->ranges)
+		return lookup->ranges;
+	result = lookup->match ? lookup->match : lookup->qs;
+	if (result)
+		g_array_ref(result);
+	return result;
+}
+
+/*
+ * Ranges of the index holding a key. Like enum_lookup, only allocates
+ * once a second range is found.
+ */
+struct enum_range_match {
+	struct enum_range_node *first;
+	GPtrArray *nodes;	/* struct enum_range_node *, or NULL */
+};
+
+static
+void enum_range_index_query(const GArray *index, size_t lo, size_t hi,
+		uint64_t key, struct enum_range_match *match)
+{
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct enum_range_node *node =
+			&g_array_index(index, struct enum_range_node, mid);
+
+		if (node->max_end < key)
+			return;
+		enum_range_index_query(index, lo, mid, key, match);
+		if (node->start > key)
+			return;
+		if (node->end >= key) {
+			if (!match->first) {
+				match->first = node;
+			} else {
+				if (!match->nodes) {
+					match->nodes = g_ptr_array_new();
+					g_ptr_array_add(match->nodes,
+							match->first);
+				}
+				g_ptr_array_add(match->nodes, node);
+			}
+		}
+		lo = mid + 1;
+	}
+}
+
+static
+gint enum_range_node_order_compare(gconstpointer a, gconstpointer b)
+{
+	const struct enum_range_node *na = *(struct enum_range_node * const *) a;
+	const struct enum_range_node *nb = *(struct enum_range_node * const *) b;
+
+	if (na->order < nb->order)
+		return -1;
+	if (na->order > nb->order)
+		return 1;
+	return 0;
+}
+
+/*
+ * Add the ranges holding key to lookup, in list order: the index is
+ * sorted by range start.
+ */
+static
+void enum_range_index_lookup(const GArray *index, uint64_t key,
+		struct enum_lookup *lookup)
+{
+	struct enum_range_match match = { NULL, NULL };
+	struct enum_range_node *node;
+	unsigned int i;
+
+	enum_range_index_query(index, 0, index->len, key, &match);
+	if (!match.nodes) {
+		if (match.first)
+			enum_lookup_add(lookup, match.first->quark,
+					match.first->quark_set);
+		return;
+	}
+	g_ptr_array_sort(match.nodes, enum_range_node_order_compare);
+	for (i = 0; i < match.nodes->len; i++) {
+		node = g_ptr_array_index(match.nodes, i);
+		enum_lookup_add(lookup, node->quark, node->quark_set);
+	}
+	g_ptr_array_free(match.nodes, TRUE);
+}
+
 /*
  * Returns a GArray or NULL.
  * Caller must release the GArray with g_array_unref().
@@ -128,43 +262,24 @@ GArray *bt_enum_uint_to_quark_set(const struct declaration_enum *enum_declaratio
 			       uint64_t v)
 {
 	struct enum_range_to_quark *iter;
-	GArray *qs, *ranges = NULL;
+	struct enum_lookup lookup = { NULL, NULL, NULL };
+	GArray *index = enum_declaration->table.range_index;
 
 	/* Single values lookup */
-	qs = g_hash_table_lookup(enum_declaration->table.value_to_quark_set,
+	lookup.qs = g_hash_table_lookup(enum_declaration->table.value_to_quark_set,
 				 get_uint_v(&v));
 
 	/* Range lookup */
+	if (index) {
+		enum_range_index_lookup(index, v, &lookup);
+		return enum_lookup_result(&lookup);
+	}
 	bt_list_for_each_entry(iter, &enum_declaration->table.range_to_quark, node) {
 		if (iter->range.start._unsigned > v || iter->range.end._unsigned < v)
 			continue;
-		if (!ranges) {
-			size_t qs_len = 0;
-
-			if (qs)
-				qs_len = qs->len;
-			ranges = g_array_sized_new(FALSE, TRUE,
-					sizeof(GQuark),
-					qs_len + 1);
-			g_array_set_size(ranges, qs_len + 1);
-			if (qs)
-				memcpy(ranges->data, qs->data,
-				       sizeof(GQuark) * qs_len);
-			g_array_index(ranges, GQuark, qs_len) = iter->quark;
-		} else {
-			size_t qs_len = ranges->len;
-
-			g_array_set_size(ranges, qs_len + 1);
-			g_array_index(ranges, GQuark, qs_len) = iter->quark;
-		}
-	}
-	if (!ranges) {
-		if (!qs)
-			return NULL;
-		ranges = qs;
-		g_array_ref(ranges);
+		enum_lookup_add(&lookup, iter->quark, NULL);
 	}
-	return ranges;
+	return enum_lookup_result(&lookup);
 }
 
 /*
@@ -175,43 +290,38 @@ GArray *bt_enum_int_to_quark_set(const struct declaration_enum *enum_declaration
 			      int64_t v)
 {
 	struct enum_range_to_quark *iter;
-	GArray *qs, *ranges = NULL;
+	struct enum_lookup lookup = { NULL, NULL, NULL };
+	GArray *index = enum_declaration->table.range_index;
 
 	/* Single values lookup */
-	qs = g_hash_table_lookup(enum_declaration->table.value_to_quark_set,
+	lookup.qs = g_hash_table_lookup(enum_declaration->table.value_to_quark_set,
 				 get_int_v(&v));
 
 	/* Range lookup */
+	if (index) {
+		enum_range_index_lookup(index, enum_int_key(v), &lookup);
+		return enum_lookup_result(&lookup);
+	}
 	bt_list_for_each_entry(iter, &enum_declaration->table.range_to_quark, node) {
 		if (iter->range.start._signed > v || iter->range.end._signed < v)
 			continue;
-		if (!ranges) {
-			size_t qs_len = 0;
-
-			if (qs)
-				qs_len = qs->len;
-			ranges = g_array_sized_new(FALSE, TRUE,
-					sizeof(GQuark),
-					qs_len + 1);
-			g_array_set_size(ranges, qs_len + 1);
-			if (qs)
-				memcpy(ranges->data, qs->data,
-				       sizeof(GQuark) * qs_len);
-			g_array_index(ranges, GQuark, qs_len) = iter->quark;
-		} else {
-			size_t qs_len = ranges->len;
-
-			g_array_set_size(ranges, qs_len + 1);
-			g_array_index(ranges, GQuark, qs_len) = iter->quark;
-		}
-	}
-	if (!ranges) {
-		if (!qs)
-			return NULL;
-		ranges = qs;
-		g_array_ref(ranges);
+		enum_lookup_add(&lookup, iter->quark, NULL);
 	}
-	return ranges;
+	return enum_lookup_result(&lookup);
+}
+
+static
+void enum_range_index_free(struct enum_table *table)
+{
+	unsigned int i;
+
+	if (!table->range_index)
+		return;
+	for (i = 0; i < table->range_index->len; i++)
+		g_array_unref(g_array_index(table->range_index,
+				struct enum_range_node, i).quark_set);
+	g_array_free(table->range_index, TRUE);
+	table->range_index = NULL;
 }
 
 static
@@ -279,6 +389,7 @@ void bt_enum_signed_insert_range_to_quark(struct declaration_enum *enum_declarat
 {
 	struct enum_range_to_quark *rtoq;
 
+	enum_range_index_free(&enum_declaration->table);
 	rtoq = g_new(struct enum_range_to_quark, 1);
 	bt_list_add(&rtoq->node, &enum_declaration->table.range_to_quark);
 	rtoq->range.start._signed = start;
@@ -292,6 +403,7 @@ void bt_enum_unsigned_insert_range_to_quark(struct declaration_enum *enum_declar
 {
 	struct enum_range_to_quark *rtoq;
 
+	enum_range_index_free(&enum_declaration->table);
 	rtoq = g_new(struct enum_range_to_quark, 1);
 	bt_list_add(&rtoq->node, &enum_declaration->table.range_to_quark);
 	rtoq->range.start._unsigned = start;
@@ -373,6 +485,77 @@ size_t bt_enum_get_nr_enumerators(struct declaration_enum *enum_declaration)
 	return g_hash_table_size(enum_declaration->table.quark_to_range_set);
 }
 
+static
+gint enum_range_node_compare(gconstpointer a, gconstpointer b)
+{
+	const struct enum_range_node *na = a, *nb = b;
+
+	if (na->start < nb->start)
+		return -1;
+	if (na->start > nb->start)
+		return 1;
+	return 0;
+}
+
+/*
+ * Compute the highest range end of the subtree rooted in the middle of
+ * [lo, hi).
+ */
+static
+uint64_t enum_range_index_build(GArray *index, size_t lo, size_t hi)
+{
+	struct enum_range_node *node;
+	uint64_t max_end, sub;
+	size_t mid;
+
+	if (lo >= hi)
+		return 0;
+	mid = lo + (hi - lo) / 2;
+	node = &g_array_index(index, struct enum_range_node, mid);
+	max_end = node->end;
+	sub = enum_range_index_build(index, lo, mid);
+	if (mid > lo && sub > max_end)
+		max_end = sub;
+	sub = enum_range_index_build(index, mid + 1, hi);
+	if (hi > mid + 1 && sub > max_end)
+		max_end = sub;
+	node->max_end = max_end;
+	return max_end;
+}
+
+void bt_enum_declaration_finalize(struct declaration_enum *enum_declaration)
+{
+	struct enum_table *table = &enum_declaration->table;
+	int signedness = enum_declaration->integer_declaration->signedness;
+	struct enum_range_to_quark *iter;
+	unsigned int order = 0;
+	GArray *index;
+
+	enum_range_index_free(table);
+	index = g_array_new(FALSE, TRUE, sizeof(struct enum_range_node));
+	bt_list_for_each_entry(iter, &table->range_to_quark, node) {
+		struct enum_range_node node;
+
+		if (signedness) {
+			node.start = enum_int_key(iter->range.start._signed);
+			node.end = enum_int_key(iter->range.end._signed);
+		} else {
+			node.start = iter->range.start._unsigned;
+			node.end = iter->range.end._unsigned;
+		}
+		node.max_end = node.end;
+		node.order = order++;
+		node.quark = iter->quark;
+		node.quark_set = g_array_sized_new(FALSE, TRUE,
+				sizeof(GQuark), 1);
+		g_array_append_val(node.quark_set, iter->quark);
+		g_array_append_val(index, node);
+	}
+	g_array_sort(index, enum_range_node_compare);
+	enum_range_index_build(index, 0, index->len);
+	table->range_index = index;
+}
+
 static
 void _enum_declaration_free(struct bt_declaration *declaration)
 {
@@ -386,6 +569,7 @@ void _enum_declaration_free(struct bt_declaration *declaration)
 		g_free(iter);
 	}
 	g_hash_table_destroy(enum_declaration->table.quark_to_range_set);
+	enum_range_index_free(&enum_declaration->table);
 	bt_declaration_unref(&enum_declaration->integer_declaration->p);
 	g_free(enum_declaration);
 }
@@ -402,6 +586,7 @@ struct declaration_enum *
 							    enum_val_free,
 							    enum_range_set_free);
 	BT_INIT_LIST_HEAD(&enum_declaration->table.range_to_quark);
+	enum_declaration->table.range_index = NULL;
 	enum_declaration->table.quark_to_range_set = g_hash_table_new_full(g_direct_hash,
 							g_direct_equal,
 							NULL, enum_range_set_free);
@@ -69,6 +69,8 @@ struct declaration_integer *
 	integer_declaration->base = base;
 	integer_declaration->encoding = encoding;
 	integer_declaration->clock = clock;
+	integer_declaration->access =
+		bt_integer_declaration_access(integer_declaration);
 	return integer_declaration;
 }
 
@@ -30,6 +30,7 @@
 #include <babeltrace/format.h>
 #include <babeltrace/types.h>
 #include <inttypes.h>
+#include <string.h>
 
 static
 struct bt_definition *_sequence_definition_new(struct bt_declaration *declaration,
@@ -39,16 +40,16 @@ struct bt_definition *_sequence_definition_new(struct bt_declaration *declaratio
 static
 void _sequence_definition_free(struct bt_definition *definition);
 
-int bt_sequence_rw(struct bt_stream_pos *pos, struct bt_definition *definition)
+/*
+ * Create the definitions of the elements of the sequence up to len.
+ */
+void bt_sequence_grow(struct definition_sequence *sequence_definition,
+		uint64_t len)
 {
-	struct definition_sequence *sequence_definition =
-		container_of(definition, struct definition_sequence, p);
 	const struct declaration_sequence *sequence_declaration =
 		sequence_definition->declaration;
-	uint64_t len, oldlen, i;
-	int ret;
+	uint64_t oldlen, i;
 
-	len = sequence_definition->length->value._unsigned;
 	/*
 	 * Yes, large sequences could be _painfully slow_ to parse due
 	 * to memory allocation for each event read. At least, never
@@ -76,6 +77,18 @@ int bt_sequence_rw(struct bt_stream_pos *pos, struct bt_definition *definition)
 					  sequence_definition->p.scope,
 					  name, i, NULL);
 	}
+}
+
+int bt_sequence_rw(struct bt_stream_pos *pos, struct bt_definition *definition)
+{
+	struct definition_sequence *sequence_definition =
+		container_of(definition, struct definition_sequence, p);
+	uint64_t len, i;
+	int ret;
+
+	bt_sequence_bulk_sync(sequence_definition);
+	len = sequence_definition->length->value._unsigned;
+	bt_sequence_grow(sequence_definition, len);
 	for (i = 0; i < len; i++) {
 		struct bt_definition **field;
 
@@ -169,6 +182,9 @@ struct bt_definition *_sequence_definition_new(struct bt_declaration *declaratio
 	bt_definition_ref(len_parent);
 
 	sequence->string = NULL;
+	sequence->bytes = NULL;
+	sequence->bytes_len = 0;
+	memset(&sequence->bulk, 0, sizeof(sequence->bulk));
 	sequence->elems = NULL;
 
 	if (sequence_declaration->elem->id == CTF_TYPE_INTEGER) {
@@ -216,6 +232,7 @@ void _sequence_definition_free(struct bt_definition *definition)
 		}
 		(void) g_ptr_array_free(sequence->elems, TRUE);
 	}
+	g_free(sequence->bulk.values);
 	bt_definition_unref(len_definition);
 	bt_free_definition_scope(sequence->p.scope);
 	bt_declaration_unref(sequence->p.declaration);
@@ -233,6 +250,16 @@ struct bt_definition *bt_sequence_index(struct definition_sequence *sequence, ui
 		return NULL;
 	if (i >= sequence->length->value._unsigned)
 		return NULL;
+	bt_sequence_bulk_sync(sequence);
 	assert(i < sequence->elems->len);
 	return g_ptr_array_index(sequence->elems, i);
 }
+
+void bt_sequence_bulk_sync(struct definition_sequence *sequence)
+{
+	if (!sequence->bulk.stale)
+		return;
+	bt_sequence_grow(sequence, sequence->bulk.len);
+	bt_bulk_sync(&sequence->bulk, sequence->declaration->elem,
+		sequence->elems);
+}
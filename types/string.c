@@ -90,6 +90,7 @@ struct bt_definition *
 					root_name);
 	string->p.scope = NULL;
 	string->value = NULL;
+	string->buf = NULL;
 	string->len = 0;
 	string->alloc_len = 0;
 	ret = bt_register_field_definition(field_name, &string->p,
@@ -105,7 +106,7 @@ void _string_definition_free(struct bt_definition *definition)
 		container_of(definition, struct definition_string, p);
 
 	bt_declaration_unref(string->p.declaration);
-	g_free(string->value);
+	g_free(string->buf);
 	g_free(string);
 }
 
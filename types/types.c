@@ -34,6 +34,8 @@
 #include <babeltrace/compat/limits.h>
 #include <glib.h>
 #include <errno.h>
+#include <float.h>
+#include <string.h>
 
 static
 GQuark prefix_quark(const char *prefix, GQuark quark)
@@ -163,6 +165,39 @@ static struct definition_scope *
 	return definition->scope;
 }
 
+/*
+ * Sequence lengths and variant tags keep a pointer to the definition
+ * they refer to: the elements of an array or sequence which may be
+ * looked up must not be decoded in bulk, or they would be read from
+ * out of date definitions.
+ */
+static
+void lookup_disable_bulk(struct bt_definition *definition)
+{
+	switch (definition->declaration->id) {
+	case CTF_TYPE_ARRAY:
+	{
+		struct definition_array *array =
+			container_of(definition, struct definition_array, p);
+
+		bt_array_bulk_sync(array);
+		array->bulk.disabled = 1;
+		break;
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		struct definition_sequence *sequence =
+			container_of(definition, struct definition_sequence, p);
+
+		bt_sequence_bulk_sync(sequence);
+		sequence->bulk.disabled = 1;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
 /*
  * OK, here is the fun. We want to lookup a field that is:
  * - either in the same dynamic scope:
@@ -240,6 +275,7 @@ lookup:
 				/* Direct child */
 				return lookup_definition;
 			} else {
+				lookup_disable_bulk(lookup_definition);
 				scope = get_definition_scope(lookup_definition);
 				/* Check if the definition has a sub-scope */
 				if (!scope)
@@ -279,16 +315,21 @@ int bt_register_field_definition(GQuark field_name, struct bt_definition *defini
 	return 0;
 }
 
+/*
+ * Declarations are shared by the definitions of all streams, which may
+ * be created from concurrent threads (e.g. packet indexing at trace
+ * open): keep their reference count atomic.
+ */
 void bt_declaration_ref(struct bt_declaration *declaration)
 {
-	declaration->ref++;
+	g_atomic_int_inc(&declaration->ref);
 }
 
 void bt_declaration_unref(struct bt_declaration *declaration)
 {
 	if (!declaration)
 		return;
-	if (!--declaration->ref)
+	if (g_atomic_int_dec_and_test(&declaration->ref))
 		declaration->declaration_free(declaration);
 }
 
@@ -676,3 +717,324 @@ struct bt_definition *bt_lookup_variant(const struct bt_definition *definition,
 	assert(lookup);
 	return lookup;
 }
+
+size_t bt_bulk_elem_size(const struct bt_declaration *elem, int *reverse)
+{
+	size_t size;
+	int byte_order;
+
+	switch (elem->id) {
+	case CTF_TYPE_INTEGER:
+	{
+		const struct declaration_integer *integer_declaration =
+			container_of(elem, const struct declaration_integer, p);
+		enum bt_integer_access access = integer_declaration->access;
+
+		/* Encoded characters are read as strings. */
+		if (integer_declaration->encoding != CTF_STRING_NONE)
+			return 0;
+		if (access == BT_INTEGER_ACCESS_UNKNOWN)
+			access = bt_integer_declaration_access(integer_declaration);
+		if (access == BT_INTEGER_ACCESS_BITFIELD)
+			return 0;
+		*reverse = (access == BT_INTEGER_ACCESS_REVERSE);
+		size = integer_declaration->len / CHAR_BIT;
+		break;
+	}
+	case CTF_TYPE_FLOAT:
+	{
+		const struct declaration_float *float_declaration =
+			container_of(elem, const struct declaration_float, p);
+
+		if (float_declaration->mantissa->len + 1 == FLT_MANT_DIG
+				&& float_declaration->exp->len == 8)
+			size = sizeof(float);
+		else if (float_declaration->mantissa->len + 1 == DBL_MANT_DIG
+				&& float_declaration->exp->len == 11)
+			size = sizeof(double);
+		else
+			return 0;
+		if (elem->alignment % CHAR_BIT)
+			return 0;
+		byte_order = float_declaration->byte_order;
+		*reverse = (byte_order && byte_order != BYTE_ORDER);
+		break;
+	}
+	default:
+		return 0;
+	}
+	/* Elements must be contiguous. */
+	if (elem->alignment > size * CHAR_BIT)
+		return 0;
+	return size;
+}
+
+void bt_bulk_sync(struct definition_bulk *bulk,
+		const struct bt_declaration *elem, GPtrArray *elems)
+{
+	uint64_t i;
+
+	if (!bulk->stale)
+		return;
+	bulk->stale = 0;
+	assert(elems->len >= bulk->len);
+
+	if (elem->id == CTF_TYPE_FLOAT) {
+		const struct declaration_float *float_declaration =
+			container_of(elem, const struct declaration_float, p);
+		int is_float = (float_declaration->mantissa->len + 1
+				== FLT_MANT_DIG);
+
+		for (i = 0; i < bulk->len; i++) {
+			struct definition_float *float_definition =
+				container_of(g_ptr_array_index(elems, i),
+					struct definition_float, p);
+
+			if (is_float)
+				float_definition->value = ((float *) bulk->values)[i];
+			else
+				float_definition->value = ((double *) bulk->values)[i];
+		}
+		return;
+	}
+
+	for (i = 0; i < bulk->len; i++) {
+		const struct declaration_integer *integer_declaration =
+			container_of(elem, const struct declaration_integer, p);
+		struct definition_integer *integer_definition =
+			container_of(g_ptr_array_index(elems, i),
+				struct definition_integer, p);
+
+		if (integer_declaration->signedness) {
+			int64_t v;
+
+			switch (integer_declaration->len) {
+			case 8:
+				v = ((int8_t *) bulk->values)[i];
+				break;
+			case 16:
+				v = ((int16_t *) bulk->values)[i];
+				break;
+			case 32:
+				v = ((int32_t *) bulk->values)[i];
+				break;
+			default:
+				v = ((int64_t *) bulk->values)[i];
+				break;
+			}
+			integer_definition->value._signed = v;
+		} else {
+			uint64_t v;
+
+			switch (integer_declaration->len) {
+			case 8:
+				v = ((uint8_t *) bulk->values)[i];
+				break;
+			case 16:
+				v = ((uint16_t *) bulk->values)[i];
+				break;
+			case 32:
+				v = ((uint32_t *) bulk->values)[i];
+				break;
+			default:
+				v = ((uint64_t *) bulk->values)[i];
+				break;
+			}
+			integer_definition->value._unsigned = v;
+		}
+	}
+}
+
+/*
+ * Copy the bulk buffer of src into dst and update the element
+ * definitions of dst from it right away, so that dst is never left
+ * stale: its readers then never have to sync it.
+ */
+static
+void bulk_copy(struct definition_bulk *dst, const struct definition_bulk *src,
+		const struct bt_declaration *elem, GPtrArray *elems)
+{
+	size_t len;
+	int reverse;
+
+	len = src->len * bt_bulk_elem_size(elem, &reverse);
+	if (dst->alloc_len < len) {
+		dst->values = g_realloc(dst->values, len);
+		dst->alloc_len = len;
+	}
+	memcpy(dst->values, src->values, len);
+	dst->len = src->len;
+	dst->stale = 1;
+	bt_bulk_sync(dst, elem, elems);
+}
+
+/*
+ * Bytes point into the packet: keep a copy of them in the string of
+ * the destination, which only exists for encoded elements.
+ */
+static
+void bytes_copy(GString *string, const char **bytes, size_t *bytes_len,
+		const char *src_bytes, size_t src_len)
+{
+	if (!string || !src_bytes) {
+		*bytes = NULL;
+		*bytes_len = 0;
+		return;
+	}
+	g_string_truncate(string, 0);
+	g_string_append_len(string, src_bytes, src_len);
+	*bytes = string->str;
+	*bytes_len = src_len;
+}
+
+static
+int elems_copy(GPtrArray *dst, GPtrArray *src, uint64_t len)
+{
+	uint64_t i;
+	int ret;
+
+	for (i = 0; i < len; i++) {
+		ret = bt_definition_copy(g_ptr_array_index(dst, i),
+				g_ptr_array_index(src, i));
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+int bt_definition_copy(struct bt_definition *dst, struct bt_definition *src)
+{
+	if (dst->declaration != src->declaration)
+		return -EINVAL;
+
+	switch (src->declaration->id) {
+	case CTF_TYPE_INTEGER:
+		container_of(dst, struct definition_integer, p)->value =
+			container_of(src, struct definition_integer, p)->value;
+		return 0;
+	case CTF_TYPE_FLOAT:
+		container_of(dst, struct definition_float, p)->value =
+			container_of(src, struct definition_float, p)->value;
+		return 0;
+	case CTF_TYPE_ENUM:
+	{
+		struct definition_enum *dst_enum =
+			container_of(dst, struct definition_enum, p);
+		struct definition_enum *src_enum =
+			container_of(src, struct definition_enum, p);
+
+		dst_enum->integer->value = src_enum->integer->value;
+		if (dst_enum->value)
+			g_array_unref(dst_enum->value);
+		dst_enum->value = src_enum->value ?
+			g_array_ref(src_enum->value) : NULL;
+		return 0;
+	}
+	case CTF_TYPE_STRING:
+	{
+		struct definition_string *dst_string =
+			container_of(dst, struct definition_string, p);
+		struct definition_string *src_string =
+			container_of(src, struct definition_string, p);
+
+		if (!src_string->value) {
+			dst_string->value = NULL;
+			dst_string->len = 0;
+			return 0;
+		}
+		if (dst_string->alloc_len < src_string->len) {
+			dst_string->buf = g_realloc(dst_string->buf,
+					src_string->len);
+			dst_string->alloc_len = src_string->len;
+		}
+		memcpy(dst_string->buf, src_string->value, src_string->len);
+		dst_string->value = dst_string->buf;
+		dst_string->len = src_string->len;
+		return 0;
+	}
+	case CTF_TYPE_STRUCT:
+	{
+		struct definition_struct *dst_struct =
+			container_of(dst, struct definition_struct, p);
+		struct definition_struct *src_struct =
+			container_of(src, struct definition_struct, p);
+
+		return elems_copy(dst_struct->fields, src_struct->fields,
+				src_struct->fields->len);
+	}
+	case CTF_TYPE_VARIANT:
+	{
+		struct definition_variant *dst_variant =
+			container_of(dst, struct definition_variant, p);
+		struct definition_variant *src_variant =
+			container_of(src, struct definition_variant, p);
+
+		unsigned int i;
+
+		/* The tag is copied along with its own scope. */
+		dst_variant->current_field = NULL;
+		if (!src_variant->current_field)
+			return 0;
+		/* Variant fields all have index 0: look the field up. */
+		for (i = 0; i < src_variant->fields->len; i++) {
+			if (g_ptr_array_index(src_variant->fields, i)
+					== src_variant->current_field)
+				break;
+		}
+		if (i == src_variant->fields->len)
+			return -EINVAL;
+		dst_variant->current_field = g_ptr_array_index(dst_variant->fields, i);
+		return bt_definition_copy(dst_variant->current_field,
+				src_variant->current_field);
+	}
+	case CTF_TYPE_ARRAY:
+	{
+		struct definition_array *dst_array =
+			container_of(dst, struct definition_array, p);
+		struct definition_array *src_array =
+			container_of(src, struct definition_array, p);
+
+		bytes_copy(dst_array->string, &dst_array->bytes,
+			&dst_array->bytes_len, src_array->bytes,
+			src_array->bytes_len);
+		if (src_array->bulk.stale) {
+			bulk_copy(&dst_array->bulk, &src_array->bulk,
+				src_array->declaration->elem, dst_array->elems);
+			return 0;
+		}
+		dst_array->bulk.stale = 0;
+		return elems_copy(dst_array->elems, src_array->elems,
+				src_array->declaration->len);
+	}
+	case CTF_TYPE_SEQUENCE:
+	{
+		struct definition_sequence *dst_sequence =
+			container_of(dst, struct definition_sequence, p);
+		struct definition_sequence *src_sequence =
+			container_of(src, struct definition_sequence, p);
+		uint64_t len;
+
+		bytes_copy(dst_sequence->string, &dst_sequence->bytes,
+			&dst_sequence->bytes_len, src_sequence->bytes,
+			src_sequence->bytes_len);
+		/* Sequences of encoded bytes have no element definitions. */
+		if (!src_sequence->elems)
+			return 0;
+		if (src_sequence->bulk.stale) {
+			bt_sequence_grow(dst_sequence, src_sequence->bulk.len);
+			bulk_copy(&dst_sequence->bulk, &src_sequence->bulk,
+				src_sequence->declaration->elem,
+				dst_sequence->elems);
+			return 0;
+		}
+		dst_sequence->bulk.stale = 0;
+		len = MIN(bt_sequence_len(src_sequence),
+			src_sequence->elems->len);
+		bt_sequence_grow(dst_sequence, len);
+		return elems_copy(dst_sequence->elems, src_sequence->elems,
+				len);
+	}
+	default:
+		return -EINVAL;
+	}
+}